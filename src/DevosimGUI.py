@@ -1,6 +1,6 @@
 from appJar import gui
 from appJar.appjar import ItemLookupError
-import subprocess
+import ctypes
 
 import numpy as np
 import matplotlib.pyplot as plt
@@ -19,6 +19,7 @@ class Generation:
         self.dgnomeAncestries = dict()  # The element[N] is the Nth dgnome's ancestry percentage array.
         self.dgnomeAncestryPercentages = dict()
         self.percentDiversity = None  # Not always defined, but it's a floating point when it is.
+        self.simulation = None  # The Simulation whose buffers the arrays above may point into.
         self.chromosomeLength = chromosomeLength
         self.population = population
 
@@ -49,73 +50,115 @@ class ChartWindow:
     def updateOptionBoxChoice(self, optionBox):
         self.optionBoxChoice = devosimGUI.getOptionBox(optionBox)
 
-# Returns an array of all the generations, in order.
-def processDevosimOutputLines(outputLines):
-
-    generationArray = []
-    currentGeneration = None # Start with a None generation.
-
-    floatRegex = re.compile(r'-?\d+\.\d+')  # Compile the regex for finding floating point units in a line of output.
-    intRegex = re.compile(r'-?\d+')  # Compile the regex for finding integers in a line of output.
-
-    firstLine = outputLines.pop(0)
-    numbersInFirstLine = [int(i) for i in intRegex.findall(firstLine)] # Get all the numbers in the first line.
-    print(numbersInFirstLine)
-    # The first number will be the chromosome length and the second will be the population.
-    chromosomeLength = numbersInFirstLine[0]
-    population = numbersInFirstLine[1]
-
-    for index, line in enumerate(outputLines):
-        if line == '':
-            continue  # Skip over blank lines.
-        # A generation starts with a line of the form "Generation X:". This case parses that line.
-        # We expect this to be the first case matched; this will probably break if I'm wrong.
-        if re.search("^Generation \d+:$", line):
-            if currentGeneration is not None:
-                generationArray.append(currentGeneration) # Append the current generation to the array.
-            reTemp = re.findall(r'\d+', line)
-            currentGenerationInt = list(map(int, reTemp))[0]
-            currentGeneration = Generation(currentGenerationInt, chromosomeLength, population) # "Start" a new generation.
-
-        # Match this pattern:
-        # Degnome X allele values:
-        # and then operate on the following line of
-        # (some amount of: floatingPointNumber\t)
-        if re.search("Degnome \d+ allele values:$", line):
-            reTemp = re.findall(r'\d+', line)
-            currentDgInt = list(map(int, reTemp))[0]
-            dgValueLine = outputLines[index + 1] # The values for this dgnome's alleles.
-            currentGeneration.dgnomeValues[currentDgInt] = [float(i) for i in floatRegex.findall(dgValueLine)]
-
-        # Match this pattern:
-        # Degnome X ancestries:
-        # and then operate on the following line of
-        # (some amount of: int\t)
-        if re.search("Degnome \d+ ancestries:$", line):
-            reTemp = re.findall(r'\d+', line)
-            currentDgInt = list(map(int, reTemp))[0]
-            dgValueLine = outputLines[index + 1] # The values for this dgnome's alleles.
-            currentGeneration.dgnomeAncestries[currentDgInt] = [int(i) for i in intRegex.findall(dgValueLine)]
-            # Inside this pattern, match this pattern with the line after dgValueLine:
-            # (floatingPoint% Degnome \d+\t)+
-            if re.search("-?\d+\.\d+% Degnome \d+", outputLines[index + 2]):
-                reTemp = re.findall(r'\d+\t', outputLines[index + 2])
-                intArray = list(map(int, reTemp))
-                floatArray = [float(i) for i in floatRegex.findall(outputLines[index + 2])]
-                zippedArray = list(zip(intArray, floatArray))
-                currentGeneration.dgnomeAncestryPercentages[currentDgInt] = zippedArray
-                # print(outputLines[index + 2])
-                # print(zippedArray)
-
-        # Match this pattern:
-        # Percent diversity: floatingPoint
-        if re.search("Percent diversity: \d+\.\d+$", line):
-            reTemp = floatRegex.findall(line)
-            currentGeneration.percentDiversity = list(map(float, reTemp))[0]
-
-    generationArray.append(currentGeneration)  # Append the last generation to the array.
-
-    return generationArray
+# ctypes mirrors of the structs in sim.h
+class SimParams(ctypes.Structure):
+    _fields_ = [("chrom_size", ctypes.c_int),
+                ("pop_size", ctypes.c_int),
+                ("mutation_rate", ctypes.c_int),
+                ("mutation_effect", ctypes.c_int),
+                ("crossover_rate", ctypes.c_int),
+                ("selective", ctypes.c_int),
+                ("uniform", ctypes.c_int),
+                ("fit_func", ctypes.c_int),
+                ("target", ctypes.c_int),
+                ("num_threads", ctypes.c_int),
+                ("seed", ctypes.c_ulong),
+                ("pin_threads", ctypes.c_int),
+                ("placement", ctypes.c_int),
+                ("schedule", ctypes.c_int),
+                ("mmap_dir", ctypes.c_char_p),
+                ("recomb_file", ctypes.c_char_p),
+                ("mutation_file", ctypes.c_char_p),
+                ("traits_file", ctypes.c_char_p)]
+
+
+class SimPopulation(ctypes.Structure):
+    _fields_ = [("generation", ctypes.c_int),
+                ("pop_size", ctypes.c_int),
+                ("chrom_size", ctypes.c_int),
+                ("alleles", ctypes.c_void_p),
+                ("ancestries", ctypes.POINTER(ctypes.c_int)),
+                ("hat_sizes", ctypes.POINTER(ctypes.c_double)),
+                ("num_traits", ctypes.c_int),
+                ("traits", ctypes.POINTER(ctypes.c_double))]
+
+
+def loadDevosimLibrary(path):
+    lib = ctypes.CDLL(path)
+    lib.sim_default_params.argtypes = [ctypes.POINTER(SimParams)]
+    lib.sim_default_params.restype = None
+    lib.sim_new.argtypes = [ctypes.POINTER(SimParams)]
+    lib.sim_new.restype = ctypes.c_void_p
+    lib.sim_step.argtypes = [ctypes.c_void_p]
+    lib.sim_step.restype = None
+    lib.sim_run.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+    lib.sim_run.restype = ctypes.c_int
+    lib.sim_get_population.argtypes = [ctypes.c_void_p, ctypes.POINTER(SimPopulation)]
+    lib.sim_get_population.restype = None
+    lib.sim_diversity.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.POINTER(ctypes.c_double))]
+    lib.sim_diversity.restype = ctypes.c_double
+    lib.sim_free.argtypes = [ctypes.c_void_p]
+    lib.sim_free.restype = None
+    lib.sim_allele_type.argtypes = []
+    lib.sim_allele_type.restype = ctypes.c_char_p
+    lib.sim_allele_scale.argtypes = []
+    lib.sim_allele_scale.restype = ctypes.c_double
+    return lib
+
+
+# The C type of SimPopulation.alleles, which depends on how libdevosim was built (make allele=...)
+ALLELE_CTYPES = {b"double": ctypes.c_double, b"float": ctypes.c_float, b"fixed": ctypes.c_int32}
+
+
+class Simulation:
+    # Owns a Sim from libdevosim. Arrays handed out by generation() are views of the Sim's own buffers,
+    # so the Simulation has to outlive them; each Generation keeps a reference to it for that reason.
+    def __init__(self, lib, params):
+        self.lib = lib
+        self.handle = lib.sim_new(ctypes.byref(params))
+
+    def __del__(self):
+        if self.handle:
+            self.lib.sim_free(self.handle)
+            self.handle = None
+
+    def run(self, generations, breakAtZeroDiversity):
+        return self.lib.sim_run(self.handle, generations, 1 if breakAtZeroDiversity else 0)
+
+    def step(self):
+        self.lib.sim_step(self.handle)
+
+    # Returns a Generation for the current parents. With copy=False the arrays are zero-copy views that are only
+    # valid until the next step.
+    def generation(self, copy=False, percentagesOnly=False):
+        percentPointer = ctypes.POINTER(ctypes.c_double)()
+        diversity = self.lib.sim_diversity(self.handle, ctypes.byref(percentPointer))
+        pop = SimPopulation()
+        self.lib.sim_get_population(self.handle, ctypes.byref(pop))
+
+        population = pop.pop_size
+        chromosomeLength = pop.chrom_size
+        alleleType = ctypes.POINTER(ALLELE_CTYPES[self.lib.sim_allele_type()])
+        alleles = np.ctypeslib.as_array(ctypes.cast(pop.alleles, alleleType), shape=(population, chromosomeLength))
+        scale = self.lib.sim_allele_scale()
+        if scale != 1:
+            # fixed point alleles are converted, so these are a copy whatever copy says
+            alleles = alleles / scale
+        ancestries = np.ctypeslib.as_array(pop.ancestries, shape=(population, chromosomeLength))
+        percentages = np.ctypeslib.as_array(percentPointer, shape=(population + 1, population))
+        if copy:
+            alleles, ancestries, percentages = alleles.copy(), ancestries.copy(), percentages.copy()
+
+        generation = Generation(pop.generation, chromosomeLength, population)
+        generation.simulation = self
+        for k in range(population):
+            if not percentagesOnly:
+                generation.dgnomeValues[k] = alleles[k]
+                generation.dgnomeAncestries[k] = ancestries[k]
+            row = percentages[k]
+            generation.dgnomeAncestryPercentages[k] = [(int(j), 100 * float(row[j])) for j in np.flatnonzero(row > 0)]
+        generation.percentDiversity = 100 * diversity
+        return generation
 
 def findWindowFromWidget(widgetName):
     reTemp = re.findall(r'\d+', widgetName)
@@ -280,51 +323,48 @@ def runDevosim(button):
     mutationRateInt = int(devosimGUI.getEntry("Mutation Rate"))
     mutationEffectInt = int(devosimGUI.getEntry("Mutation Effect"))
 
-    executableNameString = "./devosim"  # Platform-dependent
-
-    settingsStringArray = [executableNameString,
-                           "-c", f"{chromosomeLengthInt}",  # f-strings require Python 3.6, I think?
-                           "-p", f"{populationSizeInt}",
-                           "-g", f"{generationsInt}",
-                           "-o", f"{crossoverRateInt}",
-                           "-m", f"{mutationRateInt}",
-                           "-e", f"{mutationEffectInt}"
-                           ]
-
-    selectionModeString = devosimGUI.getRadioButton("selectionMode")
-    # Append no flag for Random Selection Mode
-    if selectionModeString == "Selective Pressure":
-        settingsStringArray.append("-s")
-    elif selectionModeString == "Uniform Selection":
-        settingsStringArray.append("-u")
-
-    if devosimGUI.getCheckBox("Verbose Mode"):
-        settingsStringArray.append("-v")
-
-    if devosimGUI.getCheckBox("Percentages Only"):
-        settingsStringArray.append("-r")
-
-    if devosimGUI.getCheckBox("Stop if all dgnomes are identical"):
-        settingsStringArray.append("-b")
+    libraryNameString = "./libdevosim.so"  # Platform-dependent
 
     try:
-        # subprocess.call(settingsStringArray)
-        outputString = subprocess.check_output(settingsStringArray, encoding="utf-8")
-        print(outputString)
-    except FileNotFoundError:
-        devosimGUI.errorBox("Error launching ./devosim",
-                            "./devosim was not found in this directory. "
-                            "Make sure you compiled it and that it's in the same directory as this program!")
-        return
-    except subprocess.CalledProcessError:
-        devosimGUI.errorBox("Error running ./devosim",
-                            "./devosim returned/exited with an error.")
+        lib = loadDevosimLibrary(libraryNameString)
+    except OSError:
+        devosimGUI.errorBox("Error loading ./libdevosim.so",
+                            "./libdevosim.so was not found in this directory. "
+                            "Make sure you compiled it (make libdevosim.so) and that it's in the same directory as this program!")
         return
 
-    outputLines = outputString.splitlines()
+    params = SimParams()
+    lib.sim_default_params(ctypes.byref(params))
+    params.chrom_size = chromosomeLengthInt
+    params.pop_size = populationSizeInt
+    params.crossover_rate = crossoverRateInt
+    params.mutation_rate = mutationRateInt
+    params.mutation_effect = mutationEffectInt
 
-    # Creates a strange number of generations when verbose mode is on, but otherwise, it's getting there...
-    generationArray = processDevosimOutputLines(outputLines)
+    selectionModeString = devosimGUI.getRadioButton("selectionMode")
+    # Random Selection Mode is the default
+    if selectionModeString == "Selective Pressure":
+        params.selective = 1
+    elif selectionModeString == "Uniform Selection":
+        params.uniform = 1
+
+    verbose = devosimGUI.getCheckBox("Verbose Mode")
+    percentagesOnly = devosimGUI.getCheckBox("Percentages Only")
+    breakAtZeroDiversity = devosimGUI.getCheckBox("Stop if all dgnomes are identical")
+
+    simulation = Simulation(lib, params)
+
+    if verbose:
+        # Keep a copy of every generation; the library reuses its buffers from one step to the next.
+        generationArray = [simulation.generation(copy=True, percentagesOnly=percentagesOnly)]
+        for i in range(generationsInt):
+            if breakAtZeroDiversity and generationArray[-1].percentDiversity <= 0:
+                break
+            simulation.step()
+            generationArray.append(simulation.generation(copy=True, percentagesOnly=percentagesOnly))
+    else:
+        simulation.run(generationsInt, breakAtZeroDiversity)
+        generationArray = [simulation.generation(percentagesOnly=percentagesOnly)]
 
     createNewChartWindowForGeneration(generationArray.pop())
 
@@ -0,0 +1,42 @@
+/**
+ * @file allele.h
+ * @author Daniel R. Tabin
+ * @brief The type dna_array stores allele values in
+ *
+ * double unless built with allele=float (-DALLELE_FLOAT), which halves
+ * the memory and copy bandwidth of a population, or allele=fixed
+ * (-DALLELE_FIXED), which stores whole multiples of 1/ALLELE_SCALE in
+ * an int32_t.  Hat sizes are always doubles, summed in double lanes or,
+ * for fixed point, exactly in int64_t.
+ */
+
+#ifndef ALLELE
+#define ALLELE
+
+#include <stdint.h>
+#include <math.h>
+
+#if defined(ALLELE_FLOAT)
+	typedef float allele_t;
+	#define ALLELE_NAME "float"
+	#define ALLELE_FROM(x) ((float) (x))
+	#define ALLELE_TO(a) ((double) (a))
+#elif defined(ALLELE_FIXED)
+	#ifndef ALLELE_SCALE
+		#define ALLELE_SCALE 1000
+	#endif
+	typedef int32_t allele_t;
+	#define ALLELE_NAME "fixed"
+	#define ALLELE_FROM(x) ((int32_t) lrint((x) * (double) ALLELE_SCALE))
+	#define ALLELE_TO(a) ((double) (a) / ALLELE_SCALE)
+#else
+	typedef double allele_t;
+	#define ALLELE_NAME "double"
+	#define ALLELE_FROM(x) ((double) (x))
+	#define ALLELE_TO(a) ((double) (a))
+#endif
+
+/// Add the value x (a double) to the allele a.
+#define ALLELE_ADD(a, x) ((a) += ALLELE_FROM(x))
+
+#endif
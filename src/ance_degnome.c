@@ -6,44 +6,78 @@
 
 This program will be used to simulated Polygenic evoltion of
 quantitative traits by using Degnomes as defined above.
+
+Crossovers fall uniformly over the chromosome unless recomb_map is
+set, in which case they are drawn from it already sorted (see
+recomb.c).  Likewise mutations take mutation_rate and mutation_effect
+unless mutation_map is set, which gives each locus its own (see
+mutmap.c).
 */
 #include "ance_degnome.h"
 #include "misc.h"
+#include "kernels.h"
+#include "checkmem.h"
 #include <string.h>
 #include <stdio.h>
 
+__thread int chrom_size;
+__thread const RecombMap* recomb_map;
+__thread const MutationMap* mutation_map;
+
+// Scratch for Degnome_mate, grown as needed and kept between calls
+// so that a long run allocates it once per thread.
+static __thread int* crossover_locations = NULL;
+static __thread int max_crossovers = 0;
 
 Degnome* Degnome_new() {
 	Degnome* q = malloc(sizeof(Degnome));
-	q->dna_array = malloc(chrom_size*sizeof(double));
+	q->dna_array = malloc(chrom_size*sizeof(allele_t));
 	q->GOI_array = malloc(chrom_size*sizeof(int));
 
 	return q;
 }
 
+/// A Degnome in arena, released with it rather than by Degnome_free.
+Degnome* Degnome_newIn(DegnomeArena* arena) {
+	Degnome* q = DegnomeArena_alloc(arena, sizeof(Degnome));
+	q->dna_array = DegnomeArena_alloc(arena, chrom_size*sizeof(allele_t));
+	q->GOI_array = DegnomeArena_alloc(arena, chrom_size*sizeof(int));
+
+	return q;
+}
+
 void Degnome_mate(Degnome* child, Degnome* p1, Degnome* p2, gsl_rng* rng,
 	int mutation_rate, int mutation_effect, int crossover_rate) {
 	// printf("mating\n");
 	//Cross over
 	int num_crossover = gsl_ran_poisson(rng, crossover_rate);
-	int crossover_locations[num_crossover];
+	if (num_crossover > max_crossovers) {
+		max_crossovers = 2 * num_crossover;
+		crossover_locations = realloc(crossover_locations, max_crossovers*sizeof(int));
+		CHECKMEM(crossover_locations);
+	}
 	int distance = 0;
 	int diff;
-	for (int i = 0; i < num_crossover; i++) {
-		crossover_locations[i] = gsl_rng_uniform_int(rng, chrom_size);
+	if (recomb_map != NULL) {
+		RecombMap_draw(recomb_map, rng, num_crossover, crossover_locations);
 	}
-	if (num_crossover > 0) {
-		int_qsort(crossover_locations, num_crossover);//changed
+	else {
+		for (int i = 0; i < num_crossover; i++) {
+			crossover_locations[i] = gsl_rng_uniform_int(rng, chrom_size);
+		}
+		if (num_crossover > 0) {
+			int_qsort(crossover_locations, num_crossover);//changed
+		}
 	}
 	for (int i = 0; i < num_crossover; i++) {
 		diff = crossover_locations[i] - distance;
 
 		if (i % 2 == 0) {
-			memcpy(child->dna_array+distance, p1->dna_array+distance, (diff*sizeof(double)));
+			memcpy(child->dna_array+distance, p1->dna_array+distance, (diff*sizeof(allele_t)));
 			memcpy(child->GOI_array+distance, p1->GOI_array+distance, (diff*sizeof(int)));
 		}
 		else {
-			memcpy(child->dna_array+distance, p2->dna_array+distance, (diff*sizeof(double)));
+			memcpy(child->dna_array+distance, p2->dna_array+distance, (diff*sizeof(allele_t)));
 			memcpy(child->GOI_array+distance, p2->GOI_array+distance, (diff*sizeof(int)));
 		}
 		distance = crossover_locations[i];
@@ -56,32 +90,35 @@ void Degnome_mate(Degnome* child, Degnome* p1, Degnome* p2, gsl_rng* rng,
 	}
 
 	if (num_crossover % 2 == 0) {
-		memcpy(child->dna_array+distance, p1->dna_array+distance, (diff*sizeof(double)));
+		memcpy(child->dna_array+distance, p1->dna_array+distance, (diff*sizeof(allele_t)));
 		memcpy(child->GOI_array+distance, p1->GOI_array+distance, (diff*sizeof(int)));
 	}
 	else {
-		memcpy(child->dna_array+distance, p2->dna_array+distance, (diff*sizeof(double)));
+		memcpy(child->dna_array+distance, p2->dna_array+distance, (diff*sizeof(allele_t)));
 		memcpy(child->GOI_array+distance, p2->GOI_array+distance, (diff*sizeof(int)));
 	}
 
-	child->hat_size = 0;
-
 	//mutate
 	double mutation;
-	int num_mutations = gsl_ran_poisson(rng, mutation_rate);
+	int num_mutations = gsl_ran_poisson(rng, (mutation_map != NULL
+											  ? MutationMap_rate(mutation_map) : mutation_rate));
 	int mutation_location;
 
 	for (int i = 0; i < num_mutations; i++) {
-		mutation_location = gsl_rng_uniform_int(rng, chrom_size);
-		mutation = gsl_ran_gaussian_ziggurat(rng, mutation_effect);
-		child->dna_array[mutation_location] += mutation;
+		if (mutation_map != NULL) {
+			double effect;
+			mutation_location = MutationMap_locus(mutation_map, rng, &effect);
+			mutation = gsl_ran_gaussian_ziggurat(rng, effect);
+		}
+		else {
+			mutation_location = gsl_rng_uniform_int(rng, chrom_size);
+			mutation = gsl_ran_gaussian_ziggurat(rng, mutation_effect);
+		}
+		ALLELE_ADD(child->dna_array[mutation_location], mutation);
 	}
 
 	//calculate hat_size
-
-	for (int i = 0; i < chrom_size; i++) {
-		child->hat_size += child->dna_array[i];
-	}
+	child->hat_size = Kernel_sum(child->dna_array, chrom_size);
 	//and we are done!
 }
 
@@ -89,4 +126,11 @@ void Degnome_free(Degnome* q) {
 	free(q->dna_array);
 	free(q->GOI_array);
 	free(q);
-}
\ No newline at end of file
+}
+
+/// Free the calling thread's scratch.  Degnome_mate makes it again if needed.
+void Degnome_freeScratch(void) {
+	free(crossover_locations);
+	crossover_locations = NULL;
+	max_crossovers = 0;
+}
@@ -1,6 +1,10 @@
 #ifndef DEGNOME
 #define DEGNOME
 
+#include "allele.h"
+#include "arena.h"
+#include "recomb.h"
+#include "mutmap.h"
 #include <stdlib.h>
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_randist.h>
@@ -8,17 +12,24 @@
 //Degnomedia Rogerus
 typedef struct Degnome Degnome;
 struct Degnome {
-	double* dna_array;
+	allele_t* dna_array;
 	double hat_size;
 	int* GOI_array;		// goi = Gene Origin ID
 
 };
 
 Degnome* Degnome_new(void);
+Degnome* Degnome_newIn(DegnomeArena* arena);
 void Degnome_mate(Degnome* location, Degnome* p1, Degnome* p2, gsl_rng* rng,
 	int mutation_rate, int mutation_effect, int crossover_rate);
 void Degnome_free(Degnome* q);
+void Degnome_freeScratch(void);
 
-int chrom_size;
+// Thread-local so that simulations of different lengths and maps can
+// run side by side.  Each thread that calls Degnome_new or
+// Degnome_mate must set them first.
+extern __thread int chrom_size;
+extern __thread const RecombMap* recomb_map;	// NULL => crossovers are uniform
+extern __thread const MutationMap* mutation_map;	// NULL => mutation_rate and _effect everywhere
 
 #endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+/**
+@file arena.c
+@page arena
+@author Daniel R. Tabin
+@brief Slab allocation for populations that are made and dropped whole
+
+A sweep of many small runs makes a population, steps it for a few
+generations and throws it away, thousands of times.  Each Sim used to
+malloc its degnomes, two allele matrices, two ancestry matrices and
+half a dozen per generation arrays, and free them all again at the
+end; the large ones come from fresh mappings each time, so every run
+also pays to fault their pages in.
+
+A DegnomeArena hands out blocks from a list of large slabs by bumping
+a pointer, and gives them all back at once with DegnomeArena_reset.
+The slabs are kept, so the next population reuses memory that is
+already mapped and warm in cache.  Every block starts on a cache line,
+so the rows of a matrix whose row length is a multiple of 64 bytes
+never share a line with another row's first alleles.
+
+An arena is not locked: each thread that makes populations keeps its
+own (see sweep.c).  Blocks are never freed one at a time.
+*/
+
+#include "arena.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef struct Slab Slab;
+struct Slab {
+	Slab* next;
+	size_t size;		// bytes in data
+	char* data;			// ARENA_ALIGN aligned
+};
+
+struct DegnomeArena {
+	size_t slab_size;	// of a new slab, unless one block needs more
+	Slab* first;
+	Slab* cur;			// blocks are being taken from here
+	size_t used;		// bytes of cur taken
+	size_t reserved;	// bytes in all slabs
+};
+
+static Slab* slab_new(size_t size);
+
+static Slab* slab_new(size_t size) {
+	Slab* s = malloc(sizeof(Slab));
+	CHECKMEM(s);
+	if (posix_memalign((void**) &s->data, ARENA_ALIGN, size) != 0) {
+		fprintf(stderr, "%s:%d: cannot allocate a slab of %zu bytes\n", __FILE__, __LINE__, size);
+		exit(EXIT_FAILURE);
+	}
+	s->size = size;
+	s->next = NULL;
+
+	return s;
+}
+
+/// An empty arena that takes memory slab_size bytes at a time.
+DegnomeArena* DegnomeArena_new(size_t slab_size) {
+	DegnomeArena* arena = malloc(sizeof(DegnomeArena));
+	CHECKMEM(arena);
+
+	arena->slab_size = (slab_size < ARENA_ALIGN ? ARENA_ALIGN : slab_size);
+	arena->first = NULL;
+	arena->cur = NULL;
+	arena->used = 0;
+	arena->reserved = 0;
+
+	return arena;
+}
+
+/**
+ * size bytes, aligned to ARENA_ALIGN, valid until the next
+ * DegnomeArena_reset or DegnomeArena_free.  Not zeroed.
+ */
+void* DegnomeArena_alloc(DegnomeArena* arena, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+	// slabs kept from before a reset are tried in order
+	while (arena->cur != NULL && arena->used + size > arena->cur->size) {
+		arena->cur = arena->cur->next;
+		arena->used = 0;
+	}
+	if (arena->cur == NULL) {
+		Slab* s = slab_new(size > arena->slab_size ? size : arena->slab_size);
+
+		// the new slab goes after the last one, so the order holds
+		Slab** end = &arena->first;
+		while (*end != NULL) {
+			end = &(*end)->next;
+		}
+		*end = s;
+		arena->cur = s;
+		arena->used = 0;
+		arena->reserved += s->size;
+	}
+
+	void* p = arena->cur->data + arena->used;
+	arena->used += size;
+	return p;
+}
+
+/// Release every block at once, keeping the slabs for the next ones.
+void DegnomeArena_reset(DegnomeArena* arena) {
+	arena->cur = arena->first;
+	arena->used = 0;
+}
+
+/// Bytes held in slabs, whether or not they are in use.
+size_t DegnomeArena_reserved(const DegnomeArena* arena) {
+	return arena->reserved;
+}
+
+void DegnomeArena_free(DegnomeArena* arena) {
+	Slab* s = arena->first;
+
+	while (s != NULL) {
+		Slab* next = s->next;
+		free(s->data);
+		free(s);
+		s = next;
+	}
+	free(arena);
+}
@@ -0,0 +1,22 @@
+/**
+ * @file arena.h
+ * @author Daniel R. Tabin
+ * @brief Header for arena.c
+ */
+
+#ifndef ARENA
+#define ARENA
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 64		// every block starts on a cache line
+
+typedef struct DegnomeArena DegnomeArena;
+
+DegnomeArena*	DegnomeArena_new(size_t slab_size);
+void*			DegnomeArena_alloc(DegnomeArena* arena, size_t size);
+void			DegnomeArena_reset(DegnomeArena* arena);
+size_t			DegnomeArena_reserved(const DegnomeArena* arena);
+void			DegnomeArena_free(DegnomeArena* arena);
+
+#endif
@@ -0,0 +1,226 @@
+/**
+@file autothreads.c
+@page autothreads
+@author Daniel R. Tabin
+@brief Chooses between inline mating and a JobQueue each generation
+
+With a small population, sending every child through JobQueue_addJob,
+a condition variable wakeup and JobQueue_waitOnJobs costs far more than
+the Degnome_mate calls themselves.  An AutoThreads runs one generation
+of jobs per call to AutoThreads_run and decides each time whether to
+run them inline on the calling thread or split them into contiguous
+chunks, one per worker, on a JobQueue it creates the first time it is
+needed.
+
+The decision comes from the measured cost of one job.  A generation
+run inline is timed, and the number of workers is the total work of a
+generation divided by AUTO_GRAIN, the least work that pays for waking
+a worker, capped at max_threads.  Fewer than two workers means inline.
+Every AUTO_PERIOD generations one is run inline again to refresh the
+cost and the grain goes back to AUTO_GRAIN, so the choice follows the
+run as it changes.  If a parallel generation is slower than the
+inline estimate the grain is doubled, which trims the worker count
+until the JobQueue pays for itself, and if it is faster the grain is
+halved again.  The run that creates the JobQueue also starts its
+threads, so it is not compared.
+
+When work, the product of pop_size and chrom_size, is below
+AUTO_SERIAL_WORK the jobs are always run inline and the clock is never
+read.
+*/
+
+#include "autothreads.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define AUTO_GRAIN 100e-6			// seconds of work per worker per generation
+#define AUTO_MAX_GRAIN 0.1
+#define AUTO_PERIOD 64				// generations between inline calibrations
+#define AUTO_SERIAL_WORK (1 << 12)	// alleles per generation
+
+typedef struct Chunk Chunk;
+struct Chunk {
+	AutoThreads* at;
+	int begin;
+	int end;
+};
+
+struct AutoThreads {
+	int max_threads;
+	int threads;				// workers used by the last run, 0 = inline
+	int serial_only;
+	double job_cost;			// seconds per job inline, 0 until measured
+	double grain;
+	long runs;
+	long next_calibration;		// run at which to go inline again
+
+	JobQueue* jq;				// created on first parallel run
+	int pin;					// pin its workers to cores
+	void* threadData;
+	void* (*ThreadState_new)(void*);
+	void (*ThreadState_free)(void*);
+	void* state;				// thread state for inline runs
+
+	// the run in progress
+	int (*jobfun)(void*, void*);
+	char* params;
+	size_t param_size;
+	Chunk* chunks;
+};
+
+static double now(void);
+static int choose(const AutoThreads* at, int njobs);
+static int chunkfun(void* p, void* tdat);
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/**
+ * Create an AutoThreads that will use at most max_threads workers.
+ * threadData, ThreadState_new and ThreadState_free are as for
+ * JobQueue_new; one more thread state is made for inline runs.
+ */
+AutoThreads* AutoThreads_new(int max_threads, double work, void* threadData,
+							 void* (*ThreadState_new)(void*),
+							 void (*ThreadState_free)(void*)) {
+	AutoThreads* at = malloc(sizeof(AutoThreads));
+	CHECKMEM(at);
+
+	at->max_threads = (max_threads < 1 ? 1 : max_threads);
+	at->threads = 0;
+	at->serial_only = (work < AUTO_SERIAL_WORK || at->max_threads < 2);
+	at->job_cost = 0;
+	at->grain = AUTO_GRAIN;
+	at->runs = 0;
+	at->next_calibration = 0;
+
+	at->jq = NULL;
+	at->pin = 0;
+	at->threadData = threadData;
+	at->ThreadState_new = ThreadState_new;
+	at->ThreadState_free = ThreadState_free;
+	at->state = (ThreadState_new ? ThreadState_new(threadData) : NULL);
+
+	at->chunks = malloc(at->max_threads*sizeof(Chunk));
+	CHECKMEM(at->chunks);
+	for (int i = 0; i < at->max_threads; i++) {
+		at->chunks[i].at = at;
+	}
+
+	return at;
+}
+
+/// Workers for the next run of njobs jobs, or 0 to run them inline.
+static int choose(const AutoThreads* at, int njobs) {
+	if (at->serial_only || at->runs >= at->next_calibration) {
+		return 0;
+	}
+	double n = njobs * at->job_cost / at->grain;
+	if (n > at->max_threads) {
+		n = at->max_threads;
+	}
+	if (n > njobs) {
+		n = njobs;
+	}
+	return (n < 2 ? 0 : (int) n);
+}
+
+static int chunkfun(void* p, void* tdat) {
+	Chunk* c = (Chunk*) p;
+	AutoThreads* at = c->at;
+
+	for (int j = c->begin; j < c->end; j++) {
+		at->jobfun(at->params + (size_t) j * at->param_size, tdat);
+	}
+	return 0;
+}
+
+/**
+ * Run jobfun once on each of the njobs parameters laid out param_size
+ * bytes apart from params, and return when all have finished.
+ */
+void AutoThreads_run(AutoThreads* at, int (*jobfun)(void*, void*),
+					 void* params, size_t param_size, int njobs) {
+	int n = choose(at, njobs);
+	double start = (at->serial_only ? 0 : now());
+
+	at->jobfun = jobfun;
+	at->params = (char*) params;
+	at->param_size = param_size;
+	at->threads = n;
+
+	int made_queue = 0;
+
+	if (n == 0) {
+		for (int j = 0; j < njobs; j++) {
+			jobfun(at->params + (size_t) j * param_size, at->state);
+		}
+	}
+	else {
+		if (at->jq == NULL) {
+			made_queue = 1;
+			at->jq = JobQueue_new(at->max_threads, at->threadData,
+								  at->ThreadState_new, at->ThreadState_free);
+			JobQueue_pinWorkers(at->jq, at->pin);
+		}
+		for (int i = 0; i < n; i++) {
+			at->chunks[i].begin = (int) ((long) njobs * i / n);
+			at->chunks[i].end = (int) ((long) njobs * (i+1) / n);
+			JobQueue_addJob(at->jq, chunkfun, at->chunks + i);
+		}
+		JobQueue_waitOnJobs(at->jq);
+	}
+
+	if (!at->serial_only && njobs > 0) {
+		double elapsed = now() - start;
+		if (n == 0) {
+			at->job_cost = elapsed / njobs;
+			if (at->runs >= at->next_calibration) {
+				at->next_calibration = at->runs + AUTO_PERIOD;
+				at->grain = AUTO_GRAIN;
+			}
+		}
+		else if (made_queue) {
+			// paid for starting the workers; says nothing of the grain
+		}
+		else if (elapsed > njobs * at->job_cost) {
+			at->grain = (at->grain * 2 < AUTO_MAX_GRAIN ? at->grain * 2 : AUTO_MAX_GRAIN);
+		}
+		else {
+			at->grain = (at->grain / 2 > AUTO_GRAIN ? at->grain / 2 : AUTO_GRAIN);
+		}
+	}
+	at->runs++;
+}
+
+/// Pin the JobQueue's workers when it is made; see JobQueue_pinWorkers.
+void AutoThreads_pinWorkers(AutoThreads* at, int on) {
+	at->pin = on;
+}
+
+/// Workers used by the most recent run; 0 if it ran inline.
+int AutoThreads_threads(const AutoThreads* at) {
+	return at->threads;
+}
+
+/// The JobQueue, or NULL if no run has gone parallel yet.
+JobQueue* AutoThreads_jobQueue(const AutoThreads* at) {
+	return at->jq;
+}
+
+void AutoThreads_free(AutoThreads* at) {
+	if (at->jq != NULL) {
+		JobQueue_noMoreJobs(at->jq);
+		JobQueue_free(at->jq);
+	}
+	if (at->state != NULL && at->ThreadState_free != NULL) {
+		at->ThreadState_free(at->state);
+	}
+	free(at->chunks);
+	free(at);
+}
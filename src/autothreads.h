@@ -0,0 +1,28 @@
+/**
+ * @file autothreads.h
+ * @author Daniel R. Tabin
+ * @brief Header for autothreads.c
+ */
+
+#ifndef AUTOTHREADS
+#define AUTOTHREADS
+
+#include "jobqueue.h"
+#include <stddef.h>
+
+/// Value of -t auto in flags[12] and SimParams.num_threads.
+#define THREADS_AUTO (-1)
+
+typedef struct AutoThreads AutoThreads;
+
+AutoThreads*	AutoThreads_new(int max_threads, double work, void* threadData,
+								void* (*ThreadState_new)(void*),
+								void (*ThreadState_free)(void*));
+void		AutoThreads_run(AutoThreads* at, int (*jobfun)(void*, void*),
+							void* params, size_t param_size, int njobs);
+void		AutoThreads_pinWorkers(AutoThreads* at, int on);
+int			AutoThreads_threads(const AutoThreads* at);
+JobQueue*	AutoThreads_jobQueue(const AutoThreads* at);
+void		AutoThreads_free(AutoThreads* at);
+
+#endif
@@ -0,0 +1,413 @@
+/**
+ * @file bdegnome.c
+ * @author Daniel R. Tabin
+ * @brief Microbenchmarks for the polygensim and genancesim kernels
+ *
+ * Degnome_mate over a sweep of chromosome length, crossover rate
+ * and mutation rate; Degnome_mateChunked against it on long
+ * chromosomes; uniform crossovers and mutations against recombination
+ * and mutation maps of many intervals; roulette selection as done by
+ * the mains; traits of a population as TraitMatrix_apply computes
+ * them against a dot product per degnome;
+ * get_fitness for each fitness function; int_qsort; and JobQueue
+ * add/wait round trips.  See bench.c for the output format.
+ */
+
+#include "bench.h"
+#include "degnome.h"
+#include "fitfunc.h"
+#include "jobqueue.h"
+#include "misc.h"
+#include "traits.h"
+#include "kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <gsl/gsl_rng.h>
+
+typedef struct MateArgs MateArgs;
+struct MateArgs {
+	Degnome* child;
+	Degnome* p1;
+	Degnome* p2;
+	gsl_rng* rng;
+	int mutation_rate;
+	int crossover_rate;
+};
+
+typedef struct SelectArgs SelectArgs;
+struct SelectArgs {
+	int pop_size;
+	double* hat_sizes;
+	double* cum_hat_size;
+	gsl_rng* rng;
+};
+
+typedef struct TraitsArgs TraitsArgs;
+struct TraitsArgs {
+	TraitMatrix* tm;
+	allele_t* alleles;		// rows x len
+	int rows;
+	int len;
+	double* traits;			// rows x num_traits
+	int how;				// 0 TraitMatrix_apply, 1 Kernel_weightedSums, 2 per degnome
+};
+
+typedef struct SortArgs SortArgs;
+struct SortArgs {
+	int n;
+	int* src;
+	int* work;
+};
+
+typedef struct QueueArgs QueueArgs;
+struct QueueArgs {
+	JobQueue* jq;
+	int batch;
+};
+
+volatile double sink;		// keeps results from being optimized away
+
+void op_mate(void* arg, long iters);
+void op_mate_chunked(void* arg, long iters);
+void op_select(void* arg, long iters);
+void op_fitness(void* arg, long iters);
+void op_traits(void* arg, long iters);
+void op_sort(void* arg, long iters);
+void op_queue(void* arg, long iters);
+int nop_job(void* p, void* tdat);
+
+void op_mate(void* arg, long iters) {
+	MateArgs* a = (MateArgs*) arg;
+	for (long i = 0; i < iters; i++) {
+		Degnome_mate(a->child, a->p1, a->p2, a->rng, a->mutation_rate, 2, a->crossover_rate);
+	}
+	sink = a->child->hat_size;
+}
+
+/// One op is mating a chunked child and releasing its chunks.
+void op_mate_chunked(void* arg, long iters) {
+	MateArgs* a = (MateArgs*) arg;
+	for (long i = 0; i < iters; i++) {
+		Degnome_mateChunked(a->child, a->p1, a->p2, a->rng, a->mutation_rate, 2, a->crossover_rate);
+		Degnome_releaseChunks(a->child);
+	}
+	sink = a->child->hat_size;
+}
+
+/// One op is choosing both parents of one child.
+void op_select(void* arg, long iters) {
+	SelectArgs* a = (SelectArgs*) arg;
+	int pop_size = a->pop_size;
+	long done = 0;
+	int total = 0;
+
+	while (done < iters) {
+		double* cum_hat_size = a->cum_hat_size;
+		double fit = get_fitness(a->hat_sizes[0]);
+		double total_hat_size = fit;
+		cum_hat_size[0] = fit;
+
+		for (int j = 1; j < pop_size; j++) {
+			fit = get_fitness(a->hat_sizes[j]);
+			total_hat_size += fit;
+			cum_hat_size[j] = (cum_hat_size[j-1] + fit);
+		}
+
+		for (int j = 0; j < pop_size && done < iters; j++, done++) {
+			int m, d;
+			double win_m = gsl_rng_uniform(a->rng) * total_hat_size;
+			double win_d = gsl_rng_uniform(a->rng) * total_hat_size;
+
+			for (m = 0; cum_hat_size[m] < win_m; m++) {
+				continue;
+			}
+			for (d = 0; cum_hat_size[d] < win_d; d++) {
+				continue;
+			}
+			total += m + d;
+		}
+	}
+	sink = total;
+}
+
+/// One op is the traits of one degnome, made a population at a time.
+void op_traits(void* arg, long iters) {
+	TraitsArgs* a = (TraitsArgs*) arg;
+	int k = TraitMatrix_traits(a->tm);
+	const double* w = TraitMatrix_weights(a->tm);
+
+	for (long done = 0; done < iters; done += a->rows) {
+		if (a->how == 0) {
+			TraitMatrix_apply(a->tm, a->alleles, a->rows, a->traits);
+		}
+		else if (a->how == 1) {
+			Kernel_weightedSums(a->alleles, a->rows, a->len, w, k, a->traits);
+		}
+		else {
+			for (int i = 0; i < a->rows; i++) {
+				const allele_t* x = a->alleles + (size_t) i * a->len;
+				for (int t = 0; t < k; t++) {
+					double sum = 0;
+					for (int j = 0; j < a->len; j++) {
+						sum += w[(size_t) t * a->len + j] * ALLELE_TO(x[j]);
+					}
+					a->traits[(size_t) i * k + t] = sum;
+				}
+			}
+		}
+	}
+	sink = a->traits[0];
+}
+
+void op_fitness(void* arg, long iters) {
+	double x = 0;
+	for (long i = 0; i < iters; i++) {
+		x += get_fitness(50.0 + (i & 1023));
+	}
+	sink = x;
+}
+
+void op_sort(void* arg, long iters) {
+	SortArgs* a = (SortArgs*) arg;
+	for (long i = 0; i < iters; i++) {
+		for (int k = 0; k < a->n; k++) {
+			a->work[k] = a->src[k];
+		}
+		int_qsort(a->work, a->n);
+	}
+	sink = a->work[0];
+}
+
+int nop_job(void* p, void* tdat) {
+	return 0;
+}
+
+/// One op is one job added and waited for, in batches.
+void op_queue(void* arg, long iters) {
+	QueueArgs* a = (QueueArgs*) arg;
+	long done = 0;
+
+	while (done < iters) {
+		for (int j = 0; j < a->batch && done < iters; j++, done++) {
+			JobQueue_addJob(a->jq, nop_job, NULL);
+		}
+		JobQueue_waitOnJobs(a->jq);
+	}
+}
+
+int main(int argc, char **argv) {
+	bench_init(argc, argv, "bdegnome");
+
+	gsl_rng* rng = gsl_rng_alloc(gsl_rng_taus);
+	gsl_rng_set(rng, 1);
+	char params[128];
+
+	int chrom_sizes[] = {10, 100, 1000, 10000};
+	int crossover_rates[] = {0, 2, 20};
+	int mutation_rates[] = {0, 1, 10};
+
+	for (int c = 0; c < 4; c++) {
+		chrom_size = chrom_sizes[c];
+		Degnome* p1 = Degnome_new();
+		Degnome* p2 = Degnome_new();
+		Degnome* child = Degnome_new();
+		for (int j = 0; j < chrom_size; j++) {
+			p1->dna_array[j] = ALLELE_FROM(j);
+			p2->dna_array[j] = ALLELE_FROM(-j);
+		}
+
+		for (int o = 0; o < 3; o++) {
+			for (int m = 0; m < 3; m++) {
+				MateArgs a = {child, p1, p2, rng, mutation_rates[m], crossover_rates[o]};
+				snprintf(params, sizeof(params), "c=%d,o=%d,m=%d",
+						 chrom_size, crossover_rates[o], mutation_rates[m]);
+				bench_run("Degnome_mate", params, op_mate, &a);
+			}
+		}
+		Degnome_free(p1);
+		Degnome_free(p2);
+		Degnome_free(child);
+	}
+
+	// a few crossovers and mutations on a long chromosome
+	int chunk_sizes[] = {0, 256, 4096};
+	for (int c = 0; c < 2; c++) {
+		chrom_size = (c == 0 ? 10000 : 100000);
+		Degnome* p1 = Degnome_new();
+		Degnome* p2 = Degnome_new();
+		Degnome* child = Degnome_new();
+		for (int j = 0; j < chrom_size; j++) {
+			p1->dna_array[j] = ALLELE_FROM(j);
+			p2->dna_array[j] = ALLELE_FROM(-j);
+		}
+
+		for (int k = 0; k < 3; k++) {
+			MateArgs a = {child, p1, p2, rng, 1, 2};
+			chunk_size = chunk_sizes[k];
+			snprintf(params, sizeof(params), "c=%d,o=2,m=1,chunk=%d", chrom_size, chunk_size);
+			if (chunk_size == 0) {
+				bench_run("Degnome_mate", params, op_mate, &a);
+				continue;
+			}
+			int nchunks = Degnome_chunkCount();
+			Chunk** chunks = malloc(3*nchunks*sizeof(Chunk*));
+			Degnome_chunk(p1, chunks);
+			Degnome_chunk(p2, chunks + nchunks);
+			child->chunks = chunks + 2*nchunks;
+			bench_run("Degnome_mateChunked", params, op_mate_chunked, &a);
+			Degnome_releaseChunks(p1);
+			Degnome_releaseChunks(p2);
+			free(chunks);
+		}
+		chunk_size = 0;
+		Degnome_free(p1);
+		Degnome_free(p2);
+		Degnome_free(child);
+	}
+
+	// crossovers drawn uniformly and sorted, or from a map of one
+	// interval every ten loci with rates from 0 to 9; then mutations
+	// drawn uniformly or from a map of the same intervals
+	chrom_size = 10000;
+	{
+		Degnome* p1 = Degnome_new();
+		Degnome* p2 = Degnome_new();
+		Degnome* child = Degnome_new();
+		int nint = chrom_size / 10;
+		int* starts = malloc(nint*sizeof(int));
+		double* rates = malloc(nint*sizeof(double));
+		for (int k = 0; k < nint; k++) {
+			starts[k] = 10 * k;
+			rates[k] = k % 10;
+		}
+		RecombMap* map = RecombMap_new(starts, rates, nint, chrom_size);
+		for (int j = 0; j < chrom_size; j++) {
+			p1->dna_array[j] = ALLELE_FROM(j);
+			p2->dna_array[j] = ALLELE_FROM(-j);
+		}
+
+		int rates_o[] = {2, 20, 200};
+		for (int o = 0; o < 3; o++) {
+			MateArgs a = {child, p1, p2, rng, 0, rates_o[o]};
+			for (int with_map = 0; with_map < 2; with_map++) {
+				recomb_map = (with_map ? map : NULL);
+				snprintf(params, sizeof(params), "c=%d,o=%d,m=0,map=%s",
+						 chrom_size, rates_o[o], with_map ? "1000" : "none");
+				bench_run("Degnome_mate", params, op_mate, &a);
+			}
+		}
+		recomb_map = NULL;
+		RecombMap_free(map);
+
+		int rates_m[] = {1, 10, 100};
+		double* effects = malloc(nint*sizeof(double));
+		for (int m = 0; m < 3; m++) {
+			// the same expected number of mutations either way
+			double per_locus = rates_m[m] / (4.5 * chrom_size);
+			for (int k = 0; k < nint; k++) {
+				rates[k] = (k % 10) * per_locus;
+				effects[k] = 1 + k % 3;
+			}
+			MutationMap* mutmap = MutationMap_new(starts, rates, effects, nint, chrom_size);
+			MateArgs a = {child, p1, p2, rng, rates_m[m], 0};
+			for (int with_map = 0; with_map < 2; with_map++) {
+				mutation_map = (with_map ? mutmap : NULL);
+				snprintf(params, sizeof(params), "c=%d,o=0,m=%d,mutmap=%s",
+						 chrom_size, rates_m[m], with_map ? "1000" : "none");
+				bench_run("Degnome_mate", params, op_mate, &a);
+			}
+			mutation_map = NULL;
+			MutationMap_free(mutmap);
+		}
+		free(effects);
+		free(starts);
+		free(rates);
+		Degnome_free(p1);
+		Degnome_free(p2);
+		Degnome_free(child);
+	}
+
+	int pop_sizes[] = {10, 100, 1000};
+	for (int p = 0; p < 3; p++) {
+		SelectArgs a = {pop_sizes[p], malloc(pop_sizes[p]*sizeof(double)),
+						malloc(pop_sizes[p]*sizeof(double)), rng};
+		for (int j = 0; j < a.pop_size; j++) {
+			a.hat_sizes[j] = 100 + gsl_rng_uniform(rng);
+		}
+		set_function("linear");
+		snprintf(params, sizeof(params), "p=%d", a.pop_size);
+		bench_run("roulette_select", params, op_select, &a);
+		free(a.hat_sizes);
+		free(a.cum_hat_size);
+	}
+
+	// traits of 256 degnomes: as TraitMatrix_apply picks, always the
+	// lane kernel, and a dot product per degnome and trait
+	int trait_lens[] = {100, 1000, 10000};
+	int trait_counts[] = {1, 8};
+	const char* trait_hows[] = {"apply", "kernel", "per_degnome"};
+	for (int l = 0; l < 3; l++) {
+		for (int n = 0; n < 2; n++) {
+			int rows = 256, len = trait_lens[l], k = trait_counts[n];
+			double* w = malloc((size_t) k * len * sizeof(double));
+			for (int j = 0; j < k * len; j++) {
+				w[j] = gsl_rng_uniform(rng);
+			}
+			TraitsArgs a = {TraitMatrix_new(w, k, len), malloc((size_t) rows * len * sizeof(allele_t)),
+							rows, len, malloc((size_t) rows * k * sizeof(double)), 0};
+			for (int j = 0; j < rows * len; j++) {
+				a.alleles[j] = ALLELE_FROM(gsl_rng_uniform(rng) * 20);
+			}
+			for (int how = 0; how < 3; how++) {
+				a.how = how;
+				snprintf(params, sizeof(params), "p=%d,c=%d,traits=%d,%s",
+						 rows, len, k, trait_hows[how]);
+				bench_run("TraitMatrix_apply", params, op_traits, &a);
+			}
+			TraitMatrix_free(a.tm);
+			free(a.alleles);
+			free(a.traits);
+			free(w);
+		}
+	}
+
+	const char* fit_names[] = {"linear", "sqrt", "close", "ceiling", "log"};
+	target_num = 100;
+	for (int f = 0; f < 5; f++) {
+		set_function(fit_names[f]);
+		snprintf(params, sizeof(params), "fit=%s", fit_names[f]);
+		bench_run("get_fitness", params, op_fitness, NULL);
+	}
+
+	int sort_sizes[] = {2, 8, 64, 1024};
+	for (int s = 0; s < 4; s++) {
+		SortArgs a = {sort_sizes[s], malloc(sort_sizes[s]*sizeof(int)),
+					  malloc(sort_sizes[s]*sizeof(int))};
+		for (int k = 0; k < a.n; k++) {
+			a.src[k] = (int) gsl_rng_uniform_int(rng, 10000);
+		}
+		snprintf(params, sizeof(params), "n=%d", a.n);
+		bench_run("int_qsort", params, op_sort, &a);
+		free(a.src);
+		free(a.work);
+	}
+
+	int cores = getNumCores();
+	int thread_counts[] = {1, 2, 4};
+	int batches[] = {1, 100};
+	for (int t = 0; t < 3; t++) {
+		if (thread_counts[t] > 1 && thread_counts[t] > cores) {
+			continue;
+		}
+		for (int b = 0; b < 2; b++) {
+			QueueArgs a = {JobQueue_new(thread_counts[t], NULL, NULL, NULL), batches[b]};
+			snprintf(params, sizeof(params), "t=%d,batch=%d", thread_counts[t], batches[b]);
+			bench_run("JobQueue_roundtrip", params, op_queue, &a);
+			JobQueue_noMoreJobs(a.jq);
+			JobQueue_free(a.jq);
+		}
+	}
+
+	gsl_rng_free(rng);
+	return 0;
+}
@@ -0,0 +1,113 @@
+/**
+@file bench.c
+@page bench
+@author Daniel R. Tabin
+@brief Timing harness shared by the b* microbenchmarks
+
+Each benchmark is a function that performs one operation iters
+times.  bench_run first doubles iters until a batch takes at least a
+tenth of the target time.  It then times BENCH_REPS batches sized to
+the target and prints one tab separated line:
+
+	benchmark	params	iterations	ns_per_op	min_ns_per_op
+
+where ns_per_op is the median over the batches, min_ns_per_op the
+fastest, and params is a comma separated list of key=value pairs.
+Lines starting with # are comments, so the output of "make bench"
+can be loaded straight into a spreadsheet or diffed between versions.
+
+Options for every b* program:
+	-q	quick: 10 ms per batch instead of 100 ms
+	-f	filter: only run benchmarks whose name contains the next argument
+*/
+
+#include "bench.h"
+#include "allele.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_REPS 5
+
+static double target = 0.1;				// seconds per timed batch
+static const char* filter = NULL;
+
+static int cmp_double(const void* a, const void* b);
+
+static int cmp_double(const void* a, const void* b) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/// Parse the common options and print the header comments.
+void bench_init(int argc, char** argv, const char* program) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-q") == 0) {
+			target = 0.01;
+		}
+		else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		}
+		else {
+			fprintf(stderr, "usage: %s [-q] [-f name]\n", program);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	time_t now = time(NULL);
+	char date[32];
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	printf("# %s %s\n", program, date);
+#ifdef __OPTIMIZE__
+	printf("# compiler %s, optimized\n", __VERSION__);
+#else
+	printf("# compiler %s, not optimized\n", __VERSION__);
+#endif
+	printf("# alleles %s, %zu bytes each\n", ALLELE_NAME, sizeof(allele_t));
+	printf("# benchmark\tparams\titerations\tns_per_op\tmin_ns_per_op\n");
+	fflush(stdout);
+}
+
+void bench_run(const char* name, const char* params, bench_fn op, void* arg) {
+	if (filter != NULL && strstr(name, filter) == NULL) {
+		return;
+	}
+
+	// calibrate
+	long iters = 1;
+	double elapsed;
+	for (;;) {
+		double t = bench_now();
+		op(arg, iters);
+		elapsed = bench_now() - t;
+		if (elapsed >= target / 10 || iters >= (1L << 40)) {
+			break;
+		}
+		iters *= 2;
+	}
+	if (elapsed > 0) {
+		double scaled = iters * (target / elapsed);
+		iters = (scaled < 1 ? 1 : (long) scaled);
+	}
+
+	double ns[BENCH_REPS];
+	for (int r = 0; r < BENCH_REPS; r++) {
+		double t = bench_now();
+		op(arg, iters);
+		ns[r] = 1e9 * (bench_now() - t) / iters;
+	}
+	qsort(ns, BENCH_REPS, sizeof(double), cmp_double);
+
+	printf("%s\t%s\t%ld\t%.2f\t%.2f\n", name, params, iters,
+		   ns[BENCH_REPS / 2], ns[0]);
+	fflush(stdout);
+}
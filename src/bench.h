@@ -0,0 +1,17 @@
+/**
+ * @file bench.h
+ * @author Daniel R. Tabin
+ * @brief Header for bench.c
+ */
+
+#ifndef BENCH
+#define BENCH
+
+/// Runs op iters times on arg.
+typedef void (*bench_fn)(void* arg, long iters);
+
+void	bench_init(int argc, char** argv, const char* program);
+void	bench_run(const char* name, const char* params, bench_fn op, void* arg);
+double	bench_now(void);
+
+#endif
@@ -0,0 +1,228 @@
+/**
+@file bscale.c
+@page bscale
+@author Daniel R. Tabin
+@brief Thread scaling of polygensim, genancesim and devosim
+
+Runs each simulator as a separate process, with its output thrown
+away, over a grid of chromosome lengths, population sizes and thread
+counts, and prints one tab separated line per combination:
+
+	program	c	p	threads	seconds	speedup	efficiency	recommended
+
+seconds is the fastest of the repetitions, speedup is relative to
+-t 1 for the same program and size (0 if 1 is not in the list), and
+efficiency is speedup divided by threads.  For each program and size exactly one line has
+recommended set to 1: the smallest thread count whose time is within
+5% of the fastest, since extra threads that buy nothing only take
+cores from other work.  A # comment summarizing the choice follows
+each group.
+
+The simulators must be in the current directory, as they are after
+"make".  Runs are not seeded, since the simulators only accept --seed
+with -t 1.
+
+Options:
+	-q	quick: 10 generations and 1 repetition
+	-g	generations per run (default 100)
+	-r	repetitions per combination (default 3)
+	-c	comma separated chromosome lengths (default 10,100,1000)
+	-p	comma separated population sizes (default 10,100,1000)
+	-t	comma separated thread counts (default 1,2,4,... up to the cores)
+	-P	only run programs whose name contains the next argument
+*/
+
+#include "bench.h"
+#include "jobqueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#define MAX_LIST 32
+#define SLACK 1.05		// within 5% of the fastest counts as fastest
+
+const char* usageMsg =
+	"usage: bscale [-q] [-g gens] [-r reps] [-c list] [-p list] [-t list] [-P program]\n";
+
+void usage(void);
+int parse_list(const char* arg, int* list);
+double run_once(const char* program, int c, int p, int g, int t);
+
+void usage(void) {
+	fputs(usageMsg, stderr);
+	exit(EXIT_FAILURE);
+}
+
+/// Parse a comma separated list of positive ints; returns the count.
+int parse_list(const char* arg, int* list) {
+	int n = 0;
+	const char* s = arg;
+
+	while (*s != '\0') {
+		char* end;
+		long v = strtol(s, &end, 10);
+		if (end == s || v <= 0 || n == MAX_LIST) {
+			usage();
+		}
+		list[n++] = (int) v;
+		s = (*end == ',' ? end + 1 : end);
+		if (*end != ',' && *end != '\0') {
+			usage();
+		}
+	}
+	if (n == 0) {
+		usage();
+	}
+	return n;
+}
+
+/// Wall time of one run of ./program, or a negative value on failure.
+double run_once(const char* program, int c, int p, int g, int t) {
+	char path[64], cs[16], ps[16], gs[16], ts[16];
+	snprintf(path, sizeof(path), "./%s", program);
+	snprintf(cs, sizeof(cs), "%d", c);
+	snprintf(ps, sizeof(ps), "%d", p);
+	snprintf(gs, sizeof(gs), "%d", g);
+	snprintf(ts, sizeof(ts), "%d", t);
+	char opt_c[] = "-c", opt_p[] = "-p", opt_g[] = "-g", opt_t[] = "-t";
+	char* args[] = {path, opt_c, cs, opt_p, ps, opt_g, gs, opt_t, ts, NULL};
+
+	fflush(stdout);
+	double start = bench_now();
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		if (null >= 0) {
+			dup2(null, STDOUT_FILENO);
+		}
+		execv(path, args);
+		perror(path);
+		_exit(127);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return -1;
+	}
+	return bench_now() - start;
+}
+
+int main(int argc, char **argv) {
+	const char* programs[] = {"polygensim", "genancesim", "devosim"};
+	const char* only = NULL;
+	int chrom_sizes[MAX_LIST] = {10, 100, 1000};
+	int pop_sizes[MAX_LIST] = {10, 100, 1000};
+	int threads[MAX_LIST];
+	int nc = 3, np = 3, nt = 0;
+	int gens = 100, reps = 3;
+
+	int cores = getNumCores();
+	for (int t = 1; nt < MAX_LIST; t *= 2) {
+		threads[nt++] = (t < cores ? t : cores);
+		if (t >= cores) {
+			break;
+		}
+	}
+	if (threads[0] < 1) {
+		threads[0] = 1;
+		nt = 1;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-q") == 0) {
+			gens = 10;
+			reps = 1;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			usage();
+		}
+		if (strcmp(argv[i], "-g") == 0) {
+			gens = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-r") == 0) {
+			reps = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-c") == 0) {
+			nc = parse_list(argv[++i], chrom_sizes);
+		}
+		else if (strcmp(argv[i], "-p") == 0) {
+			np = parse_list(argv[++i], pop_sizes);
+		}
+		else if (strcmp(argv[i], "-t") == 0) {
+			nt = parse_list(argv[++i], threads);
+		}
+		else if (strcmp(argv[i], "-P") == 0) {
+			only = argv[++i];
+		}
+		else {
+			usage();
+		}
+	}
+	if (gens < 1 || reps < 1) {
+		usage();
+	}
+
+	printf("# bscale, %d generations, best of %d, %d cores\n", gens, reps, cores);
+	printf("program\tc\tp\tthreads\tseconds\tspeedup\tefficiency\trecommended\n");
+
+	for (int prog = 0; prog < 3; prog++) {
+		if (only != NULL && strstr(programs[prog], only) == NULL) {
+			continue;
+		}
+		for (int ci = 0; ci < nc; ci++) {
+			for (int pi = 0; pi < np; pi++) {
+				double seconds[MAX_LIST];
+				double serial = -1;
+				double fastest = -1;
+
+				for (int ti = 0; ti < nt; ti++) {
+					seconds[ti] = -1;
+					for (int r = 0; r < reps; r++) {
+						double s = run_once(programs[prog], chrom_sizes[ci],
+											pop_sizes[pi], gens, threads[ti]);
+						if (s < 0) {
+							fprintf(stderr, "bscale: %s failed\n", programs[prog]);
+							exit(EXIT_FAILURE);
+						}
+						if (seconds[ti] < 0 || s < seconds[ti]) {
+							seconds[ti] = s;
+						}
+					}
+					if (threads[ti] == 1) {
+						serial = seconds[ti];
+					}
+					if (fastest < 0 || seconds[ti] < fastest) {
+						fastest = seconds[ti];
+					}
+				}
+
+				int best = 0;
+				for (int ti = 0; ti < nt; ti++) {
+					if (seconds[ti] <= fastest * SLACK &&
+						(seconds[best] > fastest * SLACK || threads[ti] < threads[best])) {
+						best = ti;
+					}
+				}
+
+				for (int ti = 0; ti < nt; ti++) {
+					double speedup = (serial > 0 ? serial / seconds[ti] : 0);
+					printf("%s\t%d\t%d\t%d\t%.6f\t%.3f\t%.3f\t%d\n", programs[prog],
+						   chrom_sizes[ci], pop_sizes[pi], threads[ti], seconds[ti],
+						   speedup, speedup / threads[ti], (ti == best));
+				}
+				printf("# %s -c %d -p %d: use -t %d\n", programs[prog],
+					   chrom_sizes[ci], pop_sizes[pi], threads[best]);
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,221 @@
+/**
+ * @file bsim.c
+ * @author Daniel R. Tabin
+ * @brief Microbenchmarks for the devosim kernels
+ *
+ * Degnome_mate from ance_degnome.c, which also carries the gene
+ * origin of every allele, over the same sweep as bdegnome, and
+ * calculate_diversity through sim_diversity.  This is a separate
+ * program because degnome.o and ance_degnome.o define different
+ * Degnomes and cannot be linked together.  See bench.c for the
+ * output format.
+ *
+ * numa_read reads a buffer on mem_node from a thread pinned to
+ * cpu_node, for every pair of nodes, so the gap between local and
+ * remote bandwidth shows what --numa and --pin can save.  sim_step
+ * then times whole generations on all cores with each placement,
+ * and with each SIM_SCHEDULE_* way of handing children to workers.
+ * On a machine with one node there is only the local case.
+ */
+
+#define _GNU_SOURCE
+#include "bench.h"
+#include "ance_degnome.h"
+#include "sim.h"
+#include "placement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <gsl/gsl_rng.h>
+
+typedef struct MateArgs MateArgs;
+struct MateArgs {
+	Degnome* child;
+	Degnome* p1;
+	Degnome* p2;
+	gsl_rng* rng;
+	int mutation_rate;
+	int crossover_rate;
+};
+
+typedef struct ReadArgs ReadArgs;
+struct ReadArgs {
+	double* buf;
+	size_t n;
+};
+
+#define READ_BYTES (64 << 20)	// well past the last level cache
+
+volatile double sink;		// keeps results from being optimized away
+
+void op_mate(void* arg, long iters);
+void op_diversity(void* arg, long iters);
+void op_read(void* arg, long iters);
+void op_step(void* arg, long iters);
+
+void op_mate(void* arg, long iters) {
+	MateArgs* a = (MateArgs*) arg;
+	for (long i = 0; i < iters; i++) {
+		Degnome_mate(a->child, a->p1, a->p2, a->rng, a->mutation_rate, 2, a->crossover_rate);
+	}
+	sink = a->child->hat_size;
+}
+
+void op_diversity(void* arg, long iters) {
+	Sim* sim = (Sim*) arg;
+	double x = 0;
+	for (long i = 0; i < iters; i++) {
+		x += sim_diversity(sim, NULL);
+	}
+	sink = x;
+}
+
+void op_read(void* arg, long iters) {
+	ReadArgs* a = (ReadArgs*) arg;
+	double x = 0;
+	for (long i = 0; i < iters; i++) {
+		for (size_t k = 0; k < a->n; k += 8) {		// one double per line
+			x += a->buf[k];
+		}
+	}
+	sink = x;
+}
+
+void op_step(void* arg, long iters) {
+	Sim* sim = (Sim*) arg;
+	for (long i = 0; i < iters; i++) {
+		sim_step(sim);
+	}
+}
+
+int main(int argc, char **argv) {
+	bench_init(argc, argv, "bsim");
+
+	gsl_rng* rng = gsl_rng_alloc(gsl_rng_taus);
+	gsl_rng_set(rng, 1);
+	char params[128];
+
+	int chrom_sizes[] = {10, 100, 1000, 10000};
+	int crossover_rates[] = {0, 2, 20};
+	int mutation_rates[] = {0, 1, 10};
+
+	for (int c = 0; c < 4; c++) {
+		chrom_size = chrom_sizes[c];
+		Degnome* p1 = Degnome_new();
+		Degnome* p2 = Degnome_new();
+		Degnome* child = Degnome_new();
+		for (int j = 0; j < chrom_size; j++) {
+			p1->dna_array[j] = ALLELE_FROM(j);
+			p2->dna_array[j] = ALLELE_FROM(-j);
+			p1->GOI_array[j] = 0;
+			p2->GOI_array[j] = 1;
+		}
+
+		for (int o = 0; o < 3; o++) {
+			for (int m = 0; m < 3; m++) {
+				MateArgs a = {child, p1, p2, rng, mutation_rates[m], crossover_rates[o]};
+				snprintf(params, sizeof(params), "c=%d,o=%d,m=%d",
+						 chrom_size, crossover_rates[o], mutation_rates[m]);
+				bench_run("ance_Degnome_mate", params, op_mate, &a);
+			}
+		}
+		Degnome_free(p1);
+		Degnome_free(p2);
+		Degnome_free(child);
+	}
+
+	// diversity after a few generations of drift, so the gene origins
+	// are mixed as they would be mid-run
+	int pop_sizes[] = {10, 30, 100};
+	for (int p = 0; p < 3; p++) {
+		SimParams par;
+		sim_default_params(&par);
+		par.chrom_size = 100;
+		par.pop_size = pop_sizes[p];
+		par.crossover_rate = 2;
+		par.seed = 1;
+		Sim* sim = sim_new_with_queue(&par, NULL);
+		for (int g = 0; g < 5; g++) {
+			sim_step(sim);
+		}
+		snprintf(params, sizeof(params), "c=%d,p=%d", par.chrom_size, par.pop_size);
+		bench_run("calculate_diversity", params, op_diversity, sim);
+		sim_free(sim);
+	}
+
+	// local and remote read bandwidth
+	int nodes = Placement_nodes();
+	cpu_set_t allowed;
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	ReadArgs ra;
+	ra.n = READ_BYTES / sizeof(double);
+	for (int mem = 0; mem < nodes; mem++) {
+		if (posix_memalign((void**) &ra.buf, 4096, READ_BYTES) != 0) {
+			fprintf(stderr, "bsim: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		Placement_bind(ra.buf, READ_BYTES, mem);
+		memset(ra.buf, 0, READ_BYTES);			// first touch, now on mem
+		for (int cpu = 0; cpu < nodes; cpu++) {
+			// slot cpu is on node cpu; see Placement_cpu
+			if (Placement_pin(cpu) < 0 || Placement_nodeOf(Placement_cpu(cpu)) != cpu) {
+				continue;
+			}
+			snprintf(params, sizeof(params), "cpu_node=%d,mem_node=%d,MB=%d",
+					 cpu, mem, READ_BYTES >> 20);
+			bench_run("numa_read", params, op_read, &ra);
+		}
+		free(ra.buf);
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+
+	// a generation on every core, with each placement
+	const char* place_names[] = {"none", "interleave", "partition"};
+	for (int pl = PLACE_DEFAULT; pl <= PLACE_PARTITION; pl++) {
+		for (int pin = 0; pin < 2; pin++) {
+			if (pl != PLACE_DEFAULT && !pin) {
+				continue;
+			}
+			SimParams par;
+			sim_default_params(&par);
+			par.chrom_size = 1000;
+			par.pop_size = 500;
+			par.crossover_rate = 2;
+			par.seed = 1;
+			par.num_threads = getNumCores();
+			par.pin_threads = pin;
+			par.placement = pl;
+			Sim* sim = sim_new(&par);
+			snprintf(params, sizeof(params), "c=%d,p=%d,t=%d,numa=%s,pin=%d",
+					 par.chrom_size, par.pop_size, par.num_threads, place_names[pl], pin);
+			bench_run("sim_step", params, op_step, sim);
+			sim_free(sim);
+		}
+	}
+
+	// one job per child against one block per worker, on short
+	// chromosomes where neighbouring children share cache lines
+	const char* schedule_names[] = {"child", "block", "sorted"};
+	int step_sizes[] = {10, 1000};
+	for (int c = 0; c < 2; c++) {
+		for (int s = SIM_SCHEDULE_CHILD; s <= SIM_SCHEDULE_SORTED; s++) {
+			SimParams par;
+			sim_default_params(&par);
+			par.chrom_size = step_sizes[c];
+			par.pop_size = 1000;
+			par.seed = 1;
+			par.num_threads = getNumCores();
+			par.schedule = s;
+			Sim* sim = sim_new(&par);
+			snprintf(params, sizeof(params), "c=%d,p=%d,t=%d,schedule=%s",
+					 par.chrom_size, par.pop_size, par.num_threads, schedule_names[s]);
+			bench_run("sim_step", params, op_step, sim);
+			sim_free(sim);
+		}
+	}
+
+	gsl_rng_free(rng);
+	return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef ARR_CHECKMEM_H
+#  define ARR_CHECKMEM_H
+#  include <stdio.h>
+#  include <stdlib.h>
+/// CHECKMEM(x) prints where it was called and exits if x is false,
+/// typically because malloc returned NULL.  It is a single statement,
+/// so it can stand alone under an if or else.
+#  define CHECKMEM(x) do {                                       \
+        if (!(x)) {                                             \
+            fprintf(stderr, "%s:%s:%d: allocation error\n",     \
+                    __FILE__,__func__,__LINE__);                \
+            exit(EXIT_FAILURE);                                 \
+        }                                                       \
+    } while(0)
+#endif
@@ -0,0 +1,246 @@
+/**
+@file counters.c
+@page counters
+@author Daniel R. Tabin
+@brief Per-thread hardware event counters from perf_event_open
+
+Wall-clock time says how long mating takes but not why.  Cycles and
+instructions give instructions per cycle, which is high when the
+kernel is limited by arithmetic and low when it waits on memory, and
+last level cache misses and branch misses say which memory and which
+branches.  Comparing them across chromosome lengths shows where
+Degnome_mate turns from compute bound to memory bound.
+
+Counters_start opens one counter per event for the calling thread,
+and every thread that calls Counters_attachThread afterwards (the
+JobQueue workers do so when counting is on) gets its own.  Counts are
+user space only, which is all an unprivileged process may count when
+perf_event_paranoid is 2, and they are scaled up if the kernel had to
+share the hardware counters between events.  A thread's counts are
+folded into a running total when it detaches, so Counters_readOthers
+keeps growing across JobQueues that come and go.
+
+The events are opened with the perf_event_open system call, so no
+library is needed.  An event the kernel or the hardware does not
+support, as is usual inside a virtual machine, is left out and
+Counters_have says so.  The task clock is a software event and is
+almost always there.
+*/
+
+#define _GNU_SOURCE
+#include "counters.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef __linux__
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+
+typedef struct ThreadCounters ThreadCounters;
+struct ThreadCounters {
+	ThreadCounters* next;		// attached threads other than the first
+	int fd[CTR_NUM_EVENTS];		// -1 if not counted
+};
+
+int counters_on = 0;
+
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadCounters* first = NULL;	// the thread that called Counters_start
+static ThreadCounters* others = NULL;
+static double retired[CTR_NUM_EVENTS];	// final counts of detached threads
+static int have[CTR_NUM_EVENTS];
+static int epoch = 0;					// bumped by Counters_stop
+static __thread ThreadCounters* mine = NULL;
+static __thread int mine_epoch = -1;
+
+static ThreadCounters* open_thread(int probe);
+static void close_thread(ThreadCounters* tc);
+static double read_event(int fd);
+
+#ifdef __linux__
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} events[CTR_NUM_EVENTS] = {
+	{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+#endif
+
+/// Open the events in have, or every event if probe, for the calling thread.
+static ThreadCounters* open_thread(int probe) {
+	ThreadCounters* tc = malloc(sizeof(ThreadCounters));
+	CHECKMEM(tc);
+	tc->next = NULL;
+	for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+		tc->fd[k] = -1;
+#ifdef __linux__
+		if (probe || have[k]) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = events[k].type;
+			attr.config = events[k].config;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+				| PERF_FORMAT_TOTAL_TIME_RUNNING;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			tc->fd[k] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+									  PERF_FLAG_FD_CLOEXEC);
+		}
+#endif
+	}
+	return tc;
+}
+
+static void close_thread(ThreadCounters* tc) {
+#ifdef __linux__
+	for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+		if (tc->fd[k] >= 0) {
+			close(tc->fd[k]);
+		}
+	}
+#endif
+	free(tc);
+}
+
+/// Count of one event, scaled up for the time it was not on a counter.
+static double read_event(int fd) {
+#ifdef __linux__
+	uint64_t buf[3];		// value, time enabled, time running
+
+	if (fd < 0 || read(fd, buf, sizeof(buf)) != (ssize_t) sizeof(buf) || buf[2] == 0) {
+		return 0;
+	}
+	return (buf[1] == buf[2] ? (double) buf[0] : (double) buf[0] * buf[1] / buf[2]);
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Start counting on the calling thread, and on every thread that
+ * attaches until Counters_stop.  Returns 0 if at least one event
+ * could be counted, -1 if none could or counting was already on.
+ */
+int Counters_start(void) {
+	int any = 0;
+
+	if (counters_on) {
+		return -1;
+	}
+	ThreadCounters* tc = open_thread(1);
+	for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+		have[k] = (tc->fd[k] >= 0);
+		any |= have[k];
+		retired[k] = 0;
+	}
+	if (!any) {
+		close_thread(tc);
+		return -1;
+	}
+	pthread_mutex_lock(&counters_lock);
+	first = tc;
+	others = NULL;
+	pthread_mutex_unlock(&counters_lock);
+	mine = tc;
+	mine_epoch = epoch;
+	counters_on = 1;
+	return 0;
+}
+
+/// Whether event, a CTR_* value, is being counted.
+int Counters_have(int event) {
+	return counters_on && have[event];
+}
+
+/// Count the calling thread too.  Does nothing if counting is off.
+void Counters_attachThread(void) {
+	if (!counters_on || (mine != NULL && mine_epoch == epoch)) {
+		return;
+	}
+	ThreadCounters* tc = open_thread(0);
+	pthread_mutex_lock(&counters_lock);
+	tc->next = others;
+	others = tc;
+	mine = tc;
+	mine_epoch = epoch;
+	pthread_mutex_unlock(&counters_lock);
+}
+
+/// Stop counting the calling thread, keeping what it counted so far.
+void Counters_detachThread(void) {
+	if (mine == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&counters_lock);
+	if (mine_epoch != epoch) {
+		mine = NULL;
+	}
+	else if (mine != first) {
+		for (ThreadCounters** p = &others; *p != NULL; p = &(*p)->next) {
+			if (*p == mine) {
+				*p = mine->next;
+				break;
+			}
+		}
+		for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+			retired[k] += read_event(mine->fd[k]);
+		}
+		close_thread(mine);
+		mine = NULL;
+	}
+	pthread_mutex_unlock(&counters_lock);
+}
+
+/// The calling thread's counts so far, or zeros if it is not counted.
+void Counters_read(double* values) {
+	int live = (mine != NULL && mine_epoch == epoch);
+
+	for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+		values[k] = (live ? read_event(mine->fd[k]) : 0);
+	}
+}
+
+/**
+ * The counts so far of every thread but the one that called
+ * Counters_start, including threads that have since detached.
+ */
+void Counters_readOthers(double* values) {
+	pthread_mutex_lock(&counters_lock);
+	for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+		values[k] = retired[k];
+	}
+	for (ThreadCounters* tc = others; tc != NULL; tc = tc->next) {
+		for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+			values[k] += read_event(tc->fd[k]);
+		}
+	}
+	pthread_mutex_unlock(&counters_lock);
+}
+
+/// Close every counter.  Threads still attached are forgotten.
+void Counters_stop(void) {
+	if (!counters_on) {
+		return;
+	}
+	counters_on = 0;
+	pthread_mutex_lock(&counters_lock);
+	while (others != NULL) {
+		ThreadCounters* next = others->next;
+		close_thread(others);
+		others = next;
+	}
+	close_thread(first);
+	first = NULL;
+	epoch++;
+	pthread_mutex_unlock(&counters_lock);
+}
@@ -0,0 +1,30 @@
+/**
+ * @file counters.h
+ * @author Daniel R. Tabin
+ * @brief Header for counters.c
+ */
+
+#ifndef COUNTERS
+#define COUNTERS
+
+/// Events counted per thread, in the order Counters_read returns them.
+enum {
+	CTR_TASK_CLOCK,		// nanoseconds on a cpu
+	CTR_CYCLES,
+	CTR_INSTRUCTIONS,
+	CTR_LLC_MISSES,		// last level cache misses
+	CTR_BRANCH_MISSES,
+	CTR_NUM_EVENTS
+};
+
+extern int counters_on;
+
+int		Counters_start(void);
+int		Counters_have(int event);
+void	Counters_attachThread(void);
+void	Counters_detachThread(void);
+void	Counters_read(double* values);
+void	Counters_readOthers(double* values);
+void	Counters_stop(void);
+
+#endif
@@ -6,27 +6,79 @@
 
 This program will be used to simulated Polygenic evoltion of
 quantitative traits by using Degnomes as defined above.
+
+A chromosome is normally one array of chrom_size alleles, and every
+child gets a fresh copy of it.  With chunk_size set (polygensim
+--chunk) it is instead an array of pointers to Chunks of chunk_size
+alleles, each reference counted and shared by every degnome that
+inherited it unchanged.  Degnome_mateChunked points the child at
+each chunk that lies inside one crossover segment, copies only the
+chunks a crossover falls in, and copies a shared chunk before
+mutating it.  A child of a long chromosome with few crossovers and
+mutations then costs a few chunk copies and one pointer per chunk
+instead of a copy of every allele.  Each chunk keeps the sum of its
+alleles, and the hat size is the sum of those, so it may differ from
+Degnome_mate's in the last bits.
+
+Crossovers fall uniformly over the chromosome unless recomb_map is
+set (--recomb), in which case they are drawn from it already sorted
+(see recomb.c).  Likewise mutations take mutation_rate and
+mutation_effect unless mutation_map is set (--mutation), which gives
+each locus its own (see mutmap.c).
 */
 #include "degnome.h"
 #include "misc.h"
+#include "kernels.h"
+#include "checkmem.h"
 #include <string.h>
+#include <stdio.h>
+
+int chrom_size;
+int chunk_size;
+const RecombMap* recomb_map;
+const MutationMap* mutation_map;
+
+// Scratch for Degnome_mate, grown as needed and kept between calls
+// so that a long run allocates it once per thread.
+static __thread int* crossover_locations = NULL;
+static __thread int max_crossovers = 0;
+
+static int draw_crossovers(gsl_rng* rng, int crossover_rate);
+static void mutate(Degnome* child, gsl_rng* rng, int num_mutations, int mutation_effect);
+static int draw_mutations(gsl_rng* rng, int mutation_rate);
+static int draw_mutation(gsl_rng* rng, int mutation_effect, double* mutation);
+static Chunk* chunk_new(int len);
+static int chunk_len(int b);
 
 Degnome* Degnome_new() {
 	Degnome* q = malloc(sizeof(Degnome));
-	q->dna_array = malloc(chrom_size*sizeof(double));
+	q->dna_array = malloc(chrom_size*sizeof(allele_t));
+	q->chunks = NULL;
 
 	return q;
 }
 
-void Degnome_mate(Degnome* child, Degnome* p1, Degnome* p2, gsl_rng* rng,
-	int mutation_rate, int mutation_effect, int crossover_rate) {
-	// printf("mating\n");
-	
-	//Cross over
+/// A Degnome in arena, released with it rather than by Degnome_free.
+Degnome* Degnome_newIn(DegnomeArena* arena) {
+	Degnome* q = DegnomeArena_alloc(arena, sizeof(Degnome));
+	q->dna_array = DegnomeArena_alloc(arena, chrom_size*sizeof(allele_t));
+	q->chunks = NULL;
+
+	return q;
+}
+
+/// Draw the crossovers of one mating into crossover_locations, sorted.
+static int draw_crossovers(gsl_rng* rng, int crossover_rate) {
 	int num_crossover = gsl_ran_poisson(rng, crossover_rate);
-	int crossover_locations[num_crossover];
-	int distance = 0;
-	int diff;
+	if (num_crossover > max_crossovers) {
+		max_crossovers = 2 * num_crossover;
+		crossover_locations = realloc(crossover_locations, max_crossovers*sizeof(int));
+		CHECKMEM(crossover_locations);
+	}
+	if (recomb_map != NULL) {
+		RecombMap_draw(recomb_map, rng, num_crossover, crossover_locations);
+		return num_crossover;
+	}
 
 	for (int i = 0; i < num_crossover; i++) {
 		crossover_locations[i] = gsl_rng_uniform_int(rng, chrom_size);
@@ -34,15 +86,26 @@ void Degnome_mate(Degnome* child, Degnome* p1, Degnome* p2, gsl_rng* rng,
 	if (num_crossover > 0) {
 		int_qsort(crossover_locations, num_crossover);//changed
 	}
+	return num_crossover;
+}
+
+void Degnome_mate(Degnome* child, Degnome* p1, Degnome* p2, gsl_rng* rng,
+	int mutation_rate, int mutation_effect, int crossover_rate) {
+	// printf("mating\n");
+	
+	//Cross over
+	int num_crossover = draw_crossovers(rng, crossover_rate);
+	int distance = 0;
+	int diff;
 
 	for (int i = 0; i < num_crossover; i++) {
 		diff = crossover_locations[i] - distance;
 
 		if (i % 2 == 0) {
-			memcpy(child->dna_array+distance, p1->dna_array+distance, (diff*sizeof(double)));
+			memcpy(child->dna_array+distance, p1->dna_array+distance, (diff*sizeof(allele_t)));
 		}
 		else {
-			memcpy(child->dna_array+distance, p2->dna_array+distance, (diff*sizeof(double)));
+			memcpy(child->dna_array+distance, p2->dna_array+distance, (diff*sizeof(allele_t)));
 		}
 		distance = crossover_locations[i];
 	}
@@ -55,34 +118,213 @@ void Degnome_mate(Degnome* child, Degnome* p1, Degnome* p2, gsl_rng* rng,
 	}
 
 	if (num_crossover % 2 == 0) {
-		memcpy(child->dna_array+distance, p1->dna_array+distance, (diff*sizeof(double)));
+		memcpy(child->dna_array+distance, p1->dna_array+distance, (diff*sizeof(allele_t)));
 	}
 	else {
-		memcpy(child->dna_array+distance, p2->dna_array+distance, (diff*sizeof(double)));
+		memcpy(child->dna_array+distance, p2->dna_array+distance, (diff*sizeof(allele_t)));
 	}
 
-	child->hat_size = 0;
-
 	//mutate
+	mutate(child, rng, draw_mutations(rng, mutation_rate), mutation_effect);
+	//and we are done!
+}
+
+/// Add num_mutations random mutations to child and total its hat size.
+static void mutate(Degnome* child, gsl_rng* rng, int num_mutations, int mutation_effect) {
 	double mutation;
-	int num_mutations = gsl_ran_poisson(rng, mutation_rate);
 	int mutation_location;
 
 	for (int i = 0; i < num_mutations; i++) {
-		mutation_location = gsl_rng_uniform_int(rng, chrom_size);
-		mutation = gsl_ran_gaussian_ziggurat(rng, mutation_effect);
-		child->dna_array[mutation_location] += mutation;
+		mutation_location = draw_mutation(rng, mutation_effect, &mutation);
+		ALLELE_ADD(child->dna_array[mutation_location], mutation);
 	}
 
 	//calculate hat_size
+	child->hat_size = Kernel_sum(child->dna_array, chrom_size);
+}
+
+/// Draw how many mutations one child gets.
+static int draw_mutations(gsl_rng* rng, int mutation_rate) {
+	return gsl_ran_poisson(rng, (mutation_map != NULL ? MutationMap_rate(mutation_map)
+								 : mutation_rate));
+}
 
-	for (int i = 0; i < chrom_size; i++) {
-		child->hat_size += child->dna_array[i];
+/// Draw the locus of one mutation, returned, and its size, in mutation.
+static int draw_mutation(gsl_rng* rng, int mutation_effect, double* mutation) {
+	if (mutation_map != NULL) {
+		double effect;
+		int location = MutationMap_locus(mutation_map, rng, &effect);
+		*mutation = gsl_ran_gaussian_ziggurat(rng, effect);
+		return location;
+	}
+	int location = gsl_rng_uniform_int(rng, chrom_size);
+	*mutation = gsl_ran_gaussian_ziggurat(rng, mutation_effect);
+	return location;
+}
+
+/**
+ * As Degnome_mate, drawing the same random numbers, but when p1 and p2
+ * share one dna_array (see genepool.c) and no mutation falls, the
+ * child is pointed at it instead of copying it.  Returns 1 if so; the
+ * child's own dna_array is then unused.
+ */
+int Degnome_mateOrShare(Degnome* child, Degnome* p1, Degnome* p2, gsl_rng* rng,
+	int mutation_rate, int mutation_effect, int crossover_rate) {
+	if (p1->dna_array != p2->dna_array) {
+		Degnome_mate(child, p1, p2, rng, mutation_rate, mutation_effect, crossover_rate);
+		return 0;
+	}
+
+	// every segment comes from the same genes, wherever the crossovers fall
+	draw_crossovers(rng, crossover_rate);
+
+	int num_mutations = draw_mutations(rng, mutation_rate);
+	if (num_mutations == 0) {
+		child->dna_array = p1->dna_array;
+		child->hat_size = p1->hat_size;
+		return 1;
+	}
+	memcpy(child->dna_array, p1->dna_array, chrom_size*sizeof(allele_t));
+	mutate(child, rng, num_mutations, mutation_effect);
+	return 0;
+}
+
+/// Number of chunks in a chunked chromosome.
+int Degnome_chunkCount(void) {
+	return (chrom_size + chunk_size - 1) / chunk_size;
+}
+
+/// Alleles in chunk b; the last may be short.
+static int chunk_len(int b) {
+	int rest = chrom_size - b * chunk_size;
+
+	return (rest < chunk_size ? rest : chunk_size);
+}
+
+/// A chunk of len alleles with one reference.
+static Chunk* chunk_new(int len) {
+	Chunk* c = malloc(sizeof(Chunk) + len*sizeof(allele_t));
+	CHECKMEM(c);
+	c->refs = 1;
+
+	return c;
+}
+
+/**
+ * Make q's chromosome chunked, from its dna_array, in chunks, which
+ * has room for Degnome_chunkCount pointers.  dna_array is left alone.
+ */
+void Degnome_chunk(Degnome* q, Chunk** chunks) {
+	q->chunks = chunks;
+	q->hat_size = 0;
+	for (int b = 0; b * chunk_size < chrom_size; b++) {
+		int len = chunk_len(b);
+		Chunk* c = chunk_new(len);
+
+		memcpy(c->alleles, q->dna_array + (size_t) b * chunk_size, len*sizeof(allele_t));
+		c->sum = Kernel_sum(c->alleles, len);
+		q->hat_size += c->sum;
+		chunks[b] = c;
+	}
+}
+
+/**
+ * As Degnome_mate, drawing the same random numbers, for chunked
+ * parents.  child->chunks must have room for Degnome_chunkCount
+ * pointers, which are overwritten.  Chunks are shared from the
+ * parents, so they must not be released until the child's are.
+ */
+void Degnome_mateChunked(Degnome* child, Degnome* p1, Degnome* p2, gsl_rng* rng,
+	int mutation_rate, int mutation_effect, int crossover_rate) {
+	int num_crossover = draw_crossovers(rng, crossover_rate);
+	int* cut = crossover_locations;
+	int s = 0;		// crossovers at or before the current allele
+
+	// allele x comes from p2 if an odd number of crossovers are at or before it
+	for (int b = 0; b * chunk_size < chrom_size; b++) {
+		int lo = b * chunk_size;
+		int hi = lo + chunk_len(b);
+
+		while (s < num_crossover && cut[s] <= lo) {
+			s++;
+		}
+		if (s == num_crossover || cut[s] >= hi) {
+			Chunk* c = (s % 2 == 0 ? p1 : p2)->chunks[b];
+			__atomic_add_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+			child->chunks[b] = c;
+			continue;
+		}
+
+		Chunk* c = chunk_new(hi - lo);
+		for (int x = lo, t = s; x < hi; ) {
+			int end = (t < num_crossover && cut[t] < hi ? cut[t] : hi);
+			const Chunk* from = (t % 2 == 0 ? p1 : p2)->chunks[b];
+
+			memcpy(c->alleles + (x - lo), from->alleles + (x - lo), (end - x)*sizeof(allele_t));
+			x = end;
+			while (t < num_crossover && cut[t] <= x) {
+				t++;
+			}
+		}
+		child->chunks[b] = c;
+	}
+
+	//mutate, copying a shared chunk first
+	int num_mutations = draw_mutations(rng, mutation_rate);
+
+	for (int i = 0; i < num_mutations; i++) {
+		double mutation;
+		int loc = draw_mutation(rng, mutation_effect, &mutation);
+		int b = loc / chunk_size;
+		Chunk* c = child->chunks[b];
+
+		if (c == p1->chunks[b] || c == p2->chunks[b]) {
+			Chunk* copy = chunk_new(chunk_len(b));
+			memcpy(copy->alleles, c->alleles, chunk_len(b)*sizeof(allele_t));
+			__atomic_sub_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+			child->chunks[b] = c = copy;
+		}
+		ALLELE_ADD(c->alleles[loc - b * chunk_size], mutation);
+	}
+
+	//calculate hat_size from the chunks, summing only the new ones
+	child->hat_size = 0;
+	for (int b = 0; b * chunk_size < chrom_size; b++) {
+		Chunk* c = child->chunks[b];
+
+		if (c != p1->chunks[b] && c != p2->chunks[b]) {
+			c->sum = Kernel_sum(c->alleles, chunk_len(b));
+		}
+		child->hat_size += c->sum;
+	}
+}
+
+/// Drop q's references to its chunks, freeing those no one else holds.
+void Degnome_releaseChunks(Degnome* q) {
+	for (int b = 0; b * chunk_size < chrom_size; b++) {
+		Chunk* c = q->chunks[b];
+
+		if (__atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+			free(c);
+		}
+	}
+}
+
+/// Copy q's chunked chromosome into row, which has room for chrom_size alleles.
+void Degnome_gather(const Degnome* q, allele_t* row) {
+	for (int b = 0; b * chunk_size < chrom_size; b++) {
+		memcpy(row + (size_t) b * chunk_size, q->chunks[b]->alleles, chunk_len(b)*sizeof(allele_t));
 	}
-	//and we are done!
 }
 
 void Degnome_free(Degnome* q) {
 	free(q->dna_array);
 	free(q);
-}
\ No newline at end of file
+}
+
+/// Free the calling thread's scratch.  Degnome_mate makes it again if needed.
+void Degnome_freeScratch(void) {
+	free(crossover_locations);
+	crossover_locations = NULL;
+	max_crossovers = 0;
+}
@@ -1,23 +1,49 @@
 #ifndef DEGNOME
 #define DEGNOME
 
+#include "allele.h"
+#include "arena.h"
+#include "recomb.h"
+#include "mutmap.h"
 #include <stdlib.h>
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_randist.h>
 
+// chunk_size alleles shared by every degnome that inherited them unchanged
+typedef struct Chunk Chunk;
+struct Chunk {
+	int refs;
+	double sum;			// of alleles
+	allele_t alleles[];
+};
+
 //Degnomedia Rogerus
 typedef struct Degnome Degnome;
 struct Degnome {
-	double* dna_array;
+	allele_t* dna_array;
 	double hat_size;
+	Chunk** chunks;		// the chromosome if chunked, else unused
 
 };
 
 Degnome* Degnome_new(void);
+Degnome* Degnome_newIn(DegnomeArena* arena);
 void Degnome_mate(Degnome* location, Degnome* p1, Degnome* p2, gsl_rng* rng,
 	int mutation_rate, int mutation_effect, int crossover_rate);
+int Degnome_mateOrShare(Degnome* location, Degnome* p1, Degnome* p2, gsl_rng* rng,
+	int mutation_rate, int mutation_effect, int crossover_rate);
 void Degnome_free(Degnome* q);
+void Degnome_freeScratch(void);
+int Degnome_chunkCount(void);
+void Degnome_chunk(Degnome* q, Chunk** chunks);
+void Degnome_mateChunked(Degnome* location, Degnome* p1, Degnome* p2, gsl_rng* rng,
+	int mutation_rate, int mutation_effect, int crossover_rate);
+void Degnome_releaseChunks(Degnome* q);
+void Degnome_gather(const Degnome* q, allele_t* row);
 
-int chrom_size;
+extern int chrom_size;
+extern const RecombMap* recomb_map;	// NULL => crossovers are uniform
+extern const MutationMap* mutation_map;	// NULL => mutation_rate and _effect everywhere
+extern int chunk_size;		// alleles per Chunk; 0 if chromosomes are not chunked
 
 #endif
\ No newline at end of file
@@ -1,35 +1,35 @@
-#include "jobqueue.h"
-#include "ance_degnome.h"
-#include "fitfunc.h"
-#include "flagparse.c"
+#include "sim.h"
+#include "outbuf.h"
+#include "sweep.h"
+#include "ensemble.h"
+#include "trace.h"
+#include "kernels.h"
+#include "flagparse.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <gsl/gsl_rng.h>
-#include <gsl/gsl_randist.h>
-#include <time.h>
-#include <pthread.h>
-#include <unistd.h>
-#include <limits.h>
-
-typedef struct JobData JobData;
-struct JobData {
-	Degnome* child;
-	Degnome* p1;
-	Degnome* p2;
-};
 
 void usage(void);
 void help_menu(void);
-int jobfunc(void* p, void* tdat);
-void calculate_diversity(Degnome* generation, double** percent_decent, double* diversity);
+void print_descent(OutBuf* out, const double* percent_decent, int pop_size);
+void print_traits(OutBuf* out, const SimPopulation* pop, int i);
+void print_stats(OutBuf* out, Ensemble* ens);
+int run_replicates(const SimParams* par, int replicates, int num_gens,
+				   int break_at_zero_diversity, int verbose, Profile* prof);
 
 const char* usageMsg =
 	"Usage: devosim [-bhrv] [-s | -u] [-c chromosome_length]\n"
 	"\t\t  [-e mutation_effect] [-g num_generations]\n"
 	"\t\t  [-m mutation_rate] [-o crossover_rate]\n"
-	"\t\t  [-p population_size] [-t num_threads]\n"
+	"\t\t  [-p population_size] [-t num_threads | auto]\n"
 	"\t\t  [--seed rngseed] [--target hat_height target]\n"
-	"\t\t  [--sqrt | --linear | --close | --ceiling | --log]\n";
+	"\t\t  [--sqrt | --linear | --close | --ceiling | --log]\n"
+	"\t\t  [--sweep grid_file] [--replicates R]\n"
+	"\t\t  [--profile | --counters] [--pin]\n"
+	"\t\t  [--numa none | interleave | partition]\n"
+	"\t\t  [--schedule child | block | sorted] [--trace file]\n"
+	"\t\t  [--cpu-dispatch] [--mmap dir] [--recomb map_file]\n"
+	"\t\t  [--mutation map_file] [--traits trait_file]\n";
 
 const char* helpMsg =
 	"OPTIONS\n"
@@ -57,9 +57,11 @@ const char* helpMsg =
 	"\t -s\t Degnome selection will occur.\n\n"
 	"\t -u\t All degnomes contribute to two offspring.\n\n"
 	"\t -v\t Output will be given for every generation.\n\n"
-	"\t -t num_threads\n"
+	"\t -t num_threads | auto\n"
 	"\t\t Select the number of threads to be used in the current run.\n"
 	"\t\t Default is 0 (which will result in 3/4 of cores being used).\n"
+	"\t\t auto picks inline mating or a worker count each generation\n"
+	"\t\t from the measured cost of mating a child.\n"
 	"\t\t Must be 1 if a seed is used in order to prevent race conditions.\n\n"
 	"\t --seed rngseed\n"
 	"\t\t Select the seed used by the RNG in the current run.\n"
@@ -70,22 +72,62 @@ const char* helpMsg =
 	"\t --sqrt\t\t fitness will be sqrt(hat_height)\n\n"
 	"\t --linear\t fitness will be hat_height\n\n"
 	"\t --close\t fitness will be (target - abs(target - hat_height))\n\n"
-	"\t --ceiling\t fitness will quickly level off after passing target\n\n";
-
-pthread_mutex_t seedLock = PTHREAD_MUTEX_INITIALIZER;
-unsigned long rngseed=0;
-
-//	there is no need for the line 'int chrom_size' as it is declared as a global variable in degnome.h
-int pop_size;
-int num_gens;
-int mutation_rate;
-int mutation_effect;
-int crossover_rate;
-int selective;
-int uniform;
-int verbose;
-int reduced;
-int break_at_zero_diversity;
+	"\t --ceiling\t fitness will quickly level off after passing target\n\n"
+	"\t --sweep grid_file\n"
+	"\t\t Run every combination of the parameter values listed in\n"
+	"\t\t grid_file on one thread pool and print one line per run.\n"
+	"\t\t Each line of the file is a parameter (c, e, g, m, o, p,\n"
+	"\t\t target, fit or mode) followed by its values.\n\n"
+	"\t --replicates R\n"
+	"\t\t Run R independent replicates side by side and print the\n"
+	"\t\t ensemble mean and variance of hat size and diversity.\n"
+	"\t\t With -v a line is printed for every generation.\n\n"
+	"\t --profile\t print where the time went to stderr at exit\n\n"
+	"\t --counters\n"
+	"\t\t As --profile, and also count cycles, instructions, last\n"
+	"\t\t level cache misses and branch misses in each phase.\n\n"
+	"\t --pin\n"
+	"\t\t Keep each worker thread on a core of its own, dealt\n"
+	"\t\t round robin over the NUMA nodes.\n\n"
+	"\t --numa none | interleave | partition\n"
+	"\t\t Where to put the population in memory.  interleave spreads\n"
+	"\t\t it page by page over the NUMA nodes, partition gives each\n"
+	"\t\t node a contiguous block of degnomes.  Default is none\n"
+	"\t\t (wherever it is first written).\n\n"
+	"\t --schedule child | block | sorted\n"
+	"\t\t How children are handed to the worker threads.  child\n"
+	"\t\t (the default) makes each child a job of its own.  block\n"
+	"\t\t gives each thread one contiguous block of children and\n"
+	"\t\t prefetches the parents of the next.  sorted is block with\n"
+	"\t\t each block mated in order of parent.  Ignored with -t auto.\n\n"
+	"\t --trace file\n"
+	"\t\t Write a timeline of every job, idle wait and generation\n"
+	"\t\t to file in Chrome trace format, for chrome://tracing or\n"
+	"\t\t ui.perfetto.dev.\n\n"
+	"\t --mmap dir\n"
+	"\t\t Keep the population in files in dir, mapped into memory,\n"
+	"\t\t for runs larger than RAM.  The files are deleted as they\n"
+	"\t\t are made.  Implies --schedule block.\n\n"
+	"\t --mutation map_file\n"
+	"\t\t Give each locus its own mutation rate and effect, from the\n"
+	"\t\t mutation map in map_file, in place of -m and -e.  Each line\n"
+	"\t\t is the first locus of an interval, its expected mutations\n"
+	"\t\t per locus per child and their standard deviation.\n\n"
+	"\t --recomb map_file\n"
+	"\t\t Draw crossovers from the recombination map in map_file\n"
+	"\t\t instead of uniformly.  Each line is the first locus of an\n"
+	"\t\t interval and its crossover rate per locus; loci before the\n"
+	"\t\t first line have rate 0.  The number of crossovers is\n"
+	"\t\t still set by -o.\n\n"
+	"\t --traits trait_file\n"
+	"\t\t With -s, select on traits instead of hat size.  Each line\n"
+	"\t\t of trait_file is a trait number, the first locus of an\n"
+	"\t\t interval and the weight of its alleles in that trait.\n"
+	"\t\t Fitness is the fitness function summed over the traits,\n"
+	"\t\t which are printed with each hat size.\n\n"
+	"\t --cpu-dispatch\n"
+	"\t\t Print which instruction set each vectorized kernel was\n"
+	"\t\t picked for on this cpu, and exit.\n\n";
 
 void usage(void) {
 	fputs(usageMsg, stderr);
@@ -97,71 +139,90 @@ void help_menu(void) {
 	exit(EXIT_FAILURE);
 }
 
-int num_threads = 0;
-JobQueue* jq;
-
-void *ThreadState_new(void *notused);
-void ThreadState_free(void *rng);
+/// One tab separated line of ensemble statistics.
+void print_stats(OutBuf* out, Ensemble* ens) {
+	EnsembleStats st;
+	Ensemble_stats(ens, &st);
+
+	OutBuf_putUint(out, st.generation);
+	OutBuf_putc(out, '\t');
+	OutBuf_putDouble(out, st.mean_hat_size);
+	OutBuf_putc(out, '\t');
+	OutBuf_putDouble(out, st.var_mean_hat_size);
+	OutBuf_putc(out, '\t');
+	OutBuf_putDouble(out, st.mean_var_hat_size);
+	OutBuf_putc(out, '\t');
+	OutBuf_putDouble(out, 100*st.mean_diversity);
+	OutBuf_putc(out, '\t');
+	OutBuf_putDouble(out, 100*100*st.var_diversity);
+	OutBuf_putc(out, '\n');
+}
 
-void *ThreadState_new(void *notused) {
-	// Lock seed, initialize random number generator, increment seed,
-	// and unlock.
-	gsl_rng *rng = gsl_rng_alloc(gsl_rng_taus);
+/// Step R replicates together and print their ensemble statistics.
+int run_replicates(const SimParams* par, int replicates, int num_gens,
+				   int break_at_zero_diversity, int verbose, Profile* prof) {
+	Ensemble* ens = Ensemble_new(par, replicates);
+	if (ens == NULL) {
+		fprintf(stderr, "--replicates needs c >= 1 and p >= 2\n");
+		exit(EXIT_FAILURE);
+	}
+	OutBuf* out = OutBuf_new(stdout, 1 << 20);
+	double t;
 
-	pthread_mutex_lock(&seedLock);
-	gsl_rng_set(rng, rngseed);
-	rngseed = (rngseed == ULONG_MAX ? 0 : rngseed + 1);
-	pthread_mutex_unlock(&seedLock);
+	Ensemble_set_profile(ens, prof);
 
-	return rng;
-}
+	OutBuf_printf(out, "%u, %u, %u, %u\n", par->chrom_size, par->pop_size,
+				  num_gens, replicates);
+	OutBuf_puts(out, "generation\tmean_hat_size\tvar_mean_hat_size"
+				"\tmean_var_hat_size\tpercent_diversity\tvar_percent_diversity\n");
+	print_stats(out, ens);
 
-void ThreadState_free(void *rng) {
-	gsl_rng_free((gsl_rng *) rng);
-}
+	if (verbose) {
+		for (int g = 0; g < num_gens; g++) {
+			if (Ensemble_run(ens, 1, break_at_zero_diversity) == 0) {
+				break;
+			}
+			t = Profile_mark(prof);
+			print_stats(out, ens);
+			Profile_lap(prof, PROF_OUTPUT, t);
+		}
+	}
+	else if (Ensemble_run(ens, num_gens, break_at_zero_diversity) > 0) {
+		print_stats(out, ens);
+	}
 
-int jobfunc(void* p, void* tdat) {
-	gsl_rng* rng = (gsl_rng*) tdat;
-	JobData* data = (JobData*) p;																				//get data out
-	Degnome_mate(data->child, data->p1, data->p2, rng, mutation_rate, mutation_effect, crossover_rate);			//mate
+	t = Profile_mark(prof);
+	OutBuf_free(out);
+	Profile_lap(prof, PROF_OUTPUT, t);
 
-	return 0;		//exited without error
+	Profile_report(prof, Ensemble_job_queue(ens), stderr);
+	Ensemble_free(ens);
+	Profile_free(prof);
+	return 0;
 }
 
-void calculate_diversity(Degnome* generation, double** percent_decent, double* diversity) {
-	*diversity = 0;
-	for (int i = 0; i < pop_size; i++) {			//calculate percent decent for each degnome
-		for (int j = 0; j < pop_size; j++) {
-			percent_decent[i][j] = 0;
-			for (int k = 0; k < chrom_size; k++) {
-				if (generation[i].GOI_array[k] == j) {
-					percent_decent[i][j]++;
-				}
-			}
-			percent_decent[i][j] /= chrom_size;
-		}
+/// Print degnome i's traits, if the population has any.
+void print_traits(OutBuf* out, const SimPopulation* pop, int i) {
+	if (pop->num_traits == 0) {
+		return;
 	}
-	for (int j = 0; j < pop_size; j++) {			//sum and average
-		percent_decent[pop_size][j] = 0;
-		for (int k = 0; k < pop_size; k++) {
-			percent_decent[pop_size][j] += percent_decent[k][j];
-		}
-		percent_decent[pop_size][j] /= pop_size;
+	const double* traits = pop->traits + (size_t) i * pop->num_traits;
+	OutBuf_puts(out, "\nTRAITS:");
+	for (int t = 0; t < pop->num_traits; t++) {
+		OutBuf_printf(out, "\t%lg", traits[t]);
 	}
+}
 
-	for (int i = 0; i < pop_size; i++) {			//calculate percent diversity for the entire generation
-		for (int j = 0; j < pop_size; j++) {
-			if (i == j) {
-				continue;
-			}
-			for (int k = 0; k < chrom_size; k++) {
-				if (generation[i].GOI_array[k] != generation[j].GOI_array[k]) {
-					(*diversity)++;
-				}
-			}
+/// Print every nonzero entry of one row of the percent descent matrix.
+void print_descent(OutBuf* out, const double* percent_decent, int pop_size) {
+	for (int j = 0; j < pop_size; j++) {
+		if (percent_decent[j] > 0) {
+			OutBuf_putDouble(out, 100*percent_decent[j]);
+			OutBuf_puts(out, "% Degnome ");
+			OutBuf_putUint(out, j);
+			OutBuf_putc(out, '\t');
 		}
 	}
-	*diversity /= ((pop_size-1) * pop_size * chrom_size);
 }
 
 int main(int argc, char **argv) {
@@ -178,387 +239,191 @@ int main(int argc, char **argv) {
 		help_menu();
 	}
 
-	break_at_zero_diversity = flags[1];
-	reduced = flags[3];
-	verbose = flags[4];
-	if (flags[5] == 1) {
-		selective = 1;
-	}
-	else if (flags[5] == 2) {
-		uniform = 1;
+	if (flags[23] == 1) {
+		free(flags);
+		Kernel_report(stdout);
+		exit(EXIT_SUCCESS);
 	}
-	chrom_size = flags[6];
-	mutation_effect = flags[7];
-	num_gens = flags[8];
-	mutation_rate = flags[9];
-	crossover_rate = flags[10];
-	pop_size = flags[11];
 
-	num_threads = flags[12];
+	SimParams par;
+	sim_default_params(&par);
 
-	if(flags[13] == 0){
-		set_function("linear");
+	int break_at_zero_diversity = flags[1];
+	int reduced = flags[3];
+	int verbose = flags[4];
+	if (flags[5] == 1) {
+		par.selective = 1;
 	}
-	else if(flags[13] == 1){
-		set_function("sqrt");
+	else if (flags[5] == 2) {
+		par.uniform = 1;
 	}
-	else if(flags[13] == 2){
-		set_function("close");
+	par.chrom_size = flags[6];
+	par.mutation_effect = flags[7];
+	int num_gens = flags[8];
+	par.mutation_rate = flags[9];
+	par.crossover_rate = flags[10];
+	par.pop_size = flags[11];
+	par.num_threads = flags[12];
+	par.fit_func = flags[13];
+	par.target = flags[14];
+	if (flags[15] > 0) {
+		par.seed = flags[15];
 	}
-	else if(flags[13] == 3){
-		set_function("ceiling");
+	const char* gridfile = (flags[16] > 0 ? argv[flags[16]] : NULL);
+	int replicates = flags[17];
+	Profile* prof = (flags[18] ? Profile_new() : NULL);
+	if (flags[18] == 2) {
+		Profile_counters(prof);
 	}
-	else if(flags[13] == 4){
-		set_function("log");
+	par.pin_threads = flags[19];
+	par.placement = flags[20];
+	par.schedule = flags[21];		// same order as SIM_SCHEDULE_*
+	par.mmap_dir = (flags[24] > 0 ? argv[flags[24]] : NULL);
+	par.recomb_file = (flags[26] > 0 ? argv[flags[26]] : NULL);
+	par.mutation_file = (flags[27] > 0 ? argv[flags[27]] : NULL);
+	par.traits_file = (flags[28] > 0 ? argv[flags[28]] : NULL);
+	if (flags[22] > 0) {
+		Trace_start(argv[flags[22]]);
 	}
 
-	target_num = flags[14];
+	free(flags);
 
-	if(flags[15] <= 0) {
-		time_t currtime = time(NULL);                  // time
-		unsigned long pid = (unsigned long) getpid();  // process id
-		rngseed = currtime ^ pid;                      // random seed
+	if (gridfile != NULL && replicates > 0) {
+		usage();
 	}
-	else{
-		rngseed = flags[15];
+	if (replicates > 0) {
+		return run_replicates(&par, replicates, num_gens, break_at_zero_diversity, verbose, prof);
 	}
-	gsl_rng* rng = gsl_rng_alloc(gsl_rng_taus);    // rand generator
-	gsl_rng_set(rng, rngseed);
-
-	free(flags);
-
-
-	if (num_threads <= 0) {
-		if (num_threads < 0) {
-			#ifdef DEBUG_MODE
-				fprintf(stderr, "Error invalid number of threads: %u\n", num_threads);
-			#endif
+	if (gridfile != NULL) {
+		Sweep* sw = Sweep_new(gridfile, &par, num_gens, break_at_zero_diversity);
+		int num_threads = par.num_threads;
+		if (num_threads <= 0) {
+			num_threads = getNumCores() * 3 / 4;
 		}
-		num_threads = (3*getNumCores()/4);
+		Sweep_run(sw, (num_threads < 1 ? 1 : num_threads), stdout);
+		Sweep_free(sw);
+		return 0;
 	}
-	#ifdef DEBUG_MODE
-		fprintf(stderr, "Final number of threads: %u\n", num_threads);
-	#endif
 
-	Degnome* parents;
-	Degnome* children;
-	Degnome* temp;
+	int chrom_size = par.chrom_size;
+	int pop_size = par.pop_size;
+	int selective = par.selective;
 
 	printf("%u, %u, %u\n", chrom_size, pop_size, num_gens);
 
-	parents = malloc(pop_size*sizeof(Degnome));
-	children = malloc(pop_size*sizeof(Degnome));
-
-	for (int i = 0; i < pop_size; i++) {
-		parents[i].dna_array = malloc(chrom_size*sizeof(double));
-		parents[i].GOI_array = malloc(chrom_size*sizeof(int));
-
-		children[i].dna_array = malloc(chrom_size*sizeof(double));
-		children[i].GOI_array = malloc(chrom_size*sizeof(int));
+	OutBuf* out = OutBuf_new(stdout, 1 << 20);
 
-		parents[i].hat_size = 0;
+	Sim* sim = sim_new(&par);
+	SimPopulation pop;
+	double* percent_decent;
+	double diversity;
 
-		for (int j = 0; j < chrom_size; j++) {
-			parents[i].dna_array[j] = 10;	//children aren't initialized
-			parents[i].hat_size += 10;
-			parents[i].GOI_array[j] = (i);	//track ancestries
-		}
-	}
-
-	double* diversity;
-	double** percent_decent;
-
-	diversity = malloc(sizeof(double));
-	*diversity = 1;
-	percent_decent = malloc((pop_size+1)*sizeof(double*));
-	for (int i = 0; i < pop_size+1; i++) {
-		percent_decent[i] = malloc(pop_size*sizeof(double));
-		if (i == pop_size) {
-			continue;
-		}
-		for (int j = 0; j < pop_size; j++) {
-			if (i == j) {
-				percent_decent[i][j] = 1;
-			}
-			else {
-				percent_decent[i][j] = 0;
-			}
-		}
-	}
+	sim_set_profile(sim, prof);
+	double t = Profile_mark(prof);
+	sim_get_population(sim, &pop);
 
 	if (!reduced && !verbose) {
-		printf("\nGeneration 0:\n\n");
+		OutBuf_puts(out, "\nGeneration 0:\n\n");
 		for (int i = 0; i < pop_size; i++) {
-			printf("Degnome %u allele values:\n", i);
-			if (!reduced) {
-				for (int j = 0; j < chrom_size; j++) {
-					printf("%lf\t", parents[i].dna_array[j]);
-				}
-				printf("\n");
-			}
-			else {
-				printf("%lf\n", parents[i].dna_array[0]);
-			}
+			OutBuf_printf(out, "Degnome %u allele values:\n", i);
+			OutBuf_putAlleleRow(out, pop.alleles + (size_t) i*chrom_size, chrom_size);
+			OutBuf_putc(out, '\n');
 
-			printf("Degnome %u ancestries:\n", i);
-			if (!reduced) {
-				for (int j = 0; j < chrom_size; j++) {
-					printf("%u\t", parents[i].GOI_array[j]);
-				}
-				printf("\n");
-			}
-			else {
-				printf("%u\n", parents[i].GOI_array[0]);
-			}
+			OutBuf_printf(out, "Degnome %u ancestries:\n", i);
+			OutBuf_putUintRow(out, pop.ancestries + (size_t) i*chrom_size, chrom_size);
+			OutBuf_putc(out, '\n');
 		}
 	}
-	printf("\n\n");
-
-	int final_gen;
-	int broke_early = 0;
+	OutBuf_puts(out, "\n\n");
+	Profile_lap(prof, PROF_OUTPUT, t);
 
-	jq = JobQueue_new(num_threads, NULL, ThreadState_new, ThreadState_free);
-
-	JobData* dat = malloc(pop_size*sizeof(JobData));
+	int final_gen = num_gens;
 
 	for (int i = 0; i < num_gens; i++) {
 		if (break_at_zero_diversity) {
-			calculate_diversity(parents, percent_decent, diversity);
-			if ((*diversity) <= 0) {
+			if (sim_identical(sim)) {
 				final_gen = i;
-				broke_early = 1;
 				break;
 			}
 		}
-		if (!uniform) {
-			double fit;
-			if (selective) {
-				fit = get_fitness(parents[0].hat_size);
-			}
-			else {
-				fit = 100;			//in runs withoutslection, everybody is equally fit
-			}
 
-			double total_hat_size = fit;
-			double cum_hat_size[pop_size];
-			cum_hat_size[0] = fit;
+		TRACE_INSTANT(TRACE_GENERATION, i);
+		sim_step(sim);
 
-			for (int j = 1; j < pop_size; j++) {
-				if (selective) {
-					fit = get_fitness(parents[j].hat_size);
-				}
-				else {
-					fit = 100;
-				}
-
-				total_hat_size += fit;
-				cum_hat_size[j] = (cum_hat_size[j-1] + fit);
-			}
-
-			for (int j = 0; j < pop_size; j++) {
-
-				pthread_mutex_lock(&seedLock);
-				gsl_rng_set(rng, rngseed);
-				rngseed = (rngseed == ULONG_MAX ? 0 : rngseed + 1);
-				pthread_mutex_unlock(&seedLock);
-
-				int m, d;
-
-				double win_m = gsl_rng_uniform(rng);
-				win_m *= total_hat_size;
-				double win_d = gsl_rng_uniform(rng);
-				win_d *= total_hat_size;
-
-				// printf("win_m:%lf, wind:%lf, max: %lf\n", win_m,win_d,total_hat_size);
-
-				for (m = 0; cum_hat_size[m] < win_m; m++) {
-					continue;
-				}
-
-				for (d = 0; cum_hat_size[d] < win_d; d++) {
-					continue;
-				}
-
-				// printf("m:%u, d:%u\n", m,d);				
-				dat[j].child = (children + j);
-				dat[j].p1 = (parents + m);
-				dat[j].p2 = (parents + d);
-
-				JobQueue_addJob(jq, jobfunc, dat + j);			}
-		}
-		else {
-			// printf("uniform!!!\n");
-
-			int moms[pop_size];
-			int dads[pop_size];
-			int mom_max = pop_size;
-			int dad_max = pop_size;
-
-			int m, d;
-
-			for (int j = 0; j < pop_size; j++) {
-				moms[j] = j;
-				dads[j] = j;
-			}
-
-			for (int j = 0; j < pop_size; j++) {
-				pthread_mutex_lock(&seedLock);
-				gsl_rng_set(rng, rngseed);
-				rngseed = (rngseed == ULONG_MAX ? 0 : rngseed + 1);
-
-				pthread_mutex_unlock(&seedLock);
-
-				int index_m = (int) gsl_rng_uniform_int (rng, mom_max);
-				int index_d = (int) gsl_rng_uniform_int (rng, dad_max);
-
-				m = moms[index_m];
-				d = dads[index_d];
-
-				// printf("m:\t%u\nd:\t%u\n", m, d);
-
-				//reduce the pool of available degnomes
-				//in order to make sure everybody get's two chances to mate
-				//one as a dad and one as a mom
-				
-				int temp_m = moms[index_m];
-				int temp_d = dads[index_d];
-				moms[index_m] = moms[mom_max-1];
-				dads[index_d] = dads[dad_max-1];
-				moms[mom_max-1] = temp_m;
-				dads[dad_max-1] = temp_d;
-
-				mom_max--;
-				dad_max--;				
-
-				dat[j].child = (children + j);
-				dat[j].p1 = (parents + m);
-				dat[j].p2 = (parents + d);
-
-				JobQueue_addJob(jq, jobfunc, dat + j);
-			}
-		}
-
-		JobQueue_waitOnJobs(jq);
-
-		temp = children;
-		children = parents;
-		parents = temp;
 		if (verbose) {
-			calculate_diversity(parents, percent_decent, diversity);
-			printf("\nGeneration %u:\n", i);
+			diversity = sim_diversity(sim, &percent_decent);
+			t = Profile_mark(prof);
+			sim_get_population(sim, &pop);
+			OutBuf_printf(out, "\nGeneration %u:\n", i);
 			if (!reduced) {
 				for (int k = 0; k < pop_size; k++) {
-					printf("\n\nDegnome %u allele values:\n", k);
+					OutBuf_printf(out, "\n\nDegnome %u allele values:\n", k);
 
-					for (int j = 0; j < chrom_size; j++) {
-						printf("%lf\t", parents[k].dna_array[j]);
-					}
+					OutBuf_putAlleleRow(out, pop.alleles + (size_t) k*chrom_size, chrom_size);
 					if (selective) {
-						printf("\nTOTAL HAT SIZE: %lg\n\n", parents[k].hat_size);
+						print_traits(out, &pop, k);
+						OutBuf_printf(out, "\nTOTAL HAT SIZE: %lg\n\n", pop.hat_sizes[k]);
 					}
 					else {
-						printf("\n");
+						OutBuf_putc(out, '\n');
 					}
 
-					printf("\n\nDegnome %u ancestries:\n", k);
-					for (int j = 0; j < chrom_size; j++) {
-						printf("%u\t", parents[k].GOI_array[j]);
-					}
-					printf("\n");
+					OutBuf_printf(out, "\n\nDegnome %u ancestries:\n", k);
+					OutBuf_putUintRow(out, pop.ancestries + (size_t) k*chrom_size, chrom_size);
+					OutBuf_putc(out, '\n');
 
-					for (int j = 0; j < pop_size; j++) {
-						if (percent_decent[k][j] > 0) {
-							printf("%lf%% Degnome %u\t", (100*percent_decent[k][j]), j);
-						}
-					}
-				}
-			}
-			printf("\nAverage population descent percentages:\n");
-			for (int j = 0; j < pop_size; j++) {
-				if (percent_decent[pop_size][j] > 0) {
-					printf("%lf%% Degnome %u\t", (100*percent_decent[pop_size][j]), j);
+					print_descent(out, percent_decent + (size_t) k*pop_size, pop_size);
 				}
 			}
-			printf("\nPercent diversity: %lf\n", (100* (*diversity)));
-		printf("\n\n");
+			OutBuf_puts(out, "\nAverage population descent percentages:\n");
+			print_descent(out, percent_decent + (size_t) pop_size*pop_size, pop_size);
+			OutBuf_printf(out, "\nPercent diversity: %lf\n", (100*diversity));
+			OutBuf_puts(out, "\n\n");
+			Profile_lap(prof, PROF_OUTPUT, t);
 		}
 	}
 
-	JobQueue_noMoreJobs(jq);
-
 	if (verbose) {
-		printf("\n");
+		OutBuf_putc(out, '\n');
 	}
 
-	calculate_diversity(parents, percent_decent, diversity);
-	// printf("\n\n DIVERSITY%lf\n\n\n", *diversity);
-	if (broke_early) {
-		printf("Generation %u:\n", final_gen);
-	}
-	else {
-		printf("Generation %u:\n", num_gens);
-	}
+	diversity = sim_diversity(sim, &percent_decent);
+	t = Profile_mark(prof);
+	sim_get_population(sim, &pop);
+
+	OutBuf_printf(out, "Generation %u:\n", final_gen);
 	if (!reduced) {
 		for (int i = 0; i < pop_size; i++) {
-			printf("\n\nDegnome %u allele values:\n", i);		
-			if (!reduced) {
-				for (int j = 0; j < chrom_size; j++) {
-					printf("%lf\t", parents[i].dna_array[j]);
-				}
-			}
+			OutBuf_printf(out, "\n\nDegnome %u allele values:\n", i);
+			OutBuf_putAlleleRow(out, pop.alleles + (size_t) i*chrom_size, chrom_size);
 
-			printf("\n\nDegnome %u ancestries:\n", i);
-			if (!reduced) {
-				for (int j = 0; j < chrom_size; j++) {
-					printf("%u\t", parents[i].GOI_array[j]);
-				}
-				printf("\n");
-			}
+			OutBuf_printf(out, "\n\nDegnome %u ancestries:\n", i);
+			OutBuf_putUintRow(out, pop.ancestries + (size_t) i*chrom_size, chrom_size);
+			OutBuf_putc(out, '\n');
 
-			for (int j = 0; j < pop_size; j++) {
-				if (percent_decent[i][j] > 0) {
-					printf("%lf%% Degnome %u\t", (100*percent_decent[i][j]), j);
-				}
-			}
-			printf("\n");
+			print_descent(out, percent_decent + (size_t) i*pop_size, pop_size);
+			OutBuf_putc(out, '\n');
 
 			if (selective) {
-				printf("\nTOTAL HAT SIZE: %lg\n\n", parents[i].hat_size);
+				print_traits(out, &pop, i);
+				OutBuf_printf(out, "\nTOTAL HAT SIZE: %lg\n\n", pop.hat_sizes[i]);
 			}
 			else {
-				printf("\n\n");
+				OutBuf_puts(out, "\n\n");
 			}
 		}
 	}
-	printf("Average population decent percentages:\n");
-	for (int j = 0; j < pop_size; j++) {
-		if (percent_decent[pop_size][j] > 0) {
-			printf("%lf%% Degnome %u\t", (100*percent_decent[pop_size][j]), j);
-		}
-	}
-	printf("\nPercent diversity: %lf\n", (100* (*diversity)));
-	printf("\n\n\n");
-
-	//free everything
-	JobQueue_free(jq);
-	free(dat);
+	OutBuf_puts(out, "Average population decent percentages:\n");
+	print_descent(out, percent_decent + (size_t) pop_size*pop_size, pop_size);
+	OutBuf_printf(out, "\nPercent diversity: %lf\n", (100*diversity));
+	OutBuf_puts(out, "\n\n\n");
 
-	for (int i = 0; i < pop_size; i++) {
-		free(parents[i].dna_array);
-		free(children[i].dna_array);
-		free(parents[i].GOI_array);
-		free(children[i].GOI_array);
-		parents[i].hat_size = 0;
+	OutBuf_free(out);
+	Profile_lap(prof, PROF_OUTPUT, t);
 
-		free(percent_decent[i]);
-	}
-	free(percent_decent[pop_size]);
+	Profile_report(prof, sim_job_queue(sim), stderr);
 
-	free(parents);
-	free(children);
-
-	free(percent_decent);
-	free(diversity);
-
-	gsl_rng_free (rng);
+	//free everything
+	sim_free(sim);
+	Profile_free(prof);
 }
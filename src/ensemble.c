@@ -0,0 +1,677 @@
+/**
+@file ensemble.c
+@page ensemble
+@author Daniel R. Tabin
+@brief Many devosim replicates stepped side by side
+
+An Ensemble runs R independent devosim populations with the same
+parameters.  Instead of R Sims it keeps one interleaved array in
+which the R copies of allele j of degnome i are adjacent:
+
+	alleles[(i*chrom_size + j)*R + r]
+
+so every loop over replicates is a unit-stride loop the compiler can
+vectorize.  Alleles are stored as allele_t (see allele.h), like a
+Sim's; hat sizes are summed in the stored units and converted once
+per child, so fixed point sums stay exact.  Hat sizes, fitness sums, the allele copy during mating
+and the diversity count all run lane-parallel across replicates.
+Only the random draws (parents, crossover points and mutations) are
+made one replicate at a time.
+
+Crossovers are handled as strand flips.  Each lane starts copying
+from its mother; every crossover point at locus j swaps the lane to
+its other parent from j onward.  This is the same rule Degnome_mate
+uses with its sorted crossover list.
+
+Each child gets its own seed from the Ensemble's seed sequence, so a
+seeded Ensemble gives the same results on any number of threads.
+
+With par.recomb_file set, each crossover locus is drawn from that
+recombination map (see recomb.c).  The points are bucketed by locus,
+so they need not come sorted.  par.mutation_file likewise gives each
+locus its own mutation rate and effect (see mutmap.c), and with
+par.traits_file selection is on traits (see traits.c): the replicates
+of a degnome are the columns of one matrix, so their traits are one
+matrix product per degnome.
+*/
+
+#include "ensemble.h"
+#include "jobqueue.h"
+#include "fitfunc.h"
+#include "trace.h"
+#include "mapped.h"
+#include "recomb.h"
+#include "mutmap.h"
+#include "traits.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+
+/// Per-thread random generator and scratch space for mating.
+typedef struct EnsembleWorker EnsembleWorker;
+struct EnsembleWorker {
+	gsl_rng* rng;
+	size_t* from;			// current source offset of each lane
+	size_t* other;			// offset of each lane's other parent
+	int* head;				// first crossover event at each locus
+	int* next;				// next event at the same locus
+	int* lane;				// lane that flips at this event
+	int max_events;
+};
+
+typedef struct EnsembleJob EnsembleJob;
+struct EnsembleJob {
+	Ensemble* ens;
+	int child;
+};
+
+struct Ensemble {
+	SimParams par;
+	int replicates;
+	int generation;
+
+	allele_t* alleles[2];	// pop_size x chrom_size x replicates
+	int* goi[2];			// same layout, ancestry of each allele
+	double* hat[2];			// pop_size x replicates
+	int current;			// which buffers hold the parents
+
+	int* moms;				// pop_size x replicates, chosen parents
+	int* dads;
+	double* cum_fit;		// pop_size x replicates
+	double* stats;			// 2 x replicates, scratch for Ensemble_stats
+	int* pool;				// scratch for uniform mating
+	unsigned long* seeds;	// one per child
+
+	double* diversity;		// per replicate, for diversity_gen
+	int diversity_gen;
+
+	gsl_rng* rng;
+	unsigned long rngseed;
+
+	JobQueue* jq;
+	EnsembleWorker* worker;	// used when there is no JobQueue
+	EnsembleJob* jobs;
+
+	Profile* prof;			// NULL unless profiling
+	RecombMap* recomb;		// NULL => crossovers are uniform
+	MutationMap* mutmap;	// NULL => par.mutation_rate and _effect
+	TraitMatrix* traits;	// NULL => select on hat size
+	double* trait_values;	// replicates x num_traits, of one degnome
+};
+
+static const char* fit_func_names[] = {"linear", "sqrt", "close", "ceiling", "log"};
+
+void *Ensemble_ThreadState_new(void *ens);
+void Ensemble_ThreadState_free(void *worker);
+int Ensemble_jobfunc(void* p, void* tdat);
+static void mate_child(Ensemble* ens, EnsembleWorker* w, int i);
+static void pick_parents(Ensemble* ens, double since);
+static void pick_parents_uniform(Ensemble* ens);
+static void fitness_of(Ensemble* ens, int i, double* fit);
+static void calculate_diversity(Ensemble* ens);
+static void* pop_alloc(const SimParams* par, size_t size);
+static void pop_free(const SimParams* par, void* p, size_t size);
+
+/// A population buffer, in memory placed by par->placement or in a file.
+static void* pop_alloc(const SimParams* par, size_t size) {
+	if (par->mmap_dir != NULL) {
+		return Mapped_alloc(size, par->mmap_dir);
+	}
+	return Placement_alloc(size, par->placement);
+}
+
+static void pop_free(const SimParams* par, void* p, size_t size) {
+	if (par->mmap_dir != NULL) {
+		Mapped_free(p, size);
+	}
+	else {
+		Placement_free(p, size, par->placement);
+	}
+}
+
+void *Ensemble_ThreadState_new(void *arg) {
+	Ensemble* ens = (Ensemble*) arg;
+	EnsembleWorker* w = malloc(sizeof(EnsembleWorker));
+	CHECKMEM(w);
+
+	w->rng = gsl_rng_alloc(gsl_rng_taus);
+	w->from = malloc(ens->replicates*sizeof(size_t));
+	w->other = malloc(ens->replicates*sizeof(size_t));
+	w->head = malloc(ens->par.chrom_size*sizeof(int));
+	w->max_events = 64;
+	w->next = malloc(w->max_events*sizeof(int));
+	w->lane = malloc(w->max_events*sizeof(int));
+	CHECKMEM(w->rng && w->from && w->other && w->head && w->next && w->lane);
+
+	return w;
+}
+
+void Ensemble_ThreadState_free(void *arg) {
+	EnsembleWorker* w = (EnsembleWorker*) arg;
+
+	gsl_rng_free(w->rng);
+	free(w->from);
+	free(w->other);
+	free(w->head);
+	free(w->next);
+	free(w->lane);
+	free(w);
+}
+
+int Ensemble_jobfunc(void* p, void* tdat) {
+	EnsembleJob* job = (EnsembleJob*) p;
+	mate_child(job->ens, (EnsembleWorker*) tdat, job->child);
+
+	return 0;		//exited without error
+}
+
+/**
+ * replicates copies of the population params describes.  NULL if it
+ * has fewer than two degnomes or no loci, as the variances and the
+ * diversity are not defined then.
+ */
+Ensemble* Ensemble_new(const SimParams* params, int replicates) {
+	if (params->pop_size < 2 || params->chrom_size < 1 || replicates < 1) {
+		return NULL;
+	}
+	Ensemble* ens = malloc(sizeof(Ensemble));
+	CHECKMEM(ens);
+	ens->par = *params;
+	ens->replicates = replicates;
+	ens->generation = 0;
+
+	int pop_size = ens->par.pop_size;
+	int len = ens->par.chrom_size;
+	size_t lanes = (size_t) pop_size * replicates;
+	size_t cells = lanes * len;
+
+	if (ens->par.seed == 0) {
+		time_t currtime = time(NULL);                  // time
+		unsigned long pid = (unsigned long) getpid();  // process id
+		ens->rngseed = currtime ^ pid;                 // random seed
+	}
+	else {
+		ens->rngseed = ens->par.seed;
+	}
+	ens->rng = gsl_rng_alloc(gsl_rng_taus);
+	CHECKMEM(ens->rng);
+	gsl_rng_set(ens->rng, ens->rngseed++);
+
+	for (int b = 0; b < 2; b++) {
+		ens->alleles[b] = pop_alloc(&ens->par, cells*sizeof(allele_t));
+		ens->goi[b] = pop_alloc(&ens->par, cells*sizeof(int));
+		ens->hat[b] = malloc(lanes*sizeof(double));
+		CHECKMEM(ens->alleles[b] && ens->goi[b] && ens->hat[b]);
+	}
+	ens->current = 0;
+
+	for (int i = 0; i < pop_size; i++) {
+		for (size_t k = (size_t) i * len * replicates; k < (size_t) (i+1) * len * replicates; k++) {
+			ens->alleles[0][k] = ALLELE_FROM(10);
+			ens->goi[0][k] = i;		//track ancestries
+		}
+		for (int r = 0; r < replicates; r++) {
+			ens->hat[0][(size_t) i * replicates + r] = 10.0 * len;
+		}
+	}
+
+	ens->moms = malloc(lanes*sizeof(int));
+	ens->dads = malloc(lanes*sizeof(int));
+	ens->cum_fit = malloc(lanes*sizeof(double));
+	ens->stats = malloc(2*replicates*sizeof(double));
+	ens->pool = malloc(2*lanes*sizeof(int));
+	ens->seeds = malloc(pop_size*sizeof(unsigned long));
+	ens->diversity = malloc(replicates*sizeof(double));
+	ens->jobs = malloc(pop_size*sizeof(EnsembleJob));
+	CHECKMEM(ens->moms && ens->dads && ens->cum_fit && ens->stats && ens->pool);
+	CHECKMEM(ens->seeds && ens->diversity && ens->jobs);
+	for (int r = 0; r < replicates; r++) {
+		ens->diversity[r] = 1;
+	}
+	ens->diversity_gen = 0;
+	ens->prof = NULL;
+	ens->recomb = (ens->par.recomb_file != NULL
+				   ? RecombMap_load(ens->par.recomb_file, len) : NULL);
+	ens->mutmap = (ens->par.mutation_file != NULL
+				   ? MutationMap_load(ens->par.mutation_file, len) : NULL);
+	ens->traits = (ens->par.traits_file != NULL
+				   ? TraitMatrix_load(ens->par.traits_file, len) : NULL);
+	ens->trait_values = NULL;
+	if (ens->traits != NULL) {
+		ens->trait_values = malloc((size_t) replicates * TraitMatrix_traits(ens->traits)
+								   * sizeof(double));
+		CHECKMEM(ens->trait_values);
+	}
+
+	for (int i = 0; i < pop_size; i++) {
+		ens->jobs[i].ens = ens;
+		ens->jobs[i].child = i;
+	}
+
+	if (ens->par.num_threads <= 0) {
+		ens->par.num_threads = (3*getNumCores()/4);
+	}
+	if (ens->par.num_threads > 1) {
+		ens->jq = JobQueue_new(ens->par.num_threads, ens,
+							   Ensemble_ThreadState_new, Ensemble_ThreadState_free);
+		JobQueue_pinWorkers(ens->jq, ens->par.pin_threads);
+		ens->worker = NULL;
+	}
+	else {
+		ens->jq = NULL;
+		ens->worker = Ensemble_ThreadState_new(ens);
+	}
+
+	return ens;
+}
+
+/**
+ * Build child i of every replicate from the parents chosen in
+ * moms and dads.  The copy, the ancestry copy and the hat size sum
+ * are unit-stride loops over the replicates.
+ */
+static void mate_child(Ensemble* ens, EnsembleWorker* w, int i) {
+	int reps = ens->replicates;
+	int len = ens->par.chrom_size;
+	size_t row = (size_t) len * reps;
+	const allele_t* restrict pa = ens->alleles[ens->current];
+	const int* restrict pg = ens->goi[ens->current];
+	allele_t* restrict ca = ens->alleles[!ens->current] + i * row;
+	int* restrict cg = ens->goi[!ens->current] + i * row;
+	double* restrict hat = ens->hat[!ens->current] + (size_t) i * reps;
+	const int* moms = ens->moms + (size_t) i * reps;
+	const int* dads = ens->dads + (size_t) i * reps;
+	gsl_rng* rng = w->rng;
+	int num_events = 0;
+
+	gsl_rng_set(rng, ens->seeds[i]);
+
+	for (int j = 0; j < len; j++) {
+		w->head[j] = -1;
+	}
+
+	//cross over: bucket each lane's crossover points by locus
+	for (int r = 0; r < reps; r++) {
+		w->from[r] = moms[r] * row + r;
+		w->other[r] = dads[r] * row + r;
+		hat[r] = 0;
+
+		int num_crossover = gsl_ran_poisson(rng, ens->par.crossover_rate);
+		for (int k = 0; k < num_crossover; k++) {
+			if (num_events == w->max_events) {
+				w->max_events *= 2;
+				w->next = realloc(w->next, w->max_events*sizeof(int));
+				w->lane = realloc(w->lane, w->max_events*sizeof(int));
+				CHECKMEM(w->next && w->lane);
+			}
+			int location = (ens->recomb != NULL
+							? RecombMap_locus(ens->recomb, gsl_rng_uniform(rng))
+							: (int) gsl_rng_uniform_int(rng, len));
+			w->lane[num_events] = r;
+			w->next[num_events] = w->head[location];
+			w->head[location] = num_events++;
+		}
+	}
+
+	size_t* restrict from = w->from;
+	for (int j = 0; j < len; j++) {
+		for (int ev = w->head[j]; ev >= 0; ev = w->next[ev]) {
+			int r = w->lane[ev];
+			size_t tmp = from[r];
+			from[r] = w->other[r];
+			w->other[r] = tmp;
+		}
+
+		size_t base = (size_t) j * reps;
+		for (int r = 0; r < reps; r++) {
+			ca[base + r] = pa[from[r] + base];
+			cg[base + r] = pg[from[r] + base];
+			hat[r] += ca[base + r];
+		}
+	}
+
+	//mutate
+	for (int r = 0; r < reps; r++) {
+		int num_mutations = gsl_ran_poisson(rng, (ens->mutmap != NULL
+												  ? MutationMap_rate(ens->mutmap)
+												  : ens->par.mutation_rate));
+
+		for (int k = 0; k < num_mutations; k++) {
+			double effect = ens->par.mutation_effect;
+			int mutation_location = (ens->mutmap != NULL
+									 ? MutationMap_locus(ens->mutmap, rng, &effect)
+									 : (int) gsl_rng_uniform_int(rng, len));
+			size_t cell = (size_t) mutation_location * reps + r;
+			allele_t before = ca[cell];
+			ALLELE_ADD(ca[cell], gsl_ran_gaussian_ziggurat(rng, effect));
+			hat[r] += ca[cell] - before;		// what was stored, after rounding
+		}
+		hat[r] = ALLELE_TO(hat[r]);
+	}
+}
+
+/// fit[r] = the fitness of parent i in replicate r.
+static void fitness_of(Ensemble* ens, int i, double* fit) {
+	int reps = ens->replicates;
+
+	if (ens->traits != NULL) {
+		size_t row = (size_t) i * ens->par.chrom_size * reps;
+		TraitMatrix_applyColumns(ens->traits, ens->alleles[ens->current] + row, reps,
+								 ens->trait_values);
+		get_fitness_traits(ens->trait_values, TraitMatrix_traits(ens->traits), fit, reps);
+	}
+	else {
+		get_fitness_batch(ens->hat[ens->current] + (size_t) i * reps, fit, reps);
+	}
+}
+
+/// Roulette selection of both parents of every child, per replicate.
+static void pick_parents(Ensemble* ens, double since) {
+	int pop_size = ens->par.pop_size;
+	int reps = ens->replicates;
+	double* cum = ens->cum_fit;
+
+	if (ens->par.selective) {
+		fitness_of(ens, 0, cum);
+	}
+	else {
+		for (int r = 0; r < reps; r++) {
+			cum[r] = 100;
+		}
+	}
+	for (int i = 1; i < pop_size; i++) {
+		double* c = cum + (size_t) i * reps;
+
+		if (ens->par.selective) {
+			fitness_of(ens, i, c);
+			for (int r = 0; r < reps; r++) {
+				c[r] = c[r - reps] + c[r];
+			}
+		}
+		else {
+			//in runs without selection, everybody is equally fit
+			for (int r = 0; r < reps; r++) {
+				c[r] = c[r - reps] + 100;
+			}
+		}
+	}
+
+	double t = Profile_lap(ens->prof, PROF_FITNESS, since);
+
+	const double* total = cum + (size_t) (pop_size - 1) * reps;
+	for (int i = 0; i < pop_size; i++) {
+		for (int r = 0; r < reps; r++) {
+			double win_m = gsl_rng_uniform(ens->rng) * total[r];
+			double win_d = gsl_rng_uniform(ens->rng) * total[r];
+			int m, d;
+
+			for (m = 0; cum[(size_t) m * reps + r] < win_m; m++) {
+				continue;
+			}
+			for (d = 0; cum[(size_t) d * reps + r] < win_d; d++) {
+				continue;
+			}
+			ens->moms[(size_t) i * reps + r] = m;
+			ens->dads[(size_t) i * reps + r] = d;
+		}
+	}
+	Profile_lap(ens->prof, PROF_SELECT, t);
+}
+
+/// Every degnome is a mom once and a dad once, per replicate.
+static void pick_parents_uniform(Ensemble* ens) {
+	int pop_size = ens->par.pop_size;
+	int reps = ens->replicates;
+
+	for (int r = 0; r < reps; r++) {
+		int* moms = ens->pool + (size_t) 2 * r * pop_size;
+		int* dads = moms + pop_size;
+		int mom_max = pop_size;
+		int dad_max = pop_size;
+
+		for (int j = 0; j < pop_size; j++) {
+			moms[j] = j;
+			dads[j] = j;
+		}
+
+		for (int i = 0; i < pop_size; i++) {
+			int index_m = (int) gsl_rng_uniform_int(ens->rng, mom_max);
+			int index_d = (int) gsl_rng_uniform_int(ens->rng, dad_max);
+
+			ens->moms[(size_t) i * reps + r] = moms[index_m];
+			ens->dads[(size_t) i * reps + r] = dads[index_d];
+
+			//reduce the pool of available degnomes
+			moms[index_m] = moms[--mom_max];
+			dads[index_d] = dads[--dad_max];
+		}
+	}
+}
+
+/// Breed one generation of every replicate.
+void Ensemble_step(Ensemble* ens) {
+	int f = ens->par.fit_func;
+	int pop_size = ens->par.pop_size;
+
+	set_function(fit_func_names[(f >= 0 && f <= 4) ? f : 0]);
+	target_num = ens->par.target;
+
+	double t = Profile_mark(ens->prof);
+
+	if (ens->par.uniform) {
+		pick_parents_uniform(ens);
+		Profile_lap(ens->prof, PROF_SELECT, t);
+	}
+	else {
+		pick_parents(ens, t);
+	}
+
+	t = Profile_mark(ens->prof);
+	for (int i = 0; i < pop_size; i++) {
+		ens->seeds[i] = ens->rngseed++;
+	}
+
+	if (ens->jq != NULL) {
+		for (int i = 0; i < pop_size; i++) {
+			JobQueue_addJob(ens->jq, Ensemble_jobfunc, ens->jobs + i);
+		}
+		t = Profile_lap(ens->prof, PROF_SUBMIT, t);
+		JobQueue_waitOnJobs(ens->jq);
+		Profile_lap(ens->prof, PROF_WAIT, t);
+	}
+	else {
+		for (int i = 0; i < pop_size; i++) {
+			mate_child(ens, ens->worker, i);
+		}
+		Profile_lap(ens->prof, PROF_MATE, t);
+	}
+	Profile_generation(ens->prof, (long) pop_size * ens->replicates);
+
+	ens->current = !ens->current;
+	ens->generation++;
+}
+
+/**
+ * Fraction of (degnome, degnome, locus) triples whose ancestries
+ * differ, for every replicate at once.  Each unordered pair is
+ * counted once and doubled.
+ */
+static void calculate_diversity(Ensemble* ens) {
+	int pop_size = ens->par.pop_size;
+	int len = ens->par.chrom_size;
+	int reps = ens->replicates;
+	size_t row = (size_t) len * reps;
+	const int* goi = ens->goi[ens->current];
+	double* restrict count = ens->diversity;
+
+	for (int r = 0; r < reps; r++) {
+		count[r] = 0;
+	}
+	for (int i = 0; i < pop_size; i++) {
+		for (int j = i + 1; j < pop_size; j++) {
+			const int* restrict gi = goi + i * row;
+			const int* restrict gj = goi + j * row;
+
+			for (int k = 0; k < len; k++) {
+				for (int r = 0; r < reps; r++) {
+					count[r] += (gi[(size_t) k * reps + r] != gj[(size_t) k * reps + r]);
+				}
+			}
+		}
+	}
+
+	double pairs = (double) (pop_size - 1) * pop_size * len;
+	for (int r = 0; r < reps; r++) {
+		count[r] = 2 * count[r] / pairs;
+	}
+	ens->diversity_gen = ens->generation;
+}
+
+/**
+ * Step up to num_gens generations.  If break_at_zero_diversity is
+ * set, stop as soon as every replicate has zero diversity.
+ * Returns the number of generations actually run.
+ */
+int Ensemble_run(Ensemble* ens, int num_gens, int break_at_zero_diversity) {
+	for (int g = 0; g < num_gens; g++) {
+		if (break_at_zero_diversity) {
+			double most = 0;
+			for (int r = 0; r < ens->replicates; r++) {
+				double d = Ensemble_diversity(ens, r);
+				most = (d > most ? d : most);
+			}
+			if (most <= 0) {
+				return g;
+			}
+		}
+		TRACE_INSTANT(TRACE_GENERATION, ens->generation);
+		Ensemble_step(ens);
+	}
+	return num_gens;
+}
+
+/// Charge this Ensemble's phases to prof, or stop profiling if NULL.
+void Ensemble_set_profile(Ensemble* ens, Profile* prof) {
+	ens->prof = prof;
+}
+
+/// The JobQueue the replicates are mated on, or NULL.
+JobQueue* Ensemble_job_queue(const Ensemble* ens) {
+	return ens->jq;
+}
+
+int Ensemble_generation(const Ensemble* ens) {
+	return ens->generation;
+}
+
+double Ensemble_allele(const Ensemble* ens, int replicate, int degnome, int locus) {
+	size_t k = ((size_t) degnome * ens->par.chrom_size + locus) * ens->replicates + replicate;
+	return ALLELE_TO(ens->alleles[ens->current][k]);
+}
+
+int Ensemble_ancestry(const Ensemble* ens, int replicate, int degnome, int locus) {
+	size_t k = ((size_t) degnome * ens->par.chrom_size + locus) * ens->replicates + replicate;
+	return ens->goi[ens->current][k];
+}
+
+double Ensemble_hat_size(const Ensemble* ens, int replicate, int degnome) {
+	return ens->hat[ens->current][(size_t) degnome * ens->replicates + replicate];
+}
+
+double Ensemble_diversity(Ensemble* ens, int replicate) {
+	if (ens->diversity_gen != ens->generation) {
+		double t = Profile_mark(ens->prof);
+		calculate_diversity(ens);
+		Profile_lap(ens->prof, PROF_DIVERSITY, t);
+	}
+	return ens->diversity[replicate];
+}
+
+void Ensemble_stats(Ensemble* ens, EnsembleStats* stats) {
+	int pop_size = ens->par.pop_size;
+	int reps = ens->replicates;
+	const double* hat = ens->hat[ens->current];
+	double* mean = ens->stats;
+	double* sumsq = ens->stats + reps;
+
+	for (int r = 0; r < reps; r++) {
+		mean[r] = 0;
+		sumsq[r] = 0;
+	}
+	for (int i = 0; i < pop_size; i++) {
+		const double* h = hat + (size_t) i * reps;
+		for (int r = 0; r < reps; r++) {
+			mean[r] += h[r];
+			sumsq[r] += h[r] * h[r];
+		}
+	}
+
+	double m = 0, m2 = 0, v = 0, d = 0, d2 = 0;
+	for (int r = 0; r < reps; r++) {
+		double div = Ensemble_diversity(ens, r);
+		double var = (sumsq[r] - mean[r] * mean[r] / pop_size) / (pop_size - 1);
+		double mu = mean[r] / pop_size;
+
+		m += mu;
+		m2 += mu * mu;
+		v += var;
+		d += div;
+		d2 += div * div;
+	}
+
+	stats->generation = ens->generation;
+	stats->replicates = reps;
+	stats->mean_hat_size = m / reps;
+	stats->mean_var_hat_size = v / reps;
+	stats->mean_diversity = d / reps;
+	if (reps > 1) {
+		stats->var_mean_hat_size = (m2 - m * m / reps) / (reps - 1);
+		stats->var_diversity = (d2 - d * d / reps) / (reps - 1);
+	}
+	else {
+		stats->var_mean_hat_size = 0;
+		stats->var_diversity = 0;
+	}
+}
+
+void Ensemble_free(Ensemble* ens) {
+	if (ens->jq != NULL) {
+		JobQueue_noMoreJobs(ens->jq);
+		JobQueue_free(ens->jq);
+	}
+	else {
+		Ensemble_ThreadState_free(ens->worker);
+	}
+
+	size_t cells = (size_t) ens->par.pop_size * ens->par.chrom_size * ens->replicates;
+	for (int b = 0; b < 2; b++) {
+		pop_free(&ens->par, ens->alleles[b], cells*sizeof(allele_t));
+		pop_free(&ens->par, ens->goi[b], cells*sizeof(int));
+		free(ens->hat[b]);
+	}
+	free(ens->moms);
+	free(ens->dads);
+	free(ens->cum_fit);
+	free(ens->stats);
+	free(ens->pool);
+	free(ens->seeds);
+	free(ens->diversity);
+	free(ens->jobs);
+	if (ens->recomb != NULL) {
+		RecombMap_free(ens->recomb);
+	}
+	if (ens->mutmap != NULL) {
+		MutationMap_free(ens->mutmap);
+	}
+	if (ens->traits != NULL) {
+		TraitMatrix_free(ens->traits);
+	}
+	free(ens->trait_values);
+	gsl_rng_free(ens->rng);
+	free(ens);
+}
@@ -0,0 +1,39 @@
+/**
+ * @file ensemble.h
+ * @author Daniel R. Tabin
+ * @brief Header for ensemble.c
+ */
+
+#ifndef ENSEMBLE
+#define ENSEMBLE
+
+#include "sim.h"
+
+typedef struct Ensemble Ensemble;
+
+/// Means and variances across the replicates of one generation.
+typedef struct EnsembleStats EnsembleStats;
+struct EnsembleStats {
+	int generation;
+	int replicates;
+	double mean_hat_size;		// mean over replicates of the population mean
+	double var_mean_hat_size;	// variance over replicates of the population mean
+	double mean_var_hat_size;	// mean over replicates of the population variance
+	double mean_diversity;
+	double var_diversity;
+};
+
+Ensemble*	Ensemble_new(const SimParams* params, int replicates);
+void		Ensemble_step(Ensemble* ens);
+int			Ensemble_run(Ensemble* ens, int num_gens, int break_at_zero_diversity);
+void		Ensemble_set_profile(Ensemble* ens, Profile* prof);
+JobQueue*	Ensemble_job_queue(const Ensemble* ens);
+int			Ensemble_generation(const Ensemble* ens);
+double		Ensemble_allele(const Ensemble* ens, int replicate, int degnome, int locus);
+int			Ensemble_ancestry(const Ensemble* ens, int replicate, int degnome, int locus);
+double		Ensemble_hat_size(const Ensemble* ens, int replicate, int degnome);
+double		Ensemble_diversity(Ensemble* ens, int replicate);
+void		Ensemble_stats(Ensemble* ens, EnsembleStats* stats);
+void		Ensemble_free(Ensemble* ens);
+
+#endif
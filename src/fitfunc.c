@@ -16,11 +16,13 @@ Also add command line args and testing for seeding and threading
 */
 
 #include "fitfunc.h"
+#include "kernels.h"
 #include "string.h"
 #include "math.h"
 #include "stdlib.h"
 
-fit_func_ptr func_to_run = &linear_returns;
+__thread fit_func_ptr func_to_run = &linear_returns;
+__thread double target_num;
 
 void set_function(const char* func_name) {
 	if (strcmp(func_name, "linear") == 0) {
@@ -72,3 +74,58 @@ double logarithmic_returns(double x) {
 double get_fitness(double hat_size) {
 	return (*func_to_run)(hat_size);
 }
+
+/**
+ * fitness[i] = get_fitness(hat_sizes[i]) for i < n.  The two functions
+ * that vectorize are inlined so the loop is compiled for the cpu; the
+ * rest go through func_to_run.  fitness may be hat_sizes.
+ */
+KERNEL_CLONES
+void get_fitness_batch(const double* hat_sizes, double* fitness, int n) {
+	if (func_to_run == &linear_returns) {
+		for (int i = 0; i < n; i++) {
+			fitness[i] = hat_sizes[i];
+		}
+	}
+	else if (func_to_run == &sqrt_returns) {
+		for (int i = 0; i < n; i++) {
+			fitness[i] = sqrt(hat_sizes[i]);
+		}
+	}
+	else {
+		for (int i = 0; i < n; i++) {
+			fitness[i] = (*func_to_run)(hat_sizes[i]);
+		}
+	}
+}
+
+/**
+ * fitness[i] is the sum over t < num_traits of get_fitness of
+ * traits[i*num_traits + t], for the n rows of traits made by
+ * TraitMatrix_apply (see traits.c).  Every trait is scored by the
+ * same function and target, and the traits add up, so a single trait
+ * equal to the hat size gives get_fitness_batch.
+ */
+KERNEL_CLONES
+void get_fitness_traits(const double* traits, int num_traits, double* fitness, int n) {
+	if (func_to_run == &linear_returns) {
+		for (int i = 0; i < n; i++) {
+			const double* row = traits + (size_t) i * num_traits;
+			double sum = 0;
+			for (int t = 0; t < num_traits; t++) {
+				sum += row[t];
+			}
+			fitness[i] = sum;
+		}
+	}
+	else {
+		for (int i = 0; i < n; i++) {
+			const double* row = traits + (size_t) i * num_traits;
+			double sum = 0;
+			for (int t = 0; t < num_traits; t++) {
+				sum += (*func_to_run)(row[t]);
+			}
+			fitness[i] = sum;
+		}
+	}
+}
@@ -4,11 +4,12 @@
 typedef double (*fit_func_ptr)(double);		//pointer to a fitness function which takes and returns a double
 
 //char func_name[8];							//used for command line args (may not be needed on second thought delete later)
-double input;
-double target_num;
+extern __thread double target_num;	// per thread, like the function set by set_function
 
 void set_function(const char*);
 double get_fitness(double hat_size);
+void get_fitness_batch(const double* hat_sizes, double* fitness, int n);
+void get_fitness_traits(const double* traits, int num_traits, double* fitness, int n);
 
 
 double linear_returns(double x);
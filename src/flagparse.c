@@ -1,5 +1,33 @@
 #include "flagparse.h"
+#include "autothreads.h"
+#include "placement.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+static int parse_count(char ** argv, int argc, int i, int * value);
+
+/**
+ * Read argv[i+1] into value if it is a whole number that fits an int.
+ * Returns -1, leaving value alone, if it is missing or is not one.
+ */
+static int parse_count(char ** argv, int argc, int i, int * value) {
+	char * end;
+	long n;
+
+	if (i + 1 == argc) {
+		return -1;
+	}
+	errno = 0;
+	n = strtol(argv[i+1], &end, 10);
+	if (end == argv[i+1] || *end != '\0' || errno == ERANGE || n < 0 || n > INT_MAX) {
+		return -1;
+	}
+	*value = (int) n;
+	return 0;
+}
 
 int parse_flags(int argc, char ** argv, int caller, int ** ret_flags) {
 
@@ -16,17 +44,30 @@ int parse_flags(int argc, char ** argv, int caller, int ** ret_flags) {
 	// flags[9] ->		-m mutation_rate				(Default:    1)
 	// flags[10] ->		-o crossover_rate				(Default:    2)
 	// flags[11] ->		-p population_size				(Default:   10)
-	// flags[12] ->		-t num_threads					(Default:	 0)
+	// flags[12] ->		-t num_threads | auto			(Default:	 0, auto: THREADS_AUTO)
 	// flags[13] ->		--sqrt/linear/close/ceiling/log	(Default: None)
 	// flags[14] ->		--target						(Default: 9999)
 	// flags[15] ->		--seed							(Default:	 0)
+	// flags[16] ->		--sweep grid_file (devosim)		(Default:	 0, else argv index)
+	// flags[17] ->		--replicates R (devosim)		(Default:	 0)
+	// flags[18] ->		--profile | --counters			(Default:  Off, 2: with counters)
+	// flags[19] ->		--pin							(Default:  Off)
+	// flags[20] ->		--numa policy (devosim)			(Default: none)
+	// flags[21] ->		--schedule child/block/sorted (devosim)	(Default: child)
+	// flags[22] ->		--trace file					(Default:	 0, else argv index)
+	// flags[23] ->		--cpu-dispatch					(Default:  Off)
+	// flags[24] ->		--mmap dir						(Default:	 0, else argv index)
+	// flags[25] ->		--chunk alleles (polygensim)	(Default:	 0, off)
+	// flags[26] ->		--recomb map_file				(Default:	 0, else argv index)
+	// flags[27] ->		--mutation map_file				(Default:	 0, else argv index)
+	// flags[28] ->		--traits trait_file				(Default:	 0, else argv index)
 
 
 	if (caller == 0) {
 		return -1;
 	}
 
-	int * flags = (int*)calloc(16, sizeof(int));
+	int * flags = (int*)calloc(29, sizeof(int));
 
 	flags[0] = caller;
 	flags[1] = 0;
@@ -44,6 +85,16 @@ int parse_flags(int argc, char ** argv, int caller, int ** ret_flags) {
 	flags[13] = 0;
 	flags[14] = 9999;
 	flags[15] = 0;
+	flags[16] = 0;
+	flags[17] = 0;
+	flags[18] = 0;
+	flags[19] = 0;
+	flags[20] = PLACE_DEFAULT;
+	flags[21] = 0;
+	flags[22] = 0;
+	flags[23] = 0;
+	flags[24] = 0;
+	flags[25] = 0;
 
     *ret_flags = flags;
 
@@ -72,6 +123,96 @@ int parse_flags(int argc, char ** argv, int caller, int ** ret_flags) {
 				sscanf(argv[i+1], "%u", &flags[15]);
 				i++;
 			}
+			else if (strcmp(argv[i], "--profile") == 0) {
+				flags[18] = (flags[18] ? flags[18] : 1);
+			}
+			else if (strcmp(argv[i], "--counters") == 0) {
+				flags[18] = 2;
+			}
+			else if (strcmp(argv[i], "--pin") == 0) {
+				flags[19] = 1;
+			}
+			else if (strcmp(argv[i], "--numa") == 0 && caller == 3) {
+				if (i + 1 == argc || (flags[20] = Placement_parse(argv[i+1])) < 0) {
+					return -1;
+				}
+				i++;
+			}
+			else if (strcmp(argv[i], "--schedule") == 0 && caller == 3) {
+				if (i + 1 == argc) {
+					return -1;
+				}
+				else if (strcmp(argv[i+1], "child") == 0) {
+					flags[21] = 0;
+				}
+				else if (strcmp(argv[i+1], "block") == 0) {
+					flags[21] = 1;
+				}
+				else if (strcmp(argv[i+1], "sorted") == 0) {
+					flags[21] = 2;
+				}
+				else {
+					return -1;
+				}
+				i++;
+			}
+			else if (strcmp(argv[i], "--cpu-dispatch") == 0) {
+				flags[23] = 1;
+			}
+			else if (strcmp(argv[i], "--mmap") == 0) {
+				if (i + 1 == argc) {
+					return -1;
+				}
+				flags[24] = i + 1;
+				i++;
+			}
+			else if (strcmp(argv[i], "--recomb") == 0) {
+				if (i + 1 == argc) {
+					return -1;
+				}
+				flags[26] = i + 1;
+				i++;
+			}
+			else if (strcmp(argv[i], "--mutation") == 0 && caller != 2) {
+				if (i + 1 == argc) {
+					return -1;
+				}
+				flags[27] = i + 1;
+				i++;
+			}
+			else if (strcmp(argv[i], "--traits") == 0 && caller != 2) {
+				if (i + 1 == argc) {
+					return -1;
+				}
+				flags[28] = i + 1;
+				i++;
+			}
+			else if (strcmp(argv[i], "--chunk") == 0 && caller == 1) {
+				if (parse_count(argv, argc, i, &flags[25]) != 0) {
+					return -1;
+				}
+				i++;
+			}
+			else if (strcmp(argv[i], "--trace") == 0) {
+				if (i + 1 == argc) {
+					return -1;
+				}
+				flags[22] = i + 1;
+				i++;
+			}
+			else if (strcmp(argv[i], "--sweep") == 0 && caller == 3) {
+				if (i + 1 == argc) {
+					return -1;
+				}
+				flags[16] = i + 1;
+				i++;
+			}
+			else if (strcmp(argv[i], "--replicates") == 0 && caller == 3) {
+				if (parse_count(argv, argc, i, &flags[17]) != 0) {
+					return -1;
+				}
+				i++;
+			}
 		}
 		else if (argv[i][0] == '-' && argv[i][1] == '-' && (i + 1 == argc || argv[i + 1][0] == '-')) {
 			// if (strcmp(argv[i], "--example_flag") == 0) {
@@ -142,31 +283,48 @@ int parse_flags(int argc, char ** argv, int caller, int ** ret_flags) {
 				flags[5] = 2;
 			}
 			else if (strcmp(argv[i], "-c" ) == 0) {
-				sscanf(argv[i+1], "%u", &flags[6]);
+				if (parse_count(argv, argc, i, &flags[6]) != 0) {
+					return -1;
+				}
 				i++;
 			}
 			else if (strcmp(argv[i], "-e") == 0 && caller != 2) {
-				sscanf(argv[i+1], "%u", &flags[7]);
+				if (parse_count(argv, argc, i, &flags[7]) != 0) {
+					return -1;
+				}
 				i++;
 			}
 			else if (strcmp(argv[i], "-g") == 0) {
-				sscanf(argv[i+1], "%u", &flags[8]);
+				if (parse_count(argv, argc, i, &flags[8]) != 0) {
+					return -1;
+				}
 				i++;
 			}
 			else if (strcmp(argv[i], "-m") == 0 && caller != 2) {
-				sscanf(argv[i+1], "%u", &flags[9]);
+				if (parse_count(argv, argc, i, &flags[9]) != 0) {
+					return -1;
+				}
 				i++;
 			}
 			else if (strcmp(argv[i], "-o") == 0) {
-				sscanf(argv[i+1], "%u", &flags[10]);
+				if (parse_count(argv, argc, i, &flags[10]) != 0) {
+					return -1;
+				}
 				i++;
 			}
 			else if (strcmp(argv[i], "-p") == 0) {
-				sscanf(argv[i+1], "%u", &flags[11]);
+				if (parse_count(argv, argc, i, &flags[11]) != 0) {
+					return -1;
+				}
 				i++;
 			}
 			else if (strcmp(argv[i], "-t") == 0) {
-				sscanf(argv[i+1], "%u", &flags[12]);
+				if (i + 1 < argc && strcmp(argv[i+1], "auto") == 0) {
+					flags[12] = THREADS_AUTO;
+				}
+				else if (parse_count(argv, argc, i, &flags[12]) != 0) {
+					return -1;
+				}
 				i++;
 			}
 			else {
@@ -1,7 +1,13 @@
 #include "jobqueue.h"
 #include "degnome.h"
 #include "fitfunc.h"
-#include "flagparse.c"
+#include "kernels.h"
+#include "genepool.h"
+#include "outbuf.h"
+#include "profile.h"
+#include "autothreads.h"
+#include "trace.h"
+#include "flagparse.h"
 #include <stdio.h>
 #include <string.h>
 #include <gsl/gsl_rng.h>
@@ -16,19 +22,25 @@ struct JobData {
 	Degnome* child;
 	Degnome* p1;
 	Degnome* p2;
+	allele_t* row;		// the child's own row, unused if shared
+	int shared;			// the child points at its parents' row
 };
 
 void usage(void);
 void help_menu(void);
 int jobfunc(void* p, void* tdat);
 void calculate_diversity(Degnome* generation, double** percent_decent, double* diversity);
+void intern_generation(Degnome* children, Degnome* parents, JobData* dat);
+uint64_t genes_hash(const Degnome* d);
 
 const char* usageMsg =
 	"Usage: genancesim [-bhrv] [-s | -u] [-c chromosome_length]\n"
 	"\t\t  [-g num_generations] [-o crossover_rate]\n"
-	"\t\t  [-p population_size] [-t num_threads]\n"
-	"\t\t  [--seed rngseed] [--target hat_height target]\n"
-	"\t\t  [--sqrt | --linear | --close | --ceiling | --log]\n";
+	"\t\t  [-p population_size] [-t num_threads | auto]\n"
+	"\t\t  [--seed rngseed] [--target hat_height target] [--pin]\n"
+	"\t\t  [--sqrt | --linear | --close | --ceiling | --log]\n"
+	"\t\t  [--profile | --counters] [--trace file]\n"
+	"\t\t  [--cpu-dispatch] [--mmap dir] [--recomb map_file]\n";
 
 const char* helpMsg =
 	"OPTIONS\n"
@@ -50,9 +62,11 @@ const char* helpMsg =
 	"\t -s\t Degnome selection will occur.\n\n"
 	"\t -u\t All degnomes contribute to two offspring.\n\n"
 	"\t -v\t Output will be given for every generation.\n"
-	"\t -t num_threads\n"
+	"\t -t num_threads | auto\n"
 	"\t\t Select the number of threads to be used in the current run.\n"
 	"\t\t Default is 0 (which will result in 3/4 of cores being used).\n"
+	"\t\t auto picks inline mating or a worker count each generation\n"
+	"\t\t from the measured cost of mating a child.\n"
 	"\t\t Must be 1 if a seed is used in order to prevent race conditions.\n\n"
 	"\t --seed rngseed\n"
 	"\t\t Select the seed used by the RNG in the current run.\n"
@@ -63,7 +77,31 @@ const char* helpMsg =
 	"\t --sqrt\t\t fitness will be sqrt(hat_height)\n\n"
 	"\t --linear\t fitness will be hat_height\n\n"
 	"\t --close\t fitness will be (target - abs(target - hat_height))\n\n"
-	"\t --ceiling\t fitness will quickly level off after passing target\n\n";
+	"\t --ceiling\t fitness will quickly level off after passing target\n\n"
+	"\t --profile\t print where the time went to stderr at exit\n\n"
+	"\t --counters\n"
+	"\t\t As --profile, and also count cycles, instructions, last\n"
+	"\t\t level cache misses and branch misses in each phase.\n\n"
+	"\t --pin\n"
+	"\t\t Keep each worker thread on a core of its own, dealt\n"
+	"\t\t round robin over the NUMA nodes.\n\n"
+	"\t --trace file\n"
+	"\t\t Write a timeline of every job, idle wait and generation\n"
+	"\t\t to file in Chrome trace format, for chrome://tracing or\n"
+	"\t\t ui.perfetto.dev.\n\n"
+	"\t --mmap dir\n"
+	"\t\t Keep the population in files in dir, mapped into memory,\n"
+	"\t\t for runs larger than RAM.  The files are deleted as they\n"
+	"\t\t are made.\n\n"
+	"\t --recomb map_file\n"
+	"\t\t Draw crossovers from the recombination map in map_file\n"
+	"\t\t instead of uniformly.  Each line is the first locus of an\n"
+	"\t\t interval and its crossover rate per locus; loci before the\n"
+	"\t\t first line have rate 0.  The number of crossovers is\n"
+	"\t\t still set by -o.\n\n"
+	"\t --cpu-dispatch\n"
+	"\t\t Print which instruction set each vectorized kernel was\n"
+	"\t\t picked for on this cpu, and exit.\n\n";
 
 pthread_mutex_t seedLock = PTHREAD_MUTEX_INITIALIZER;
 unsigned long rngseed=0;
@@ -80,6 +118,8 @@ int break_at_zero_diversity;
 
 int num_threads = 0;
 JobQueue* jq;
+AutoThreads* at;		// non-NULL with -t auto
+GenePool* gp;			// every chromosome, shared by identical degnomes
 
 void *ThreadState_new(void *notused);
 void ThreadState_free(void *rng);
@@ -99,12 +139,13 @@ void *ThreadState_new(void *notused) {
 
 void ThreadState_free(void *rng) {
 	gsl_rng_free((gsl_rng *) rng);
+	Degnome_freeScratch();
 }
 
 int jobfunc(void* p, void* tdat) {
 	gsl_rng* rng = (gsl_rng*) tdat;
 	JobData* data = (JobData*) p;																				//get data out
-	Degnome_mate(data->child, data->p1, data->p2, rng, 0, 0, crossover_rate);			//mate
+	data->shared = Degnome_mateOrShare(data->child, data->p1, data->p2, rng, 0, 0, crossover_rate);	//mate
 
 	return 0;		//exited without error
 }
@@ -119,16 +160,40 @@ void help_menu(void) {
 	exit(EXIT_FAILURE);
 }
 
+/**
+ * The hat size sums the genes, so degnomes with the same genes have the
+ * same hat size bit for bit, and hashing it costs nothing per allele.
+ */
+uint64_t genes_hash(const Degnome* d) {
+	return Kernel_hash(&d->hat_size, sizeof(double));
+}
+
+/**
+ * Point each child at the one row of its genes in gp, then release
+ * the parents' rows.  Children that share their parents' row take a
+ * reference to it and give back the row they were mated into.
+ */
+void intern_generation(Degnome* children, Degnome* parents, JobData* dat) {
+	GenePool_newGeneration(gp);
+	for (int j = 0; j < pop_size; j++) {
+		if (dat[j].shared) {
+			GenePool_ref(gp, children[j].dna_array);
+			GenePool_unref(gp, dat[j].row);
+		}
+		children[j].dna_array = GenePool_intern(gp, children[j].dna_array,
+												genes_hash(children + j));
+	}
+	for (int j = 0; j < pop_size; j++) {
+		GenePool_unref(gp, parents[j].dna_array);
+	}
+}
+
 void calculate_diversity(Degnome* generation, double** percent_decent, double* diversity) {
 	*diversity = 0;
 	for (int i = 0; i < pop_size; i++) {			//calculate percent decent for each degnome
 		for (int j = 0; j < pop_size; j++) {
-			percent_decent[i][j] = 0;
-			for (int k = 0; k < chrom_size; k++) {
-				if (generation[i].dna_array[k] == j) {
-					percent_decent[i][j]++;
-				}
-			}
+			percent_decent[i][j] = Kernel_countEqualAlleles(generation[i].dna_array,
+															chrom_size, ALLELE_FROM(j));
 			percent_decent[i][j] /= chrom_size;
 		}
 	}
@@ -145,14 +210,11 @@ void calculate_diversity(Degnome* generation, double** percent_decent, double* d
 			if (i == j) {
 				continue;
 			}
-			for (int k = 0; k < chrom_size; k++) {
-				if (generation[i].dna_array[k] != generation[j].dna_array[k]) {
-					(*diversity)++;
-				}
-			}
+			*diversity += Kernel_countDiffsAlleles(generation[i].dna_array,
+												   generation[j].dna_array, chrom_size);
 		}
 	}
-	*diversity /= ((pop_size-1) * pop_size * chrom_size);
+	*diversity /= ((double) (pop_size-1) * pop_size * chrom_size);
 }
 
 int main(int argc, char **argv) {
@@ -169,6 +231,12 @@ int main(int argc, char **argv) {
 		help_menu();
 	}
 
+	if (flags[23] == 1) {
+		free(flags);
+		Kernel_report(stdout);
+		exit(EXIT_SUCCESS);
+	}
+
 	break_at_zero_diversity = flags[1];
 	reduced = flags[3];
 	verbose = flags[4];
@@ -213,15 +281,35 @@ int main(int argc, char **argv) {
 	gsl_rng* rng = gsl_rng_alloc(gsl_rng_taus);    // rand generator
 	gsl_rng_set(rng, rngseed);
 
+	Profile* prof = (flags[18] ? Profile_new() : NULL);
+	if (flags[18] == 2) {
+		Profile_counters(prof);
+	}
+	int pin_threads = flags[19];
+	const char* mmap_dir = (flags[24] > 0 ? argv[flags[24]] : NULL);
+	if (flags[22] > 0) {
+		Trace_start(argv[flags[22]]);
+	}
+	RecombMap* map = (flags[26] > 0 ? RecombMap_load(argv[flags[26]], chrom_size) : NULL);
+	recomb_map = map;
+
 	free(flags);
 
-	if (num_threads <= 0) {
+	if (num_threads == THREADS_AUTO) {
+		at = AutoThreads_new(getNumCores(), (double) pop_size * chrom_size, NULL,
+							 ThreadState_new, ThreadState_free);
+		AutoThreads_pinWorkers(at, pin_threads);
+	}
+	else if (num_threads <= 0) {
 		if (num_threads < 0) {
 			#ifdef DEBUG_MODE
 				fprintf(stderr, "Error invalid number of threads: %u\n", num_threads);
 			#endif
 		}
 		num_threads = (3*getNumCores()/4);
+		if (num_threads < 1) {
+			num_threads = 1;
+		}
 	}
 	#ifdef DEBUG_MODE
 		fprintf(stderr, "Final number of threads: %u\n", num_threads);
@@ -234,18 +322,25 @@ int main(int argc, char **argv) {
 
 	printf("%u, %u, %u\n", chrom_size, pop_size, num_gens);
 
+	OutBuf* out = OutBuf_new(stdout, 1 << 20);
+	double t = Profile_mark(prof);
+
 	parents = malloc(pop_size*sizeof(Degnome));
 	children = malloc(pop_size*sizeof(Degnome));
 
+	// the parents' rows and the children's, in a file with --mmap
+	gp = GenePool_new(2 * pop_size, chrom_size, mmap_dir);
+
+	GenePool_newGeneration(gp);
 	for (int i = 0; i < pop_size; i++) {
-		parents[i].dna_array = malloc(chrom_size*sizeof(double));
-		children[i].dna_array = malloc(chrom_size*sizeof(double));
+		parents[i].dna_array = GenePool_take(gp);
 		parents[i].hat_size = 0;
 
 		for (int j = 0; j < chrom_size; j++) {
-			parents[i].dna_array[j] = (i);	//children aren't initialized
+			parents[i].dna_array[j] = ALLELE_FROM(i);	//children aren't initialized
 			parents[i].hat_size += (i);		//all genes are a degnome are identical so they are easy to source
 		}
+		parents[i].dna_array = GenePool_intern(gp, parents[i].dna_array, genes_hash(parents + i));
 	}
 
 	double* diversity;
@@ -269,62 +364,64 @@ int main(int argc, char **argv) {
 		}
 	}
 	if (!verbose) {
-		printf("\nGeneration 0:\n\n");
+		OutBuf_puts(out, "\nGeneration 0:\n\n");
 		for (int i = 0; i < pop_size; i++) {
-			printf("Degnome %u\n", i);
+			OutBuf_printf(out, "Degnome %u\n", i);
 			if (!reduced) {
-				for (int j = 0; j < chrom_size; j++) {
-					printf("%lf\t", parents[i].dna_array[j]);
-				}
-				printf("\n");
+				OutBuf_putAlleleRow(out, parents[i].dna_array, chrom_size);
+				OutBuf_putc(out, '\n');
 			}
 			else {
-				printf("%lf\n", parents[i].dna_array[0]);
+				OutBuf_printf(out, "%lf\n", ALLELE_TO(parents[i].dna_array[0]));
 			}
 		}
-		printf("\n\n");
+		OutBuf_puts(out, "\n\n");
 	}
+	t = Profile_lap(prof, PROF_OUTPUT, t);
 
 	int final_gen;
 	int broke_early = 0;
 
-	jq = JobQueue_new(num_threads, NULL, ThreadState_new, ThreadState_free);
+	jq = (at == NULL ? JobQueue_new(num_threads, NULL, ThreadState_new, ThreadState_free) : NULL);
+	if (jq != NULL) {
+		JobQueue_pinWorkers(jq, pin_threads);
+	}
 
 	JobData* dat = malloc(pop_size*sizeof(JobData));
+	double* cum_hat_size = malloc(pop_size*sizeof(double));
+	int* moms = malloc(pop_size*sizeof(int));
+	int* dads = malloc(pop_size*sizeof(int));
 
 	for (int i = 0; i < num_gens; i++) {
+		TRACE_INSTANT(TRACE_GENERATION, i);
 		if (break_at_zero_diversity) {
-			calculate_diversity(parents, percent_decent, diversity);
-			if ((*diversity) <= 0) {
+			// identical degnomes share a row, so this is the same as zero
+			// diversity, which a population of one never has
+			int uniform_pop = (pop_size > 1 && GenePool_distinct(gp) == 1);
+			t = Profile_lap(prof, PROF_DIVERSITY, t);
+			if (uniform_pop) {
 				final_gen = i;
 				broke_early = 1;
 				break;
 			}
 		}
+		for (int j = 0; j < pop_size; j++) {
+			children[j].dna_array = GenePool_take(gp);
+			dat[j].row = children[j].dna_array;
+		}
 		if (!uniform) {
-			double fit;
-			if (selective) {
-				fit = get_fitness(parents[0].hat_size);
+			for (int j = 0; j < pop_size; j++) {
+				//in runs withoutslection, everybody is equally fit
+				cum_hat_size[j] = (selective ? parents[j].hat_size : 100);
 			}
-			else {
-				fit = 100;			//in runs withoutslection, everybody is equally fit
+			if (selective) {
+				get_fitness_batch(cum_hat_size, cum_hat_size, pop_size);
 			}
-
-			double total_hat_size = fit;
-			double cum_hat_size[pop_size];
-			cum_hat_size[0] = fit;
-
 			for (int j = 1; j < pop_size; j++) {
-				if (selective) {
-					fit = get_fitness(parents[j].hat_size);
-				}
-				else {
-					fit = 100;
-				}
-
-				total_hat_size += fit;
-				cum_hat_size[j] = (cum_hat_size[j-1] + fit);
+				cum_hat_size[j] += cum_hat_size[j-1];
 			}
+			double total_hat_size = cum_hat_size[pop_size-1];
+			t = Profile_lap(prof, PROF_FITNESS, t);
 
 			for (int j = 0; j < pop_size; j++) {
 
@@ -355,16 +452,18 @@ int main(int argc, char **argv) {
 				dat[j].child = (children + j);
 				dat[j].p1 = (parents + m);
 				dat[j].p2 = (parents + d);
+				t = Profile_lap(prof, PROF_SELECT, t);
 
-				JobQueue_addJob(jq, jobfunc, dat + j);
+				if (at == NULL) {
+					JobQueue_addJob(jq, jobfunc, dat + j);
+					t = Profile_lap(prof, PROF_SUBMIT, t);
+				}
 			}
 		}
 		
 		else {
 			// printf("uniform!!!\n");
 
-			int moms[pop_size];
-			int dads[pop_size];
 			int mom_max = pop_size;
 			int dad_max = pop_size;
 
@@ -407,101 +506,140 @@ int main(int argc, char **argv) {
 				dat[j].child = (children + j);
 				dat[j].p1 = (parents + m);
 				dat[j].p2 = (parents + d);
+				t = Profile_lap(prof, PROF_SELECT, t);
 
-				JobQueue_addJob(jq, jobfunc, dat + j);
+				if (at == NULL) {
+					JobQueue_addJob(jq, jobfunc, dat + j);
+					t = Profile_lap(prof, PROF_SUBMIT, t);
+				}
 			}
 		}
 
-		JobQueue_waitOnJobs(jq);
+		if (at != NULL) {
+			AutoThreads_run(at, jobfunc, dat, sizeof(JobData), pop_size);
+			t = Profile_lap(prof, (AutoThreads_threads(at) ? PROF_WAIT : PROF_MATE), t);
+		}
+		else {
+			JobQueue_waitOnJobs(jq);
+			t = Profile_lap(prof, PROF_WAIT, t);
+		}
+		intern_generation(children, parents, dat);
+		Profile_generation(prof, pop_size);
 		
 		temp = children;
 		children = parents;
 		parents = temp;
 		if (verbose) {
 			calculate_diversity(parents, percent_decent, diversity);
-			printf("\nGeneration %u:\n", i);
+			t = Profile_lap(prof, PROF_DIVERSITY, t);
+			OutBuf_printf(out, "\nGeneration %u:\n", i);
 			for (int k = 0; k < pop_size; k++) {
-				printf("\n\nDegnome %u\n", k);
+				OutBuf_printf(out, "\n\nDegnome %u\n", k);
 				if (!reduced) {
-					for (int j = 0; j < chrom_size; j++) {
-						printf("%lf\t", parents[k].dna_array[j]);
-					}
+					OutBuf_putAlleleRow(out, parents[k].dna_array, chrom_size);
 					if (selective) {
-						printf("\nTOTAL HAT SIZE: %lg\n\n", parents[k].hat_size);
+						OutBuf_printf(out, "\nTOTAL HAT SIZE: %lg\n\n", parents[k].hat_size);
 					}
 					else {
-						printf("\n");
+						OutBuf_putc(out, '\n');
 					}
 				}
 				for (int j = 0; j < pop_size; j++) {
 					if (percent_decent[k][j] > 0) {
-						printf("%lf%% Degnome %u\t", (100*percent_decent[k][j]), j);
+						OutBuf_putDouble(out, 100*percent_decent[k][j]);
+						OutBuf_puts(out, "% Degnome ");
+						OutBuf_putUint(out, j);
+						OutBuf_putc(out, '\t');
 					}
 				}
 			}
-			printf("\nAverage population decent percentages:\n");
+			OutBuf_puts(out, "\nAverage population decent percentages:\n");
 			for (int j = 0; j < pop_size; j++) {
 				if (percent_decent[pop_size][j] > 0) {
-					printf("%lf%% Degnome %u\t", (100*percent_decent[pop_size][j]), j);
+					OutBuf_putDouble(out, 100*percent_decent[pop_size][j]);
+					OutBuf_puts(out, "% Degnome ");
+					OutBuf_putUint(out, j);
+					OutBuf_putc(out, '\t');
 				}
 			}
-			printf("\nPercent diversity: %lf\n", (100* (*diversity)));
-		printf("\n\n");
+			OutBuf_printf(out, "\nPercent diversity: %lf\n", (100* (*diversity)));
+		OutBuf_puts(out, "\n\n");
+			t = Profile_lap(prof, PROF_OUTPUT, t);
 		}
 	}
-	JobQueue_noMoreJobs(jq);
+	if (jq != NULL) {
+		JobQueue_noMoreJobs(jq);
+	}
 	
 	if (verbose) {
-		printf("\n");
+		OutBuf_putc(out, '\n');
 	}
 
 	calculate_diversity(parents, percent_decent, diversity);
+	t = Profile_lap(prof, PROF_DIVERSITY, t);
 	// printf("\n\n DIVERSITY%lf\n\n\n", *diversity);
 	if (broke_early) {
-		printf("Generation %u:\n", final_gen);
+		OutBuf_printf(out, "Generation %u:\n", final_gen);
 	}
 	else {
-		printf("Generation %u:\n", num_gens);
+		OutBuf_printf(out, "Generation %u:\n", num_gens);
 	}
 	for (int i = 0; i < pop_size; i++) {
-		printf("Degnome %u\n", i);
+		OutBuf_printf(out, "Degnome %u\n", i);
 		if (!reduced) {
-			for (int j = 0; j < chrom_size; j++) {
-				printf("%lf\t", parents[i].dna_array[j]);
-			}
-			printf("\n");
+			OutBuf_putAlleleRow(out, parents[i].dna_array, chrom_size);
+			OutBuf_putc(out, '\n');
 		}
 		for (int j = 0; j < pop_size; j++) {
 			if (percent_decent[i][j] > 0) {
-				printf("%lf%% Degnome %u\t", (100*percent_decent[i][j]), j);
+				OutBuf_putDouble(out, 100*percent_decent[i][j]);
+				OutBuf_puts(out, "% Degnome ");
+				OutBuf_putUint(out, j);
+				OutBuf_putc(out, '\t');
 			}
 		}
-		printf("\n");
+		OutBuf_putc(out, '\n');
 
 		if (selective) {
-			printf("\nTOTAL HAT SIZE: %lg\n\n", parents[i].hat_size);
+			OutBuf_printf(out, "\nTOTAL HAT SIZE: %lg\n\n", parents[i].hat_size);
 		}
 		else {
-			printf("\n\n");
+			OutBuf_puts(out, "\n\n");
 		}
 	}
-	printf("Average population decent percentages:\n");
+	OutBuf_puts(out, "Average population decent percentages:\n");
 	for (int j = 0; j < pop_size; j++) {
 		if (percent_decent[pop_size][j] > 0) {
-			printf("%lf%% Degnome %u\t", (100*percent_decent[pop_size][j]), j);
+			OutBuf_putDouble(out, 100*percent_decent[pop_size][j]);
+			OutBuf_puts(out, "% Degnome ");
+			OutBuf_putUint(out, j);
+			OutBuf_putc(out, '\t');
 		}
 	}
-	printf("\nPercent diversity: %lf\n", (100* (*diversity)));
-	printf("\n\n\n");
+	OutBuf_printf(out, "\nPercent diversity: %lf\n", (100* (*diversity)));
+	OutBuf_puts(out, "\n\n\n");
+
+	OutBuf_free(out);
+	t = Profile_lap(prof, PROF_OUTPUT, t);
+
+	Profile_report(prof, (at != NULL ? AutoThreads_jobQueue(at) : jq), stderr);
 
 	//free everything
+	Profile_free(prof);
 
-	JobQueue_free(jq);
+	if (at != NULL) {
+		AutoThreads_free(at);
+	}
+	else {
+		JobQueue_free(jq);
+	}
 	free(dat);
+	free(cum_hat_size);
+	free(moms);
+	free(dads);
+	Degnome_freeScratch();
 
 	for (int i = 0; i < pop_size; i++) {
-		free(parents[i].dna_array);
-		free(children[i].dna_array);
 		parents[i].hat_size = 0;
 
 		free(percent_decent[i]);
@@ -510,9 +648,13 @@ int main(int argc, char **argv) {
 
 	free(parents);
 	free(children);
+	GenePool_free(gp);
 
 	free(percent_decent);
 	free(diversity);
 
+	if (map != NULL) {
+		RecombMap_free(map);
+	}
 	gsl_rng_free (rng);
 }
\ No newline at end of file
@@ -0,0 +1,192 @@
+/**
+@file genepool.c
+@page genepool
+@author Daniel R. Tabin
+@brief Chromosomes shared by every degnome that has the same genes
+
+Late in a genancesim run most of the population descends from a few
+ancestors and many degnomes carry exactly the same chromosome.  A
+GenePool holds the chromosomes as reference counted rows, and each
+generation's children are interned: a child whose genes match one
+already seen that generation is pointed at that row and its own row
+goes back to the pool.  Identical degnomes then share one dna_array,
+so
+
+- mating a degnome with itself, or with its twin, copies a pointer
+  rather than the chromosome when no mutation falls (see
+  Degnome_mateOrShare), and
+- the population is uniform exactly when GenePool_distinct is 1,
+  which -b checks instead of computing the diversity.
+
+Rows are looked up by a hash of their genes, which the caller gives,
+in an open addressed table.  Equal genes must hash alike; different
+genes may too, as a match is confirmed with memcmp and two rows are
+merged only if they are equal bit for bit.  genancesim hashes the hat
+size, which it has already summed from the genes.
+
+A pool of 2 x pop_size rows is enough: pop_size for the parents and
+pop_size for children that do not share.  All the rows are one block,
+in a file with --mmap.  Only the thread stepping the generation may
+call these functions; workers only fill rows they were given.
+*/
+
+#include "genepool.h"
+#include "mapped.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct GenePool {
+	int rows;
+	int len;				// alleles per row
+	size_t stride;			// len, or 1 if len is 0
+	const char* mmap_dir;	// NULL => rows are malloced
+	allele_t* block;		// rows x len
+	int* refs;				// degnomes pointing at each row
+	uint64_t* hash;			// of each row interned this generation
+	int* free_rows;			// stack of rows with no references
+	int nfree;
+
+	int* table;				// row of each slot, or -1
+	size_t slots;			// a power of two, at least 2 x rows
+	int distinct;			// rows in table
+};
+
+static int row_index(const GenePool* gp, const allele_t* row);
+static allele_t* row_at(const GenePool* gp, int r);
+
+static int row_index(const GenePool* gp, const allele_t* row) {
+	return (int) ((size_t) (row - gp->block) / gp->stride);
+}
+
+static allele_t* row_at(const GenePool* gp, int r) {
+	return gp->block + (size_t) r * gp->stride;
+}
+
+/**
+ * A pool of rows chromosomes of len alleles, in files in mmap_dir if
+ * it is not NULL.
+ */
+GenePool* GenePool_new(int rows, int len, const char* mmap_dir) {
+	GenePool* gp = malloc(sizeof(GenePool));
+	CHECKMEM(gp);
+	size_t stride = (len > 0 ? (size_t) len : 1);
+	size_t bytes = (size_t) rows * stride * sizeof(allele_t);
+
+	gp->rows = rows;
+	gp->len = len;
+	gp->stride = stride;
+	gp->mmap_dir = mmap_dir;
+	gp->block = (mmap_dir != NULL ? Mapped_alloc(bytes, mmap_dir) : malloc(bytes));
+	if (gp->block == NULL) {
+		exit(EXIT_FAILURE);
+	}
+
+	gp->slots = 1;
+	while (gp->slots < 2 * (size_t) rows) {
+		gp->slots *= 2;
+	}
+	gp->refs = calloc(rows, sizeof(int));
+	gp->hash = malloc(rows*sizeof(uint64_t));
+	gp->free_rows = malloc(rows*sizeof(int));
+	gp->table = malloc(gp->slots*sizeof(int));
+	CHECKMEM(gp->refs && gp->hash && gp->free_rows && gp->table);
+
+	// handed out from row 0 up
+	for (int r = 0; r < rows; r++) {
+		gp->free_rows[r] = rows - 1 - r;
+	}
+	gp->nfree = rows;
+	GenePool_newGeneration(gp);
+
+	return gp;
+}
+
+/// An unused row, with one reference.  Its contents are undefined.
+allele_t* GenePool_take(GenePool* gp) {
+	if (gp->nfree == 0) {
+		fprintf(stderr, "%s:%d: all %d rows are in use\n", __FILE__, __LINE__, gp->rows);
+		exit(EXIT_FAILURE);
+	}
+	int r = gp->free_rows[--gp->nfree];
+
+	gp->refs[r] = 1;
+	return row_at(gp, r);
+}
+
+/// Add a reference to row.
+void GenePool_ref(GenePool* gp, allele_t* row) {
+	gp->refs[row_index(gp, row)]++;
+}
+
+/// Drop a reference to row; with none left it goes back to the pool.
+void GenePool_unref(GenePool* gp, allele_t* row) {
+	int r = row_index(gp, row);
+
+	if (--gp->refs[r] == 0) {
+		gp->free_rows[gp->nfree++] = r;
+	}
+}
+
+/// Forget the rows interned so far, before interning a new generation.
+void GenePool_newGeneration(GenePool* gp) {
+	for (size_t s = 0; s < gp->slots; s++) {
+		gp->table[s] = -1;
+	}
+	gp->distinct = 0;
+}
+
+/**
+ * The row of this generation with the same genes as row, whose hash
+ * is hash.  The caller's reference to row becomes a reference to the
+ * row returned; if that is another row, row itself is released.
+ */
+allele_t* GenePool_intern(GenePool* gp, allele_t* row, uint64_t hash) {
+	int r = row_index(gp, row);
+	size_t mask = gp->slots - 1;
+
+	for (size_t s = hash & mask; ; s = (s + 1) & mask) {
+		int e = gp->table[s];
+
+		if (e < 0) {
+			gp->table[s] = r;
+			gp->hash[r] = hash;
+			gp->distinct++;
+			return row;
+		}
+		if (e == r) {
+			return row;
+		}
+		if (gp->hash[e] == hash
+			&& memcmp(row_at(gp, e), row, gp->len * sizeof(allele_t)) == 0) {
+			gp->refs[e]++;
+			GenePool_unref(gp, row);
+			return row_at(gp, e);
+		}
+	}
+}
+
+/// Number of different rows interned this generation.
+int GenePool_distinct(const GenePool* gp) {
+	return gp->distinct;
+}
+
+/// Number of rows with a reference.
+int GenePool_used(const GenePool* gp) {
+	return gp->rows - gp->nfree;
+}
+
+void GenePool_free(GenePool* gp) {
+	if (gp->mmap_dir != NULL) {
+		Mapped_free(gp->block, (size_t) gp->rows * gp->stride * sizeof(allele_t));
+	}
+	else {
+		free(gp->block);
+	}
+	free(gp->refs);
+	free(gp->hash);
+	free(gp->free_rows);
+	free(gp->table);
+	free(gp);
+}
@@ -0,0 +1,25 @@
+/**
+ * @file genepool.h
+ * @author Daniel R. Tabin
+ * @brief Header for genepool.c
+ */
+
+#ifndef GENEPOOL
+#define GENEPOOL
+
+#include "allele.h"
+#include <stdint.h>
+
+typedef struct GenePool GenePool;
+
+GenePool*	GenePool_new(int rows, int len, const char* mmap_dir);
+allele_t*	GenePool_take(GenePool* gp);
+void		GenePool_ref(GenePool* gp, allele_t* row);
+void		GenePool_unref(GenePool* gp, allele_t* row);
+void		GenePool_newGeneration(GenePool* gp);
+allele_t*	GenePool_intern(GenePool* gp, allele_t* row, uint64_t hash);
+int			GenePool_distinct(const GenePool* gp);
+int			GenePool_used(const GenePool* gp);
+void		GenePool_free(GenePool* gp);
+
+#endif
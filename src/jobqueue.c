@@ -9,18 +9,40 @@
  * another. When all jobs are finished, control returns to the main
  * function. 
  *
+ * There are two kinds of queue.  JOBQUEUE_MUTEX keeps jobs on a list
+ * guarded by one mutex, and workers sleep on condition variables.
+ * JOBQUEUE_RING, available on Linux, keeps them in a bounded
+ * lock-free multi-producer/multi-consumer ring (Vyukov's design), so
+ * adding and taking a job costs a couple of atomic operations.  Idle
+ * workers there park on futexes used as eventcounts: a worker reads
+ * the count, announces itself as a sleeper, checks the ring once more
+ * and only then sleeps, so a producer that bumps the count after
+ * pushing can never lose the wakeup.  JobQueue_new makes a ring where
+ * it can and the mutex kind otherwise; JobQueue_newKind picks one.
+ *
  * @copyright Copyright (c) 2014, Alan R. Rogers 
  * <rogers@anthro.utah.edu>. This file is released under the Internet
  * Systems Consortium License, which can be found in file "LICENSE".
  */
 
 #include "jobqueue.h"
+#include "placement.h"
+#include "trace.h"
+#include "counters.h"
+#include "checkmem.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <time.h>
+#include <limits.h>
+#if defined(__linux__) && !defined(JOBQUEUE_NO_RING)
+	#define JOBQUEUE_HAVE_RING
+	#include <linux/futex.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
 #ifdef _WIN32
 	#include <windows.h>
 #elif defined(MACOS)
@@ -44,16 +66,9 @@ pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;
 	exit(1);\
 }while(0)
 
-#undef CHECKMEM
-#define   CHECKMEM(x) do {                                  \
-		if (!(x)) {                                          \
-			fprintf(stderr, "%s:%s:%d: allocation error\n", \
-					__FILE__,__func__,__LINE__);            \
-			exit(EXIT_FAILURE);                             \
-		}                                                   \
-	} while(0);
-
 typedef struct Job Job;
+typedef struct WorkerTimes WorkerTimes;
+typedef struct RingCell RingCell;
 
 /// A single job in the queue
 struct Job {
@@ -62,10 +77,39 @@ struct Job {
 	int (*jobfun) (void *param, void *tdat);    // function that does job
 };
 
+/// A slot of the ring.  seq says whose turn it is: pos for the
+/// producer of position pos, pos + 1 for its consumer.
+struct RingCell {
+	size_t seq;
+	void *param;
+	int (*jobfun) (void *param, void *tdat);
+};
+
+#define JOBQUEUE_RING_SIZE 4096     // cells; a power of 2
+#define JOBQUEUE_SPIN 200           // polls of the ring before parking
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#  define CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#  define CPU_RELAX() do {} while (0)
+#endif
+
+/// Time one worker has spent running jobs and waiting for them
+struct WorkerTimes {
+	double busy;                // seconds inside jobfun
+	double idle;                // seconds waiting on wakeWorker
+	double idleSince;           // start of current wait, if waiting
+	bool waiting;
+	long jobs;                  // number of jobs run
+};
+
 /// All data used by job queue
 struct JobQueue {
 
 	Job *todo;                  // list of jobs
+	Job *spare;                 // finished Jobs kept for reuse
 	bool acceptingJobs;         // false => don't wait for work
 	int maxThreads;             // maxumum number of threads
 	int nThreads;               // current number of threads
@@ -86,6 +130,29 @@ struct JobQueue {
 	void *threadData;           // constructor argument; not locally owned
 	void *(*ThreadState_new) (void *threadData);    // constuctor
 	void (*ThreadState_free) (void *threadState);   // destructor
+
+	int launched;               // threads ever started
+	WorkerTimes *times;         // one per thread, in order of launch
+
+	int kind;                   // JOBQUEUE_MUTEX or JOBQUEUE_RING
+	bool pin;                   // pin each worker to its own core
+
+	// JOBQUEUE_RING only.  nThreads is atomic there, and is also a
+	// futex that JobQueue_free waits on for workers to exit.
+	RingCell *ring;
+	size_t mask;                // ring size - 1
+	size_t enqPos __attribute__((aligned(64)));
+	size_t deqPos __attribute__((aligned(64)));
+	long pending __attribute__((aligned(64)));  // added, not finished
+	int workSeq;                // futex: bumped to wake workers
+	int doneSeq;                // futex: bumped when pending hits 0
+	int freeSeq;                // futex: bumped when a full ring drains
+	int sleepers;               // workers parked or about to park
+	int wakePending;            // a wakeup is on its way to a sleeper
+	int mainWaiting;            // threads in JobQueue_waitOnJobs
+	int fullWaiting;            // producers waiting on a full ring
+	int freePending;            // a wakeup is on its way to a producer
+	int spin;                   // polls before parking
 };
 
 #define JOBQUEUE_VALID 8131950
@@ -96,6 +163,29 @@ pthread_mutex_t stdoutLock = PTHREAD_MUTEX_INITIALIZER;
 
 void *threadfun(void *varg);
 void Job_free(Job * job);
+static double monotonic(void);
+#ifdef JOBQUEUE_HAVE_RING
+void *ringfun(void *varg);
+static void futex_wait(int *addr, int val);
+static void futex_wake(int *addr, int n);
+static bool ring_push(JobQueue * jq, int (*jobfun) (void *, void *),
+					  void *param);
+static bool ring_pop(JobQueue * jq, int (**jobfun) (void *, void *),
+					 void **param);
+static void ring_addJob(JobQueue * jq, int (*jobfun) (void *, void *),
+						void *param);
+static void ring_wakeOne(JobQueue * jq);
+static void ring_noMoreJobs(JobQueue * jq);
+static void ring_waitOnJobs(JobQueue * jq);
+static void ring_waitOnExit(JobQueue * jq);
+#endif
+
+/// Seconds on the monotonic clock.
+static double monotonic(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
 #ifdef DPRINTF_ON
 void Job_print(Job * job);
 
@@ -109,20 +199,61 @@ void Job_print(Job * job) {
 }
 #endif
 
+/// A JobQueue of the fastest kind this platform supports.
 JobQueue *JobQueue_new(int maxThreads, void *threadData,
 					   void *(*ThreadState_new) (void *),
 					   void (*ThreadState_free) (void *)) {
+	return JobQueue_newKind(JOBQUEUE_RING, maxThreads, threadData,
+							ThreadState_new, ThreadState_free);
+}
+
+/**
+ * A JobQueue of the given kind.  JOBQUEUE_RING falls back to
+ * JOBQUEUE_MUTEX where futexes are not available; JobQueue_kind
+ * tells which one was made.
+ */
+JobQueue *JobQueue_newKind(int kind, int maxThreads, void *threadData,
+						   void *(*ThreadState_new) (void *),
+						   void (*ThreadState_free) (void *)) {
 	int i;
-	JobQueue *jq = malloc(sizeof(JobQueue));
+	JobQueue *jq = NULL;
+	// the ring counters sit on their own cache lines
+	if (posix_memalign((void **) &jq, 64, sizeof(JobQueue)))
+		jq = NULL;
 	CHECKMEM(jq);
 
 	jq->todo = NULL;
+	jq->spare = NULL;
 	jq->acceptingJobs = true;
 	jq->idle = jq->nThreads = 0;
 	jq->maxThreads = maxThreads;
 	jq->threadData = threadData;
 	jq->ThreadState_new = ThreadState_new;
 	jq->ThreadState_free = ThreadState_free;
+	jq->launched = 0;
+	jq->times = calloc((maxThreads > 0 ? maxThreads : 1), sizeof(WorkerTimes));
+	CHECKMEM(jq->times);
+
+	jq->pin = false;
+	jq->kind = JOBQUEUE_MUTEX;
+	jq->ring = NULL;
+#ifdef JOBQUEUE_HAVE_RING
+	if (kind == JOBQUEUE_RING) {
+		jq->kind = JOBQUEUE_RING;
+		jq->mask = JOBQUEUE_RING_SIZE - 1;
+		jq->ring = malloc(JOBQUEUE_RING_SIZE * sizeof(RingCell));
+		CHECKMEM(jq->ring);
+		for (size_t k = 0; k <= jq->mask; k++)
+			jq->ring[k].seq = k;
+		jq->enqPos = jq->deqPos = 0;
+		jq->pending = 0;
+		jq->workSeq = jq->doneSeq = jq->freeSeq = 0;
+		jq->sleepers = jq->mainWaiting = jq->fullWaiting = 0;
+		jq->wakePending = jq->freePending = 0;
+		// spinning only helps if the producer runs on another core
+		jq->spin = (getNumCores() > 1 ? JOBQUEUE_SPIN : 0);
+	}
+#endif
 
 	// set attr for detached threads
 	if ((i = pthread_attr_init(&jq->attr))) {
@@ -178,15 +309,29 @@ void JobQueue_addJob(JobQueue * jq, int (*jobfun) (void *, void *),
 		exit(1);
 	}
 
-	Job *job = malloc(sizeof(Job));
-	CHECKMEM(job);
-	job->jobfun = jobfun;
-	job->param = param;
+#ifdef JOBQUEUE_HAVE_RING
+	if (jq->kind == JOBQUEUE_RING) {
+		ring_addJob(jq, jobfun, param);
+		return;
+	}
+#endif
 
 	status = pthread_mutex_lock(&jq->lock);
 	if (status)
 		ERR(status, "lock");
 
+	// Reuse a finished Job if there is one, so that once the queue has
+	// held its largest batch, adding a job never touches the heap.
+	Job *job = jq->spare;
+	if (job != NULL) {
+		jq->spare = job->next;
+	} else {
+		job = malloc(sizeof(Job));
+		CHECKMEM(job);
+	}
+	job->jobfun = jobfun;
+	job->param = param;
+
 	job->next = jq->todo;
 	jq->todo = job;
 
@@ -201,6 +346,7 @@ void JobQueue_addJob(JobQueue * jq, int (*jobfun) (void *, void *),
 		status = pthread_cond_signal(&jq->wakeWorker);
 		if (status)
 			ERR(status, "signal wakeWorker");
+		TRACE_INSTANT(TRACE_WAKE, 1);
 
 	} else if (jq->nThreads < jq->maxThreads) {
 
@@ -233,9 +379,30 @@ void *threadfun(void *arg) {
 
 	//    struct timespec timeout;
 	JobQueue *jq = (JobQueue *) arg;
-	Job *job;
+	Job *job = NULL;
 	int status;
+	WorkerTimes *me;
+	double t = 0;
+	bool ran = false;
 	void *threadState = NULL;
+	int slot;
+
+	status = pthread_mutex_lock(&jq->lock);
+	if (status)
+		ERR(status, "lock");
+	slot = jq->launched++;
+	me = jq->times + slot;
+	status = pthread_mutex_unlock(&jq->lock);
+	if (status)
+		ERR(status, "unlock");
+
+	// pin before anything is allocated, so it is allocated locally
+	if (jq->pin)
+		Placement_pin(slot);
+	if (trace_on)
+		Trace_nameThread("worker", slot);
+	if (counters_on)
+		Counters_attachThread();
 	if (jq->ThreadState_new != NULL) {
 		threadState = jq->ThreadState_new(jq->threadData);
 		CHECKMEM(threadState);
@@ -251,6 +418,16 @@ void *threadfun(void *arg) {
 		else
 			DPRINTF(("%s:%s:%d: locked\n", __FILE__, __func__, __LINE__));
 
+		// Account for the job just finished and return it to the
+		// spare list while we hold the lock
+		if (ran) {
+			me->busy += t;
+			++me->jobs;
+			job->next = jq->spare;
+			jq->spare = job;
+			ran = false;
+		}
+
 		// Wait while the queue is empty and accepting jobs
 		while(NULL == jq->todo && jq->acceptingJobs) {
 			DPRINTF(("%s:%d:  awaiting work. todo=%p\n",
@@ -262,9 +439,15 @@ void *threadfun(void *arg) {
 				if (status)
 					ERR(status, "signal wakeMain");
 			}
+			me->idleSince = monotonic();
+			me->waiting = true;
 			//status = pthread_cond_timedwait(&jq->wakeWorker, &jq->lock,
 			//                                &timeout);
+			TRACE_BEGIN(TRACE_IDLE);
 			status = pthread_cond_wait(&jq->wakeWorker, &jq->lock);
+			TRACE_END(TRACE_IDLE, 0);
+			me->waiting = false;
+			me->idle += monotonic() - me->idleSince;
 			--jq->idle;
 			//if (status == ETIMEDOUT)
 			//    continue;
@@ -306,10 +489,14 @@ void *threadfun(void *arg) {
 
 			DPRINTF(("%s %lu calling jobfun\n", __func__,
 					 (unsigned long) pthread_self()));
+			TRACE_BEGIN(TRACE_JOB);
+			t = monotonic();
 			job->jobfun(job->param, threadState);
+			t = monotonic() - t;
+			TRACE_END(TRACE_JOB, 0);
 			DPRINTF(("%s %lu back fr jobfun\n", __func__,
 					 (unsigned long) pthread_self()));
-			free(job);
+			ran = true;
 		}
 	}
 	// still have lock
@@ -327,6 +514,7 @@ void *threadfun(void *arg) {
 
 	if (threadState)
 		jq->ThreadState_free(threadState);
+	Counters_detachThread();
 
 	DPRINTF(("%s %lu exit\n", __func__, (unsigned long) pthread_self()));
 	return NULL;
@@ -344,6 +532,13 @@ void JobQueue_noMoreJobs(JobQueue * jq) {
 		exit(1);
 	}
 
+#ifdef JOBQUEUE_HAVE_RING
+	if (jq->kind == JOBQUEUE_RING) {
+		ring_noMoreJobs(jq);
+		return;
+	}
+#endif
+
 	status = pthread_mutex_lock(&jq->lock);
 	if (status)
 		ERR(status, "lock");
@@ -381,6 +576,15 @@ void JobQueue_waitOnJobs(JobQueue * jq) {
 		exit(1);
 	}
 
+	TRACE_BEGIN(TRACE_WAIT);
+#ifdef JOBQUEUE_HAVE_RING
+	if (jq->kind == JOBQUEUE_RING) {
+		ring_waitOnJobs(jq);
+		TRACE_END(TRACE_WAIT, 0);
+		return;
+	}
+#endif
+
 	status = pthread_mutex_lock(&jq->lock);
 	if (status)
 		ERR(status, "lock");
@@ -422,14 +626,57 @@ void JobQueue_waitOnJobs(JobQueue * jq) {
 	else
 		DPRINTF(("%s:%s:%d: unlocked\n", __FILE__, __func__, __LINE__));
 
+	TRACE_END(TRACE_WAIT, 0);
 	DPRINTF(("%s:%d: exit\n", __func__, __LINE__));
 }
 
+/**
+ * Copy the busy and idle seconds and job counts of up to n workers,
+ * in the order they were launched, into busy, idle and jobs.  Any
+ * of the three may be NULL.  Returns the number of workers launched
+ * so far.
+ */
+int JobQueue_workerTimes(JobQueue * jq, double *busy, double *idle,
+						 long *jobs, int n) {
+	int status, launched;
+	double now = monotonic();
+
+	status = pthread_mutex_lock(&jq->lock);
+	if (status)
+		ERR(status, "lock");
+
+	// Ring workers update their own times without the lock.
+	launched = __atomic_load_n(&jq->launched, __ATOMIC_ACQUIRE);
+	for (int i = 0; i < launched && i < n; i++) {
+		WorkerTimes *w = jq->times + i;
+		double b, d, since;
+		bool waiting;
+		__atomic_load(&w->busy, &b, __ATOMIC_RELAXED);
+		__atomic_load(&w->idle, &d, __ATOMIC_RELAXED);
+		__atomic_load(&w->idleSince, &since, __ATOMIC_RELAXED);
+		__atomic_load(&w->waiting, &waiting, __ATOMIC_RELAXED);
+		if (busy)
+			busy[i] = b;
+		if (idle)
+			idle[i] = d + (waiting ? now - since : 0);
+		if (jobs)
+			jobs[i] = __atomic_load_n(&w->jobs, __ATOMIC_RELAXED);
+	}
+
+	status = pthread_mutex_unlock(&jq->lock);
+	if (status)
+		ERR(status, "unlock");
+
+	return launched;
+}
+
+/// Free a list of jobs.  Iterative, as the spare list can be long.
 void Job_free(Job * job) {
-	if (NULL == job)
-		return;
-	Job_free(job->next);
-	free(job);
+	while (job != NULL) {
+		Job *next = job->next;
+		free(job);
+		job = next;
+	}
 }
 
 void JobQueue_free(JobQueue * jq) {
@@ -446,14 +693,21 @@ void JobQueue_free(JobQueue * jq) {
 	JobQueue_noMoreJobs(jq);
 	JobQueue_waitOnJobs(jq);
 
-	// sleep to give threads time to release mutex
-	struct timespec t = {
-		.tv_sec = 0,
-		.tv_nsec = 10000000L    // 1/100 of a second
-	};
-	status = nanosleep(&t, NULL);
-	if (status)
-		ERR(status, "nanosleep");
+#ifdef JOBQUEUE_HAVE_RING
+	if (jq->kind == JOBQUEUE_RING) {
+		ring_waitOnExit(jq);
+	} else
+#endif
+	{
+		// sleep to give threads time to release mutex
+		struct timespec t = {
+			.tv_sec = 0,
+			.tv_nsec = 10000000L    // 1/100 of a second
+		};
+		status = nanosleep(&t, NULL);
+		if (status)
+			ERR(status, "nanosleep");
+	}
 
 	status = pthread_attr_destroy(&jq->attr);
 	if (status)
@@ -472,9 +726,285 @@ void JobQueue_free(JobQueue * jq) {
 		ERR(status, "destroy wakeMain");
 
 	Job_free(jq->todo);
+	Job_free(jq->spare);
+	free(jq->ring);
+	free(jq->times);
 	free(jq);
 }
 
+/// JOBQUEUE_MUTEX or JOBQUEUE_RING
+int JobQueue_kind(const JobQueue * jq) {
+	return jq->kind;
+}
+
+/**
+ * Pin each worker started from now on to a core of its own, dealt
+ * round robin over the NUMA nodes (see placement.c).  Call it before
+ * the first JobQueue_addJob; workers already running stay unpinned.
+ */
+void JobQueue_pinWorkers(JobQueue * jq, int on) {
+	jq->pin = (on != 0);
+}
+
+#ifdef JOBQUEUE_HAVE_RING
+
+static void futex_wait(int *addr, int val) {
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(int *addr, int n) {
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/// Claim the cell at enqPos and fill it.  False if the ring is full.
+static bool ring_push(JobQueue * jq, int (*jobfun) (void *, void *),
+					  void *param) {
+	size_t pos = __atomic_load_n(&jq->enqPos, __ATOMIC_RELAXED);
+	RingCell *cell;
+
+	for (;;) {
+		cell = jq->ring + (pos & jq->mask);
+		size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		long dif = (long) (seq - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&jq->enqPos, &pos, pos + 1, true,
+											__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return false;
+		} else {
+			pos = __atomic_load_n(&jq->enqPos, __ATOMIC_RELAXED);
+		}
+	}
+	cell->jobfun = jobfun;
+	cell->param = param;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/// Take the cell at deqPos.  False if the ring is empty.
+static bool ring_pop(JobQueue * jq, int (**jobfun) (void *, void *),
+					 void **param) {
+	size_t pos = __atomic_load_n(&jq->deqPos, __ATOMIC_RELAXED);
+	RingCell *cell;
+
+	for (;;) {
+		cell = jq->ring + (pos & jq->mask);
+		size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		long dif = (long) (seq - (pos + 1));
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&jq->deqPos, &pos, pos + 1, true,
+											__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return false;
+		} else {
+			pos = __atomic_load_n(&jq->deqPos, __ATOMIC_RELAXED);
+		}
+	}
+	*jobfun = cell->jobfun;
+	*param = cell->param;
+	__atomic_store_n(&cell->seq, pos + jq->mask + 1, __ATOMIC_RELEASE);
+
+	// A producer may be parked on a full ring.  Wake it once the ring
+	// is half empty, and only once until it is back.  Occupancy comes
+	// from deqPos as it is now, not from pos: a worker preempted
+	// between claiming its cell and releasing it may be the one the
+	// producer is waiting on, after the others have emptied the ring.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&jq->fullWaiting, __ATOMIC_RELAXED) > 0) {
+		size_t deq = __atomic_load_n(&jq->deqPos, __ATOMIC_SEQ_CST);
+		size_t enq = __atomic_load_n(&jq->enqPos, __ATOMIC_SEQ_CST);
+		int expected = 0;
+		if (enq - deq <= jq->mask / 2
+			&& __atomic_compare_exchange_n(&jq->freePending, &expected, 1, false,
+										   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			__atomic_add_fetch(&jq->freeSeq, 1, __ATOMIC_SEQ_CST);
+			futex_wake(&jq->freeSeq, INT_MAX);
+		}
+	}
+	return true;
+}
+
+/**
+ * Wake one parked worker, unless a wakeup is already on its way: the
+ * worker it reaches will take every job in the ring before parking
+ * again, and wakes the next sleeper itself if there is more to do.
+ * This keeps a producer that fills the ring faster than workers get
+ * scheduled from making a system call per job.  A worker clears
+ * wakePending after it counts itself as a sleeper and before it looks
+ * at the ring one last time, so a stale flag can cost an extra
+ * wakeup but never a lost one.  freePending works the same way for
+ * a producer waiting on a full ring.
+ */
+static void ring_wakeOne(JobQueue * jq) {
+	int expected = 0;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&jq->sleepers, __ATOMIC_RELAXED) > 0
+		&& __atomic_compare_exchange_n(&jq->wakePending, &expected, 1, false,
+									   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&jq->workSeq, 1, __ATOMIC_SEQ_CST);
+		futex_wake(&jq->workSeq, 1);
+		TRACE_INSTANT(TRACE_WAKE, 1);
+	}
+}
+
+static void ring_addJob(JobQueue * jq, int (*jobfun) (void *, void *),
+						void *param) {
+	__atomic_add_fetch(&jq->pending, 1, __ATOMIC_SEQ_CST);
+
+	while (!ring_push(jq, jobfun, param)) {
+		// full: park until a worker takes a job
+		int key = __atomic_load_n(&jq->freeSeq, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&jq->fullWaiting, 1, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&jq->freePending, 0, __ATOMIC_SEQ_CST);
+		bool pushed = ring_push(jq, jobfun, param);
+		if (!pushed)
+			futex_wait(&jq->freeSeq, key);
+		__atomic_sub_fetch(&jq->fullWaiting, 1, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&jq->freePending, 0, __ATOMIC_SEQ_CST);
+		if (pushed)
+			break;
+	}
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&jq->sleepers, __ATOMIC_RELAXED) > 0) {
+		ring_wakeOne(jq);
+		return;
+	}
+
+	// nobody is idle: launch a worker if we may
+	int n = __atomic_load_n(&jq->nThreads, __ATOMIC_RELAXED);
+	while (n < jq->maxThreads) {
+		if (__atomic_compare_exchange_n(&jq->nThreads, &n, n + 1, false,
+										__ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			pthread_t id;
+			int status = pthread_create(&id, &jq->attr, ringfun, (void *) jq);
+			if (status) {
+				fprintf(stderr, "%s:%d: pthread_create returned %d (%s)\n",
+						__func__, __LINE__, status, strerror(status));
+				exit(1);
+			}
+			break;
+		}
+	}
+}
+
+/// Worker for JOBQUEUE_RING; the counterpart of threadfun.
+void *ringfun(void *arg) {
+	JobQueue *jq = (JobQueue *) arg;
+	int (*jobfun) (void *, void *);
+	void *param;
+	void *threadState = NULL;
+	int slot = __atomic_fetch_add(&jq->launched, 1, __ATOMIC_ACQ_REL);
+	WorkerTimes *me = jq->times + slot;
+
+	if (jq->pin)
+		Placement_pin(slot);
+	if (trace_on)
+		Trace_nameThread("worker", slot);
+	if (counters_on)
+		Counters_attachThread();
+	if (jq->ThreadState_new != NULL) {
+		threadState = jq->ThreadState_new(jq->threadData);
+		CHECKMEM(threadState);
+	}
+
+	for (;;) {
+		bool got = ring_pop(jq, &jobfun, &param);
+		for (int k = 0; !got && k < jq->spin; k++) {
+			CPU_RELAX();
+			got = ring_pop(jq, &jobfun, &param);
+		}
+
+		if (!got) {
+			// announce ourselves, look once more, then sleep
+			int key = __atomic_load_n(&jq->workSeq, __ATOMIC_SEQ_CST);
+			__atomic_add_fetch(&jq->sleepers, 1, __ATOMIC_SEQ_CST);
+			__atomic_store_n(&jq->wakePending, 0, __ATOMIC_SEQ_CST);
+			got = ring_pop(jq, &jobfun, &param);
+			if (!got) {
+				if (!__atomic_load_n(&jq->acceptingJobs, __ATOMIC_SEQ_CST)) {
+					__atomic_sub_fetch(&jq->sleepers, 1, __ATOMIC_SEQ_CST);
+					__atomic_store_n(&jq->wakePending, 0, __ATOMIC_SEQ_CST);
+					break;
+				}
+				double since = monotonic();
+				bool yes = true, no = false;
+				__atomic_store(&me->idleSince, &since, __ATOMIC_RELAXED);
+				__atomic_store(&me->waiting, &yes, __ATOMIC_RELAXED);
+				TRACE_BEGIN(TRACE_IDLE);
+				futex_wait(&jq->workSeq, key);
+				TRACE_END(TRACE_IDLE, 0);
+				double idle = me->idle + (monotonic() - since);
+				__atomic_store(&me->idle, &idle, __ATOMIC_RELAXED);
+				__atomic_store(&me->waiting, &no, __ATOMIC_RELAXED);
+			}
+			__atomic_sub_fetch(&jq->sleepers, 1, __ATOMIC_SEQ_CST);
+			__atomic_store_n(&jq->wakePending, 0, __ATOMIC_SEQ_CST);
+			if (!got)
+				continue;
+		}
+
+		// pass the wakeup along if there is more work than ours
+		if (__atomic_load_n(&jq->enqPos, __ATOMIC_RELAXED)
+			!= __atomic_load_n(&jq->deqPos, __ATOMIC_RELAXED))
+			ring_wakeOne(jq);
+
+		TRACE_BEGIN(TRACE_JOB);
+		double t = monotonic();
+		jobfun(param, threadState);
+		double busy = me->busy + (monotonic() - t);
+		TRACE_END(TRACE_JOB, 0);
+		__atomic_store(&me->busy, &busy, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&me->jobs, 1, __ATOMIC_RELAXED);
+
+		if (__atomic_sub_fetch(&jq->pending, 1, __ATOMIC_SEQ_CST) == 0
+			&& __atomic_load_n(&jq->mainWaiting, __ATOMIC_SEQ_CST) > 0) {
+			__atomic_add_fetch(&jq->doneSeq, 1, __ATOMIC_SEQ_CST);
+			futex_wake(&jq->doneSeq, INT_MAX);
+		}
+	}
+
+	if (threadState)
+		jq->ThreadState_free(threadState);
+	Counters_detachThread();
+
+	// last touch of jq: JobQueue_free may return as soon as this lands
+	if (__atomic_sub_fetch(&jq->nThreads, 1, __ATOMIC_SEQ_CST) == 0)
+		futex_wake(&jq->nThreads, INT_MAX);
+	return NULL;
+}
+
+static void ring_noMoreJobs(JobQueue * jq) {
+	__atomic_store_n(&jq->acceptingJobs, false, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&jq->workSeq, 1, __ATOMIC_SEQ_CST);
+	futex_wake(&jq->workSeq, INT_MAX);
+}
+
+/// Wait until every job added so far has finished.
+static void ring_waitOnJobs(JobQueue * jq) {
+	for (;;) {
+		int key = __atomic_load_n(&jq->doneSeq, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&jq->pending, __ATOMIC_SEQ_CST) == 0)
+			return;
+		__atomic_add_fetch(&jq->mainWaiting, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&jq->pending, __ATOMIC_SEQ_CST) != 0)
+			futex_wait(&jq->doneSeq, key);
+		__atomic_sub_fetch(&jq->mainWaiting, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+/// After ring_noMoreJobs, wait for every worker to exit.
+static void ring_waitOnExit(JobQueue * jq) {
+	int n;
+	while ((n = __atomic_load_n(&jq->nThreads, __ATOMIC_SEQ_CST)) != 0)
+		futex_wait(&jq->nThreads, n);
+}
+
+#endif
+
 /**
  * An almost platform-independent function that returns the number of
  * CPU cores on the current machine.
@@ -12,13 +12,23 @@
 
 typedef struct JobQueue JobQueue;
 
+/// Kinds of JobQueue; see jobqueue.c
+enum { JOBQUEUE_MUTEX, JOBQUEUE_RING };
+
 JobQueue   *JobQueue_new(int nthreads, void *threadData,
 						 void *(*ThreadState_new) (void *),
 						 void (*ThreadState_free) (void *));
+JobQueue   *JobQueue_newKind(int kind, int nthreads, void *threadData,
+							 void *(*ThreadState_new) (void *),
+							 void (*ThreadState_free) (void *));
+int         JobQueue_kind(const JobQueue * jq);
+void        JobQueue_pinWorkers(JobQueue * jq, int on);
 void        JobQueue_addJob(JobQueue * jq,
 							int (*jobfun) (void *, void *), void *param);
 void        JobQueue_noMoreJobs(JobQueue * jq);
 void        JobQueue_waitOnJobs(JobQueue * jq);
 void        JobQueue_free(JobQueue * jq);
+int         JobQueue_workerTimes(JobQueue * jq, double *busy,
+								 double *idle, long *jobs, int n);
 int			getNumCores(void);
 #endif
@@ -0,0 +1,228 @@
+/**
+@file kernels.c
+@page kernels
+@author Daniel R. Tabin
+@brief Inner loops compiled for several instruction sets
+
+One binary runs on machines with AVX-512, machines with only AVX2,
+and older ones, so it cannot be built with -march for any of them.
+Instead each loop here, and get_fitness_batch in fitfunc.c, is marked
+KERNEL_CLONES: GCC compiles it once for AVX-512, once for AVX2 and
+once for the default target, and an ifunc resolver picks one when
+the program is loaded.  Kernel_report (--cpu-dispatch) prints the
+choice.
+
+Every variant gives the same result bit for bit, so a seeded run
+prints the same output on every machine.  The counting kernels are
+exact in any order.  Kernel_sum adds in eight interleaved lanes in a
+fixed order, which every variant follows whatever its vector width;
+with fixed point alleles the lanes are int64_t and the sum is exact.
+Kernel_weightedSums uses the same eight double lanes for each of its
+dot products; release builds are compiled with -ffp-contract=off, so
+no variant fuses the multiply and add where another does not.
+
+Kernel_hash mixes eight interleaved lanes of 64-bit words the same
+way, so identical rows hash alike on every machine.
+
+Copying crossover segments is left to memcpy, which glibc already
+picks per cpu in the same way.
+*/
+
+#include "kernels.h"
+#include <string.h>
+
+#define SUM_LANES 8
+#define HASH_LANES 8
+#define HASH_MUL 0x9e3779b97f4a7c15ULL
+
+#ifdef ALLELE_FIXED
+typedef int64_t lane_t;
+#else
+typedef double lane_t;
+#endif
+
+/**
+ * x[0] + ... + x[n-1] as a double.  Element i goes to lane i % SUM_LANES
+ * and the lanes are added pairwise at the end, so the result does not
+ * depend on which variant runs.
+ */
+KERNEL_CLONES
+double Kernel_sum(const allele_t* x, int n) {
+	lane_t lane[SUM_LANES] = {0};
+	int i = 0;
+
+	for (; i + SUM_LANES <= n; i += SUM_LANES) {
+		for (int k = 0; k < SUM_LANES; k++) {
+			lane[k] += x[i + k];
+		}
+	}
+	for (int k = 0; i + k < n; k++) {
+		lane[k] += x[i + k];
+	}
+	return ALLELE_TO(((lane[0] + lane[4]) + (lane[1] + lane[5]))
+					 + ((lane[2] + lane[6]) + (lane[3] + lane[7])));
+}
+
+/**
+ * out[i*k + t] = w[t*len] x[i*len] + ... + w[t*len + len-1] x[i*len + len-1]
+ * for i < rows and t < k: the k weighted sums of each of rows rows of
+ * len alleles, added in SUM_LANES lanes as in Kernel_sum.
+ */
+KERNEL_CLONES
+void Kernel_weightedSums(const allele_t* x, int rows, int len, const double* w, int k,
+						 double* out) {
+	for (int i = 0; i < rows; i++) {
+		const allele_t* row = x + (size_t) i * len;
+
+		for (int t = 0; t < k; t++) {
+			const double* wt = w + (size_t) t * len;
+			double lane[SUM_LANES] = {0};
+			int j = 0;
+
+			for (; j + SUM_LANES <= len; j += SUM_LANES) {
+				for (int l = 0; l < SUM_LANES; l++) {
+					lane[l] += wt[j + l] * (double) row[j + l];
+				}
+			}
+			for (int l = 0; j + l < len; l++) {
+				lane[l] += wt[j + l] * (double) row[j + l];
+			}
+			out[(size_t) i * k + t] = ALLELE_TO(((lane[0] + lane[4]) + (lane[1] + lane[5]))
+												+ ((lane[2] + lane[6]) + (lane[3] + lane[7])));
+		}
+	}
+}
+
+/// Number of k < n with a[k] != b[k].
+KERNEL_CLONES
+int Kernel_countDiffs(const int* a, const int* b, int n) {
+	int count = 0;
+
+	for (int k = 0; k < n; k++) {
+		count += (a[k] != b[k]);
+	}
+	return count;
+}
+
+/// Number of k < n with a[k] != b[k].
+KERNEL_CLONES
+int Kernel_countDiffsAlleles(const allele_t* a, const allele_t* b, int n) {
+	int count = 0;
+
+	for (int k = 0; k < n; k++) {
+		count += (a[k] != b[k]);
+	}
+	return count;
+}
+
+/// Number of k < n with a[k] == value.
+KERNEL_CLONES
+int Kernel_countEqual(const int* a, int n, int value) {
+	int count = 0;
+
+	for (int k = 0; k < n; k++) {
+		count += (a[k] == value);
+	}
+	return count;
+}
+
+/// Number of k < n with a[k] == value.
+KERNEL_CLONES
+int Kernel_countEqualAlleles(const allele_t* a, int n, allele_t value) {
+	int count = 0;
+
+	for (int k = 0; k < n; k++) {
+		count += (a[k] == value);
+	}
+	return count;
+}
+
+/**
+ * A 64-bit hash of the bytes at p.  Equal bytes give equal hashes; a
+ * match still has to be confirmed with memcmp.  Word i goes to lane
+ * i % HASH_LANES, so the lanes multiply independently.
+ */
+KERNEL_CLONES
+uint64_t Kernel_hash(const void* p, size_t bytes) {
+	const unsigned char* b = (const unsigned char*) p;
+	size_t n = bytes / 8;
+	uint64_t lane[HASH_LANES];
+	uint64_t w;
+	size_t i = 0;
+
+	for (int k = 0; k < HASH_LANES; k++) {
+		lane[k] = k + 1;
+	}
+	for (; i + HASH_LANES <= n; i += HASH_LANES) {
+		for (int k = 0; k < HASH_LANES; k++) {
+			memcpy(&w, b + 8 * (i + k), 8);
+			lane[k] = (lane[k] ^ w) * HASH_MUL;
+		}
+	}
+	for (int k = 0; i + k < n; k++) {
+		memcpy(&w, b + 8 * (i + k), 8);
+		lane[k] = (lane[k] ^ w) * HASH_MUL;
+	}
+	w = 0;
+	memcpy(&w, b + 8 * n, bytes % 8);
+
+	uint64_t h = (bytes ^ w) * HASH_MUL;
+	for (int k = 0; k < HASH_LANES; k++) {
+		h = (h ^ lane[k]) * HASH_MUL;
+		h ^= h >> 29;
+	}
+	h ^= h >> 32;
+	h *= HASH_MUL;
+	h ^= h >> 29;
+	return h;
+}
+
+/**
+ * The variant of every KERNEL_CLONES function that runs on this cpu:
+ * "avx512f", "avx2" or "default".  This is the order GCC's resolver
+ * tries them in.
+ */
+const char* Kernel_target(void) {
+#ifdef KERNEL_HAVE_CLONES
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return "avx512f";
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return "avx2";
+	}
+#endif
+	return "default";
+}
+
+/// Print which variant each kernel runs, as for --cpu-dispatch.
+void Kernel_report(FILE* out) {
+	const char* kernels[] = {
+		"Kernel_sum", "hat size of a child",
+		"Kernel_weightedSums", "traits (float and fixed alleles)",
+		"Kernel_countDiffs", "diversity (devosim)",
+		"Kernel_countDiffsAlleles", "diversity (genancesim)",
+		"Kernel_countEqual", "percent descent (devosim)",
+		"Kernel_countEqualAlleles", "percent descent (genancesim)",
+		"Kernel_hash", "identical ancestries (devosim -b)",
+		"get_fitness_batch", "fitness of a generation",
+		"get_fitness_traits", "fitness of a generation's traits"
+	};
+	const char* target = Kernel_target();
+
+	fprintf(out, "CPU DISPATCH\n");
+	fprintf(out, "alleles are %s, %zu bytes each\n", ALLELE_NAME, sizeof(allele_t));
+#ifdef KERNEL_HAVE_CLONES
+	__builtin_cpu_init();
+	fprintf(out, "cpu has avx512f: %s, avx2: %s\n",
+			(__builtin_cpu_supports("avx512f") ? "yes" : "no"),
+			(__builtin_cpu_supports("avx2") ? "yes" : "no"));
+#else
+	fprintf(out, "built without runtime dispatch; every kernel is the default\n");
+#endif
+	fprintf(out, "%-24s %-10s %s\n", "kernel", "variant", "used for");
+	for (int k = 0; k < 18; k += 2) {
+		fprintf(out, "%-24s %-10s %s\n", kernels[k], target, kernels[k+1]);
+	}
+	fprintf(out, "%-24s %-10s %s\n", "memcpy", "glibc", "crossover copying");
+}
@@ -0,0 +1,37 @@
+/**
+ * @file kernels.h
+ * @author Daniel R. Tabin
+ * @brief Header for kernels.c
+ */
+
+#ifndef KERNELS
+#define KERNELS
+
+#include "allele.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A function marked KERNEL_CLONES is compiled once per instruction set
+// below, and the dynamic loader picks the best one the cpu has when the
+// program starts.  Elsewhere it is compiled once, for the default.
+#if defined(__x86_64__) && defined(__linux__) && !defined(__clang__) \
+	&& defined(__GNUC__) && __GNUC__ >= 6
+	#define KERNEL_HAVE_CLONES
+	#define KERNEL_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+	#define KERNEL_CLONES
+#endif
+
+double		Kernel_sum(const allele_t* x, int n);
+void		Kernel_weightedSums(const allele_t* x, int rows, int len, const double* w, int k,
+								double* out);
+int			Kernel_countDiffs(const int* a, const int* b, int n);
+int			Kernel_countDiffsAlleles(const allele_t* a, const allele_t* b, int n);
+int			Kernel_countEqual(const int* a, int n, int value);
+int			Kernel_countEqualAlleles(const allele_t* a, int n, allele_t value);
+uint64_t	Kernel_hash(const void* p, size_t bytes);
+const char*	Kernel_target(void);
+void		Kernel_report(FILE* out);
+
+#endif
@@ -0,0 +1,90 @@
+/**
+@file mapped.c
+@page mapped
+@author Daniel R. Tabin
+@brief Population buffers backed by files, for runs larger than memory
+
+A million degnomes of ten thousand loci take 80 GB of alleles per
+generation, and devosim keeps two generations and their ancestries.
+With --mmap dir each of those buffers is a file in dir mapped into
+memory, so the kernel pages them in and out as the run goes and the
+population may be as large as the disk.  The files are unlinked as
+soon as they are made, so nothing is left behind however the run
+ends.
+
+Out of core, speed depends on the order pages are touched in.  The
+mappings are advised sequential, so the kernel reads ahead and drops
+pages behind, and children are mated in order of their rows: devosim
+switches to the block schedule, which gives each worker one
+contiguous run of children, and polygensim and genancesim hand out
+children in order already.  Parents are read a row at a time in
+whatever order selection picks them.
+
+Off Linux, buffers come from malloc and dir is ignored.
+*/
+
+#define _GNU_SOURCE
+#include "mapped.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef __linux__
+	#include <unistd.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+#endif
+
+/**
+ * Allocate size bytes backed by a new file in dir.  Free it with
+ * Mapped_free and the same size.  The memory is zeroed.  Prints why
+ * and returns NULL on failure.
+ */
+void* Mapped_alloc(size_t size, const char* dir) {
+#ifdef __linux__
+	size_t len = (size > 0 ? size : 1);
+	size_t pathlen = strlen(dir) + sizeof("/devosim-XXXXXX");
+	char* path = malloc(pathlen);
+
+	if (path == NULL) {
+		return NULL;
+	}
+	snprintf(path, pathlen, "%s/devosim-XXXXXX", dir);
+	int fd = mkostemp(path, O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "%s:%d: can't make a file in \"%s\": %s\n",
+				__FILE__, __LINE__, dir, strerror(errno));
+		free(path);
+		return NULL;
+	}
+	unlink(path);
+	free(path);
+
+	void* p = MAP_FAILED;
+	if (ftruncate(fd, (off_t) len) == 0) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "%s:%d: can't map %zu bytes in \"%s\": %s\n",
+				__FILE__, __LINE__, len, dir, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	madvise(p, len, MADV_SEQUENTIAL);
+	return p;
+#else
+	return calloc(1, size);
+#endif
+}
+
+/// Free a buffer from Mapped_alloc(size, dir).  Its file goes with it.
+void Mapped_free(void* p, size_t size) {
+#ifdef __linux__
+	if (p != NULL) {
+		munmap(p, (size > 0 ? size : 1));
+	}
+#else
+	free(p);
+#endif
+}
@@ -0,0 +1,15 @@
+/**
+ * @file mapped.h
+ * @author Daniel R. Tabin
+ * @brief Header for mapped.c
+ */
+
+#ifndef MAPPED
+#define MAPPED
+
+#include <stddef.h>
+
+void*	Mapped_alloc(size_t size, const char* dir);
+void	Mapped_free(void* p, size_t size);
+
+#endif
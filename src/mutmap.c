@@ -0,0 +1,227 @@
+/**
+@file mutmap.c
+@page mutmap
+@author Daniel R. Tabin
+@brief Mutation maps: a mutation rate and effect size for every locus
+
+By default every child gets a Poisson number of mutations with mean
+-m, each at a uniformly chosen locus and with a normal effect of
+standard deviation -e.  A mutation map sets both per locus instead.
+A map file has one interval per line: the locus it starts at, the
+expected number of mutations per locus per child, and the standard
+deviation of their effects:
+
+	# a conserved region, then a mutable one of small effect
+	0 0.001 2
+	400 0
+	600 0.01 0.5
+
+Each interval runs to the start of the next, or the end of the
+chromosome.  A line without an effect keeps the one before it (or 1
+on the first line); loci before the first line do not mutate, and
+intervals starting past the end of the chromosome are dropped.
+
+A child's number of mutations is Poisson with mean the sum of the
+rates over every locus (MutationMap_rate), and each one picks its
+interval from a Walker alias table over the intervals, weighted by
+rate times length, and its locus uniformly within.  Both take
+constant time, so a child costs O(mutations) whatever the length of
+the chromosome or the number of intervals.
+*/
+
+#include "mutmap.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MUTMAP_MAX_LINE 256
+
+struct MutationMap {
+	int n;				// intervals that can mutate
+	int* start;			// first locus of each
+	int* len;			// loci in each
+	double* effect;		// standard deviation of each one's mutations
+	double* prob;		// alias table: keep interval k with chance prob[k],
+	int* alias;			// else take alias[k]
+	double rate;		// expected mutations per child
+};
+
+/**
+ * A map of n intervals, the k-th starting at locus starts[k] with
+ * rates[k] mutations per locus and effects of standard deviation
+ * effects[k], on a chromosome of chrom_size loci.  NULL if starts do
+ * not increase, a rate or effect is negative, or no locus can mutate.
+ */
+MutationMap* MutationMap_new(const int* starts, const double* rates, const double* effects,
+							 int n, int chrom_size) {
+	for (int k = 0; k < n; k++) {
+		if (!(rates[k] >= 0) || !isfinite(rates[k]) || !(effects[k] >= 0)
+			|| starts[k] < 0 || (k > 0 && starts[k] <= starts[k-1])) {
+			return NULL;
+		}
+	}
+
+	MutationMap* map = malloc(sizeof(MutationMap));
+	CHECKMEM(map);
+	map->start = malloc((n + 1)*sizeof(int));
+	map->len = malloc((n + 1)*sizeof(int));
+	map->effect = malloc((n + 1)*sizeof(double));
+	map->prob = malloc((n + 1)*sizeof(double));
+	map->alias = malloc((n + 1)*sizeof(int));
+	CHECKMEM(map->start && map->len && map->effect && map->prob && map->alias);
+
+	// only intervals on the chromosome with a rate above 0 are kept
+	int m = 0;
+	double rate = 0;
+	for (int k = 0; k < n && starts[k] < chrom_size; k++) {
+		int end = (k + 1 < n && starts[k+1] < chrom_size ? starts[k+1] : chrom_size);
+		if (rates[k] > 0) {
+			map->start[m] = starts[k];
+			map->len[m] = end - starts[k];
+			map->effect[m] = effects[k];
+			map->prob[m] = rates[k] * map->len[m];
+			rate += map->prob[m];
+			m++;
+		}
+	}
+	map->n = m;
+	map->rate = rate;
+	if (m == 0) {
+		MutationMap_free(map);
+		return NULL;
+	}
+
+	// Vose's method: scale the weights to mean 1, then pair each
+	// interval below 1 with one above to fill its column
+	int* small = malloc(m*sizeof(int));
+	int* large = malloc(m*sizeof(int));
+	CHECKMEM(small && large);
+	int ns = 0, nl = 0;
+	for (int k = 0; k < m; k++) {
+		map->prob[k] *= m / rate;
+		map->alias[k] = k;
+		if (map->prob[k] < 1) {
+			small[ns++] = k;
+		}
+		else {
+			large[nl++] = k;
+		}
+	}
+	while (ns > 0 && nl > 0) {
+		int s = small[--ns];
+		int l = large[nl - 1];
+
+		map->alias[s] = l;
+		map->prob[l] -= 1 - map->prob[s];
+		if (map->prob[l] < 1) {
+			nl--;
+			small[ns++] = l;
+		}
+	}
+	// what is left is 1 up to rounding
+	while (nl > 0) {
+		map->prob[large[--nl]] = 1;
+	}
+	while (ns > 0) {
+		map->prob[small[--ns]] = 1;
+	}
+	free(small);
+	free(large);
+
+	return map;
+}
+
+/**
+ * The map in the file at path, for a chromosome of chrom_size loci.
+ * Prints what is wrong with the file and exits if it cannot be used.
+ */
+MutationMap* MutationMap_load(const char* path, int chrom_size) {
+	FILE* in = fopen(path, "r");
+	if (in == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	int max = 64, n = 0;
+	int* starts = malloc(max*sizeof(int));
+	double* rates = malloc(max*sizeof(double));
+	double* effects = malloc(max*sizeof(double));
+	CHECKMEM(starts && rates && effects);
+	char line[MUTMAP_MAX_LINE];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		lineno++;
+		char* p = line + strspn(line, " \t\r\n");
+		if (*p == '\0' || *p == '#') {
+			continue;
+		}
+		if (n == max) {
+			max *= 2;
+			starts = realloc(starts, max*sizeof(int));
+			rates = realloc(rates, max*sizeof(double));
+			effects = realloc(effects, max*sizeof(double));
+			CHECKMEM(starts && rates && effects);
+		}
+		char extra;
+		int got = sscanf(p, "%d %lf %lf %c", starts + n, rates + n, effects + n, &extra);
+		if (got == 2) {
+			effects[n] = (n > 0 ? effects[n-1] : 1);
+		}
+		else if (got != 3) {
+			fprintf(stderr, "%s:%d: expected a locus, a rate and an effect\n", path, lineno);
+			exit(EXIT_FAILURE);
+		}
+		if (starts[n] < 0 || !(rates[n] >= 0) || !(effects[n] >= 0)
+			|| (n > 0 && starts[n] <= starts[n-1])) {
+			fprintf(stderr, "%s:%d: loci must increase and rates and effects must not be negative\n",
+					path, lineno);
+			exit(EXIT_FAILURE);
+		}
+		n++;
+	}
+	fclose(in);
+
+	MutationMap* map = MutationMap_new(starts, rates, effects, n, chrom_size);
+	if (map == NULL) {
+		fprintf(stderr, "%s: no locus of a %d locus chromosome can mutate\n",
+				path, chrom_size);
+		exit(EXIT_FAILURE);
+	}
+	free(starts);
+	free(rates);
+	free(effects);
+
+	return map;
+}
+
+/// Expected number of mutations per child: the sum of every locus's rate.
+double MutationMap_rate(const MutationMap* map) {
+	return map->rate;
+}
+
+/// Pick the locus of one mutation, and set *effect to its standard deviation.
+int MutationMap_locus(const MutationMap* map, gsl_rng* rng, double* effect) {
+	double u = gsl_rng_uniform(rng) * map->n;
+	int k = (int) u;
+
+	if (k >= map->n) {
+		k = map->n - 1;
+	}
+	if (u - k >= map->prob[k]) {
+		k = map->alias[k];
+	}
+	*effect = map->effect[k];
+	return map->start[k] + (int) gsl_rng_uniform_int(rng, map->len[k]);
+}
+
+void MutationMap_free(MutationMap* map) {
+	free(map->start);
+	free(map->len);
+	free(map->effect);
+	free(map->prob);
+	free(map->alias);
+	free(map);
+}
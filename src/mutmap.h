@@ -0,0 +1,21 @@
+/**
+ * @file mutmap.h
+ * @author Daniel R. Tabin
+ * @brief Header for mutmap.c
+ */
+
+#ifndef MUTMAP
+#define MUTMAP
+
+#include <gsl/gsl_rng.h>
+
+typedef struct MutationMap MutationMap;
+
+MutationMap*	MutationMap_new(const int* starts, const double* rates, const double* effects,
+								int n, int chrom_size);
+MutationMap*	MutationMap_load(const char* path, int chrom_size);
+double			MutationMap_rate(const MutationMap* map);
+int				MutationMap_locus(const MutationMap* map, gsl_rng* rng, double* effect);
+void			MutationMap_free(MutationMap* map);
+
+#endif
@@ -0,0 +1,231 @@
+/**
+@file outbuf.c
+@page outbuf
+@author Daniel R. Tabin
+@brief Buffered text output for allele and ancestry tables
+
+Printing a population one printf("%lf\t") at a time spends most of
+its time inside stdio's locale-aware formatter.  An OutBuf collects
+text in a large private buffer and hands it to the stream with a
+single fwrite once the buffer fills.  Doubles are formatted by
+format_lf, which produces exactly what printf("%lf") would (six
+decimals, rounded half to even on the exact binary value) using
+integer arithmetic instead of stdio.  Values too large for the
+integer path are passed on to snprintf.
+
+Anything printed straight to the stream must come after an
+OutBuf_flush, or it will show up ahead of text still in the buffer.
+*/
+
+#include "outbuf.h"
+#include "checkmem.h"
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define OUTBUF_MIN_SIZE 4096
+
+struct OutBuf {
+	FILE* stream;
+	char* buf;
+	size_t size;		// capacity of buf
+	size_t used;		// bytes waiting to be written
+};
+
+static inline void reserve(OutBuf* ob, size_t n);
+
+static inline void reserve(OutBuf* ob, size_t n) {
+	if (ob->used + n > ob->size) {
+		OutBuf_flush(ob);
+	}
+}
+
+OutBuf* OutBuf_new(FILE* stream, size_t size) {
+	if (size < OUTBUF_MIN_SIZE) {
+		size = OUTBUF_MIN_SIZE;
+	}
+
+	OutBuf* ob = malloc(sizeof(OutBuf));
+	CHECKMEM(ob);
+	ob->buf = malloc(size);
+	CHECKMEM(ob->buf);
+	ob->stream = stream;
+	ob->size = size;
+	ob->used = 0;
+
+	return ob;
+}
+
+/// Write the decimal digits of x to dest; return the number written.
+size_t format_uint(char* dest, unsigned long x) {
+	char tmp[24];
+	size_t n = 0;
+
+	do {
+		tmp[n++] = (char) ('0' + x % 10);
+		x /= 10;
+	} while (x > 0);
+
+	for (size_t i = 0; i < n; i++) {
+		dest[i] = tmp[n - 1 - i];
+	}
+	return n;
+}
+
+/**
+ * Write x to dest exactly as printf("%lf") would and return the
+ * length.  No terminating null is written.  dest must have room for
+ * LF_MAX_LEN characters.
+ *
+ * For |x| < 2^53 the integer part is exact in a uint64_t.  The
+ * fraction is m * 2^-k for an integer m < 2^53, so fraction * 10^6
+ * is (m * 10^6) >> k with a remainder that decides the rounding,
+ * all of which fits in 128 bits.
+ */
+size_t format_lf(char* dest, double x) {
+	double ax = fabs(x);
+
+	if (!(ax < 9007199254740992.0)) {		// 2^53, inf or nan
+		char tmp[LF_MAX_LEN + 1];
+		int len = snprintf(tmp, sizeof(tmp), "%lf", x);
+		memcpy(dest, tmp, len);
+		return len;
+	}
+
+	size_t n = 0;
+	if (signbit(x)) {
+		dest[n++] = '-';
+	}
+
+	double ip = floor(ax);
+	double f = ax - ip;					// exact
+	uint64_t whole = (uint64_t) ip;
+	uint64_t frac = 0;
+
+	if (f > 0) {
+		int ex;
+		double fr = frexp(f, &ex);		// f = fr * 2^ex, fr in [0.5, 1)
+		uint64_t m = (uint64_t) ldexp(fr, 53);
+		int k = 53 - ex;
+
+		// m * 10^6 < 2^73, so past 74 bits of shift it rounds to 0
+		if (k < 75) {
+			unsigned __int128 prod = (unsigned __int128) m * 1000000u;
+			unsigned __int128 rem = prod & ((((unsigned __int128) 1) << k) - 1);
+			unsigned __int128 half = ((unsigned __int128) 1) << (k - 1);
+
+			frac = (uint64_t) (prod >> k);
+			if (rem > half || (rem == half && (frac & 1))) {
+				frac++;
+			}
+			if (frac == 1000000) {
+				frac = 0;
+				whole++;
+			}
+		}
+	}
+
+	n += format_uint(dest + n, whole);
+	dest[n++] = '.';
+	for (int i = 5; i >= 0; i--) {
+		dest[n + i] = (char) ('0' + frac % 10);
+		frac /= 10;
+	}
+	return n + 6;
+}
+
+void OutBuf_putc(OutBuf* ob, char c) {
+	reserve(ob, 1);
+	ob->buf[ob->used++] = c;
+}
+
+void OutBuf_puts(OutBuf* ob, const char* s) {
+	size_t len = strlen(s);
+
+	if (len > ob->size) {
+		OutBuf_flush(ob);
+		fwrite(s, 1, len, ob->stream);
+		return;
+	}
+	reserve(ob, len);
+	memcpy(ob->buf + ob->used, s, len);
+	ob->used += len;
+}
+
+void OutBuf_putDouble(OutBuf* ob, double x) {
+	reserve(ob, LF_MAX_LEN);
+	ob->used += format_lf(ob->buf + ob->used, x);
+}
+
+void OutBuf_putUint(OutBuf* ob, unsigned long x) {
+	reserve(ob, 24);
+	ob->used += format_uint(ob->buf + ob->used, x);
+}
+
+/// Same output as printf("%lf\t") for each element of array.
+void OutBuf_putDoubleRow(OutBuf* ob, const double* array, int n) {
+	for (int i = 0; i < n; i++) {
+		reserve(ob, LF_MAX_LEN + 1);
+		ob->used += format_lf(ob->buf + ob->used, array[i]);
+		ob->buf[ob->used++] = '\t';
+	}
+}
+
+/// Same output as OutBuf_putDoubleRow of the values of array.
+void OutBuf_putAlleleRow(OutBuf* ob, const allele_t* array, int n) {
+	for (int i = 0; i < n; i++) {
+		reserve(ob, LF_MAX_LEN + 1);
+		ob->used += format_lf(ob->buf + ob->used, ALLELE_TO(array[i]));
+		ob->buf[ob->used++] = '\t';
+	}
+}
+
+/// Same output as printf("%u\t") for each element of array.
+void OutBuf_putUintRow(OutBuf* ob, const int* array, int n) {
+	for (int i = 0; i < n; i++) {
+		reserve(ob, 24);
+		ob->used += format_uint(ob->buf + ob->used, (unsigned) array[i]);
+		ob->buf[ob->used++] = '\t';
+	}
+}
+
+void OutBuf_printf(OutBuf* ob, const char* fmt, ...) {
+	va_list ap;
+	size_t avail = ob->size - ob->used;
+
+	va_start(ap, fmt);
+	int len = vsnprintf(ob->buf + ob->used, avail, fmt, ap);
+	va_end(ap);
+
+	if (len < 0 || (size_t) len < avail) {
+		ob->used += (len > 0 ? len : 0);
+		return;
+	}
+
+	// didn't fit: make room and try again, or bypass the buffer
+	OutBuf_flush(ob);
+	va_start(ap, fmt);
+	if ((size_t) len < ob->size) {
+		ob->used += vsnprintf(ob->buf, ob->size, fmt, ap);
+	}
+	else {
+		vfprintf(ob->stream, fmt, ap);
+	}
+	va_end(ap);
+}
+
+void OutBuf_flush(OutBuf* ob) {
+	if (ob->used > 0) {
+		fwrite(ob->buf, 1, ob->used, ob->stream);
+		ob->used = 0;
+	}
+}
+
+void OutBuf_free(OutBuf* ob) {
+	OutBuf_flush(ob);
+	fflush(ob->stream);
+	free(ob->buf);
+	free(ob);
+}
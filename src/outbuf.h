@@ -0,0 +1,35 @@
+/**
+ * @file outbuf.h
+ * @author Daniel R. Tabin
+ * @brief Header for outbuf.c
+ */
+
+#ifndef OUTBUF
+#define OUTBUF
+
+#include "allele.h"
+#include <stdio.h>
+#include <stddef.h>
+
+// longest string format_lf can produce ("%lf" of -DBL_MAX)
+#define LF_MAX_LEN 320
+
+typedef struct OutBuf OutBuf;
+
+OutBuf* OutBuf_new(FILE* stream, size_t size);
+void OutBuf_putc(OutBuf* ob, char c);
+void OutBuf_puts(OutBuf* ob, const char* s);
+void OutBuf_putDouble(OutBuf* ob, double x);
+void OutBuf_putUint(OutBuf* ob, unsigned long x);
+void OutBuf_putDoubleRow(OutBuf* ob, const double* array, int n);
+void OutBuf_putAlleleRow(OutBuf* ob, const allele_t* array, int n);
+void OutBuf_putUintRow(OutBuf* ob, const int* array, int n);
+void OutBuf_printf(OutBuf* ob, const char* fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void OutBuf_flush(OutBuf* ob);
+void OutBuf_free(OutBuf* ob);
+
+size_t format_lf(char* dest, double x);
+size_t format_uint(char* dest, unsigned long x);
+
+#endif
@@ -0,0 +1,287 @@
+/**
+@file placement.c
+@page placement
+@author Daniel R. Tabin
+@brief Pins threads to cores and places buffers on NUMA nodes
+
+On a machine with more than one socket each socket has its own
+memory, and a core reads the memory of another socket at a fraction
+of the bandwidth of its own.  Linux puts a page on the node of the
+thread that first writes it and lets threads migrate between cores,
+so by default a population written by the main thread lives on one
+node and JobQueue workers read it from wherever they happen to be.
+
+Placement_pin binds the calling thread to one core.  Slots are dealt
+round robin over the nodes, so workers 0, 1, 2, ... land on nodes
+0, 1, 0, 1, ... of a two-socket machine and each socket gets its share
+of the threads.  Only cores in the process's affinity mask are used,
+so runs started under taskset or numactl stay where they were put.
+
+Placement_alloc maps a buffer whose pages are placed by policy rather
+than by first touch: PLACE_INTERLEAVE spreads them page by page over
+every node, and PLACE_PARTITION gives each node one contiguous block,
+so that a degnome's row is almost never split between nodes.  Both
+spread the bandwidth of a generation over all memory controllers
+instead of one.
+
+The topology comes from /sys/devices/system/node and policies are set
+with the mbind system call, so libnuma is not needed.  On a machine
+with one node, or off Linux, buffers come from malloc and pinning is
+all that is done.
+*/
+
+#define _GNU_SOURCE
+#include "placement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __linux__
+	#include <sched.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <linux/mempolicy.h>
+#endif
+
+#define MAX_NODES 64
+#define LONG_BITS (8 * sizeof(unsigned long))
+
+#ifdef __linux__
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static int num_nodes = 1;
+static int node_ids[MAX_NODES];				// nodes that have cpus
+static unsigned long node_mask[MAX_NODES / LONG_BITS + 1];
+static signed char cpu_node[CPU_SETSIZE];	// index into node_ids
+
+typedef struct CpuKey CpuKey;
+struct CpuKey {
+	int cpu;
+	int key;			// rank within its node, then node
+};
+
+static void read_topology(void);
+static void parse_cpulist(const char* s, int node);
+static int cmp_key(const void* a, const void* b);
+static size_t page_round(size_t size);
+
+/// Mark every cpu in a list such as "0-7,16-23" as on node.
+static void parse_cpulist(const char* s, int node) {
+	while (*s != '\0' && *s != '\n') {
+		char* end;
+		long lo = strtol(s, &end, 10);
+		long hi = lo;
+		if (end == s) {
+			return;
+		}
+		if (*end == '-') {
+			s = end + 1;
+			hi = strtol(s, &end, 10);
+		}
+		for (long c = lo; c <= hi && c < CPU_SETSIZE; c++) {
+			if (c >= 0) {
+				cpu_node[c] = (signed char) node;
+			}
+		}
+		s = (*end == ',' ? end + 1 : end);
+	}
+}
+
+static void read_topology(void) {
+	char path[64], line[4096];
+
+	memset(cpu_node, 0, sizeof(cpu_node));
+	num_nodes = 0;
+	for (int n = 0; n < MAX_NODES; n++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+		FILE* f = fopen(path, "r");
+		if (f == NULL) {
+			continue;
+		}
+		if (fgets(line, sizeof(line), f) != NULL && line[0] != '\n') {
+			parse_cpulist(line, num_nodes);
+			node_ids[num_nodes++] = n;
+			node_mask[n / LONG_BITS] |= 1UL << (n % LONG_BITS);
+		}
+		fclose(f);
+	}
+	if (num_nodes == 0) {
+		num_nodes = 1;
+		node_ids[0] = 0;
+		node_mask[0] = 1;
+	}
+}
+
+static int cmp_key(const void* a, const void* b) {
+	return ((const CpuKey*) a)->key - ((const CpuKey*) b)->key;
+}
+
+static size_t page_round(size_t size) {
+	size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	return (size + page - 1) / page * page;
+}
+#endif
+
+/// Number of NUMA nodes with cpus; 1 if unknown.
+int Placement_nodes(void) {
+#ifdef __linux__
+	pthread_once(&topology_once, read_topology);
+	return num_nodes;
+#else
+	return 1;
+#endif
+}
+
+/// Node of cpu, as an index from 0 to Placement_nodes() - 1.
+int Placement_nodeOf(int cpu) {
+#ifdef __linux__
+	pthread_once(&topology_once, read_topology);
+	return (cpu >= 0 && cpu < CPU_SETSIZE ? cpu_node[cpu] : 0);
+#else
+	return 0;
+#endif
+}
+
+/**
+ * The cpu for the slot-th pinned thread: the allowed cpus dealt round
+ * robin over the nodes, wrapping when there are more slots than cpus.
+ * Returns -1 if the affinity mask cannot be read.
+ */
+int Placement_cpu(int slot) {
+#ifdef __linux__
+	cpu_set_t allowed;
+	int rank[MAX_NODES] = {0};
+	CpuKey* keys;
+	int n = 0;
+
+	pthread_once(&topology_once, read_topology);
+	if (slot < 0 || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		return -1;
+	}
+	keys = malloc(CPU_SETSIZE * sizeof(CpuKey));
+	if (keys == NULL) {
+		return -1;
+	}
+	for (int c = 0; c < CPU_SETSIZE; c++) {
+		if (CPU_ISSET(c, &allowed)) {
+			keys[n].cpu = c;
+			keys[n].key = rank[(int) cpu_node[c]]++ * MAX_NODES + cpu_node[c];
+			n++;
+		}
+	}
+	int cpu = -1;
+	if (n > 0) {
+		qsort(keys, n, sizeof(CpuKey), cmp_key);
+		cpu = keys[slot % n].cpu;
+	}
+	free(keys);
+	return cpu;
+#else
+	return -1;
+#endif
+}
+
+/// Pin the calling thread to Placement_cpu(slot); returns the cpu or -1.
+int Placement_pin(int slot) {
+	return Placement_pinCpu(Placement_cpu(slot));
+}
+
+/// Pin the calling thread to cpu; returns cpu or -1.
+int Placement_pinCpu(int cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+
+	if (cpu < 0 || cpu >= CPU_SETSIZE) {
+		return -1;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? cpu : -1);
+#else
+	return -1;
+#endif
+}
+
+/**
+ * Allocate size bytes with pages placed by policy, one of the PLACE_*
+ * values.  Free it with Placement_free and the same size and policy.
+ * Placement is a hint: if the kernel refuses a policy the buffer is
+ * still usable.  The memory is zeroed unless it came from malloc.
+ * NULL on failure.
+ */
+void* Placement_alloc(size_t size, int policy) {
+#ifdef __linux__
+	if (policy == PLACE_DEFAULT || Placement_nodes() < 2) {
+		return malloc(size);
+	}
+	size_t len = page_round(size);
+	void* p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	if (policy == PLACE_INTERLEAVE) {
+		syscall(SYS_mbind, p, len, MPOL_INTERLEAVE, node_mask, MAX_NODES + 1, 0);
+	}
+	else {
+		size_t page = (size_t) sysconf(_SC_PAGESIZE);
+		size_t pages = len / page;
+		for (int k = 0; k < num_nodes; k++) {
+			size_t begin = pages * k / num_nodes;
+			size_t end = pages * (k+1) / num_nodes;
+			if (end > begin) {
+				Placement_bind((char*) p + begin * page, (end - begin) * page, k);
+			}
+		}
+	}
+	return p;
+#else
+	return malloc(size);
+#endif
+}
+
+/**
+ * Ask for the pages of p, which must be page aligned, to be placed on
+ * node (an index as from Placement_nodeOf).  Pages already touched
+ * stay where they are.  Returns 0 on success.
+ */
+int Placement_bind(void* p, size_t size, int node) {
+#ifdef __linux__
+	unsigned long mask[MAX_NODES / LONG_BITS + 1] = {0};
+
+	if (node < 0 || node >= Placement_nodes()) {
+		return -1;
+	}
+	int id = node_ids[node];
+	mask[id / LONG_BITS] = 1UL << (id % LONG_BITS);
+	return (syscall(SYS_mbind, p, page_round(size), MPOL_PREFERRED,
+					mask, MAX_NODES + 1, 0) == 0 ? 0 : -1);
+#else
+	return -1;
+#endif
+}
+
+/// Free a buffer from Placement_alloc(size, policy).
+void Placement_free(void* p, size_t size, int policy) {
+#ifdef __linux__
+	if (p != NULL && policy != PLACE_DEFAULT && Placement_nodes() > 1) {
+		munmap(p, page_round(size));
+		return;
+	}
+#endif
+	free(p);
+}
+
+/// PLACE_* value for "none", "interleave" or "partition"; -1 otherwise.
+int Placement_parse(const char* name) {
+	if (strcmp(name, "none") == 0) {
+		return PLACE_DEFAULT;
+	}
+	if (strcmp(name, "interleave") == 0) {
+		return PLACE_INTERLEAVE;
+	}
+	if (strcmp(name, "partition") == 0) {
+		return PLACE_PARTITION;
+	}
+	return -1;
+}
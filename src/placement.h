@@ -0,0 +1,29 @@
+/**
+ * @file placement.h
+ * @author Daniel R. Tabin
+ * @brief Header for placement.c
+ */
+
+#ifndef PLACEMENT
+#define PLACEMENT
+
+#include <stddef.h>
+
+/// Where Placement_alloc puts the pages of a buffer.
+enum {
+	PLACE_DEFAULT,		// wherever the first thread to touch them runs
+	PLACE_INTERLEAVE,	// page by page, round robin over the nodes
+	PLACE_PARTITION		// one contiguous block per node
+};
+
+int		Placement_nodes(void);
+int		Placement_nodeOf(int cpu);
+int		Placement_cpu(int slot);
+int		Placement_pin(int slot);
+int		Placement_pinCpu(int cpu);
+void*	Placement_alloc(size_t size, int policy);
+int		Placement_bind(void* p, size_t size, int node);
+void	Placement_free(void* p, size_t size, int policy);
+int		Placement_parse(const char* name);
+
+#endif
@@ -1,7 +1,14 @@
 #include "jobqueue.h"
 #include "degnome.h"
 #include "fitfunc.h"
-#include "flagparse.c"
+#include "kernels.h"
+#include "mapped.h"
+#include "outbuf.h"
+#include "profile.h"
+#include "autothreads.h"
+#include "trace.h"
+#include "flagparse.h"
+#include "traits.h"
 #include <stdio.h>
 #include <string.h>
 #include <gsl/gsl_rng.h>
@@ -21,14 +28,18 @@ struct JobData {
 void usage(void);
 void help_menu(void);
 int jobfunc(void* p, void* tdat);
+void print_degnome(OutBuf* out, Degnome* d, allele_t* row, const double* traits);
 
 const char* usageMsg =
 	"Usage: polygensim [-h] [-c chromosome_length] [-e mutation_effect]\n"
 	"\t\t  [-g num_generations] [-m mutation_rate]\n"
 	"\t\t  [-o crossover_rate] [-p population_size]\n"
-	"\t\t  [-t num_threads] [--seed rngseed]\n"
-	"\t\t  [--target hat_height target]\n"
-	"\t\t  [--sqrt | --linear | --close | --ceiling | --log]\n";
+	"\t\t  [-t num_threads | auto] [--seed rngseed] [--pin]\n"
+	"\t\t  [--target hat_height target] [--trace file]\n"
+	"\t\t  [--sqrt | --linear | --close | --ceiling | --log]\n"
+	"\t\t  [--profile | --counters] [--cpu-dispatch]\n"
+	"\t\t  [--mmap dir | --chunk alleles] [--recomb map_file]\n"
+	"\t\t  [--mutation map_file] [--traits trait_file]\n";
 
 const char* helpMsg =
 	"OPTIONS\n"
@@ -51,9 +62,11 @@ const char* helpMsg =
 	"\t -p population_size\n"
 	"\t\t Set the population size for the current simulation.\n"
 	"\t\t Default population size is 10.\n"
-	"\t -t num_threads\n"
+	"\t -t num_threads | auto\n"
 	"\t\t Select the number of threads to be used in the current run.\n"
 	"\t\t Default is 0 (which will result in 3/4 of cores being used).\n"
+	"\t\t auto picks inline mating or a worker count each generation\n"
+	"\t\t from the measured cost of mating a child.\n"
 	"\t\t Must be 1 if a seed is used in order to prevent race conditions.\n\n"
 	"\t --seed rngseed\n"
 	"\t\t Select the seed used by the RNG in the current run.\n"
@@ -64,7 +77,49 @@ const char* helpMsg =
 	"\t --sqrt\t\t fitness will be sqrt(hat_height)\n\n"
 	"\t --linear\t fitness will be hat_height\n\n"
 	"\t --close\t fitness will be (target - abs(target - hat_height))\n\n"
-	"\t --ceiling\t fitness will quickly level off after passing target\n\n";
+	"\t --ceiling\t fitness will quickly level off after passing target\n\n"
+	"\t --profile\t print where the time went to stderr at exit\n\n"
+	"\t --counters\n"
+	"\t\t As --profile, and also count cycles, instructions, last\n"
+	"\t\t level cache misses and branch misses in each phase.\n\n"
+	"\t --pin\n"
+	"\t\t Keep each worker thread on a core of its own, dealt\n"
+	"\t\t round robin over the NUMA nodes.\n\n"
+	"\t --trace file\n"
+	"\t\t Write a timeline of every job, idle wait and generation\n"
+	"\t\t to file in Chrome trace format, for chrome://tracing or\n"
+	"\t\t ui.perfetto.dev.\n\n"
+	"\t --mmap dir\n"
+	"\t\t Keep the population in files in dir, mapped into memory,\n"
+	"\t\t for runs larger than RAM.  The files are deleted as they\n"
+	"\t\t are made.\n\n"
+	"\t --mutation map_file\n"
+	"\t\t Give each locus its own mutation rate and effect, from the\n"
+	"\t\t mutation map in map_file, in place of -m and -e.  Each line\n"
+	"\t\t is the first locus of an interval, its expected mutations\n"
+	"\t\t per locus per child and their standard deviation.\n\n"
+	"\t --recomb map_file\n"
+	"\t\t Draw crossovers from the recombination map in map_file\n"
+	"\t\t instead of uniformly.  Each line is the first locus of an\n"
+	"\t\t interval and its crossover rate per locus; loci before the\n"
+	"\t\t first line have rate 0.  The number of crossovers is\n"
+	"\t\t still set by -o.\n\n"
+	"\t --traits trait_file\n"
+	"\t\t Select on traits instead of hat size.  Each line of\n"
+	"\t\t trait_file is a trait number, the first locus of an\n"
+	"\t\t interval and the weight of its alleles in that trait.\n"
+	"\t\t Fitness is the fitness function summed over the traits,\n"
+	"\t\t which are printed with each degnome.  Cannot be used\n"
+	"\t\t with --chunk.\n\n"
+	"\t --chunk alleles\n"
+	"\t\t Store chromosomes as shared blocks of this many alleles.\n"
+	"\t\t A child copies only the blocks its crossovers and\n"
+	"\t\t mutations fall in, which saves time and memory when\n"
+	"\t\t chromosomes are long and those are few.  Hat sizes may\n"
+	"\t\t differ in the last digits.\n\n"
+	"\t --cpu-dispatch\n"
+	"\t\t Print which instruction set each vectorized kernel was\n"
+	"\t\t picked for on this cpu, and exit.\n\n";
 
 pthread_mutex_t seedLock = PTHREAD_MUTEX_INITIALIZER;
 unsigned long rngseed = 0;
@@ -77,7 +132,9 @@ int mutation_effect;
 int crossover_rate;
 
 int num_threads = 0;
+int num_traits = 0;		// 0 => select on hat size
 JobQueue* jq;
+AutoThreads* at;		// non-NULL with -t auto
 
 void *ThreadState_new(void *notused);
 void ThreadState_free(void *rng);
@@ -97,16 +154,43 @@ void *ThreadState_new(void *notused) {
 
 void ThreadState_free(void *rng) {
 	gsl_rng_free((gsl_rng *) rng);
+	Degnome_freeScratch();
 }
 
 int jobfunc(void* p, void* tdat) {
 	gsl_rng* rng = (gsl_rng*) tdat;
 	JobData* data = (JobData*) p;																				//get data out
-	Degnome_mate(data->child, data->p1, data->p2, rng, mutation_rate, mutation_effect, crossover_rate);			//mate
+	if (chunk_size > 0) {
+		Degnome_mateChunked(data->child, data->p1, data->p2, rng, mutation_rate, mutation_effect, crossover_rate);
+	}
+	else {
+		Degnome_mate(data->child, data->p1, data->p2, rng, mutation_rate, mutation_effect, crossover_rate);			//mate
+	}
 
 	return 0;		//exited without error
 }
 
+/**
+ * Print d's alleles, its traits if traits is not NULL, and its hat
+ * size, gathering the alleles into row if chunked.
+ */
+void print_degnome(OutBuf* out, Degnome* d, allele_t* row, const double* traits) {
+	if (chunk_size > 0) {
+		Degnome_gather(d, row);
+	}
+	else {
+		row = d->dna_array;
+	}
+	OutBuf_putAlleleRow(out, row, chrom_size);
+	if (traits != NULL) {
+		OutBuf_puts(out, "\nTRAITS:");
+		for (int t = 0; t < num_traits; t++) {
+			OutBuf_printf(out, "\t%lg", traits[t]);
+		}
+	}
+	OutBuf_printf(out, "\nTOTAL HAT SIZE: %lg\n\n", d->hat_size);
+}
+
 void usage(void) {
 	fputs(usageMsg, stderr);
 	exit(EXIT_FAILURE);
@@ -131,6 +215,12 @@ int main(int argc, char **argv) {
 		help_menu();
 	}
 
+	if (flags[23] == 1) {
+		free(flags);
+		Kernel_report(stdout);
+		exit(EXIT_SUCCESS);
+	}
+
 	chrom_size = flags[6];
 	mutation_effect = flags[7];
 	num_gens = flags[8];
@@ -168,16 +258,51 @@ int main(int argc, char **argv) {
 	gsl_rng* rng = gsl_rng_alloc(gsl_rng_taus);    // rand generator
 	gsl_rng_set(rng, rngseed);
 
+	Profile* prof = (flags[18] ? Profile_new() : NULL);
+	if (flags[18] == 2) {
+		Profile_counters(prof);
+	}
+	int pin_threads = flags[19];
+	const char* mmap_dir = (flags[24] > 0 ? argv[flags[24]] : NULL);
+	chunk_size = flags[25];
+	if (chunk_size > 0 && mmap_dir != NULL) {
+		free(flags);
+		fprintf(stderr, "--chunk keeps chunks in memory, so it can't be used with --mmap\n");
+		usage();
+	}
+	if (flags[22] > 0) {
+		Trace_start(argv[flags[22]]);
+	}
+	RecombMap* map = (flags[26] > 0 ? RecombMap_load(argv[flags[26]], chrom_size) : NULL);
+	recomb_map = map;
+	MutationMap* mutmap = (flags[27] > 0 ? MutationMap_load(argv[flags[27]], chrom_size) : NULL);
+	mutation_map = mutmap;
+	if (flags[28] > 0 && chunk_size > 0) {
+		free(flags);
+		fprintf(stderr, "--traits needs each generation's alleles in one block, so it can't be used with --chunk\n");
+		usage();
+	}
+	TraitMatrix* tm = (flags[28] > 0 ? TraitMatrix_load(argv[flags[28]], chrom_size) : NULL);
+	num_traits = (tm != NULL ? TraitMatrix_traits(tm) : 0);
+
 	free(flags);
 
 
-	if (num_threads <= 0) {
+	if (num_threads == THREADS_AUTO) {
+		at = AutoThreads_new(getNumCores(), (double) pop_size * chrom_size, NULL,
+							 ThreadState_new, ThreadState_free);
+		AutoThreads_pinWorkers(at, pin_threads);
+	}
+	else if (num_threads <= 0) {
 		if (num_threads < 0) {
 			#ifdef DEBUG_MODE
 				fprintf(stderr, "Error invalid number of threads: %u\n", num_threads);
 			#endif
 		}
 		num_threads = (3*getNumCores()/4);
+		if (num_threads < 1) {
+			num_threads = 1;
+		}
 	}
 	#ifdef DEBUG_MODE
 		fprintf(stderr, "Final number of threads: %u\n", num_threads);
@@ -192,44 +317,98 @@ int main(int argc, char **argv) {
 	parents = malloc(pop_size*sizeof(Degnome));
 	children = malloc(pop_size*sizeof(Degnome));
 
+	// each generation's alleles are one block, in a file with --mmap.
+	// Chunked, the chunks are the alleles and one row is enough to
+	// build or print a degnome in.
+	int nchunks = (chunk_size > 0 ? Degnome_chunkCount() : 0);
+	int nbufs = (chunk_size > 0 ? 1 : 2);
+	size_t cells = (size_t) (chunk_size > 0 ? 1 : pop_size) * chrom_size;
+	allele_t* allele_buf[2] = {NULL, NULL};
+	Chunk** chunk_buf[2] = {NULL, NULL};
+	for (int b = 0; b < nbufs; b++) {
+		allele_buf[b] = (mmap_dir != NULL ? Mapped_alloc(cells*sizeof(allele_t), mmap_dir)
+						 : malloc(cells*sizeof(allele_t)));
+		if (allele_buf[b] == NULL) {
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (int b = 0; b < 2 && chunk_size > 0; b++) {
+		chunk_buf[b] = malloc((size_t) pop_size * nchunks * sizeof(Chunk*));
+		if (chunk_buf[b] == NULL) {
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	for (int i = 0; i < pop_size; i++) {
-		parents[i].dna_array = malloc(chrom_size*sizeof(double));
-		children[i].dna_array = malloc(chrom_size*sizeof(double));
+		if (chunk_size > 0) {
+			parents[i].dna_array = children[i].dna_array = allele_buf[0];
+			parents[i].chunks = chunk_buf[0] + (size_t) i * nchunks;
+			children[i].chunks = chunk_buf[1] + (size_t) i * nchunks;
+		}
+		else {
+			parents[i].dna_array = allele_buf[0] + (size_t) i * chrom_size;
+			children[i].dna_array = allele_buf[1] + (size_t) i * chrom_size;
+		}
 		parents[i].hat_size = 0;
 
 		for (int j = 0; j < chrom_size; j++) {
-			parents[i].dna_array[j] = (i+j);	//children isn't initiilized
+			parents[i].dna_array[j] = ALLELE_FROM(i+j);	//children isn't initiilized
 			parents[i].hat_size += (i+j);
 		}
+		if (chunk_size > 0) {
+			Degnome_chunk(parents + i, parents[i].chunks);
+		}
 	}
 
-	printf("Generation 0:\n");
-	for (int i = 0; i < pop_size; i++) {
-		printf("Degnome %u\n", i);
-		for (int j = 0; j < chrom_size; j++) {
-			printf("%lf\t", parents[i].dna_array[j]);
+	// pop_size x num_traits, for the parents
+	double* traits = (tm != NULL ? malloc((size_t) pop_size * num_traits * sizeof(double)) : NULL);
+	if (tm != NULL) {
+		if (traits == NULL) {
+			exit(EXIT_FAILURE);
 		}
-		printf("\nTOTAL HAT SIZE: %lg\n\n", parents[i].hat_size);
+		TraitMatrix_apply(tm, parents[0].dna_array, pop_size, traits);
 	}
 
-	jq = JobQueue_new(num_threads, NULL, ThreadState_new, ThreadState_free);
+	OutBuf* out = OutBuf_new(stdout, 1 << 20);
+	double t = Profile_mark(prof);
 
-	JobData* dat = malloc(pop_size*sizeof(JobData));
+	OutBuf_puts(out, "Generation 0:\n");
+	for (int i = 0; i < pop_size; i++) {
+		OutBuf_printf(out, "Degnome %u\n", i);
+		print_degnome(out, parents + i, allele_buf[0],
+					  (tm != NULL ? traits + (size_t) i * num_traits : NULL));
+	}
+	OutBuf_flush(out);
+	t = Profile_lap(prof, PROF_OUTPUT, t);
 
-	for (int i = 0; i < num_gens; i++) {
+	jq = (at == NULL ? JobQueue_new(num_threads, NULL, ThreadState_new, ThreadState_free) : NULL);
+	if (jq != NULL) {
+		JobQueue_pinWorkers(jq, pin_threads);
+	}
 
-		double fit = get_fitness(parents[0].hat_size);
+	JobData* dat = malloc(pop_size*sizeof(JobData));
+	double* cum_hat_size = malloc(pop_size*sizeof(double));
 
-		double total_hat_size = fit;
-		double cum_hat_size[pop_size];
-		cum_hat_size[0] = fit;
+	for (int i = 0; i < num_gens; i++) {
+		TRACE_INSTANT(TRACE_GENERATION, i);
 
+		if (tm != NULL) {
+			// the parents are rows of one block, so all their traits
+			// are one matrix product
+			TraitMatrix_apply(tm, parents[0].dna_array, pop_size, traits);
+			get_fitness_traits(traits, num_traits, cum_hat_size, pop_size);
+		}
+		else {
+			for (int j = 0; j < pop_size; j++) {
+				cum_hat_size[j] = parents[j].hat_size;
+			}
+			get_fitness_batch(cum_hat_size, cum_hat_size, pop_size);
+		}
 		for (int j = 1; j < pop_size; j++) {
-			fit = get_fitness(parents[j].hat_size);
-
-			total_hat_size += fit;
-			cum_hat_size[j] = (cum_hat_size[j-1] + fit);
+			cum_hat_size[j] += cum_hat_size[j-1];
 		}
+		double total_hat_size = cum_hat_size[pop_size-1];
+		t = Profile_lap(prof, PROF_FITNESS, t);
 
 		for (int j = 0; j < pop_size; j++) {
 
@@ -254,40 +433,90 @@ int main(int argc, char **argv) {
 			dat[j].child = (children + j);
 			dat[j].p1 = (parents + m);
 			dat[j].p2 = (parents + d);
+			t = Profile_lap(prof, PROF_SELECT, t);
 
-			JobQueue_addJob(jq, jobfunc, dat + j);
+			if (at == NULL) {
+				JobQueue_addJob(jq, jobfunc, dat + j);
+				t = Profile_lap(prof, PROF_SUBMIT, t);
+			}
 		}
 
-		JobQueue_waitOnJobs(jq);
+		if (at != NULL) {
+			AutoThreads_run(at, jobfunc, dat, sizeof(JobData), pop_size);
+			t = Profile_lap(prof, (AutoThreads_threads(at) ? PROF_WAIT : PROF_MATE), t);
+		}
+		else {
+			JobQueue_waitOnJobs(jq);
+			t = Profile_lap(prof, PROF_WAIT, t);
+		}
+		if (chunk_size > 0) {
+			for (int j = 0; j < pop_size; j++) {
+				Degnome_releaseChunks(parents + j);
+			}
+			t = Profile_lap(prof, PROF_MATE, t);
+		}
+		Profile_generation(prof, pop_size);
 		temp = children;
 		children = parents;
 		parents = temp;
 	}
 
-	JobQueue_noMoreJobs(jq);
+	if (jq != NULL) {
+		JobQueue_noMoreJobs(jq);
+	}
 
-	printf("Generation %u:\n", num_gens);
+	if (tm != NULL) {
+		TraitMatrix_apply(tm, parents[0].dna_array, pop_size, traits);
+	}
+	OutBuf_printf(out, "Generation %u:\n", num_gens);
 	for (int i = 0; i < pop_size; i++) {
-		printf("Degnome %u\n", i);
-		for (int j = 0; j < chrom_size; j++) {
-			printf("%lf\t", parents[i].dna_array[j]);
-		}
-		printf("\nTOTAL HAT SIZE: %lg\n\n", parents[i].hat_size);
+		OutBuf_printf(out, "Degnome %u\n", i);
+		print_degnome(out, parents + i, allele_buf[0],
+					  (tm != NULL ? traits + (size_t) i * num_traits : NULL));
 	}
+	OutBuf_free(out);
+	t = Profile_lap(prof, PROF_OUTPUT, t);
+
+	Profile_report(prof, (at != NULL ? AutoThreads_jobQueue(at) : jq), stderr);
 
 	//free everything
+	Profile_free(prof);
 
-	JobQueue_free(jq);
+	if (at != NULL) {
+		AutoThreads_free(at);
+	}
+	else {
+		JobQueue_free(jq);
+	}
 	free(dat);
+	free(cum_hat_size);
+	Degnome_freeScratch();
 
-	for (int i = 0; i < pop_size; i++) {
-		free(parents[i].dna_array);
-		free(children[i].dna_array);
-		parents[i].hat_size = 0;
+	for (int i = 0; i < pop_size && chunk_size > 0; i++) {
+		Degnome_releaseChunks(parents + i);
 	}
-
 	free(parents);
 	free(children);
+	free(chunk_buf[0]);
+	free(chunk_buf[1]);
+	for (int b = 0; b < nbufs; b++) {
+		if (mmap_dir != NULL) {
+			Mapped_free(allele_buf[b], cells*sizeof(allele_t));
+		}
+		else {
+			free(allele_buf[b]);
+		}
+	}
 
+	if (map != NULL) {
+		RecombMap_free(map);
+	}
+	if (mutmap != NULL) {
+		MutationMap_free(mutmap);
+	}
+	if (tm != NULL) {
+		TraitMatrix_free(tm);
+	}
+	free(traits);
 	gsl_rng_free (rng);
 }
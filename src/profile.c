@@ -0,0 +1,223 @@
+/**
+@file profile.c
+@page profile
+@author Daniel R. Tabin
+@brief Phase timers for the generational loop
+
+A Profile adds up wall-clock time spent in each phase of a run on
+the monotonic clock.  The loop takes a mark when a phase starts and
+calls Profile_lap when it ends, which charges the time since the mark
+to that phase and returns a new mark for the next one:
+
+	double t = Profile_mark(prof);
+	... compute fitness ...
+	t = Profile_lap(prof, PROF_FITNESS, t);
+	... pick parents ...
+	t = Profile_lap(prof, PROF_SELECT, t);
+
+Every function accepts a NULL Profile and then does nothing, not even
+read the clock, so the calls can stay in the loop when --profile is
+off.  Profile_report prints the phases, the busy and idle time of
+each JobQueue worker, and throughput.
+
+After Profile_counters (--counters), each mark and lap also reads the
+hardware event counters of counters.c, and the report adds cycles,
+instructions per cycle, and cache and branch misses per offspring for
+every phase.  The main thread's counts go to the phase being lapped.
+The JobQueue workers only ever mate, so their counts all go to mate,
+spinning while they wait for a job included; the main thread's wait
+phase is then only the cost of waiting.
+*/
+
+#include "profile.h"
+#include "counters.h"
+#include "checkmem.h"
+#include <stdlib.h>
+#include <time.h>
+
+struct Profile {
+	double start;
+	double seconds[PROF_NUM_PHASES];
+	long generations;
+	long offspring;
+	int counting;					// 1 after Profile_counters, -1 if it failed
+	double mark[CTR_NUM_EVENTS];	// main thread's counts at the last mark
+	double others[CTR_NUM_EVENTS];	// other threads' counts at the last lap
+	double counts[PROF_NUM_PHASES][CTR_NUM_EVENTS];
+};
+
+static const char* phase_names[] = {
+	"fitness", "select", "submit", "mate", "wait", "diversity", "output"
+};
+
+static double now(void);
+static void print_count(FILE* out, double x, int have, const char* format);
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+Profile* Profile_new(void) {
+	Profile* prof = calloc(1, sizeof(Profile));
+	CHECKMEM(prof);
+	prof->start = now();
+
+	return prof;
+}
+
+/**
+ * Count hardware events as well as time, from now on.  Call it before
+ * any JobQueue is made, so that the workers are counted too.  Returns
+ * 0, or -1 if the counters could not be opened.
+ */
+int Profile_counters(Profile* prof) {
+	if (prof == NULL) {
+		return -1;
+	}
+	if (Counters_start() != 0) {
+		prof->counting = -1;
+		return -1;
+	}
+	prof->counting = 1;
+	Counters_read(prof->mark);
+	Counters_readOthers(prof->others);
+	return 0;
+}
+
+/// The current time, or 0 if prof is NULL.
+double Profile_mark(Profile* prof) {
+	if (prof == NULL) {
+		return 0;
+	}
+	if (prof->counting > 0) {
+		Counters_read(prof->mark);
+	}
+	return now();
+}
+
+/// Charge the time since mark since to phase and return a new mark.
+double Profile_lap(Profile* prof, int phase, double since) {
+	if (prof == NULL) {
+		return 0;
+	}
+	double t = now();
+	prof->seconds[phase] += t - since;
+
+	if (prof->counting > 0) {
+		double c[CTR_NUM_EVENTS];
+		Counters_read(c);
+		for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+			prof->counts[phase][k] += c[k] - prof->mark[k];
+			prof->mark[k] = c[k];
+		}
+		Counters_readOthers(c);
+		for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+			prof->counts[PROF_MATE][k] += c[k] - prof->others[k];
+			prof->others[k] = c[k];
+		}
+	}
+	return t;
+}
+
+/// Count one finished generation of offspring children.
+void Profile_generation(Profile* prof, long offspring) {
+	if (prof == NULL) {
+		return;
+	}
+	prof->generations++;
+	prof->offspring += offspring;
+}
+
+/**
+ * Print the breakdown so far.  jq may be NULL if the run had no
+ * JobQueue; otherwise its workers are listed too.
+ */
+void Profile_report(Profile* prof, JobQueue* jq, FILE* out) {
+	if (prof == NULL) {
+		return;
+	}
+	double wall = now() - prof->start;
+	double timed = 0;
+
+	fprintf(out, "\nPROFILE\n");
+	fprintf(out, "%-12s %12s %8s\n", "phase", "seconds", "percent");
+	for (int p = 0; p < PROF_NUM_PHASES; p++) {
+		timed += prof->seconds[p];
+		fprintf(out, "%-12s %12.6f %7.2f%%\n", phase_names[p], prof->seconds[p],
+				(wall > 0 ? 100 * prof->seconds[p] / wall : 0));
+	}
+	fprintf(out, "%-12s %12.6f %7.2f%%\n", "other", wall - timed,
+			(wall > 0 ? 100 * (wall - timed) / wall : 0));
+	fprintf(out, "%-12s %12.6f\n", "total", wall);
+
+	if (jq != NULL) {
+		int n = JobQueue_workerTimes(jq, NULL, NULL, NULL, 0);
+		double* busy = malloc((n > 0 ? n : 1) * sizeof(double));
+		double* idle = malloc((n > 0 ? n : 1) * sizeof(double));
+		long* jobs = malloc((n > 0 ? n : 1) * sizeof(long));
+		CHECKMEM(busy && idle && jobs);
+		int m = JobQueue_workerTimes(jq, busy, idle, jobs, n);
+		n = (m < n ? m : n);
+
+		fprintf(out, "\n%-12s %12s %12s %10s %8s\n", "worker", "busy", "idle",
+				"jobs", "busy%");
+		for (int i = 0; i < n; i++) {
+			double life = busy[i] + idle[i];
+			fprintf(out, "%-12d %12.6f %12.6f %10ld %7.2f%%\n", i, busy[i], idle[i],
+					jobs[i], (life > 0 ? 100 * busy[i] / life : 0));
+		}
+		free(busy);
+		free(idle);
+		free(jobs);
+	}
+
+	if (prof->counting < 0) {
+		fprintf(out, "\nhardware counters unavailable (see perf_event_paranoid)\n");
+	}
+	else if (prof->counting > 0) {
+		int cycles = Counters_have(CTR_CYCLES);
+		int ipc = cycles && Counters_have(CTR_INSTRUCTIONS);
+		int llc = Counters_have(CTR_LLC_MISSES);
+		int branch = Counters_have(CTR_BRANCH_MISSES);
+		double per = (prof->offspring > 0 ? 1.0 / prof->offspring : 0);
+
+		fprintf(out, "\n%-12s %12s %12s %12s %12s %12s\n", "counters", "cpu_sec",
+				"cycles/off", "IPC", "LLC-miss/off", "br-miss/off");
+		for (int p = 0; p < PROF_NUM_PHASES; p++) {
+			double* c = prof->counts[p];
+			fprintf(out, "%-12s", phase_names[p]);
+			print_count(out, 1e-9 * c[CTR_TASK_CLOCK], Counters_have(CTR_TASK_CLOCK), " %12.6f");
+			print_count(out, per * c[CTR_CYCLES], cycles, " %12.1f");
+			print_count(out, (c[CTR_CYCLES] > 0 ? c[CTR_INSTRUCTIONS] / c[CTR_CYCLES] : 0),
+						ipc, " %12.3f");
+			print_count(out, per * c[CTR_LLC_MISSES], llc, " %12.3f");
+			print_count(out, per * c[CTR_BRANCH_MISSES], branch, " %12.3f");
+			fputc('\n', out);
+		}
+	}
+
+	fprintf(out, "\n%ld generations, %ld offspring\n", prof->generations, prof->offspring);
+	if (wall > 0) {
+		fprintf(out, "%.1f offspring/sec, %.2f generations/sec\n",
+				prof->offspring / wall, prof->generations / wall);
+	}
+}
+
+/// Print x with format, or a dash if the event was not counted.
+static void print_count(FILE* out, double x, int have, const char* format) {
+	if (have) {
+		fprintf(out, format, x);
+	}
+	else {
+		fprintf(out, " %12s", "-");
+	}
+}
+
+void Profile_free(Profile* prof) {
+	if (prof != NULL && prof->counting > 0) {
+		Counters_stop();
+	}
+	free(prof);
+}
@@ -0,0 +1,35 @@
+/**
+ * @file profile.h
+ * @author Daniel R. Tabin
+ * @brief Header for profile.c
+ */
+
+#ifndef PROFILE
+#define PROFILE
+
+#include "jobqueue.h"
+#include <stdio.h>
+
+/// Phases of the generational loop, timed on the main thread.
+enum {
+	PROF_FITNESS,		// fitness and cumulative fitness
+	PROF_SELECT,		// choosing parents
+	PROF_SUBMIT,		// JobQueue_addJob
+	PROF_MATE,			// mating done inline on the main thread
+	PROF_WAIT,			// JobQueue_waitOnJobs
+	PROF_DIVERSITY,		// calculate_diversity
+	PROF_OUTPUT,		// formatting and writing results
+	PROF_NUM_PHASES
+};
+
+typedef struct Profile Profile;
+
+Profile*	Profile_new(void);
+int			Profile_counters(Profile* prof);
+double		Profile_mark(Profile* prof);
+double		Profile_lap(Profile* prof, int phase, double since);
+void		Profile_generation(Profile* prof, long offspring);
+void		Profile_report(Profile* prof, JobQueue* jq, FILE* out);
+void		Profile_free(Profile* prof);
+
+#endif
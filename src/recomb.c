@@ -0,0 +1,201 @@
+/**
+@file recomb.c
+@page recomb
+@author Daniel R. Tabin
+@brief Recombination maps: crossovers that favour some loci over others
+
+By default a crossover is equally likely at every locus.  A
+recombination map instead divides the chromosome into intervals, each
+with its own rate per locus, so hotspots and cold regions can be
+modelled.  A map file has one interval per line, the locus it starts
+at and its rate:
+
+	# a cold first half and a hotspot at 700
+	0 1
+	500 0.1
+	700 25
+	720 1
+
+Each interval runs to the start of the next, or the end of the
+chromosome.  Loci before the first line have rate 0, and intervals
+starting past the end of the chromosome are dropped, so one map serves
+any chromosome length.  Only the ratios of the rates matter: the
+number of crossovers per child is still Poisson with mean -o.
+
+A locus is drawn by inverting the cumulative distribution of the map,
+which is piecewise linear.  A guide table (Chen and Asau) of one entry
+per interval gives the interval a uniform lands in after one step on
+average, however many intervals there are.  Because the inverse is
+monotone, mapping sorted uniforms gives sorted loci; RecombMap_draw
+makes the n sorted uniforms directly, from the top down as products of
+powers of uniforms, so a child's crossovers are never sorted.
+*/
+
+#include "recomb.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define RECOMB_MAX_LINE 256
+
+struct RecombMap {
+	int n;				// intervals
+	int* start;			// first locus of each; start[n] is chrom_size
+	double* cdf;		// chance of a locus before each; cdf[n] is 1
+	int* guide;			// first interval reaching past g/n, for each g
+};
+
+/**
+ * A map of n intervals, the k-th starting at locus starts[k] with rate
+ * rates[k], on a chromosome of chrom_size loci.  starts must increase.
+ * NULL if they do not, a rate is negative, or no locus can cross over.
+ */
+RecombMap* RecombMap_new(const int* starts, const double* rates, int n, int chrom_size) {
+	if (n < 1 || chrom_size < 1) {
+		return NULL;
+	}
+	for (int k = 0; k < n; k++) {
+		if (rates[k] < 0 || !isfinite(rates[k]) || starts[k] < 0
+			|| (k > 0 && starts[k] <= starts[k-1])) {
+			return NULL;
+		}
+	}
+
+	RecombMap* map = malloc(sizeof(RecombMap));
+	CHECKMEM(map);
+	map->start = malloc((n + 2)*sizeof(int));
+	map->cdf = malloc((n + 2)*sizeof(double));
+	CHECKMEM(map->start && map->cdf);
+	map->guide = NULL;
+
+	// a leading interval of rate 0 if the map starts past locus 0
+	int m = 0;
+	double* weight = map->cdf + 1;
+	if (starts[0] > 0) {
+		map->start[m] = 0;
+		weight[m++] = 0;
+	}
+	for (int k = 0; k < n && starts[k] < chrom_size; k++) {
+		map->start[m] = starts[k];
+		weight[m++] = rates[k];
+	}
+	map->start[m] = chrom_size;
+	map->n = m;
+
+	// weight of interval k becomes the cumulative chance up to its end
+	double total = 0;
+	map->cdf[0] = 0;
+	for (int k = 0; k < m; k++) {
+		total += weight[k] * (map->start[k+1] - map->start[k]);
+		map->cdf[k+1] = total;
+	}
+	if (!(total > 0)) {
+		RecombMap_free(map);
+		return NULL;
+	}
+	for (int k = 1; k < m; k++) {
+		map->cdf[k] /= total;
+	}
+	map->cdf[m] = 1;
+
+	map->guide = malloc(m*sizeof(int));
+	CHECKMEM(map->guide);
+	for (int g = 0, k = 0; g < m; g++) {
+		while (map->cdf[k+1] <= (double) g / m) {
+			k++;
+		}
+		map->guide[g] = k;
+	}
+
+	return map;
+}
+
+/**
+ * The map in the file at path, for a chromosome of chrom_size loci.
+ * Prints what is wrong with the file and exits if it cannot be used.
+ */
+RecombMap* RecombMap_load(const char* path, int chrom_size) {
+	FILE* in = fopen(path, "r");
+	if (in == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	int max = 64, n = 0;
+	int* starts = malloc(max*sizeof(int));
+	double* rates = malloc(max*sizeof(double));
+	CHECKMEM(starts && rates);
+	char line[RECOMB_MAX_LINE];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		lineno++;
+		char* p = line + strspn(line, " \t\r\n");
+		if (*p == '\0' || *p == '#') {
+			continue;
+		}
+		char extra;
+		if (n == max) {
+			max *= 2;
+			starts = realloc(starts, max*sizeof(int));
+			rates = realloc(rates, max*sizeof(double));
+			CHECKMEM(starts && rates);
+		}
+		if (sscanf(p, "%d %lf %c", starts + n, rates + n, &extra) != 2) {
+			fprintf(stderr, "%s:%d: expected a locus and a rate\n", path, lineno);
+			exit(EXIT_FAILURE);
+		}
+		if (starts[n] < 0 || rates[n] < 0 || (n > 0 && starts[n] <= starts[n-1])) {
+			fprintf(stderr, "%s:%d: loci must increase and rates must not be negative\n",
+					path, lineno);
+			exit(EXIT_FAILURE);
+		}
+		n++;
+	}
+	fclose(in);
+
+	RecombMap* map = RecombMap_new(starts, rates, n, chrom_size);
+	if (map == NULL) {
+		fprintf(stderr, "%s: no locus of a %d locus chromosome can cross over\n",
+				path, chrom_size);
+		exit(EXIT_FAILURE);
+	}
+	free(starts);
+	free(rates);
+
+	return map;
+}
+
+/// The locus a uniform u in [0, 1) maps to.  Never decreases as u grows.
+int RecombMap_locus(const RecombMap* map, double u) {
+	int g = (int) (u * map->n);
+	int k = map->guide[g < map->n ? g : map->n - 1];
+
+	while (map->cdf[k+1] <= u) {
+		k++;
+	}
+
+	int len = map->start[k+1] - map->start[k];
+	int x = map->start[k] + (int) ((u - map->cdf[k]) / (map->cdf[k+1] - map->cdf[k]) * len);
+	return (x < map->start[k+1] ? x : map->start[k+1] - 1);
+}
+
+/// Draw n crossover loci from map into loci, in increasing order.
+void RecombMap_draw(const RecombMap* map, gsl_rng* rng, int n, int* loci) {
+	double u = 1;
+
+	// the largest of k uniforms below u is u * U^(1/k)
+	for (int k = n; k > 0; k--) {
+		u *= pow(gsl_rng_uniform(rng), 1.0 / k);
+		loci[k-1] = RecombMap_locus(map, u);
+	}
+}
+
+void RecombMap_free(RecombMap* map) {
+	free(map->start);
+	free(map->cdf);
+	free(map->guide);
+	free(map);
+}
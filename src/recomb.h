@@ -0,0 +1,20 @@
+/**
+ * @file recomb.h
+ * @author Daniel R. Tabin
+ * @brief Header for recomb.c
+ */
+
+#ifndef RECOMB
+#define RECOMB
+
+#include <gsl/gsl_rng.h>
+
+typedef struct RecombMap RecombMap;
+
+RecombMap*	RecombMap_new(const int* starts, const double* rates, int n, int chrom_size);
+RecombMap*	RecombMap_load(const char* path, int chrom_size);
+int			RecombMap_locus(const RecombMap* map, double u);
+void		RecombMap_draw(const RecombMap* map, gsl_rng* rng, int n, int* loci);
+void		RecombMap_free(RecombMap* map);
+
+#endif
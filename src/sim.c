@@ -0,0 +1,872 @@
+/**
+@file sim.c
+@page sim
+@author Daniel R. Tabin
+@brief The devosim engine, usable in-process through libdevosim
+
+A Sim owns one devosim population and the JobQueue that mates it.
+The devosim executable is a thin wrapper that parses flags, steps a
+Sim and prints it.  Other programs (such as DevosimGUI.py through
+ctypes) can link libdevosim.so instead and read the allele and
+ancestry matrices directly through sim_get_population rather than
+parsing text.
+
+The allele and ancestry arrays of every degnome in a generation are
+rows of one contiguous pop_size x chrom_size matrix, so a caller can
+wrap them as a 2-d array without copying.
+
+Degnome_mate and the fitness functions read chrom_size, target_num
+and the chosen fitness function from thread-local variables.  A Sim
+sets them on the thread that steps it, and jobfunc sets chrom_size on
+each worker, so several Sims can run at once (see sweep.c).  A Sim
+can also share a JobQueue owned by someone else, or have none at all
+and mate every child inline on the calling thread.  With num_threads
+set to THREADS_AUTO, sim_new leaves that choice to an AutoThreads,
+which makes it again every generation (see autothreads.c).
+
+On a NUMA machine par.placement spreads the two population matrices
+over the nodes and par.pin_threads keeps each worker on one core
+(see placement.c).
+
+A Sim made by sim_new_in takes its degnomes, population matrices and
+per generation arrays from a DegnomeArena instead of malloc, so that
+a caller making many short runs (see sweep.c) can release them all
+with one DegnomeArena_reset and reuse the memory for the next run.
+Placed and mapped matrices still come from placement.c and mapped.c.
+
+By default each child is a job of its own, so consecutive jobs on a
+worker read random parents and neighbouring child rows are written by
+different workers, which share the cache line at every row boundary
+when chromosomes are short.  With par.schedule set to
+SIM_SCHEDULE_BLOCK the children are split into one contiguous block
+per worker instead, and the worker prefetches the rows of the next
+child while it mates the current one.  SIM_SCHEDULE_SORTED also mates
+each block in order of parent, so a parent chosen twice in a block is
+still in cache the second time; it gives different offspring than the
+other two schedules for the same seed.
+
+sim_run stops at zero diversity by comparing a hash of each degnome's
+ancestry rather than computing the diversity, which takes time
+proportional to pop_size squared.  Once asked, each worker hashes the
+ancestry of every child it mates.
+
+With par.recomb_file set, crossovers are drawn from that
+recombination map (see recomb.c) instead of uniformly; the map is
+loaded for the Sim's chromosome length and set on each thread that
+mates its children, like chrom_size.  par.mutation_file does the same
+for a mutation map (see mutmap.c), which replaces mutation_rate and
+mutation_effect.  With par.traits_file set, selection is on the
+traits of that file (see traits.c) rather than on hat size: each
+generation's traits are one matrix product over the parents' allele
+matrix, made once and shared by sim_step and sim_get_population.
+*/
+
+#include "sim.h"
+#include "ance_degnome.h"
+#include "jobqueue.h"
+#include "fitfunc.h"
+#include "kernels.h"
+#include "mapped.h"
+#include "traits.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+
+typedef struct JobData JobData;
+struct JobData {
+	Sim* sim;
+	Degnome* child;
+	Degnome* p1;
+	Degnome* p2;
+	uint64_t* hash;		// where to put the child's ancestry hash, or NULL
+};
+
+/// Children begin to end - 1, for SIM_SCHEDULE_BLOCK and _SORTED.
+typedef struct SimBlock SimBlock;
+struct SimBlock {
+	Sim* sim;
+	int begin;
+	int end;
+};
+
+#define PREFETCH_BYTES 512			// of each row; the hardware streams the rest
+
+struct Sim {
+	SimParams par;
+	int generation;
+
+	Degnome* parents;
+	Degnome* children;
+	allele_t* allele_buf[2];	// backing store for dna_array
+	int* goi_buf[2];			// backing store for GOI_array
+	uint64_t* goi_hash[2];		// of each row of goi_buf, once hashing
+	int hashing;				// set by the first sim_identical
+	int current;				// which buffer the parents are in
+	double* hat_sizes;			// filled by sim_get_population
+	double* cum_fit;			// scratch for sim_step, pop_size each
+	int* moms;
+	int* dads;
+
+	double diversity;
+	double* percent_block;		// (pop_size+1) x pop_size
+	double** percent_decent;	// row pointers into percent_block
+
+	gsl_rng* rng;
+	pthread_mutex_t seedLock;
+	unsigned long rngseed;
+
+	JobQueue* jq;
+	int owns_jq;
+	AutoThreads* at;			// picks inline or a JobQueue per step
+	gsl_rng* mate_rng;			// used when there is no JobQueue
+	JobData* dat;
+	SimBlock* blocks;			// made by the first blocked sim_step
+	int nblocks;
+
+	Profile* prof;				// NULL unless profiling
+	DegnomeArena* arena;		// NULL => everything is malloced
+	RecombMap* recomb;			// NULL => crossovers are uniform
+	MutationMap* mutmap;		// NULL => par.mutation_rate and _effect
+	TraitMatrix* traits;		// NULL => select on hat size
+	double* trait_values;		// pop_size x num_traits, of the parents
+	int traits_gen;				// generation trait_values are of, or -1
+};
+
+static const char* fit_func_names[] = {"linear", "sqrt", "close", "ceiling", "log"};
+
+static void *ThreadState_new(void *sim);
+static void ThreadState_free(void *rng);
+static int jobfunc(void* p, void* tdat);
+static int blockfunc(void* p, void* tdat);
+static void calculate_diversity(Sim* sim);
+static unsigned long next_seed(Sim* sim);
+static void wire_generation(Sim* sim, Degnome* generation, int buf);
+static void bind_thread(const Sim* sim);
+static void breed(Sim* sim, int j, int m, int d);
+static void mate_blocks(Sim* sim);
+static void prefetch_rows(const JobData* dat, int len);
+static int cmp_parents(const void* a, const void* b);
+static Sim* sim_alloc(const SimParams* params, DegnomeArena* arena);
+static void* sim_take(Sim* sim, size_t size);
+static void sim_give(Sim* sim, void* p);
+static void* pop_alloc(Sim* sim, size_t size);
+static void pop_free(Sim* sim, void* p, size_t size);
+static void update_traits(Sim* sim);
+
+/// Hand out the next seed in sequence.  Called by workers and main.
+static unsigned long next_seed(Sim* sim) {
+	pthread_mutex_lock(&sim->seedLock);
+	unsigned long seed = sim->rngseed;
+	sim->rngseed = (sim->rngseed == ULONG_MAX ? 0 : sim->rngseed + 1);
+	pthread_mutex_unlock(&sim->seedLock);
+
+	return seed;
+}
+
+static void *ThreadState_new(void *sim) {
+	gsl_rng *rng = gsl_rng_alloc(gsl_rng_taus);
+	gsl_rng_set(rng, next_seed((Sim*) sim));
+
+	return rng;
+}
+
+static void ThreadState_free(void *rng) {
+	gsl_rng_free((gsl_rng *) rng);
+	Degnome_freeScratch();
+}
+
+static int jobfunc(void* p, void* tdat) {
+	gsl_rng* rng = (gsl_rng*) tdat;
+	JobData* data = (JobData*) p;
+	SimParams* par = &data->sim->par;
+
+	chrom_size = par->chrom_size;
+	recomb_map = data->sim->recomb;
+	mutation_map = data->sim->mutmap;
+	Degnome_mate(data->child, data->p1, data->p2, rng,
+		par->mutation_rate, par->mutation_effect, par->crossover_rate);
+	if (data->hash != NULL) {
+		*data->hash = Kernel_hash(data->child->GOI_array, par->chrom_size*sizeof(int));
+	}
+
+	return 0;		//exited without error
+}
+
+/// Start loading the first lines of the rows dat will read and write.
+static void prefetch_rows(const JobData* dat, int len) {
+	size_t dbytes = len * sizeof(allele_t);
+	size_t gbytes = len * sizeof(int);
+
+	for (size_t k = 0; k < dbytes && k < PREFETCH_BYTES; k += 64) {
+		__builtin_prefetch((const char*) dat->p1->dna_array + k, 0, 3);
+		__builtin_prefetch((const char*) dat->p2->dna_array + k, 0, 3);
+		__builtin_prefetch((char*) dat->child->dna_array + k, 1, 3);
+	}
+	for (size_t k = 0; k < gbytes && k < PREFETCH_BYTES; k += 64) {
+		__builtin_prefetch((const char*) dat->p1->GOI_array + k, 0, 3);
+		__builtin_prefetch((const char*) dat->p2->GOI_array + k, 0, 3);
+		__builtin_prefetch((char*) dat->child->GOI_array + k, 1, 3);
+	}
+}
+
+/// Order jobs by first parent, then second.
+static int cmp_parents(const void* a, const void* b) {
+	const JobData* x = (const JobData*) a;
+	const JobData* y = (const JobData*) b;
+
+	if (x->p1 != y->p1) {
+		return (x->p1 < y->p1 ? -1 : 1);
+	}
+	return (x->p2 < y->p2 ? -1 : x->p2 > y->p2);
+}
+
+/// Mate a block of children on one thread.
+static int blockfunc(void* p, void* tdat) {
+	SimBlock* block = (SimBlock*) p;
+	Sim* sim = block->sim;
+	JobData* dat = sim->dat;
+	int len = sim->par.chrom_size;
+
+	if (sim->par.schedule == SIM_SCHEDULE_SORTED) {
+		qsort(dat + block->begin, block->end - block->begin, sizeof(JobData),
+			  cmp_parents);
+	}
+	for (int j = block->begin; j < block->end; j++) {
+		if (j + 1 < block->end) {
+			prefetch_rows(dat + j + 1, len);
+		}
+		jobfunc(dat + j, tdat);
+	}
+
+	return 0;
+}
+
+/// Point each degnome of generation at its row of buffer buf.
+static void wire_generation(Sim* sim, Degnome* generation, int buf) {
+	int len = sim->par.chrom_size;
+
+	for (int i = 0; i < sim->par.pop_size; i++) {
+		generation[i].dna_array = sim->allele_buf[buf] + (size_t) i * len;
+		generation[i].GOI_array = sim->goi_buf[buf] + (size_t) i * len;
+	}
+}
+
+/// Load this Sim's settings into the calling thread's globals.
+static void bind_thread(const Sim* sim) {
+	int f = sim->par.fit_func;
+
+	chrom_size = sim->par.chrom_size;
+	recomb_map = sim->recomb;
+	mutation_map = sim->mutmap;
+	set_function(fit_func_names[(f >= 0 && f <= 4) ? f : 0]);
+	target_num = sim->par.target;
+}
+
+void sim_default_params(SimParams* params) {
+	params->chrom_size = 10;
+	params->pop_size = 10;
+	params->mutation_rate = 1;
+	params->mutation_effect = 2;
+	params->crossover_rate = 2;
+	params->selective = 0;
+	params->uniform = 0;
+	params->fit_func = 0;
+	params->target = 9999;
+	params->num_threads = 0;
+	params->seed = 0;
+	params->pin_threads = 0;
+	params->placement = PLACE_DEFAULT;
+	params->schedule = SIM_SCHEDULE_CHILD;
+	params->mmap_dir = NULL;
+	params->recomb_file = NULL;
+	params->mutation_file = NULL;
+	params->traits_file = NULL;
+}
+
+/**
+ * Create a Sim with its own JobQueue of par.num_threads workers, or
+ * with an AutoThreads if par.num_threads is THREADS_AUTO.
+ */
+Sim* sim_new(const SimParams* params) {
+	Sim* sim = sim_alloc(params, NULL);
+
+	if (sim->par.num_threads == THREADS_AUTO) {
+		sim->at = AutoThreads_new(getNumCores(),
+								  (double) sim->par.pop_size * sim->par.chrom_size,
+								  sim, ThreadState_new, ThreadState_free);
+		AutoThreads_pinWorkers(sim->at, sim->par.pin_threads);
+		sim->jq = NULL;
+		sim->owns_jq = 0;
+		return sim;
+	}
+	if (sim->par.num_threads <= 0) {
+		sim->par.num_threads = (3*getNumCores()/4);
+		if (sim->par.num_threads < 1) {
+			sim->par.num_threads = 1;
+		}
+	}
+	sim->jq = JobQueue_new(sim->par.num_threads, sim, ThreadState_new, ThreadState_free);
+	JobQueue_pinWorkers(sim->jq, sim->par.pin_threads);
+	sim->owns_jq = 1;
+
+	return sim;
+}
+
+/**
+ * Create a Sim that mates its children on jq, which the caller owns
+ * and must keep alive until sim_free.  Each worker's thread state
+ * must be a gsl_rng*.  If jq is NULL every child is mated inline by
+ * the thread calling sim_step.
+ */
+Sim* sim_new_with_queue(const SimParams* params, JobQueue* jq) {
+	return sim_new_in(params, jq, NULL);
+}
+
+/**
+ * As sim_new_with_queue, but the population and its scratch come
+ * from arena if it is not NULL.  The arena must not be reset or freed
+ * until after sim_free, and while the Sim lives only the thread that
+ * steps it may use the arena.
+ */
+Sim* sim_new_in(const SimParams* params, JobQueue* jq, DegnomeArena* arena) {
+	Sim* sim = sim_alloc(params, arena);
+
+	sim->jq = jq;
+	sim->owns_jq = 0;
+
+	return sim;
+}
+
+/// size bytes from the Sim's arena, or from malloc.
+static void* sim_take(Sim* sim, size_t size) {
+	if (sim->arena != NULL) {
+		return DegnomeArena_alloc(sim->arena, size);
+	}
+	return malloc(size);
+}
+
+/// Free p if it came from malloc; arena blocks go with the arena.
+static void sim_give(Sim* sim, void* p) {
+	if (sim->arena == NULL) {
+		free(p);
+	}
+}
+
+/// A population buffer, in memory placed by par.placement or in a file.
+static void* pop_alloc(Sim* sim, size_t size) {
+	const SimParams* par = &sim->par;
+
+	if (par->mmap_dir != NULL) {
+		return Mapped_alloc(size, par->mmap_dir);
+	}
+	if (par->placement == PLACE_DEFAULT) {
+		return sim_take(sim, size);
+	}
+	return Placement_alloc(size, par->placement);
+}
+
+static void pop_free(Sim* sim, void* p, size_t size) {
+	const SimParams* par = &sim->par;
+
+	if (par->mmap_dir != NULL) {
+		Mapped_free(p, size);
+	}
+	else if (par->placement == PLACE_DEFAULT) {
+		sim_give(sim, p);
+	}
+	else {
+		Placement_free(p, size, par->placement);
+	}
+}
+
+/// Everything but the JobQueue.
+static Sim* sim_alloc(const SimParams* params, DegnomeArena* arena) {
+	Sim* sim = malloc(sizeof(Sim));
+	CHECKMEM(sim);
+	sim->par = *params;
+	sim->arena = arena;
+	sim->recomb = (sim->par.recomb_file != NULL
+				   ? RecombMap_load(sim->par.recomb_file, sim->par.chrom_size) : NULL);
+	sim->mutmap = (sim->par.mutation_file != NULL
+				   ? MutationMap_load(sim->par.mutation_file, sim->par.chrom_size) : NULL);
+	sim->traits = (sim->par.traits_file != NULL
+				   ? TraitMatrix_load(sim->par.traits_file, sim->par.chrom_size) : NULL);
+	sim->generation = 0;
+	if (sim->par.mmap_dir != NULL && sim->par.schedule == SIM_SCHEDULE_CHILD) {
+		sim->par.schedule = SIM_SCHEDULE_BLOCK;		// write children in file order
+	}
+
+	int pop_size = sim->par.pop_size;
+	size_t cells = (size_t) pop_size * sim->par.chrom_size;
+
+	bind_thread(sim);
+
+	if (sim->par.seed == 0) {
+		time_t currtime = time(NULL);                  // time
+		unsigned long pid = (unsigned long) getpid();  // process id
+		sim->rngseed = currtime ^ pid;                 // random seed
+	}
+	else {
+		sim->rngseed = sim->par.seed;
+	}
+	pthread_mutex_init(&sim->seedLock, NULL);
+	sim->rng = gsl_rng_alloc(gsl_rng_taus);    // rand generator
+	gsl_rng_set(sim->rng, sim->rngseed);
+	sim->mate_rng = gsl_rng_alloc(gsl_rng_taus);
+	gsl_rng_set(sim->mate_rng, next_seed(sim));
+
+	sim->parents = sim_take(sim, pop_size*sizeof(Degnome));
+	sim->children = sim_take(sim, pop_size*sizeof(Degnome));
+	CHECKMEM(sim->parents && sim->children);
+	for (int b = 0; b < 2; b++) {
+		sim->allele_buf[b] = pop_alloc(sim, cells*sizeof(allele_t));
+		sim->goi_buf[b] = pop_alloc(sim, cells*sizeof(int));
+		CHECKMEM(sim->allele_buf[b] && sim->goi_buf[b]);
+	}
+	sim->current = 0;
+	sim->goi_hash[0] = NULL;		// made by the first sim_identical
+	sim->goi_hash[1] = NULL;
+	sim->hashing = 0;
+	wire_generation(sim, sim->parents, 0);
+	wire_generation(sim, sim->children, 1);
+
+	for (int i = 0; i < pop_size; i++) {
+		sim->parents[i].hat_size = 0;
+
+		for (int j = 0; j < chrom_size; j++) {
+			sim->parents[i].dna_array[j] = ALLELE_FROM(10);	//children aren't initialized
+			sim->parents[i].hat_size += 10;
+			sim->parents[i].GOI_array[j] = (i);	//track ancestries
+		}
+	}
+	sim->hat_sizes = sim_take(sim, pop_size*sizeof(double));
+	sim->cum_fit = sim_take(sim, pop_size*sizeof(double));
+	sim->moms = sim_take(sim, pop_size*sizeof(int));
+	sim->dads = sim_take(sim, pop_size*sizeof(int));
+	CHECKMEM(sim->hat_sizes && sim->cum_fit && sim->moms && sim->dads);
+	sim->trait_values = NULL;
+	sim->traits_gen = -1;
+	if (sim->traits != NULL) {
+		sim->trait_values = sim_take(sim, (size_t) pop_size * TraitMatrix_traits(sim->traits)
+									 * sizeof(double));
+		CHECKMEM(sim->trait_values);
+	}
+
+	sim->diversity = 1;
+	sim->percent_block = NULL;		// made by the first sim_diversity
+	sim->percent_decent = NULL;
+
+	sim->prof = NULL;
+	sim->at = NULL;
+	sim->blocks = NULL;
+	sim->nblocks = 0;
+
+	sim->dat = sim_take(sim, pop_size*sizeof(JobData));
+	CHECKMEM(sim->dat);
+	for (int j = 0; j < pop_size; j++) {
+		sim->dat[j].sim = sim;
+	}
+
+	return sim;
+}
+
+static void calculate_diversity(Sim* sim) {
+	Degnome* generation = sim->parents;
+	int pop_size = sim->par.pop_size;
+	int len = sim->par.chrom_size;
+	double diversity = 0;
+
+	// pop_size squared, so not made unless asked for
+	if (sim->percent_block == NULL) {
+		sim->percent_block = sim_take(sim, (size_t) (pop_size+1) * pop_size * sizeof(double));
+		sim->percent_decent = sim_take(sim, (pop_size+1)*sizeof(double*));
+		CHECKMEM(sim->percent_block && sim->percent_decent);
+		for (int i = 0; i < pop_size+1; i++) {
+			sim->percent_decent[i] = sim->percent_block + (size_t) i * pop_size;
+		}
+	}
+	double** percent_decent = sim->percent_decent;
+
+	for (int i = 0; i < pop_size; i++) {			//calculate percent decent for each degnome
+		for (int j = 0; j < pop_size; j++) {
+			percent_decent[i][j] = Kernel_countEqual(generation[i].GOI_array, len, j);
+			percent_decent[i][j] /= len;
+		}
+	}
+	for (int j = 0; j < pop_size; j++) {			//sum and average
+		percent_decent[pop_size][j] = 0;
+		for (int k = 0; k < pop_size; k++) {
+			percent_decent[pop_size][j] += percent_decent[k][j];
+		}
+		percent_decent[pop_size][j] /= pop_size;
+	}
+
+	for (int i = 0; i < pop_size; i++) {			//calculate percent diversity for the entire generation
+		for (int j = 0; j < pop_size; j++) {
+			if (i == j) {
+				continue;
+			}
+			diversity += Kernel_countDiffs(generation[i].GOI_array,
+										   generation[j].GOI_array, len);
+		}
+	}
+	sim->diversity = diversity / ((double) (pop_size-1) * pop_size * len);
+}
+
+/**
+ * Compute percent descent and diversity for the current parents.
+ * If percent_descent is not NULL it is pointed at the
+ * (pop_size+1) x pop_size matrix of descent fractions; the last row
+ * is the population average.
+ */
+double sim_diversity(Sim* sim, double** percent_descent) {
+	double t = Profile_mark(sim->prof);
+	calculate_diversity(sim);
+	Profile_lap(sim->prof, PROF_DIVERSITY, t);
+	if (percent_descent != NULL) {
+		*percent_descent = sim->percent_block;
+	}
+	return sim->diversity;
+}
+
+/**
+ * Mate child j from parents m and d, now or on the JobQueue.  With an
+ * AutoThreads or a blocked schedule the mating waits for the whole
+ * generation in sim_step.
+ */
+static void breed(Sim* sim, int j, int m, int d) {
+	JobData* dat = sim->dat + j;
+
+	dat->child = (sim->children + j);
+	dat->p1 = (sim->parents + m);
+	dat->p2 = (sim->parents + d);
+	dat->hash = (sim->hashing ? sim->goi_hash[!sim->current] + j : NULL);
+
+	if (sim->at != NULL || sim->par.schedule != SIM_SCHEDULE_CHILD) {
+		return;
+	}
+	if (sim->jq != NULL) {
+		JobQueue_addJob(sim->jq, jobfunc, dat);
+	}
+	else {
+		jobfunc(dat, sim->mate_rng);
+	}
+}
+
+/**
+ * Mate the generation as one block per worker, or as one block
+ * inline if there is no JobQueue.  A Sim sharing someone else's
+ * JobQueue assumes a worker per core.
+ */
+static void mate_blocks(Sim* sim) {
+	int pop_size = sim->par.pop_size;
+
+	if (sim->blocks == NULL) {
+		int n = 1;
+		if (sim->jq != NULL) {
+			n = (sim->par.num_threads > 0 ? sim->par.num_threads : getNumCores());
+		}
+		if (n > pop_size) {
+			n = pop_size;
+		}
+		if (n < 1) {
+			n = 1;
+		}
+		sim->blocks = sim_take(sim, n*sizeof(SimBlock));
+		CHECKMEM(sim->blocks);
+		sim->nblocks = n;
+		for (int b = 0; b < n; b++) {
+			sim->blocks[b].sim = sim;
+			sim->blocks[b].begin = (int) ((long) pop_size * b / n);
+			sim->blocks[b].end = (int) ((long) pop_size * (b+1) / n);
+		}
+	}
+
+	if (sim->jq == NULL) {
+		blockfunc(sim->blocks, sim->mate_rng);
+		return;
+	}
+	for (int b = 0; b < sim->nblocks; b++) {
+		JobQueue_addJob(sim->jq, blockfunc, sim->blocks + b);
+	}
+	JobQueue_waitOnJobs(sim->jq);
+}
+
+/// Breed one generation and make the offspring the new parents.
+void sim_step(Sim* sim) {
+	int pop_size = sim->par.pop_size;
+	Degnome* parents = sim->parents;
+	Degnome* children = sim->children;
+	gsl_rng* rng = sim->rng;
+	Profile* prof = sim->prof;
+	int blocked = (sim->at == NULL && sim->par.schedule != SIM_SCHEDULE_CHILD);
+	int breed_phase = (sim->at != NULL || blocked ? PROF_SELECT :
+					   sim->jq != NULL ? PROF_SUBMIT : PROF_MATE);
+	double t = Profile_mark(prof);
+
+	bind_thread(sim);
+
+	if (!sim->par.uniform) {
+		double* cum_hat_size = sim->cum_fit;
+
+		if (sim->par.selective && sim->traits != NULL) {
+			update_traits(sim);
+			get_fitness_traits(sim->trait_values, TraitMatrix_traits(sim->traits),
+							   cum_hat_size, pop_size);
+		}
+		else {
+			for (int j = 0; j < pop_size; j++) {
+				//in runs withoutslection, everybody is equally fit
+				cum_hat_size[j] = (sim->par.selective ? parents[j].hat_size : 100);
+			}
+			if (sim->par.selective) {
+				get_fitness_batch(cum_hat_size, cum_hat_size, pop_size);
+			}
+		}
+		for (int j = 1; j < pop_size; j++) {
+			cum_hat_size[j] += cum_hat_size[j-1];
+		}
+		double total_hat_size = cum_hat_size[pop_size-1];
+		t = Profile_lap(prof, PROF_FITNESS, t);
+
+		for (int j = 0; j < pop_size; j++) {
+			gsl_rng_set(rng, next_seed(sim));
+
+			int m, d;
+
+			double win_m = gsl_rng_uniform(rng);
+			win_m *= total_hat_size;
+			double win_d = gsl_rng_uniform(rng);
+			win_d *= total_hat_size;
+
+			for (m = 0; cum_hat_size[m] < win_m; m++) {
+				continue;
+			}
+
+			for (d = 0; cum_hat_size[d] < win_d; d++) {
+				continue;
+			}
+
+			t = Profile_lap(prof, PROF_SELECT, t);
+			breed(sim, j, m, d);
+			t = Profile_lap(prof, breed_phase, t);
+		}
+	}
+	else {
+		int* moms = sim->moms;
+		int* dads = sim->dads;
+		int mom_max = pop_size;
+		int dad_max = pop_size;
+
+		int m, d;
+
+		for (int j = 0; j < pop_size; j++) {
+			moms[j] = j;
+			dads[j] = j;
+		}
+
+		for (int j = 0; j < pop_size; j++) {
+			gsl_rng_set(rng, next_seed(sim));
+
+			int index_m = (int) gsl_rng_uniform_int (rng, mom_max);
+			int index_d = (int) gsl_rng_uniform_int (rng, dad_max);
+
+			m = moms[index_m];
+			d = dads[index_d];
+
+			//reduce the pool of available degnomes
+			//in order to make sure everybody get's two chances to mate
+			//one as a dad and one as a mom
+
+			int temp_m = moms[index_m];
+			int temp_d = dads[index_d];
+			moms[index_m] = moms[mom_max-1];
+			dads[index_d] = dads[dad_max-1];
+			moms[mom_max-1] = temp_m;
+			dads[dad_max-1] = temp_d;
+
+			mom_max--;
+			dad_max--;
+
+			t = Profile_lap(prof, PROF_SELECT, t);
+			breed(sim, j, m, d);
+			t = Profile_lap(prof, breed_phase, t);
+		}
+	}
+
+	if (blocked) {
+		mate_blocks(sim);
+		Profile_lap(prof, (sim->jq != NULL ? PROF_WAIT : PROF_MATE), t);
+	}
+	else if (sim->jq != NULL) {
+		JobQueue_waitOnJobs(sim->jq);
+		Profile_lap(prof, PROF_WAIT, t);
+	}
+	else if (sim->at != NULL) {
+		AutoThreads_run(sim->at, jobfunc, sim->dat, sizeof(JobData), pop_size);
+		Profile_lap(prof, (AutoThreads_threads(sim->at) ? PROF_WAIT : PROF_MATE), t);
+	}
+	Profile_generation(prof, pop_size);
+
+	sim->children = parents;
+	sim->parents = children;
+	sim->current = !sim->current;
+	sim->generation++;
+}
+
+/**
+ * 1 if every degnome of the current generation has the same ancestry,
+ * so that sim_diversity would be 0.  The first call hashes the
+ * ancestries; after that they are hashed as children are mated, and
+ * this takes time proportional to pop_size until they all match.
+ */
+int sim_identical(Sim* sim) {
+	int pop_size = sim->par.pop_size;
+	size_t bytes = sim->par.chrom_size * sizeof(int);
+	Degnome* parents = sim->parents;
+	double t = Profile_mark(sim->prof);
+	int identical = (pop_size > 1);		// a population of one has no diversity
+
+	if (!sim->hashing) {
+		for (int b = 0; b < 2; b++) {
+			sim->goi_hash[b] = sim_take(sim, pop_size*sizeof(uint64_t));
+			CHECKMEM(sim->goi_hash[b]);
+		}
+		for (int i = 0; i < pop_size; i++) {
+			sim->goi_hash[sim->current][i] = Kernel_hash(parents[i].GOI_array, bytes);
+		}
+		sim->hashing = 1;
+	}
+
+	uint64_t* hash = sim->goi_hash[sim->current];
+	for (int i = 1; i < pop_size && identical; i++) {
+		identical = (hash[i] == hash[0]);
+	}
+	// all equal hashes happens once a run, so make sure
+	for (int i = 1; i < pop_size && identical; i++) {
+		identical = (memcmp(parents[i].GOI_array, parents[0].GOI_array, bytes) == 0);
+	}
+	Profile_lap(sim->prof, PROF_DIVERSITY, t);
+
+	return identical;
+}
+
+/**
+ * Step up to num_gens generations.  If break_at_zero_diversity is
+ * set, stop as soon as every degnome has identical ancestry.
+ * Returns the number of generations actually run.
+ */
+int sim_run(Sim* sim, int num_gens, int break_at_zero_diversity) {
+	for (int i = 0; i < num_gens; i++) {
+		if (break_at_zero_diversity && sim_identical(sim)) {
+			return i;
+		}
+		sim_step(sim);
+	}
+	return num_gens;
+}
+
+/// Charge this Sim's phases to prof, or stop profiling if NULL.
+void sim_set_profile(Sim* sim, Profile* prof) {
+	sim->prof = prof;
+}
+
+/// The JobQueue this Sim mates on, or NULL.
+JobQueue* sim_job_queue(const Sim* sim) {
+	return (sim->at != NULL ? AutoThreads_jobQueue(sim->at) : sim->jq);
+}
+
+int sim_generation(const Sim* sim) {
+	return sim->generation;
+}
+
+void sim_get_population(Sim* sim, SimPopulation* pop) {
+	for (int i = 0; i < sim->par.pop_size; i++) {
+		sim->hat_sizes[i] = sim->parents[i].hat_size;
+	}
+
+	pop->generation = sim->generation;
+	pop->pop_size = sim->par.pop_size;
+	pop->chrom_size = sim->par.chrom_size;
+	pop->alleles = sim->allele_buf[sim->current];
+	pop->ancestries = sim->goi_buf[sim->current];
+	pop->hat_sizes = sim->hat_sizes;
+	pop->num_traits = 0;
+	pop->traits = NULL;
+	if (sim->traits != NULL) {
+		update_traits(sim);
+		pop->num_traits = TraitMatrix_traits(sim->traits);
+		pop->traits = sim->trait_values;
+	}
+}
+
+/// Compute the parents' traits, unless they already are.
+static void update_traits(Sim* sim) {
+	if (sim->traits_gen == sim->generation) {
+		return;
+	}
+	TraitMatrix_apply(sim->traits, sim->allele_buf[sim->current], sim->par.pop_size,
+					  sim->trait_values);
+	sim->traits_gen = sim->generation;
+}
+
+void sim_free(Sim* sim) {
+	if (sim->owns_jq) {
+		JobQueue_noMoreJobs(sim->jq);
+		JobQueue_free(sim->jq);
+	}
+	if (sim->at != NULL) {
+		AutoThreads_free(sim->at);
+	}
+	sim_give(sim, sim->dat);
+	sim_give(sim, sim->blocks);
+	sim_give(sim, sim->goi_hash[0]);
+	sim_give(sim, sim->goi_hash[1]);
+
+	size_t cells = (size_t) sim->par.pop_size * sim->par.chrom_size;
+	for (int b = 0; b < 2; b++) {
+		pop_free(sim, sim->allele_buf[b], cells*sizeof(allele_t));
+		pop_free(sim, sim->goi_buf[b], cells*sizeof(int));
+	}
+	sim_give(sim, sim->parents);
+	sim_give(sim, sim->children);
+	sim_give(sim, sim->hat_sizes);
+	sim_give(sim, sim->cum_fit);
+	sim_give(sim, sim->moms);
+	sim_give(sim, sim->dads);
+	sim_give(sim, sim->trait_values);
+	Degnome_freeScratch();
+	sim_give(sim, sim->percent_decent);
+	sim_give(sim, sim->percent_block);
+
+	if (sim->recomb != NULL) {
+		RecombMap_free(sim->recomb);
+	}
+	if (sim->mutmap != NULL) {
+		MutationMap_free(sim->mutmap);
+	}
+	if (sim->traits != NULL) {
+		TraitMatrix_free(sim->traits);
+	}
+	gsl_rng_free(sim->rng);
+	gsl_rng_free(sim->mate_rng);
+	pthread_mutex_destroy(&sim->seedLock);
+	free(sim);
+}
+
+/// "double", "float" or "fixed": the type of SimPopulation.alleles.
+const char* sim_allele_type(void) {
+	return ALLELE_NAME;
+}
+
+/// What an allele of 1.0 is stored as: ALLELE_SCALE if fixed point, else 1.
+double sim_allele_scale(void) {
+	return (double) ALLELE_FROM(1);
+}
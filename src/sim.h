@@ -0,0 +1,87 @@
+/**
+ * @file sim.h
+ * @author Daniel R. Tabin
+ * @brief Header for sim.c, the devosim engine and libdevosim C API
+ */
+
+#ifndef SIM
+#define SIM
+
+#include "jobqueue.h"
+#include "profile.h"
+#include "autothreads.h"
+#include "placement.h"
+#include "allele.h"
+#include "arena.h"
+
+typedef struct Sim Sim;
+
+/// How a generation's children are handed to the JobQueue.
+enum {
+	SIM_SCHEDULE_CHILD,		// one job per child, in order
+	SIM_SCHEDULE_BLOCK,		// one contiguous block of children per worker
+	SIM_SCHEDULE_SORTED		// blocks, each mated in order of parent
+};
+
+/// Everything that can be set on the devosim command line.
+typedef struct SimParams SimParams;
+struct SimParams {
+	int chrom_size;
+	int pop_size;
+	int mutation_rate;
+	int mutation_effect;
+	int crossover_rate;
+	int selective;			// select parents by fitness
+	int uniform;			// every degnome is a parent exactly twice
+	int fit_func;			// 0 linear, 1 sqrt, 2 close, 3 ceiling, 4 log
+	int target;				// target hat height for close and ceiling
+	int num_threads;		// 0 => 3/4 of the cores, THREADS_AUTO => per step
+	unsigned long seed;		// 0 => seed from the time and pid
+	int pin_threads;		// pin each worker to its own core
+	int placement;			// PLACE_* policy for the population buffers
+	int schedule;			// SIM_SCHEDULE_*; ignored with THREADS_AUTO
+	const char* mmap_dir;	// NULL => in memory, else files in this directory
+	const char* recomb_file;	// NULL => uniform crossovers, else a map (recomb.c)
+	const char* mutation_file;	// NULL => mutation_rate and _effect, else a map (mutmap.c)
+	const char* traits_file;	// NULL => select on hat size, else on traits (traits.c)
+};
+
+/**
+ * A view of the current parent generation.  The arrays belong to the
+ * Sim and stay valid until the next call to sim_step or sim_free.
+ * alleles and ancestries are pop_size rows of chrom_size values each,
+ * stored contiguously in row-major order.  alleles are of the type
+ * named by sim_allele_type, with fixed point values in units of
+ * 1/sim_allele_scale.  With par.traits_file set, traits holds
+ * num_traits traits per degnome, pop_size rows in row-major order;
+ * otherwise num_traits is 0 and traits is NULL.
+ */
+typedef struct SimPopulation SimPopulation;
+struct SimPopulation {
+	int generation;
+	int pop_size;
+	int chrom_size;
+	allele_t* alleles;
+	int* ancestries;		// GOI of each allele
+	double* hat_sizes;
+	int num_traits;
+	double* traits;
+};
+
+void	sim_default_params(SimParams* params);
+Sim*	sim_new(const SimParams* params);
+Sim*	sim_new_with_queue(const SimParams* params, JobQueue* jq);
+Sim*	sim_new_in(const SimParams* params, JobQueue* jq, DegnomeArena* arena);
+void	sim_step(Sim* sim);
+int		sim_run(Sim* sim, int num_gens, int break_at_zero_diversity);
+void	sim_set_profile(Sim* sim, Profile* prof);
+JobQueue* sim_job_queue(const Sim* sim);
+int		sim_generation(const Sim* sim);
+void	sim_get_population(Sim* sim, SimPopulation* pop);
+double	sim_diversity(Sim* sim, double** percent_descent);
+int		sim_identical(Sim* sim);
+void	sim_free(Sim* sim);
+const char*	sim_allele_type(void);
+double	sim_allele_scale(void);
+
+#endif
@@ -0,0 +1,348 @@
+/**
+@file sweep.c
+@page sweep
+@author Daniel R. Tabin
+@brief Parameter sweeps that share one thread pool
+
+A sweep runs devosim once for every combination of the values in a
+grid file, all in one process on one JobQueue.  Each line of the
+file names a parameter and lists the values it should take:
+
+	# comments and blank lines are ignored
+	m 0 1 2
+	o 1 2 4
+	p 10 100 1000
+	fit linear sqrt
+	mode random selective
+
+Parameters are c, e, g, m, o, p and target (integers), fit (linear,
+sqrt, close, ceiling or log) and mode (random, selective or
+uniform).  Anything not in the file comes from the command line.
+
+Runs with fewer than SWEEP_SMALL_CELLS alleles are too small to
+split, so each is a single job that breeds every child inline on
+its worker.  Larger runs then go one at a time with their children
+spread across the same pool.  Results come out one tagged line per
+run, in grid order.
+
+Each thread that runs a Sim keeps a DegnomeArena (see arena.c) and
+resets it after every run, so a sweep of many small runs allocates
+its populations once per thread instead of once per run.
+*/
+
+#include "sweep.h"
+#include "jobqueue.h"
+#include "arena.h"
+#include "checkmem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include <gsl/gsl_rng.h>
+
+// pop_size * chrom_size below which a run gets a worker to itself
+#define SWEEP_SMALL_CELLS (1 << 17)
+
+#define SWEEP_MAX_VALUES 256
+
+// slab size of each thread's arena: all of a small run fits in one
+#define SWEEP_ARENA_SLAB (1 << 22)
+
+enum {KEY_C, KEY_E, KEY_G, KEY_M, KEY_O, KEY_P, KEY_TARGET, KEY_FIT, KEY_MODE, NUM_KEYS};
+
+static const char* key_names[] = {"c", "e", "g", "m", "o", "p", "target", "fit", "mode"};
+static const char* fit_names[] = {"linear", "sqrt", "close", "ceiling", "log"};
+static const char* mode_names[] = {"random", "selective", "uniform"};
+
+typedef struct SweepAxis SweepAxis;
+struct SweepAxis {
+	int key;
+	int n;
+	int vals[SWEEP_MAX_VALUES];
+};
+
+typedef struct SweepRun SweepRun;
+struct SweepRun {
+	int id;
+	SimParams par;
+	int num_gens;
+	int break_at_zero_diversity;
+
+	int generations;			// generations actually run
+	double mean_hat_size;
+	double var_hat_size;
+	double diversity;
+};
+
+struct Sweep {
+	int nruns;
+	SweepRun* runs;
+
+	pthread_mutex_t seedLock;	// seeds for the workers' generators
+	unsigned long rngseed;
+	int pin;					// pin the workers, from base->pin_threads
+};
+
+void *Sweep_ThreadState_new(void *sw);
+void Sweep_ThreadState_free(void *rng);
+int Sweep_runjob(void* p, void* tdat);
+static void run_one(SweepRun* run, JobQueue* jq);
+static int lookup(const char* name, const char** names, int n);
+static unsigned long mix_seed(unsigned long x);
+static void free_arena(void);
+
+// populations of the runs on this thread, made by the first
+static __thread DegnomeArena* run_arena = NULL;
+
+void *Sweep_ThreadState_new(void *arg) {
+	Sweep* sw = (Sweep*) arg;
+	gsl_rng *rng = gsl_rng_alloc(gsl_rng_taus);
+
+	pthread_mutex_lock(&sw->seedLock);
+	gsl_rng_set(rng, sw->rngseed);
+	sw->rngseed = (sw->rngseed == ULONG_MAX ? 0 : sw->rngseed + 1);
+	pthread_mutex_unlock(&sw->seedLock);
+
+	return rng;
+}
+
+void Sweep_ThreadState_free(void *rng) {
+	gsl_rng_free((gsl_rng *) rng);
+	free_arena();
+}
+
+/// Free the calling thread's arena, if it ran any Sims.
+static void free_arena(void) {
+	if (run_arena != NULL) {
+		DegnomeArena_free(run_arena);
+		run_arena = NULL;
+	}
+}
+
+static int lookup(const char* name, const char** names, int n) {
+	for (int i = 0; i < n; i++) {
+		if (strcmp(name, names[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Sims consume consecutive seeds, so neighbouring runs must not start
+ * from neighbouring seeds.  This is the splitmix64 finalizer.
+ */
+static unsigned long mix_seed(unsigned long x) {
+	unsigned long long z = x + 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	return (z == 0 ? 1 : (unsigned long) z);
+}
+
+Sweep* Sweep_new(const char* gridfile, const SimParams* base, int num_gens,
+				 int break_at_zero_diversity) {
+	FILE* fp = fopen(gridfile, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "%s:%d: can't open grid file \"%s\"\n",
+				__FILE__, __LINE__, gridfile);
+		exit(EXIT_FAILURE);
+	}
+
+	SweepAxis* axes = malloc(NUM_KEYS*sizeof(SweepAxis));
+	CHECKMEM(axes);
+	int naxes = 0;
+	char line[4096];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		char* save;
+		char* tok = strtok_r(line, " \t\r\n", &save);
+		if (tok == NULL || tok[0] == '#') {
+			continue;
+		}
+
+		int key = lookup(tok, key_names, NUM_KEYS);
+		if (key < 0) {
+			fprintf(stderr, "%s:%d: unknown parameter \"%s\"\n", gridfile, lineno, tok);
+			exit(EXIT_FAILURE);
+		}
+		for (int a = 0; a < naxes; a++) {
+			if (axes[a].key == key) {
+				fprintf(stderr, "%s:%d: \"%s\" listed twice\n", gridfile, lineno, tok);
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		SweepAxis* ax = axes + naxes++;
+		ax->key = key;
+		ax->n = 0;
+		while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL && tok[0] != '#') {
+			int v;
+			char* end;
+			if (key == KEY_FIT) {
+				v = lookup(tok, fit_names, 5);
+			}
+			else if (key == KEY_MODE) {
+				v = lookup(tok, mode_names, 3);
+			}
+			else {
+				long l = strtol(tok, &end, 10);
+				v = (*end == '\0' && l >= 0 && l <= INT_MAX) ? (int) l : -1;
+			}
+			if (v < 0 || ax->n == SWEEP_MAX_VALUES) {
+				fprintf(stderr, "%s:%d: bad value \"%s\"\n", gridfile, lineno, tok);
+				exit(EXIT_FAILURE);
+			}
+			ax->vals[ax->n++] = v;
+		}
+		if (ax->n == 0) {
+			fprintf(stderr, "%s:%d: no values for \"%s\"\n", gridfile, lineno, key_names[key]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	fclose(fp);
+
+	Sweep* sw = malloc(sizeof(Sweep));
+	CHECKMEM(sw);
+	sw->nruns = 1;
+	for (int a = 0; a < naxes; a++) {
+		if (sw->nruns > INT_MAX / axes[a].n) {
+			fprintf(stderr, "%s: more than %d runs in the grid\n", gridfile, INT_MAX);
+			exit(EXIT_FAILURE);
+		}
+		sw->nruns *= axes[a].n;
+	}
+	sw->runs = malloc((size_t) sw->nruns*sizeof(SweepRun));
+	CHECKMEM(sw->runs);
+
+	unsigned long seed = base->seed;
+	if (seed == 0) {
+		seed = ((unsigned long) time(NULL)) ^ ((unsigned long) getpid());
+	}
+	pthread_mutex_init(&sw->seedLock, NULL);
+	sw->rngseed = mix_seed(seed);
+	sw->pin = base->pin_threads;
+
+	// Cartesian product of the axes, last axis varying fastest
+	for (int r = 0; r < sw->nruns; r++) {
+		SweepRun* run = sw->runs + r;
+		run->id = r;
+		run->par = *base;
+		run->par.seed = mix_seed(seed + r + 1);
+		run->num_gens = num_gens;
+		run->break_at_zero_diversity = break_at_zero_diversity;
+
+		int rest = r;
+		for (int a = naxes - 1; a >= 0; a--) {
+			int v = axes[a].vals[rest % axes[a].n];
+			rest /= axes[a].n;
+
+			switch (axes[a].key) {
+			case KEY_C: run->par.chrom_size = v; break;
+			case KEY_E: run->par.mutation_effect = v; break;
+			case KEY_G: run->num_gens = v; break;
+			case KEY_M: run->par.mutation_rate = v; break;
+			case KEY_O: run->par.crossover_rate = v; break;
+			case KEY_P: run->par.pop_size = v; break;
+			case KEY_TARGET: run->par.target = v; break;
+			case KEY_FIT: run->par.fit_func = v; break;
+			case KEY_MODE:
+				run->par.selective = (v == 1);
+				run->par.uniform = (v == 2);
+				break;
+			}
+		}
+		if (run->par.chrom_size < 1 || run->par.pop_size < 2) {
+			fprintf(stderr, "%s: run %d needs c >= 1 and p >= 2\n", gridfile, r);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	free(axes);
+	return sw;
+}
+
+int Sweep_size(const Sweep* sw) {
+	return sw->nruns;
+}
+
+/// Run one simulation to completion and record its summary.
+static void run_one(SweepRun* run, JobQueue* jq) {
+	if (run_arena == NULL) {
+		run_arena = DegnomeArena_new(SWEEP_ARENA_SLAB);
+	}
+	Sim* sim = sim_new_in(&run->par, jq, run_arena);
+	SimPopulation pop;
+
+	run->generations = sim_run(sim, run->num_gens, run->break_at_zero_diversity);
+	run->diversity = sim_diversity(sim, NULL);
+	sim_get_population(sim, &pop);
+
+	double sum = 0;
+	double sumsq = 0;
+	for (int i = 0; i < pop.pop_size; i++) {
+		sum += pop.hat_sizes[i];
+		sumsq += pop.hat_sizes[i] * pop.hat_sizes[i];
+	}
+	run->mean_hat_size = sum / pop.pop_size;
+	run->var_hat_size = (sumsq - sum * run->mean_hat_size) / (pop.pop_size - 1);
+
+	sim_free(sim);
+	DegnomeArena_reset(run_arena);
+}
+
+/// A whole small run as one job, bred inline on this worker.
+int Sweep_runjob(void* p, void* tdat) {
+	run_one((SweepRun*) p, NULL);
+	return 0;
+}
+
+void Sweep_run(Sweep* sw, int num_threads, FILE* out) {
+	JobQueue* jq = JobQueue_new(num_threads, sw, Sweep_ThreadState_new,
+								Sweep_ThreadState_free);
+	JobQueue_pinWorkers(jq, sw->pin);
+
+	for (int r = 0; r < sw->nruns; r++) {
+		SweepRun* run = sw->runs + r;
+		if ((long) run->par.pop_size * run->par.chrom_size < SWEEP_SMALL_CELLS) {
+			JobQueue_addJob(jq, Sweep_runjob, run);
+		}
+	}
+	JobQueue_waitOnJobs(jq);
+
+	for (int r = 0; r < sw->nruns; r++) {
+		SweepRun* run = sw->runs + r;
+		if ((long) run->par.pop_size * run->par.chrom_size >= SWEEP_SMALL_CELLS) {
+			run_one(run, jq);
+		}
+	}
+
+	JobQueue_noMoreJobs(jq);
+	JobQueue_free(jq);
+	free_arena();
+
+	fprintf(out, "run\tc\tp\tg\tm\te\to\tfit\ttarget\tmode\tgenerations"
+			"\tmean_hat_size\tvar_hat_size\tpercent_diversity\n");
+	for (int r = 0; r < sw->nruns; r++) {
+		SweepRun* run = sw->runs + r;
+		int mode = run->par.selective ? 1 : (run->par.uniform ? 2 : 0);
+		int f = run->par.fit_func;
+
+		fprintf(out, "%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\t%d\t%s\t%d\t%lf\t%lf\t%lf\n",
+				run->id, run->par.chrom_size, run->par.pop_size, run->num_gens,
+				run->par.mutation_rate, run->par.mutation_effect,
+				run->par.crossover_rate, fit_names[(f >= 0 && f <= 4) ? f : 0],
+				run->par.target, mode_names[mode], run->generations,
+				run->mean_hat_size, run->var_hat_size, 100*run->diversity);
+	}
+}
+
+void Sweep_free(Sweep* sw) {
+	pthread_mutex_destroy(&sw->seedLock);
+	free(sw->runs);
+	free(sw);
+}
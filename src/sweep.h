@@ -0,0 +1,21 @@
+/**
+ * @file sweep.h
+ * @author Daniel R. Tabin
+ * @brief Header for sweep.c
+ */
+
+#ifndef SWEEP
+#define SWEEP
+
+#include "sim.h"
+#include <stdio.h>
+
+typedef struct Sweep Sweep;
+
+Sweep*	Sweep_new(const char* gridfile, const SimParams* base, int num_gens,
+				  int break_at_zero_diversity);
+int		Sweep_size(const Sweep* sw);
+void	Sweep_run(Sweep* sw, int num_threads, FILE* out);
+void	Sweep_free(Sweep* sw);
+
+#endif
@@ -0,0 +1,229 @@
+/**
+@file trace.c
+@page trace
+@author Daniel R. Tabin
+@brief Timeline of job execution, written as Chrome trace JSON
+
+Profile (see profile.c) says how much time went where; a trace says
+when.  With tracing on, every thread records what it does into a ring
+buffer of its own: each job a worker runs, each wait for work, each
+wait of the main thread in JobQueue_waitOnJobs, each wakeup sent to a
+sleeping worker, and the start of each generation.  Trace_finish
+writes them all as one JSON file in the Chrome trace event format,
+which chrome://tracing and https://ui.perfetto.dev open directly, one
+row per thread.  Load imbalance shows up as workers idling while one
+is still busy at the end of a generation.
+
+Timestamps come from the monotonic clock, in microseconds from
+Trace_start.  A buffer holds the last TRACE_CAPACITY events of its
+thread; older ones are overwritten, so a long run keeps its end.
+Buffers outlive their threads and are written and freed by
+Trace_finish, which Trace_start arranges to run at exit.
+
+The hooks in the code are the TRACE_* macros of trace.h.  When
+tracing is off each is one well-predicted branch on trace_on.
+*/
+
+#include "trace.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define TRACE_CAPACITY (1 << 16)	// events per thread
+
+typedef struct TraceEvent TraceEvent;
+struct TraceEvent {
+	double begin;				// seconds; equal to end for instants
+	double end;
+	long arg;
+	int kind;
+};
+
+typedef struct TraceBuf TraceBuf;
+struct TraceBuf {
+	TraceBuf* next;				// all buffers, newest first
+	int tid;
+	char name[32];
+	double since[TRACE_NUM_KINDS];	// begin of each open span
+	long count;					// events ever recorded
+	TraceEvent events[TRACE_CAPACITY];
+};
+
+int trace_on = 0;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceBuf* buffers = NULL;
+static int num_buffers = 0;
+static char* trace_path = NULL;
+static double trace_start = 0;
+static int epoch = 0;				// bumped by Trace_finish
+static __thread TraceBuf* mine = NULL;
+static __thread int mine_epoch = -1;	// a buffer of an older trace is gone
+
+static const char* kind_names[] = {"job", "idle", "wait", "wake", "generation"};
+
+static double now(void);
+static TraceBuf* my_buffer(void);
+static void record(int kind, double begin, double end, long arg);
+static void finish_at_exit(void);
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/// This thread's buffer, made on first use.
+static TraceBuf* my_buffer(void) {
+	if (mine == NULL || mine_epoch != epoch) {
+		mine = malloc(sizeof(TraceBuf));
+		CHECKMEM(mine);
+		mine->count = 0;
+		mine->name[0] = '\0';
+		pthread_mutex_lock(&trace_lock);
+		mine_epoch = epoch;
+		mine->tid = num_buffers++;
+		mine->next = buffers;
+		buffers = mine;
+		pthread_mutex_unlock(&trace_lock);
+	}
+	return mine;
+}
+
+static void record(int kind, double begin, double end, long arg) {
+	TraceBuf* buf = my_buffer();
+	TraceEvent* e = buf->events + (buf->count % TRACE_CAPACITY);
+
+	e->begin = begin;
+	e->end = end;
+	e->arg = arg;
+	e->kind = kind;
+	buf->count++;
+}
+
+static void finish_at_exit(void) {
+	Trace_finish();
+}
+
+/**
+ * Start tracing every thread, to be written to path by Trace_finish
+ * or at exit.  The calling thread is named "main".  Returns 0, or -1
+ * if tracing was already on.
+ */
+int Trace_start(const char* path) {
+	static int registered = 0;
+
+	if (trace_on) {
+		return -1;
+	}
+	trace_path = malloc(strlen(path) + 1);
+	CHECKMEM(trace_path);
+	strcpy(trace_path, path);
+	trace_start = now();
+	if (!registered) {
+		atexit(finish_at_exit);
+		registered = 1;
+	}
+	trace_on = 1;
+	Trace_nameThread("main", -1);
+	return 0;
+}
+
+/// Name the calling thread's row, with n appended unless negative.
+void Trace_nameThread(const char* name, int n) {
+	if (!trace_on) {
+		return;
+	}
+	TraceBuf* buf = my_buffer();
+	if (n < 0) {
+		snprintf(buf->name, sizeof(buf->name), "%s", name);
+	}
+	else {
+		snprintf(buf->name, sizeof(buf->name), "%s %d", name, n);
+	}
+}
+
+void Trace_begin(int kind) {
+	my_buffer()->since[kind] = now();
+}
+
+/// Close the span opened by Trace_begin(kind) on this thread.
+void Trace_end(int kind, long arg) {
+	record(kind, my_buffer()->since[kind], now(), arg);
+}
+
+void Trace_instant(int kind, long arg) {
+	double t = now();
+	record(kind, t, t, arg);
+}
+
+/**
+ * Stop tracing and write every buffer to the path given to
+ * Trace_start.  Call it once the JobQueues are freed, so no worker is
+ * still recording.  Returns 0 on success, -1 if tracing was off or
+ * the file could not be written.
+ */
+int Trace_finish(void) {
+	if (!trace_on) {
+		return -1;
+	}
+	trace_on = 0;
+
+	FILE* out = fopen(trace_path, "w");
+	if (out == NULL) {
+		fprintf(stderr, "%s:%d: can't write trace \"%s\"\n",
+				__FILE__, __LINE__, trace_path);
+	}
+
+	pthread_mutex_lock(&trace_lock);
+	if (out != NULL) {
+		const char* sep = "";
+		fprintf(out, "{\"traceEvents\":[\n");
+		for (TraceBuf* buf = buffers; buf != NULL; buf = buf->next) {
+			if (buf->name[0] != '\0') {
+				fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+						"\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+						sep, buf->tid, buf->name);
+				sep = ",\n";
+			}
+			long first = (buf->count > TRACE_CAPACITY ? buf->count - TRACE_CAPACITY : 0);
+			for (long k = first; k < buf->count; k++) {
+				TraceEvent* e = buf->events + (k % TRACE_CAPACITY);
+				double ts = 1e6 * (e->begin - trace_start);
+				const char* name = kind_names[e->kind];
+				if (e->kind == TRACE_WAKE || e->kind == TRACE_GENERATION) {
+					fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"%c\",\"pid\":1,"
+							"\"tid\":%d,\"ts\":%.3f,\"args\":{\"n\":%ld}}",
+							sep, name, (e->kind == TRACE_GENERATION ? 'p' : 't'),
+							buf->tid, ts, e->arg);
+				}
+				else {
+					fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+							"\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+							sep, name, buf->tid, ts, 1e6 * (e->end - e->begin));
+				}
+				sep = ",\n";
+			}
+		}
+		fprintf(out, "\n]}\n");
+	}
+
+	while (buffers != NULL) {
+		TraceBuf* next = buffers->next;
+		free(buffers);
+		buffers = next;
+	}
+	num_buffers = 0;
+	epoch++;
+	pthread_mutex_unlock(&trace_lock);
+
+	free(trace_path);
+	trace_path = NULL;
+	if (out == NULL || fclose(out) != 0) {
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file trace.h
+ * @author Daniel R. Tabin
+ * @brief Header for trace.c
+ */
+
+#ifndef TRACE
+#define TRACE
+
+/// Kinds of trace event.  Spans have a begin and an end; the others
+/// are instants.
+enum {
+	TRACE_JOB,			// span: a worker running one job
+	TRACE_IDLE,			// span: a worker waiting for a job
+	TRACE_WAIT,			// span: JobQueue_waitOnJobs
+	TRACE_WAKE,			// instant: a sleeping worker was woken
+	TRACE_GENERATION,	// instant: a new generation begins
+	TRACE_NUM_KINDS
+};
+
+extern int trace_on;
+
+// Each costs one branch on trace_on when tracing is off.
+#define TRACE_BEGIN(kind) do {						\
+		if (__builtin_expect(trace_on, 0)) {		\
+			Trace_begin(kind);						\
+		}											\
+	} while (0)
+#define TRACE_END(kind, arg) do {					\
+		if (__builtin_expect(trace_on, 0)) {		\
+			Trace_end((kind), (arg));				\
+		}											\
+	} while (0)
+#define TRACE_INSTANT(kind, arg) do {				\
+		if (__builtin_expect(trace_on, 0)) {		\
+			Trace_instant((kind), (arg));			\
+		}											\
+	} while (0)
+
+int		Trace_start(const char* path);
+void	Trace_nameThread(const char* name, int n);
+void	Trace_begin(int kind);
+void	Trace_end(int kind, long arg);
+void	Trace_instant(int kind, long arg);
+int		Trace_finish(void);
+
+#endif
@@ -0,0 +1,250 @@
+/**
+@file traits.c
+@page traits
+@author Daniel R. Tabin
+@brief Traits as weighted sums of a degnome's alleles
+
+A degnome's hat size is the plain sum of its alleles.  A TraitMatrix
+gives it any number of traits instead, each a weighted sum: with W
+the num_traits x chrom_size matrix of weights, the traits of a
+degnome with alleles x are W x.  A trait file has one interval per
+line: the trait it belongs to (counting from 0), the locus it starts
+at, and the weight of every allele in it:
+
+	# trait 0 is the whole chromosome, trait 1 only its second half
+	0 0 1
+	1 500 1
+	1 800 -0.5
+
+Each interval of a trait runs to the start of the trait's next line,
+or the end of the chromosome.  Loci before a trait's first line have
+weight 0, as does every locus of a trait with no lines, and intervals
+starting past the end of the chromosome are dropped.  The file
+0 0 1 makes one trait equal to the hat size.
+
+Since the alleles of a generation are one pop_size x chrom_size
+matrix, TraitMatrix_apply computes every degnome's traits at once as
+the matrix product alleles x W^T.  While W fits in cache that is
+fastest as one pass of Kernel_weightedSums (see kernels.c) per
+degnome.  A larger W of double alleles goes to cblas_dgemm, which
+blocks the product so that each weight is read once per block of
+degnomes rather than once per degnome; that is gslcblas unless the
+programs are linked against an optimized CBLAS instead (make
+lib=...).  The traits are then turned into fitness by
+get_fitness_traits (see fitfunc.c).
+
+An Ensemble stores the replicates of each degnome as the columns of
+a chrom_size x replicates matrix (see ensemble.c), and
+TraitMatrix_applyColumns takes the traits of all of them in one
+product the same way, by cblas_dgemm for double alleles and by a
+loop over the columns otherwise.
+*/
+
+#include "traits.h"
+#include "kernels.h"
+#include "checkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_cblas.h>
+
+#define TRAITS_MAX_LINE 256
+#define TRAITS_MAX 1024		// traits a file may define
+#define TRAITS_GEMM_BYTES (256 << 10)	// of weights, above which cblas_dgemm wins
+
+struct TraitMatrix {
+	int num_traits;
+	int chrom_size;
+	double* weights;	// num_traits x chrom_size, row-major
+};
+
+/**
+ * A matrix of num_traits traits on a chromosome of chrom_size loci,
+ * trait t weighting allele j by weights[t*chrom_size + j].  The
+ * weights are copied.  NULL if there are no traits or a weight is not
+ * finite.
+ */
+TraitMatrix* TraitMatrix_new(const double* weights, int num_traits, int chrom_size) {
+	if (num_traits < 1 || chrom_size < 0) {
+		return NULL;
+	}
+	size_t cells = (size_t) num_traits * chrom_size;
+	for (size_t k = 0; k < cells; k++) {
+		if (!isfinite(weights[k])) {
+			return NULL;
+		}
+	}
+
+	TraitMatrix* tm = malloc(sizeof(TraitMatrix));
+	CHECKMEM(tm);
+	tm->num_traits = num_traits;
+	tm->chrom_size = chrom_size;
+	tm->weights = malloc((cells > 0 ? cells : 1)*sizeof(double));
+	CHECKMEM(tm->weights);
+	memcpy(tm->weights, weights, cells*sizeof(double));
+
+	return tm;
+}
+
+/**
+ * The traits in the file at path, for a chromosome of chrom_size loci.
+ * Prints what is wrong with the file and exits if it cannot be used.
+ */
+TraitMatrix* TraitMatrix_load(const char* path, int chrom_size) {
+	FILE* in = fopen(path, "r");
+	if (in == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	// the interval each trait is in the middle of
+	int* start = malloc(TRAITS_MAX*sizeof(int));
+	double* weight = malloc(TRAITS_MAX*sizeof(double));
+	CHECKMEM(start && weight);
+	for (int t = 0; t < TRAITS_MAX; t++) {
+		start[t] = -1;
+		weight[t] = 0;
+	}
+	size_t len = (size_t) chrom_size;
+	double* w = NULL;		// rows of weights, 0 until set
+	int rows = 0;
+	int num_traits = 0;
+	char line[TRAITS_MAX_LINE];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		lineno++;
+		char* p = line + strspn(line, " \t\r\n");
+		if (*p == '\0' || *p == '#') {
+			continue;
+		}
+		int t, locus;
+		double x;
+		char extra;
+		if (sscanf(p, "%d %d %lf %c", &t, &locus, &x, &extra) != 3) {
+			fprintf(stderr, "%s:%d: expected a trait, a locus and a weight\n", path, lineno);
+			exit(EXIT_FAILURE);
+		}
+		if (t < 0 || t >= TRAITS_MAX) {
+			fprintf(stderr, "%s:%d: traits are numbered from 0 to %d\n",
+					path, lineno, TRAITS_MAX - 1);
+			exit(EXIT_FAILURE);
+		}
+		if (locus < 0 || locus <= start[t] || !isfinite(x)) {
+			fprintf(stderr, "%s:%d: each trait's loci must increase and weights must be finite\n",
+					path, lineno);
+			exit(EXIT_FAILURE);
+		}
+
+		if (t >= rows) {
+			int more = (2 * rows > t + 1 ? 2 * rows : t + 1);
+			more = (more < TRAITS_MAX ? more : TRAITS_MAX);
+			w = realloc(w, (more * len + 1)*sizeof(double));
+			CHECKMEM(w);
+			memset(w + rows * len, 0, (more - rows) * len * sizeof(double));
+			rows = more;
+		}
+
+		// close the trait's last interval
+		for (int j = start[t]; j >= 0 && j < locus && j < chrom_size; j++) {
+			w[t * len + j] = weight[t];
+		}
+		start[t] = locus;
+		weight[t] = x;
+		num_traits = (t + 1 > num_traits ? t + 1 : num_traits);
+	}
+	fclose(in);
+
+	if (num_traits == 0) {
+		fprintf(stderr, "%s: no traits\n", path);
+		exit(EXIT_FAILURE);
+	}
+	for (int t = 0; t < num_traits; t++) {
+		for (int j = start[t]; j >= 0 && j < chrom_size; j++) {
+			w[t * len + j] = weight[t];
+		}
+	}
+
+	TraitMatrix* tm = TraitMatrix_new(w, num_traits, chrom_size);
+	free(start);
+	free(weight);
+	free(w);
+
+	return tm;
+}
+
+int TraitMatrix_traits(const TraitMatrix* tm) {
+	return tm->num_traits;
+}
+
+/// The num_traits x chrom_size weights, row-major.
+const double* TraitMatrix_weights(const TraitMatrix* tm) {
+	return tm->weights;
+}
+
+/**
+ * The traits of rows degnomes whose alleles are the rows of the
+ * row-major rows x chrom_size matrix alleles: traits is rows x
+ * num_traits, row-major.
+ */
+void TraitMatrix_apply(const TraitMatrix* tm, const allele_t* alleles, int rows,
+					   double* traits) {
+	if (rows <= 0) {
+		return;
+	}
+	if (tm->chrom_size == 0) {
+		memset(traits, 0, (size_t) rows * tm->num_traits * sizeof(double));
+		return;
+	}
+#if !defined(ALLELE_FLOAT) && !defined(ALLELE_FIXED)
+	if ((size_t) tm->num_traits * tm->chrom_size * sizeof(double) > TRAITS_GEMM_BYTES) {
+		cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans, rows, tm->num_traits,
+					tm->chrom_size, 1.0, alleles, tm->chrom_size, tm->weights,
+					tm->chrom_size, 0.0, traits, tm->num_traits);
+		return;
+	}
+#endif
+	Kernel_weightedSums(alleles, rows, tm->chrom_size, tm->weights, tm->num_traits, traits);
+}
+
+/**
+ * The traits of cols degnomes whose alleles are the columns of the
+ * row-major chrom_size x cols matrix alleles: traits is cols x
+ * num_traits, row-major, as for TraitMatrix_apply.
+ */
+void TraitMatrix_applyColumns(const TraitMatrix* tm, const allele_t* alleles, int cols,
+							  double* traits) {
+	if (cols <= 0) {
+		return;
+	}
+	if (tm->chrom_size == 0) {
+		memset(traits, 0, (size_t) cols * tm->num_traits * sizeof(double));
+		return;
+	}
+#if !defined(ALLELE_FLOAT) && !defined(ALLELE_FIXED)
+	cblas_dgemm(CblasRowMajor, CblasTrans, CblasTrans, cols, tm->num_traits,
+				tm->chrom_size, 1.0, alleles, cols, tm->weights,
+				tm->chrom_size, 0.0, traits, tm->num_traits);
+#else
+	int k = tm->num_traits;
+	memset(traits, 0, (size_t) cols * k * sizeof(double));
+	for (int t = 0; t < k; t++) {
+		const double* wt = tm->weights + (size_t) t * tm->chrom_size;
+		for (int j = 0; j < tm->chrom_size; j++) {
+			const allele_t* row = alleles + (size_t) j * cols;
+			for (int c = 0; c < cols; c++) {
+				traits[(size_t) c * k + t] += wt[j] * (double) row[c];
+			}
+		}
+	}
+	for (size_t i = 0; i < (size_t) cols * k; i++) {
+		traits[i] = ALLELE_TO(traits[i]);
+	}
+#endif
+}
+
+void TraitMatrix_free(TraitMatrix* tm) {
+	free(tm->weights);
+	free(tm);
+}
@@ -0,0 +1,24 @@
+/**
+ * @file traits.h
+ * @author Daniel R. Tabin
+ * @brief Header for traits.c
+ */
+
+#ifndef TRAITS
+#define TRAITS
+
+#include "allele.h"
+
+typedef struct TraitMatrix TraitMatrix;
+
+TraitMatrix*	TraitMatrix_new(const double* weights, int num_traits, int chrom_size);
+TraitMatrix*	TraitMatrix_load(const char* path, int chrom_size);
+int				TraitMatrix_traits(const TraitMatrix* tm);
+const double*	TraitMatrix_weights(const TraitMatrix* tm);
+void			TraitMatrix_apply(const TraitMatrix* tm, const allele_t* alleles, int rows,
+								  double* traits);
+void			TraitMatrix_applyColumns(const TraitMatrix* tm, const allele_t* alleles, int cols,
+										 double* traits);
+void			TraitMatrix_free(TraitMatrix* tm);
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file xarena.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for arena
+ */
+
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xarena [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xarena [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	size_t slab = 4096;
+	DegnomeArena* arena = DegnomeArena_new(slab);
+	assert(DegnomeArena_reserved(arena) == 0);
+
+	// blocks of every odd size are aligned, apart and keep what is written
+	int n = 100;
+	unsigned char* blocks[n];
+	for (int i = 0; i < n; i++) {
+		size_t size = 1 + 7 * i;
+		blocks[i] = DegnomeArena_alloc(arena, size);
+		assert((uintptr_t) blocks[i] % ARENA_ALIGN == 0);
+		memset(blocks[i], i, size);
+	}
+	for (int i = 0; i < n; i++) {
+		for (size_t k = 0; k < 1 + 7 * (size_t) i; k++) {
+			assert(blocks[i][k] == i);
+		}
+	}
+	size_t reserved = DegnomeArena_reserved(arena);
+	assert(reserved >= slab && reserved % slab == 0);
+
+	// a block larger than a slab gets a slab of its own
+	unsigned char* big = DegnomeArena_alloc(arena, 3 * slab + 1);
+	assert((uintptr_t) big % ARENA_ALIGN == 0);
+	memset(big, 0xab, 3 * slab + 1);
+	assert(DegnomeArena_reserved(arena) > reserved + 3 * slab);
+	reserved = DegnomeArena_reserved(arena);
+
+	// after a reset the same requests reuse the same memory
+	DegnomeArena_reset(arena);
+	for (int i = 0; i < n; i++) {
+		assert(DegnomeArena_alloc(arena, 1 + 7 * i) == blocks[i]);
+	}
+	assert(DegnomeArena_alloc(arena, 3 * slab + 1) == big);
+	assert(DegnomeArena_reserved(arena) == reserved);
+
+	// and many resets do not grow it
+	for (int r = 0; r < 1000; r++) {
+		DegnomeArena_reset(arena);
+		for (int i = 0; i < n; i++) {
+			DegnomeArena_alloc(arena, 1 + 7 * i);
+		}
+	}
+	assert(DegnomeArena_reserved(arena) == reserved);
+	DegnomeArena_free(arena);
+
+	if (verbose) {
+		printf("alignment, reuse and oversized blocks ok\n");
+	}
+	printf("All tests for xarena completed\n");
+}
@@ -0,0 +1,162 @@
+/**
+ * @file xautothreads.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for autothreads
+ */
+
+#include "autothreads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+#define NJOBS 16
+
+typedef struct Param Param;
+struct Param {
+	int runs;
+	int nap;			// sleep this many microseconds
+};
+
+int states = 0;
+void* inline_state = NULL;		// the state of an AutoThreads' inline runs
+int worker_nap = 0;				// extra microseconds a job sleeps on a worker
+
+int job(void* p, void* tdat);
+void *State_new(void *notused);
+void State_free(void *state);
+
+int job(void* p, void* tdat) {
+	Param* par = (Param*) p;
+	assert(tdat != NULL);
+	int nap = par->nap + (tdat != inline_state ? worker_nap : 0);
+	if (nap > 0) {
+		struct timespec t = {.tv_sec = 0, .tv_nsec = 1000L * nap};
+		nanosleep(&t, NULL);
+	}
+	par->runs++;
+	return 0;
+}
+
+void *State_new(void *notused) {
+	void* state = malloc(1);
+	if (inline_state == NULL) {
+		inline_state = state;		// made by AutoThreads_new
+	}
+	states++;
+	return state;
+}
+
+void State_free(void *state) {
+	free(state);
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xautothreads [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xautothreads [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	Param par[NJOBS];
+	memset(par, 0, sizeof(par));
+
+	// too little work: always inline, never a JobQueue
+	AutoThreads* at = AutoThreads_new(4, 100, NULL, State_new, State_free);
+	assert(states == 1);
+	for (int r = 0; r < 100; r++) {
+		AutoThreads_run(at, job, par, sizeof(Param), NJOBS);
+		assert(AutoThreads_threads(at) == 0);
+	}
+	assert(AutoThreads_jobQueue(at) == NULL);
+	for (int j = 0; j < NJOBS; j++) {
+		assert(par[j].runs == 100);
+	}
+	AutoThreads_free(at);
+
+	// one worker at most is never worth a JobQueue
+	at = AutoThreads_new(1, 1e9, NULL, State_new, State_free);
+	AutoThreads_run(at, job, par, sizeof(Param), NJOBS);
+	AutoThreads_run(at, job, par, sizeof(Param), NJOBS);
+	assert(AutoThreads_threads(at) == 0);
+	assert(AutoThreads_jobQueue(at) == NULL);
+	AutoThreads_free(at);
+
+	// slow jobs: the first run calibrates inline, then all workers
+	// split the jobs, and a later run goes inline to recalibrate
+	memset(par, 0, sizeof(par));
+	for (int j = 0; j < NJOBS; j++) {
+		par[j].nap = 500;
+	}
+	at = AutoThreads_new(4, 1e9, NULL, State_new, State_free);
+	int inline_runs = 0;
+	for (int r = 0; r < 100; r++) {
+		AutoThreads_run(at, job, par, sizeof(Param), NJOBS);
+		int n = AutoThreads_threads(at);
+		if (verbose) {
+			printf("run %d: %d threads\n", r, n);
+		}
+		assert(n == 0 || n == 4);
+		if (r == 0) {
+			assert(n == 0);
+		}
+		else if (r == 1) {
+			assert(n == 4);
+			assert(AutoThreads_jobQueue(at) != NULL);
+		}
+		inline_runs += (n == 0);
+	}
+	assert(inline_runs >= 2 && inline_runs < 10);
+	for (int j = 0; j < NJOBS; j++) {
+		assert(par[j].runs == 100);
+	}
+
+	// zero jobs is a no-op
+	AutoThreads_run(at, job, par, sizeof(Param), 0);
+	AutoThreads_free(at);
+
+	// workers slower than inline push a run inline; it goes parallel
+	// again once the work grows and the workers pay
+	inline_state = NULL;
+	worker_nap = 3000;
+	for (int j = 0; j < NJOBS; j++) {
+		par[j].nap = 100;
+	}
+	at = AutoThreads_new(4, 1e9, NULL, State_new, State_free);
+	int late_inline = 0;
+	for (int r = 0; r < 70; r++) {
+		AutoThreads_run(at, job, par, sizeof(Param), NJOBS);
+		late_inline += (r >= 20 && AutoThreads_threads(at) == 0);
+	}
+	assert(late_inline >= 30);
+	worker_nap = 0;
+	for (int j = 0; j < NJOBS; j++) {
+		par[j].nap = 300;
+	}
+	int late_parallel = 0;
+	for (int r = 0; r < 140; r++) {
+		AutoThreads_run(at, job, par, sizeof(Param), NJOBS);
+		late_parallel += (r >= 80 && AutoThreads_threads(at) > 0);
+	}
+	if (verbose) {
+		printf("slow workers: %d of 50 late runs inline; then %d of 60 parallel\n",
+			   late_inline, late_parallel);
+	}
+	assert(late_parallel >= 50);
+	AutoThreads_free(at);
+
+	printf("All tests for xautothreads completed\n");
+}
@@ -0,0 +1,129 @@
+/**
+ * @file xcounters.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for counters
+ */
+
+#include "counters.h"
+#include "jobqueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int spinfunc(void* p, void* tdat);
+static void spin(int n);
+
+static void spin(int n) {
+	volatile double x = 0;
+
+	for (int i = 0; i < n; i++) {
+		x += i * 0.5;
+	}
+}
+
+/// A job of about a million additions.
+int spinfunc(void* p, void* tdat) {
+	spin(1000000);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+	const char* names[] = {"task-clock", "cycles", "instructions",
+						   "LLC-misses", "branch-misses"};
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xcounters [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xcounters [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// off: nothing is counted and attaching does nothing
+	double a[CTR_NUM_EVENTS], b[CTR_NUM_EVENTS];
+	assert(counters_on == 0);
+	Counters_attachThread();
+	Counters_read(a);
+	Counters_readOthers(b);
+	for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+		assert(a[k] == 0 && b[k] == 0 && !Counters_have(k));
+	}
+	Counters_detachThread();
+	Counters_stop();
+
+	for (int round = 0; round < 2; round++) {
+		if (Counters_start() != 0) {
+			printf("perf_event_open is not permitted here; nothing to test\n");
+			break;
+		}
+		assert(counters_on == 1);
+		assert(Counters_start() == -1);
+		if (verbose && round == 0) {
+			for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+				printf("%-14s %s\n", names[k], (Counters_have(k) ? "yes" : "no"));
+			}
+		}
+
+		// the calling thread's counts grow as it works
+		Counters_read(a);
+		spin(1000000);
+		Counters_read(b);
+		for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+			assert(b[k] >= a[k]);
+			if (Counters_have(k) && k != CTR_LLC_MISSES && k != CTR_BRANCH_MISSES) {
+				assert(b[k] > a[k]);
+			}
+		}
+
+		// workers are counted as others, and keep their counts once gone
+		Counters_readOthers(a);
+		for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+			assert(a[k] == 0);
+		}
+		int kinds[] = {JOBQUEUE_MUTEX, JOBQUEUE_RING};
+		for (int q = 0; q < 2; q++) {
+			JobQueue* jq = JobQueue_newKind(kinds[q], 2, NULL, NULL, NULL);
+			for (int j = 0; j < 8; j++) {
+				JobQueue_addJob(jq, spinfunc, NULL);
+			}
+			JobQueue_waitOnJobs(jq);
+			Counters_readOthers(b);
+			JobQueue_free(jq);
+			Counters_readOthers(a);
+			for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+				assert(a[k] >= b[k]);
+			}
+			if (verbose) {
+				printf("others after queue %d:", q);
+				for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+					printf(" %.0f", a[k]);
+				}
+				putchar('\n');
+			}
+		}
+		for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+			if (Counters_have(k) && k != CTR_LLC_MISSES && k != CTR_BRANCH_MISSES) {
+				assert(a[k] > 0);
+			}
+		}
+
+		Counters_stop();
+		assert(counters_on == 0);
+		Counters_read(a);
+		for (int k = 0; k < CTR_NUM_EVENTS; k++) {
+			assert(a[k] == 0 && !Counters_have(k));
+		}
+	}
+
+	printf("All tests for xcounters completed\n");
+}
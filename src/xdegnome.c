@@ -12,9 +12,48 @@
 #include <time.h>
 #include <unistd.h>
 #include <limits.h>
+#include <assert.h>
+#include <math.h>
 
 unsigned long rngseed=0;
 
+static int cmp_int(const void* a, const void* b) {
+	return (*(const int*) a > *(const int*) b) - (*(const int*) a < *(const int*) b);
+}
+
+/*
+ * Degnome_mate done in doubles, drawing from rng in the same order, so
+ * a double population can shadow one stored in allele_t.  Returns the
+ * number of mutations.
+ */
+static int ref_mate(double* child, const double* p1, const double* p2, gsl_rng* rng,
+	int mutation_rate, int mutation_effect, int crossover_rate) {
+	int num_crossover = gsl_ran_poisson(rng, crossover_rate);
+	int cuts[num_crossover + 1];
+
+	for (int i = 0; i < num_crossover; i++) {
+		cuts[i] = gsl_rng_uniform_int(rng, chrom_size);
+	}
+	qsort(cuts, num_crossover, sizeof(int), cmp_int);
+	cuts[num_crossover] = chrom_size;
+
+	int distance = 0;
+	for (int i = 0; i <= num_crossover; i++) {
+		const double* from = (i % 2 == 0 ? p1 : p2);
+		for (int k = distance; k < cuts[i]; k++) {
+			child[k] = from[k];
+		}
+		distance = cuts[i];
+	}
+
+	int num_mutations = gsl_ran_poisson(rng, mutation_rate);
+	for (int i = 0; i < num_mutations; i++) {
+		int loc = gsl_rng_uniform_int(rng, chrom_size);
+		child[loc] += gsl_ran_gaussian_ziggurat(rng, mutation_effect);
+	}
+	return num_mutations;
+}
+
 int main(int argc, char **argv) {
 	int verbose = 0;
 	int seeded =0;
@@ -78,17 +117,17 @@ int main(int argc, char **argv) {
 	
 	
 	for (int i = 0; i < chrom_size; i++) {
-		bom_mom->dna_array[i] = 2*i;
-		bad_dad->dna_array[i] = 1*i;
+		bom_mom->dna_array[i] = ALLELE_FROM(2*i);
+		bad_dad->dna_array[i] = ALLELE_FROM(1*i);
 
-		bom_mom->hat_size += bom_mom->dna_array[i];
-		bad_dad->hat_size += bad_dad->dna_array[i];
+		bom_mom->hat_size += ALLELE_TO(bom_mom->dna_array[i]);
+		bad_dad->hat_size += ALLELE_TO(bad_dad->dna_array[i]);
 	}
 
 	if (verbose) {
 		printf("pre-mating values:\n");
 		for (int i = 0; i < chrom_size; i++) {
-			printf("Mom: %lf\t Dad: %f\n", bom_mom->dna_array[i], bad_dad->dna_array[i]);
+			printf("Mom: %lf\t Dad: %f\n", ALLELE_TO(bom_mom->dna_array[i]), ALLELE_TO(bad_dad->dna_array[i]));
 		}
 		printf("Mom hat_size: %lf\t Dad hat_size: %f\n", bom_mom->hat_size, bad_dad->hat_size);
 	}
@@ -99,11 +138,258 @@ int main(int argc, char **argv) {
 	if (verbose) {
 		printf("post-mating values:\n");
 		for (int i = 0; i < chrom_size; i++) {
-			printf("Mom: %lf\t Dad: %f\t Kid: %f\n", bom_mom->dna_array[i], bad_dad->dna_array[i], tst_bby->dna_array[i]);
+			printf("Mom: %lf\t Dad: %f\t Kid: %f\n", ALLELE_TO(bom_mom->dna_array[i]),
+				   ALLELE_TO(bad_dad->dna_array[i]), ALLELE_TO(tst_bby->dna_array[i]));
 		}
 		printf("Mom hat_size: %lf\t Dad hat_size: %f\t Kid hat_size: %f\n", bom_mom->hat_size, bad_dad->hat_size, tst_bby->hat_size);
 	}
 
+	// far more crossovers than loci grows the scratch; every allele
+	// still comes from one parent or the other
+	for (int round = 0; round < 3; round++) {
+		for (int n = 0; n < 20; n++) {
+			Degnome_mate(tst_bby, bom_mom, bad_dad, rng, 0, 0, 50 * (round + 1));
+			for (int i = 0; i < chrom_size; i++) {
+				assert(tst_bby->dna_array[i] == bom_mom->dna_array[i]
+					   || tst_bby->dna_array[i] == bad_dad->dna_array[i]);
+			}
+		}
+		Degnome_freeScratch();
+	}
+
+	// A neutral population stored as allele_t, shadowed by one in
+	// doubles that makes the same draws, stays within rounding of it:
+	// nothing for double, half a step per mutation for fixed point, a
+	// float's precision per mutation for float.
+#if defined(ALLELE_FIXED)
+	double step = 0.5 / ALLELE_SCALE;
+#elif defined(ALLELE_FLOAT)
+	double step = 1e-4;
+#else
+	double step = 0;
+#endif
+	int pop = 40, gens = 20;
+	Degnome* gen[2][pop];
+	double ref[2][pop][chrom_size];
+	double err[2][pop];
+	gsl_rng* ref_rng = gsl_rng_alloc(gsl_rng_taus);
+	gsl_rng* pick = gsl_rng_alloc(gsl_rng_taus);
+
+	gsl_rng_set(pick, rngseed);
+	for (int n = 0; n < pop; n++) {
+		gen[0][n] = Degnome_new();
+		gen[1][n] = Degnome_new();
+		for (int i = 0; i < chrom_size; i++) {
+			gen[0][n]->dna_array[i] = ALLELE_FROM(n + i);
+			ref[0][n][i] = n + i;
+		}
+		err[0][n] = 0;
+	}
+	for (int g = 0; g < gens; g++) {
+		int cur = g % 2, nxt = 1 - cur;
+		double mean = 0, ref_mean = 0;
+		double sq = 0, ref_sq = 0;
+
+		for (int n = 0; n < pop; n++) {
+			int m = gsl_rng_uniform_int(pick, pop);
+			int d = gsl_rng_uniform_int(pick, pop);
+
+			gsl_rng_memcpy(ref_rng, rng);
+			Degnome_mate(gen[nxt][n], gen[cur][m], gen[cur][d], rng, 4, 1, 3);
+			int muts = ref_mate(ref[nxt][n], ref[cur][m], ref[cur][d], ref_rng, 4, 1, 3);
+			assert(gsl_rng_get(ref_rng) == gsl_rng_get(rng));
+
+			err[nxt][n] = (err[cur][m] > err[cur][d] ? err[cur][m] : err[cur][d]) + muts * step;
+			double ref_hat = 0;
+			for (int i = 0; i < chrom_size; i++) {
+				assert(fabs(ALLELE_TO(gen[nxt][n]->dna_array[i]) - ref[nxt][n][i]) <= err[nxt][n]);
+				ref_hat += ref[nxt][n][i];
+			}
+			double hat = gen[nxt][n]->hat_size;
+			assert(fabs(hat - ref_hat) <= chrom_size * err[nxt][n] + 1e-9 * (1 + fabs(ref_hat)));
+
+			mean += hat;
+			ref_mean += ref_hat;
+			sq += hat * hat;
+			ref_sq += ref_hat * ref_hat;
+		}
+		mean /= pop;
+		ref_mean /= pop;
+		double var = sq / pop - mean * mean;
+		double ref_var = ref_sq / pop - ref_mean * ref_mean;
+		if (verbose) {
+			printf("generation %d: mean %f (double %f), variance %f (double %f)\n",
+				   g, mean, ref_mean, var, ref_var);
+		}
+		assert(fabs(mean - ref_mean) <= 1e-3 * (1 + fabs(ref_mean)));
+		assert(fabs(var - ref_var) <= 1e-3 * (1 + fabs(ref_var)));
+	}
+	for (int n = 0; n < pop; n++) {
+		Degnome_free(gen[0][n]);
+		Degnome_free(gen[1][n]);
+	}
+	gsl_rng_free(pick);
+
+	// chunked mating draws the same numbers and gives the same genes
+	// as flat mating, for chunks that do and don't divide the length,
+	// and shares every chunk no crossover or mutation touches
+	chrom_size = 100;
+	for (int size = 1; size <= 128; size = size * 3 + 1) {
+		chunk_size = size;
+		int nchunks = Degnome_chunkCount();
+		Degnome* mom = Degnome_new();
+		Degnome* dad = Degnome_new();
+		Degnome* flat = Degnome_new();
+		Degnome* kid = Degnome_new();
+		Chunk** chunks = malloc(3*nchunks*sizeof(Chunk*));
+		allele_t row[chrom_size];
+
+		for (int i = 0; i < chrom_size; i++) {
+			mom->dna_array[i] = ALLELE_FROM(i);
+			dad->dna_array[i] = ALLELE_FROM(-i);
+		}
+		Degnome_chunk(mom, chunks);
+		Degnome_chunk(dad, chunks + nchunks);
+		kid->chunks = chunks + 2*nchunks;
+		Degnome_gather(mom, row);
+		assert(memcmp(row, mom->dna_array, chrom_size*sizeof(allele_t)) == 0);
+
+		for (int n = 0; n < 50; n++) {
+			gsl_rng_memcpy(ref_rng, rng);
+			Degnome_mate(flat, mom, dad, ref_rng, 3, 1, 4);
+			Degnome_mateChunked(kid, mom, dad, rng, 3, 1, 4);
+			assert(gsl_rng_get(ref_rng) == gsl_rng_get(rng));
+
+			Degnome_gather(kid, row);
+			assert(memcmp(row, flat->dna_array, chrom_size*sizeof(allele_t)) == 0);
+			assert(fabs(kid->hat_size - flat->hat_size) <= 1e-9 * (1 + fabs(flat->hat_size)));
+			Degnome_releaseChunks(kid);
+		}
+
+		// no crossovers or mutations: every chunk is mom's
+		Degnome_mateChunked(kid, mom, dad, rng, 0, 0, 0);
+		for (int b = 0; b < nchunks; b++) {
+			assert(kid->chunks[b] == mom->chunks[b]);
+			assert(mom->chunks[b]->refs == 2);
+		}
+		Degnome_releaseChunks(kid);
+		assert(mom->chunks[0]->refs == 1);
+
+		Degnome_releaseChunks(mom);
+		Degnome_releaseChunks(dad);
+		free(chunks);
+		Degnome_free(mom);
+		Degnome_free(dad);
+		Degnome_free(flat);
+		Degnome_free(kid);
+	}
+	chunk_size = 0;
+	if (verbose) {
+		printf("chunked mating matches flat mating\n");
+	}
+
+	// with a map that only crosses over past locus 80, the child has
+	// its mother's genes up to there, and chunked mating still matches
+	int hot[] = {80};
+	double rate[] = {1};
+	RecombMap* map = RecombMap_new(hot, rate, 1, chrom_size);
+	recomb_map = map;
+	{
+		Degnome* mom = Degnome_new();
+		Degnome* dad = Degnome_new();
+		Degnome* kid = Degnome_new();
+		int from_dad = 0;
+
+		for (int i = 0; i < chrom_size; i++) {
+			mom->dna_array[i] = ALLELE_FROM(1);
+			dad->dna_array[i] = ALLELE_FROM(2);
+		}
+		for (int n = 0; n < 200; n++) {
+			Degnome_mate(kid, mom, dad, rng, 0, 1, 3);
+			for (int i = 0; i < 80; i++) {
+				assert(ALLELE_TO(kid->dna_array[i]) == 1);
+			}
+			for (int i = 80; i < chrom_size; i++) {
+				from_dad += (ALLELE_TO(kid->dna_array[i]) == 2);
+			}
+		}
+		assert(from_dad > 0);
+		Degnome_free(mom);
+		Degnome_free(dad);
+		Degnome_free(kid);
+	}
+	recomb_map = NULL;
+	RecombMap_free(map);
+
+	// with a mutation map, only the loci it names mutate, and chunked
+	// mating draws the same mutations
+	int mut_at[] = {50, 60};
+	double mut_rates[] = {0.5, 0};
+	double mut_effects[] = {4, 0};
+	MutationMap* mutmap = MutationMap_new(mut_at, mut_rates, mut_effects, 2, chrom_size);
+	mutation_map = mutmap;
+	{
+		Degnome* mom = Degnome_new();
+		Degnome* kid = Degnome_new();
+		Degnome* flat = Degnome_new();
+		int mutated = 0;
+
+		chunk_size = 16;
+		int nchunks = Degnome_chunkCount();
+		Chunk** chunks = malloc(2*nchunks*sizeof(Chunk*));
+		allele_t row[chrom_size];
+		for (int i = 0; i < chrom_size; i++) {
+			mom->dna_array[i] = ALLELE_FROM(3);
+		}
+		Degnome_chunk(mom, chunks);
+		kid->chunks = chunks + nchunks;
+		for (int n = 0; n < 100; n++) {
+			gsl_rng_memcpy(ref_rng, rng);
+			Degnome_mate(flat, mom, mom, ref_rng, 0, 1, 2);
+			Degnome_mateChunked(kid, mom, mom, rng, 0, 1, 2);
+			Degnome_gather(kid, row);
+			assert(memcmp(row, flat->dna_array, chrom_size*sizeof(allele_t)) == 0);
+			for (int i = 0; i < chrom_size; i++) {
+				if (i < 50 || i >= 60) {
+					assert(ALLELE_TO(flat->dna_array[i]) == 3);
+				}
+				mutated += (flat->dna_array[i] != mom->dna_array[i]);
+			}
+			Degnome_releaseChunks(kid);
+		}
+		assert(mutated > 0);
+		Degnome_releaseChunks(mom);
+		chunk_size = 0;
+		free(chunks);
+		Degnome_free(mom);
+		Degnome_free(kid);
+		Degnome_free(flat);
+	}
+	mutation_map = NULL;
+	MutationMap_free(mutmap);
+
+	// degnomes in an arena have aligned rows and mate as any other
+	DegnomeArena* arena = DegnomeArena_new(256);
+	for (int r = 0; r < 2; r++) {
+		Degnome* mom = Degnome_newIn(arena);
+		Degnome* dad = Degnome_newIn(arena);
+		Degnome* kid = Degnome_newIn(arena);
+
+		assert((size_t) kid->dna_array % ARENA_ALIGN == 0);
+		for (int i = 0; i < chrom_size; i++) {
+			mom->dna_array[i] = ALLELE_FROM(1);
+			dad->dna_array[i] = ALLELE_FROM(2);
+		}
+		Degnome_mate(kid, mom, dad, rng, 0, 1, 5);
+		for (int i = 0; i < chrom_size; i++) {
+			assert(kid->dna_array[i] == mom->dna_array[i] || kid->dna_array[i] == dad->dna_array[i]);
+		}
+		assert(kid->hat_size >= chrom_size && kid->hat_size <= 2 * chrom_size);
+		DegnomeArena_reset(arena);
+	}
+	DegnomeArena_free(arena);
+	gsl_rng_free(ref_rng);
+
 	Degnome_free(bom_mom);
 	Degnome_free(bad_dad);
 	Degnome_free(tst_bby);
@@ -0,0 +1,186 @@
+/**
+ * @file xensemble.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for ensemble
+ */
+
+#include "ensemble.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xensemble [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xensemble [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	SimParams par;
+	sim_default_params(&par);
+	par.pop_size = 6;
+	par.chrom_size = 9;
+	par.mutation_rate = 0;
+	par.num_threads = 1;
+	par.seed = 42;
+
+	// one degnome, or no loci, has no variance or diversity to report
+	par.pop_size = 1;
+	assert(Ensemble_new(&par, 2) == NULL);
+	par.pop_size = 2;
+	par.chrom_size = 0;
+	assert(Ensemble_new(&par, 2) == NULL);
+
+	// the smallest population gives finite statistics, many replicates
+	// or not
+	par.chrom_size = 10;
+	par.mutation_rate = 1;
+	for (int r = 1; r <= 9; r += 8) {
+		Ensemble* small = Ensemble_new(&par, r);
+		EnsembleStats small_st;
+		Ensemble_run(small, 3, 0);
+		Ensemble_stats(small, &small_st);
+		assert(isfinite(small_st.mean_hat_size) && isfinite(small_st.var_mean_hat_size));
+		assert(isfinite(small_st.mean_var_hat_size) && isfinite(small_st.mean_diversity));
+		assert(isfinite(small_st.var_diversity));
+		Ensemble_free(small);
+	}
+	par.pop_size = 6;
+	par.chrom_size = 9;
+	par.mutation_rate = 0;
+
+	int reps = 7;
+	Ensemble* ens = Ensemble_new(&par, reps);
+	EnsembleStats st;
+
+	// generation 0: every allele is 10 and degnome i descends from i
+	assert(Ensemble_generation(ens) == 0);
+	for (int r = 0; r < reps; r++) {
+		assert(Ensemble_diversity(ens, r) == 1);
+		for (int i = 0; i < par.pop_size; i++) {
+			assert(Ensemble_hat_size(ens, r, i) == 10 * par.chrom_size);
+			for (int j = 0; j < par.chrom_size; j++) {
+				assert(Ensemble_allele(ens, r, i, j) == 10);
+				assert(Ensemble_ancestry(ens, r, i, j) == i);
+			}
+		}
+	}
+
+	// without mutation alleles never change and ancestries stay in range
+	for (int g = 1; g <= 5; g++) {
+		Ensemble_step(ens);
+		assert(Ensemble_generation(ens) == g);
+
+		for (int r = 0; r < reps; r++) {
+			double diversity = Ensemble_diversity(ens, r);
+			assert(diversity >= 0 && diversity <= 1);
+			for (int i = 0; i < par.pop_size; i++) {
+				assert(Ensemble_hat_size(ens, r, i) == 10 * par.chrom_size);
+				for (int j = 0; j < par.chrom_size; j++) {
+					int goi = Ensemble_ancestry(ens, r, i, j);
+					assert(goi >= 0 && goi < par.pop_size);
+				}
+			}
+		}
+		Ensemble_stats(ens, &st);
+		assert(st.mean_hat_size == 10 * par.chrom_size);
+		assert(st.var_mean_hat_size == 0 && st.mean_var_hat_size == 0);
+		if (verbose) {
+			printf("generation %d: diversity %lf +- %lf\n", g,
+				   st.mean_diversity, sqrt(st.var_diversity));
+		}
+	}
+	Ensemble_free(ens);
+
+	// with mutation and selection, hat sizes still sum the alleles, and a
+	// seeded ensemble is the same on any number of threads
+	par.mutation_rate = 3;
+	par.selective = 1;
+	ens = Ensemble_new(&par, reps);
+	par.num_threads = 3;
+	Ensemble* ens3 = Ensemble_new(&par, reps);
+	Ensemble_run(ens, 20, 0);
+	Ensemble_run(ens3, 20, 0);
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < par.pop_size; i++) {
+			double total = 0;
+			for (int j = 0; j < par.chrom_size; j++) {
+				total += Ensemble_allele(ens, r, i, j);
+				assert(Ensemble_allele(ens, r, i, j) == Ensemble_allele(ens3, r, i, j));
+				assert(Ensemble_ancestry(ens, r, i, j) == Ensemble_ancestry(ens3, r, i, j));
+			}
+			assert(fabs(total - Ensemble_hat_size(ens, r, i)) < 1e-9);
+		}
+	}
+	Ensemble_stats(ens, &st);
+	assert(st.replicates == reps && st.generation == 20);
+	assert(st.var_mean_hat_size > 0 && st.mean_var_hat_size > 0);
+	Ensemble_free(ens);
+	Ensemble_free(ens3);
+
+	// uniform mating without crossover makes each child a copy of a
+	// different mom, so the children are the parents reshuffled
+	par.pop_size = 3;
+	par.crossover_rate = 0;
+	par.selective = 0;
+	par.uniform = 1;
+	ens = Ensemble_new(&par, reps);
+	Ensemble_run(ens, 10, 0);
+	for (int r = 0; r < reps; r++) {
+		assert(Ensemble_diversity(ens, r) == 1);
+	}
+	Ensemble_free(ens);
+
+	// with -b small populations drift to zero diversity and stop
+	par.uniform = 0;
+	ens = Ensemble_new(&par, reps);
+	int ran = Ensemble_run(ens, 10000, 1);
+	assert(ran < 10000);
+	assert(Ensemble_generation(ens) == ran);
+	for (int r = 0; r < reps; r++) {
+		assert(Ensemble_diversity(ens, r) == 0);
+	}
+	if (verbose) {
+		printf("zero diversity in every replicate after %d generations\n", ran);
+	}
+	Ensemble_free(ens);
+
+	// selection follows the traits: with every weight 0 no degnome is
+	// fitter than degnome 0, which parents every child in every lane
+	char path[] = "xensembleXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	FILE* f = fdopen(fd, "w");
+	fprintf(f, "0 0 0\n");
+	fclose(f);
+	par.selective = 1;
+	par.traits_file = path;
+	ens = Ensemble_new(&par, reps);
+	unlink(path);
+	Ensemble_step(ens);
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < par.pop_size; i++) {
+			for (int j = 0; j < par.chrom_size; j++) {
+				assert(Ensemble_ancestry(ens, r, i, j) == 0);
+			}
+		}
+	}
+	Ensemble_free(ens);
+
+	printf("All tests for xensemble completed\n");
+}
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <assert.h>
 
 int main(int argc, char **argv) {
 	int verbose = 0;
@@ -103,6 +104,43 @@ int main(int argc, char **argv) {
 		printf("log(%lf) = %lf\n", x,y);
 	}
 
+	// the batch gives what get_fitness gives, one by one
+	const char* funcs[] = {"linear", "sqrt", "close", "ceiling", "log"};
+	double hats[13], fits[13];
+	target_num = 7;
+	for (int f = 0; f < 5; f++) {
+		set_function(funcs[f]);
+		for (int i = 0; i < 13; i++) {
+			hats[i] = 0.75 * (i + 1);
+		}
+		get_fitness_batch(hats, fits, 13);
+		for (int i = 0; i < 13; i++) {
+			assert(fits[i] == get_fitness(hats[i]));
+		}
+		get_fitness_batch(hats, hats, 13);
+		assert(memcmp(hats, fits, sizeof(fits)) == 0);
+	}
+
+	// traits are scored one by one and added; one trait is the batch
+	double traits[13 * 3], sums[13];
+	for (int f = 0; f < 5; f++) {
+		set_function(funcs[f]);
+		for (int k = 0; k < 13 * 3; k++) {
+			traits[k] = 0.5 * (k + 1);
+		}
+		get_fitness_traits(traits, 3, sums, 13);
+		for (int i = 0; i < 13; i++) {
+			double sum = 0;
+			for (int t = 0; t < 3; t++) {
+				sum += get_fitness(traits[3*i + t]);
+			}
+			assert(sums[i] == sum);
+		}
+		get_fitness_traits(traits, 1, sums, 13);
+		get_fitness_batch(traits, fits, 13);
+		assert(memcmp(sums, fits, sizeof(fits)) == 0);
+	}
+
 
 
 	printf("All tests for xfitfunc completed\n");
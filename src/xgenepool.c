@@ -0,0 +1,130 @@
+/**
+ * @file xgenepool.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for genepool
+ */
+
+#include "genepool.h"
+#include "kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+static void fill(allele_t* row, int len, int value);
+static allele_t* intern(GenePool* gp, allele_t* row, int len);
+
+static void fill(allele_t* row, int len, int value) {
+	for (int k = 0; k < len; k++) {
+		row[k] = ALLELE_FROM(value);
+	}
+}
+
+static allele_t* intern(GenePool* gp, allele_t* row, int len) {
+	return GenePool_intern(gp, row, Kernel_hash(row, len*sizeof(allele_t)));
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xgenepool [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xgenepool [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	int len = 13, pop = 6;
+	GenePool* gp = GenePool_new(2 * pop, len, NULL);
+	allele_t* parents[pop];
+	allele_t* children[pop];
+
+	// three pairs of twins intern to three rows
+	GenePool_newGeneration(gp);
+	for (int i = 0; i < pop; i++) {
+		parents[i] = GenePool_take(gp);
+		fill(parents[i], len, i / 2);
+		parents[i] = intern(gp, parents[i], len);
+	}
+	assert(GenePool_distinct(gp) == 3);
+	assert(GenePool_used(gp) == 3);
+	for (int i = 0; i < pop; i += 2) {
+		assert(parents[i] == parents[i+1]);
+		assert(parents[i] != parents[(i+2) % pop]);
+	}
+
+	// a child sharing a parent's row, one copying it, and four new
+	// degnomes all alike: two rows, and the parents' go back
+	GenePool_newGeneration(gp);
+	children[0] = parents[0];
+	GenePool_ref(gp, children[0]);
+	children[0] = intern(gp, children[0], len);
+	children[1] = GenePool_take(gp);
+	memcpy(children[1], parents[0], len*sizeof(allele_t));
+	children[1] = intern(gp, children[1], len);
+	assert(children[1] == children[0]);
+	for (int i = 2; i < pop; i++) {
+		children[i] = GenePool_take(gp);
+		fill(children[i], len, 7);
+		children[i] = intern(gp, children[i], len);
+		assert(children[i] == children[2]);
+	}
+	for (int i = 0; i < pop; i++) {
+		GenePool_unref(gp, parents[i]);
+	}
+	assert(GenePool_distinct(gp) == 2);
+	assert(GenePool_used(gp) == 2);
+
+	// rows whose hashes collide are kept apart
+	GenePool_newGeneration(gp);
+	for (int i = 0; i < pop; i++) {
+		parents[i] = GenePool_take(gp);
+		fill(parents[i], len, i);
+		parents[i] = GenePool_intern(gp, parents[i], 42);
+	}
+	for (int i = 0; i < pop; i++) {
+		GenePool_unref(gp, children[i]);
+	}
+	assert(GenePool_distinct(gp) == pop);
+	assert(GenePool_used(gp) == pop);
+	for (int i = 0; i < pop; i++) {
+		for (int k = 0; k < len; k++) {
+			assert(ALLELE_TO(parents[i][k]) == i);
+		}
+		GenePool_unref(gp, parents[i]);
+	}
+	assert(GenePool_used(gp) == 0);
+
+	// every row can be taken, and each is a separate len alleles
+	for (int i = 0; i < 2 * pop; i++) {
+		allele_t* row = GenePool_take(gp);
+		fill(row, len, i);
+	}
+	assert(GenePool_used(gp) == 2 * pop);
+	GenePool_free(gp);
+
+	// empty chromosomes all intern to one row
+	gp = GenePool_new(4, 0, NULL);
+	GenePool_newGeneration(gp);
+	allele_t* a = GenePool_take(gp);
+	allele_t* b = GenePool_take(gp);
+	assert(a != b);
+	assert(intern(gp, a, 0) == a);
+	assert(intern(gp, b, 0) == a);
+	assert(GenePool_distinct(gp) == 1 && GenePool_used(gp) == 1);
+	GenePool_free(gp);
+
+	if (verbose) {
+		printf("interning, sharing and collisions ok\n");
+	}
+	printf("All tests for xgenepool completed\n");
+}
@@ -2,6 +2,11 @@
  * @file xjobqueue.c
  * @author Alan R. Rogers
  * @brief Test jobqueue.c.
+ *
+ * Runs the same checks on both kinds of JobQueue, then a stress test
+ * of many rounds of random batch sizes (some larger than the ring)
+ * and of repeated creation and destruction, and finally prints the
+ * throughput of each kind as jobs per second.
  * @copyright Copyright (c) 2014, Alan R. Rogers
  * <rogers@anthro.utah.edu>. This file is released under the Internet
  * Systems Consortium License, which can be found in file "LICENSE".
@@ -11,6 +16,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 
 #ifdef NDEBUG
@@ -25,9 +31,20 @@ typedef struct {
 	int i;
 } ThreadState;
 
+typedef struct {
+	int runs;
+	int work;
+} StressParam;
+
+static const char *kindName[] = {"mutex", "ring"};
+
 void *ThreadState_new(void *dat);
 void ThreadState_free(void *self);
 static void unitTstResult(const char *facility, const char *result);
+static double now(void);
+static void testKind(int kind, int verbose);
+static void stress(int kind, int nthreads, int verbose);
+static double throughput(int kind, int nthreads, int batch, long njobs);
 
 static void unitTstResult(const char *facility, const char *result) {
 	printf("%-26s %s\n", facility, result);
@@ -50,6 +67,8 @@ void ThreadState_free(void *self) {
 }
 
 int jobfunc(void *p, void *tdat);
+int stressfunc(void *p, void *tdat);
+int nopfunc(void *p, void *tdat);
 
 int jobfunc(void *p, void *tdat) {
 	TstParam *param = (TstParam *) p;
@@ -60,6 +79,27 @@ int jobfunc(void *p, void *tdat) {
 	return 0;
 }
 
+/// Count the run and burn a little time, so workers interleave.
+int stressfunc(void *p, void *tdat) {
+	StressParam *param = (StressParam *) p;
+	volatile int x = 0;
+
+	for (int i = 0; i < param->work; ++i)
+		x += i;
+	param->runs++;
+	return 0;
+}
+
+int nopfunc(void *p, void *tdat) {
+	return 0;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
 int main(int argc, char **argv) {
 
 	int verbose = 0;
@@ -79,13 +119,42 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
+	int kinds[] = {JOBQUEUE_MUTEX, JOBQUEUE_RING};
+	int maxThreads = getNumCores() > 4 ? getNumCores() : 4;
+
+	for (int k = 0; k < 2; ++k) {
+		testKind(kinds[k], verbose);
+		for (int nthreads = 1; nthreads <= maxThreads; nthreads *= 2)
+			stress(kinds[k], nthreads, verbose);
+	}
+
+	printf("%-6s %8s %8s %14s\n", "kind", "threads", "batch", "jobs/sec");
+	for (int nthreads = 1; nthreads <= 4; nthreads *= 2) {
+		for (int batch = 1; batch <= 1000; batch *= 1000) {
+			for (int k = 0; k < 2; ++k) {
+				JobQueue *jq = JobQueue_newKind(kinds[k], 1, NULL, NULL, NULL);
+				int kind = JobQueue_kind(jq);
+				JobQueue_free(jq);
+				printf("%-6s %8d %8d %14.0f\n", kindName[kind], nthreads, batch,
+					   throughput(kinds[k], nthreads, batch,
+									   (batch == 1 ? 20000 : 200000)));
+			}
+		}
+	}
+
+	unitTstResult("JobQueue", "OK");
+	return 0;
+}
+
+/// The original checks: results, worker accounting and reuse.
+static void testKind(int kind, int verbose) {
 	int i, njobs = 6, nthreads = 3;
 	TstParam jobs[njobs];
 	int multiplier = 3;
-	JobQueue *jq = JobQueue_new(nthreads,
-								&multiplier,
-								ThreadState_new,
-								ThreadState_free);
+	JobQueue *jq = JobQueue_newKind(kind, nthreads,
+									&multiplier,
+									ThreadState_new,
+									ThreadState_free);
 
 	for (i = 0; i < njobs; ++i) {
 		jobs[i].arg = i + 1.0;
@@ -110,6 +179,34 @@ int main(int argc, char **argv) {
 	}
 
 	JobQueue_waitOnJobs(jq);
+
+	// every job was run by exactly one worker
+	double busy[nthreads], idle[nthreads];
+	long done[nthreads], total = 0;
+	int nworkers = JobQueue_workerTimes(jq, busy, idle, done, nthreads);
+	assert(nworkers >= 1 && nworkers <= nthreads);
+	for (i = 0; i < nworkers; ++i) {
+		if (verbose)
+			printf("worker %d: %ld jobs, busy %lg idle %lg\n",
+				   i, done[i], busy[i], idle[i]);
+		assert(busy[i] >= 0 && idle[i] >= 0);
+		total += done[i];
+	}
+	assert(total == 2 * njobs);
+
+	// many rounds reuse the same Job nodes; results must stay right
+	TstParam again[njobs];
+	for (int round = 0; round < 1000; ++round) {
+		for (i = 0; i < njobs; ++i) {
+			again[i].arg = round + i;
+			again[i].result = -99.0;
+			JobQueue_addJob(jq, jobfunc, again + i);
+		}
+		JobQueue_waitOnJobs(jq);
+		for (i = 0; i < njobs; ++i)
+			assert(again[i].result == (round + i) * multiplier);
+	}
+
 	JobQueue_noMoreJobs(jq);
 
 	for (i = 0; i < njobs; ++i) {
@@ -121,6 +218,65 @@ int main(int argc, char **argv) {
 	}
 
 	JobQueue_free(jq);
-	unitTstResult("JobQueue", "OK");
-	return 0;
 }
+
+/**
+ * Rounds of random batch sizes, some larger than the ring, each job
+ * counted exactly once; then queues made and freed, some unused.
+ */
+static void stress(int kind, int nthreads, int verbose) {
+	int maxBatch = 10000;
+	StressParam *param = calloc(maxBatch, sizeof(StressParam));
+	assert(param != NULL);
+	unsigned seed = 12345u + nthreads;
+
+	JobQueue *jq = JobQueue_newKind(kind, nthreads, NULL, NULL, NULL);
+	for (int round = 0; round < 200; ++round) {
+		seed = seed * 1103515245u + 12345u;
+		int batch = (round % 20 == 0 ? maxBatch : (int) (seed >> 16) % 300);
+		for (int i = 0; i < batch; ++i) {
+			param[i].runs = 0;
+			param[i].work = (int) ((seed >> (i % 16)) & 255);
+			JobQueue_addJob(jq, stressfunc, param + i);
+		}
+		JobQueue_waitOnJobs(jq);
+		for (int i = 0; i < batch; ++i)
+			assert(param[i].runs == 1);
+	}
+	JobQueue_noMoreJobs(jq);
+	JobQueue_free(jq);
+
+	for (int cycle = 0; cycle < 10; ++cycle) {
+		jq = JobQueue_newKind(kind, nthreads, NULL, NULL, NULL);
+		for (int i = 0; i < cycle; ++i) {
+			param[i].runs = 0;
+			param[i].work = 0;
+			JobQueue_addJob(jq, stressfunc, param + i);
+		}
+		JobQueue_noMoreJobs(jq);
+		JobQueue_free(jq);
+		for (int i = 0; i < cycle; ++i)
+			assert(param[i].runs == 1);
+	}
+	free(param);
+
+	if (verbose)
+		printf("stress %s, %d threads: ok\n", kindName[kind], nthreads);
+}
+
+/// Empty jobs per second, added batch at a time then waited on.
+static double throughput(int kind, int nthreads, int batch, long njobs) {
+	JobQueue *jq = JobQueue_newKind(kind, nthreads, NULL, NULL, NULL);
+	double t = now();
+
+	for (long done = 0; done < njobs; done += batch) {
+		for (int i = 0; i < batch; ++i)
+			JobQueue_addJob(jq, nopfunc, NULL);
+		JobQueue_waitOnJobs(jq);
+	}
+	t = now() - t;
+
+	JobQueue_noMoreJobs(jq);
+	JobQueue_free(jq);
+	return njobs / t;
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+/**
+ * @file xkernels.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for kernels
+ */
+
+#include "kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xkernels [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xkernels [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const char* target = Kernel_target();
+	assert(strcmp(target, "avx512f") == 0 || strcmp(target, "avx2") == 0
+		   || strcmp(target, "default") == 0);
+	if (verbose) {
+		Kernel_report(stdout);
+	}
+
+	// every length from empty to a few vectors, so each tail is covered
+	int max = 70;
+	allele_t x[max], y[max];
+	int a[max], b[max];
+
+	for (int n = 0; n <= max; n++) {
+		double sum = 0;
+		int diffs = 0, equal = 0;
+
+		for (int k = 0; k < n; k++) {
+			a[k] = (k * 7) % 5;
+			b[k] = (k % 3 == 0 ? a[k] + 1 : a[k]);
+			x[k] = ALLELE_FROM(a[k]);
+			y[k] = ALLELE_FROM(b[k]);
+			sum += a[k];
+			diffs += (k % 3 == 0);
+			equal += (a[k] == 2);
+		}
+		// whole numbers add exactly in any order
+		assert(Kernel_sum(x, n) == sum);
+		assert(Kernel_countDiffs(a, b, n) == diffs);
+		assert(Kernel_countDiffsAlleles(x, y, n) == diffs);
+		assert(Kernel_countDiffs(a, a, n) == 0);
+		assert(Kernel_countEqual(a, n, 2) == equal);
+		assert(Kernel_countEqualAlleles(x, n, ALLELE_FROM(2)) == equal);
+		assert(Kernel_countEqual(a, n, -1) == 0);
+	}
+
+	// equal bytes hash alike, and changing any one byte of a chromosome,
+	// whatever its length, changes the hash
+	unsigned char bytes[130], copy[130];
+	for (int k = 0; k < 130; k++) {
+		bytes[k] = (unsigned char) (k * 37);
+	}
+	memcpy(copy, bytes, sizeof(bytes));
+	for (size_t n = 0; n <= sizeof(bytes); n++) {
+		uint64_t h = Kernel_hash(bytes, n);
+		assert(Kernel_hash(copy, n) == h);
+		for (size_t k = 0; k < n; k++) {
+			copy[k] ^= 0x10;
+			assert(Kernel_hash(copy, n) != h);
+			copy[k] ^= 0x10;
+		}
+		if (n > 0) {
+			assert(Kernel_hash(bytes, n - 1) != h);
+		}
+	}
+	// and words in the same lane do not cancel
+	int rows[2][32] = {{0}};
+	rows[0][0] = rows[0][16] = 1;
+	rows[1][8] = rows[1][24] = 1;
+	assert(Kernel_hash(rows[0], sizeof(rows[0])) != Kernel_hash(rows[1], sizeof(rows[1])));
+
+	// the lanes are combined in a fixed order
+	allele_t z[11];
+	for (int k = 0; k < 11; k++) {
+		z[k] = ALLELE_FROM(1.0 / (k + 1));
+	}
+#ifdef ALLELE_FIXED
+	int64_t lane[8] = {0};
+#else
+	double lane[8] = {0};
+#endif
+	for (int k = 0; k < 11; k++) {
+		lane[k % 8] += z[k];
+	}
+	assert(Kernel_sum(z, 11) == ALLELE_TO(((lane[0] + lane[4]) + (lane[1] + lane[5]))
+										  + ((lane[2] + lane[6]) + (lane[3] + lane[7]))));
+
+	printf("All tests for xkernels completed\n");
+}
@@ -0,0 +1,97 @@
+/**
+ * @file xmapped.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for mapped
+ */
+
+#include "mapped.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+static int count_files(const char* dir);
+
+/// Number of entries in dir other than . and ..
+static int count_files(const char* dir) {
+	DIR* d = opendir(dir);
+	int n = 0;
+
+	assert(d != NULL);
+	for (struct dirent* e = readdir(d); e != NULL; e = readdir(d)) {
+		n += (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0);
+	}
+	closedir(d);
+	return n;
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xmapped [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xmapped [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	char dir[] = "xmapped-XXXXXX";
+	assert(mkdtemp(dir) != NULL);
+
+	// zeroed, writable, and no file is left in dir
+	size_t sizes[] = {0, 1, 4096, 3 << 20};
+	for (int s = 0; s < 4; s++) {
+		size_t n = sizes[s] / sizeof(double);
+		double* p = Mapped_alloc(sizes[s], dir);
+		assert(p != NULL);
+		assert(count_files(dir) == 0);
+		for (size_t k = 0; k < n; k++) {
+			assert(p[k] == 0);
+			p[k] = (double) k;
+		}
+		for (size_t k = 0; k < n; k++) {
+			assert(p[k] == (double) k);
+		}
+		Mapped_free(p, sizes[s]);
+		if (verbose) {
+			printf("%zu bytes ok\n", sizes[s]);
+		}
+	}
+
+	// two at once are separate
+	int* a = Mapped_alloc(1000*sizeof(int), dir);
+	int* b = Mapped_alloc(1000*sizeof(int), dir);
+	assert(a != NULL && b != NULL && a != b);
+	for (int k = 0; k < 1000; k++) {
+		a[k] = k;
+		b[k] = -k;
+	}
+	for (int k = 0; k < 1000; k++) {
+		assert(a[k] == k && b[k] == -k);
+	}
+	Mapped_free(a, 1000*sizeof(int));
+	Mapped_free(b, 1000*sizeof(int));
+
+	assert(remove(dir) == 0);
+
+	// a directory that isn't there fails cleanly
+	if (verbose) {
+		printf("expect an error about a missing directory:\n");
+	}
+	else {
+		assert(freopen("/dev/null", "w", stderr) != NULL);
+	}
+	assert(Mapped_alloc(64, dir) == NULL);
+
+	printf("All tests for xmapped completed\n");
+}
@@ -0,0 +1,133 @@
+/**
+ * @file xmutmap.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for mutmap
+ */
+
+#include "mutmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+#include <gsl/gsl_rng.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xmutmap [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xmutmap [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	gsl_rng* rng = gsl_rng_alloc(gsl_rng_taus);
+	gsl_rng_set(rng, 5);
+
+	// maps nothing can mutate in, or out of order, are refused
+	int starts[] = {0, 400, 600, 2000};
+	double rates[] = {0.001, 0, 0.01, 1};
+	double effects[] = {2, 1, 0.5, 3};
+	double none[] = {0, 0, 0, 0};
+	double negative[] = {0.001, 0, -0.01, 1};
+	int backwards[] = {0, 600, 400, 2000};
+	assert(MutationMap_new(starts, none, effects, 4, 1000) == NULL);
+	assert(MutationMap_new(starts, negative, effects, 4, 1000) == NULL);
+	assert(MutationMap_new(backwards, rates, effects, 4, 1000) == NULL);
+	assert(MutationMap_new(starts + 3, rates + 3, effects + 3, 1, 1000) == NULL);
+
+	// the rate is summed over loci, and the interval past the end of
+	// the chromosome is dropped: 400 x 0.001 + 400 x 0.01
+	int c = 1000;
+	MutationMap* map = MutationMap_new(starts, rates, effects, 4, c);
+	assert(fabs(MutationMap_rate(map) - 4.4) < 1e-12);
+
+	// mutations fall in proportion to rate, never where it is 0, and
+	// carry their interval's effect
+	int n = 220000;
+	int first = 0, third = 0;
+	for (int k = 0; k < n; k++) {
+		double effect;
+		int x = MutationMap_locus(map, rng, &effect);
+		assert(x >= 0 && x < c);
+		assert(x < 400 || x >= 600);
+		if (x < 400) {
+			assert(effect == 2);
+			first++;
+		}
+		else {
+			assert(effect == 0.5);
+			third++;
+		}
+	}
+	assert(fabs((double) first / n - 0.4 / 4.4) < 0.005);
+	MutationMap_free(map);
+
+	// the alias table reproduces many uneven weights, one locus each
+	int m = 97;
+	int loci[97];
+	double weights[97], ones[97];
+	double total = 0;
+	for (int k = 0; k < m; k++) {
+		loci[k] = k;
+		weights[k] = (k % 7 == 0 ? 0 : (k * 31) % 13 + 0.5);
+		ones[k] = 1;
+		total += weights[k];
+	}
+	map = MutationMap_new(loci, weights, ones, m, m);
+	assert(fabs(MutationMap_rate(map) - total) < 1e-9);
+	int counts[97] = {0};
+	n = 1000000;
+	for (int k = 0; k < n; k++) {
+		double effect;
+		counts[MutationMap_locus(map, rng, &effect)]++;
+	}
+	double worst = 0;
+	for (int k = 0; k < m; k++) {
+		double expected = n * weights[k] / total;
+		if (weights[k] == 0) {
+			assert(counts[k] == 0);
+			continue;
+		}
+		double z = fabs(counts[k] - expected) / sqrt(expected);
+		worst = (z > worst ? z : worst);
+	}
+	assert(worst < 5);
+	if (verbose) {
+		printf("alias table: largest deviation %.2f standard errors\n", worst);
+	}
+	MutationMap_free(map);
+
+	// a file gives the same map; a line without an effect keeps the
+	// last one, and loci before the first line do not mutate
+	char path[] = "xmutmapXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	FILE* f = fdopen(fd, "w");
+	fprintf(f, "# test map\n\n100 0.5 3\n 200 0.25\n300\t0\n");
+	fclose(f);
+	map = MutationMap_load(path, c);
+	unlink(path);
+	assert(fabs(MutationMap_rate(map) - 75) < 1e-12);
+	for (int k = 0; k < 10000; k++) {
+		double effect;
+		int x = MutationMap_locus(map, rng, &effect);
+		assert(x >= 100 && x < 300);
+		assert(effect == 3);
+	}
+	MutationMap_free(map);
+	gsl_rng_free(rng);
+
+	printf("All tests for xmutmap completed\n");
+}
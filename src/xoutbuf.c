@@ -0,0 +1,134 @@
+/**
+ * @file xoutbuf.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for outbuf
+ */
+
+#include "outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+static int check_lf(double x, int verbose);
+
+static int check_lf(double x, int verbose) {
+	char want[LF_MAX_LEN + 1];
+	char got[LF_MAX_LEN + 1];
+
+	snprintf(want, sizeof(want), "%lf", x);
+	size_t len = format_lf(got, x);
+	got[len] = '\0';
+
+	if (strcmp(want, got) != 0) {
+		fprintf(stderr, "format_lf(%a): got \"%s\", want \"%s\"\n", x, got, want);
+		return 1;
+	}
+	if (verbose) {
+		printf("%a -> %s\n", x, got);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xoutbuf [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xoutbuf [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	int bad = 0;
+
+	double edge[] = {0.0, -0.0, 1.0, -1.0, 0.5, 10, 0.0078125, 0.0234375,
+		-0.0078125, 0.9999995, 0.99999949999, 1e-7, -1e-7, 4.9999999e-7,
+		5e-7, 5.0000001e-7, 123456.7890125, 999999.9999995, 1e15, 4503599627370495.5,
+		9007199254740991.0, 9007199254740992.0, 1e300, -1e300, 1e-300,
+		INFINITY, -INFINITY, NAN};
+	for (size_t i = 0; i < sizeof(edge)/sizeof(edge[0]); i++) {
+		bad += check_lf(edge[i], verbose);
+	}
+
+	// every tie at the sixth decimal below 1 is a multiple of 2^-7
+	for (int i = 0; i < 128; i++) {
+		bad += check_lf(i / 128.0, 0);
+		bad += check_lf(17 + i / 128.0, 0);
+	}
+
+	srand(12345);
+	for (int i = 0; i < 200000; i++) {
+		double x = (rand() / (double) RAND_MAX - 0.5) * pow(10, rand() % 24 - 8);
+		bad += check_lf(x, 0);
+		bad += check_lf(nextafter(x, 0), 0);
+	}
+
+	char tmp[32];
+	unsigned long ints[] = {0, 7, 10, 4294967295UL, 18446744073709551615UL};
+	for (size_t i = 0; i < sizeof(ints)/sizeof(ints[0]); i++) {
+		char want[32];
+		snprintf(want, sizeof(want), "%lu", ints[i]);
+		tmp[format_uint(tmp, ints[i])] = '\0';
+		assert(strcmp(tmp, want) == 0);
+	}
+
+	assert(bad == 0);
+
+	// A small buffer must flush in order and match printf byte for byte
+	FILE* a = tmpfile();
+	FILE* b = tmpfile();
+	assert(a && b);
+	OutBuf* ob = OutBuf_new(a, 0);
+	double row[1000];
+	int ids[1000];
+	for (int i = 0; i < 1000; i++) {
+		row[i] = (i - 500) * 1.37;
+		ids[i] = i * 7;
+	}
+	for (int k = 0; k < 20; k++) {
+		OutBuf_printf(ob, "Degnome %u allele values:\n", k);
+		OutBuf_putDoubleRow(ob, row, 1000);
+		OutBuf_putc(ob, '\n');
+		OutBuf_putUintRow(ob, ids, 1000);
+		OutBuf_puts(ob, "\n");
+		OutBuf_printf(ob, "%lf%% Degnome %u\t", row[k], k);
+
+		fprintf(b, "Degnome %u allele values:\n", k);
+		for (int i = 0; i < 1000; i++) {
+			fprintf(b, "%lf\t", row[i]);
+		}
+		fprintf(b, "\n");
+		for (int i = 0; i < 1000; i++) {
+			fprintf(b, "%u\t", ids[i]);
+		}
+		fprintf(b, "\n");
+		fprintf(b, "%lf%% Degnome %u\t", row[k], k);
+	}
+	OutBuf_free(ob);
+	fflush(b);
+
+	assert(ftell(a) == ftell(b));
+	rewind(a);
+	rewind(b);
+	int ca, cb;
+	do {
+		ca = fgetc(a);
+		cb = fgetc(b);
+		assert(ca == cb);
+	} while (ca != EOF);
+	fclose(a);
+	fclose(b);
+
+	printf("All tests for xoutbuf completed\n");
+}
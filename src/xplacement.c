@@ -0,0 +1,92 @@
+/**
+ * @file xplacement.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for placement
+ */
+
+#define _GNU_SOURCE
+#include "placement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xplacement [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xplacement [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	assert(Placement_parse("none") == PLACE_DEFAULT);
+	assert(Placement_parse("interleave") == PLACE_INTERLEAVE);
+	assert(Placement_parse("partition") == PLACE_PARTITION);
+	assert(Placement_parse("local") == -1);
+
+	int nodes = Placement_nodes();
+	assert(nodes >= 1);
+	if (verbose) {
+		printf("%d nodes\n", nodes);
+	}
+
+	// every slot gets an allowed cpu, and the first slots visit every
+	// node before any node gets a second thread
+	cpu_set_t allowed;
+	assert(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+	int ncpus = CPU_COUNT(&allowed);
+	int seen[64] = {0};
+	for (int slot = 0; slot < 2 * ncpus; slot++) {
+		int cpu = Placement_cpu(slot);
+		assert(cpu >= 0 && CPU_ISSET(cpu, &allowed));
+		assert(cpu == Placement_cpu(slot % ncpus));
+		int node = Placement_nodeOf(cpu);
+		assert(node >= 0 && node < nodes);
+		if (slot < nodes && nodes <= 64) {
+			assert(seen[node] == 0);
+			seen[node] = 1;
+		}
+		if (verbose && slot < ncpus) {
+			printf("slot %d: cpu %d node %d\n", slot, cpu, node);
+		}
+	}
+	assert(Placement_cpu(-1) == -1);
+
+	// pinning moves the calling thread and nothing else
+	int cpu = Placement_pin(ncpus - 1);
+	assert(cpu == Placement_cpu(ncpus - 1));
+	cpu_set_t now;
+	assert(pthread_getaffinity_np(pthread_self(), sizeof(now), &now) == 0);
+	assert(CPU_COUNT(&now) == 1 && CPU_ISSET(cpu, &now));
+	assert(Placement_pinCpu(-1) == -1);
+	assert(pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed) == 0);
+
+	// every policy gives usable memory of any size
+	size_t sizes[] = {1, 4096, 100000, 1 << 22};
+	for (int policy = PLACE_DEFAULT; policy <= PLACE_PARTITION; policy++) {
+		for (int k = 0; k < 4; k++) {
+			unsigned char* p = Placement_alloc(sizes[k], policy);
+			assert(p != NULL);
+			memset(p, policy + 1, sizes[k]);
+			assert(p[0] == policy + 1 && p[sizes[k] - 1] == policy + 1);
+			Placement_free(p, sizes[k], policy);
+		}
+	}
+	Placement_free(NULL, 0, PLACE_INTERLEAVE);
+	assert(Placement_bind(NULL, 4096, nodes) == -1);
+
+	printf("All tests for xplacement completed\n");
+}
@@ -0,0 +1,124 @@
+/**
+ * @file xprofile.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for profile
+ */
+
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int spin(void* p, void* tdat);
+
+/// A job that takes about a millisecond.
+int spin(void* p, void* tdat) {
+	struct timespec t = {.tv_sec = 0, .tv_nsec = 1000000L};
+	nanosleep(&t, NULL);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xprofile [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xprofile [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// a NULL profile ignores everything without reading the clock
+	assert(Profile_mark(NULL) == 0);
+	assert(Profile_lap(NULL, PROF_FITNESS, 0) == 0);
+	Profile_generation(NULL, 10);
+	Profile_report(NULL, NULL, stderr);
+	Profile_free(NULL);
+
+	// laps are monotonic and each returns the next mark
+	Profile* prof = Profile_new();
+	double t0 = Profile_mark(prof);
+	double t1 = Profile_lap(prof, PROF_SELECT, t0);
+	double t2 = Profile_lap(prof, PROF_WAIT, t1);
+	assert(t0 > 0 && t1 >= t0 && t2 >= t1);
+
+	JobQueue* jq = JobQueue_new(2, NULL, NULL, NULL);
+	for (int g = 0; g < 3; g++) {
+		double t = Profile_mark(prof);
+		for (int i = 0; i < 4; i++) {
+			JobQueue_addJob(jq, spin, NULL);
+		}
+		t = Profile_lap(prof, PROF_SUBMIT, t);
+		JobQueue_waitOnJobs(jq);
+		Profile_lap(prof, PROF_WAIT, t);
+		Profile_generation(prof, 4);
+	}
+
+	FILE* fp = tmpfile();
+	assert(fp != NULL);
+	Profile_report(prof, jq, fp);
+	rewind(fp);
+
+	char line[256];
+	int saw_wait = 0, saw_worker = 0, saw_total = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (verbose) {
+			fputs(line, stdout);
+		}
+		saw_wait |= (strncmp(line, "wait ", 5) == 0);
+		saw_worker |= (strncmp(line, "0 ", 2) == 0);
+		saw_total |= (strcmp(line, "3 generations, 12 offspring\n") == 0);
+	}
+	assert(saw_wait && saw_worker && saw_total);
+	fclose(fp);
+
+	JobQueue_noMoreJobs(jq);
+	JobQueue_free(jq);
+	Profile_free(prof);
+
+	// with counters the report gains a table, or says why it can't
+	prof = Profile_new();
+	int counting = (Profile_counters(prof) == 0);
+	jq = JobQueue_new(2, NULL, NULL, NULL);
+	double t = Profile_mark(prof);
+	for (int i = 0; i < 4; i++) {
+		JobQueue_addJob(jq, spin, NULL);
+	}
+	JobQueue_waitOnJobs(jq);
+	Profile_lap(prof, PROF_WAIT, t);
+	Profile_generation(prof, 4);
+
+	fp = tmpfile();
+	assert(fp != NULL);
+	Profile_report(prof, jq, fp);
+	rewind(fp);
+	int saw_counters = 0, saw_mate = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (verbose) {
+			fputs(line, stdout);
+		}
+		saw_counters |= (strncmp(line, "counters ", 9) == 0
+						 || strncmp(line, "hardware counters unavailable", 29) == 0);
+		saw_mate |= (strncmp(line, "mate ", 5) == 0);
+	}
+	assert(saw_counters && saw_mate);
+	fclose(fp);
+	JobQueue_free(jq);
+	Profile_free(prof);
+	if (verbose) {
+		printf("counters %s\n", (counting ? "on" : "unavailable"));
+	}
+
+	printf("All tests for xprofile completed\n");
+}
@@ -0,0 +1,136 @@
+/**
+ * @file xrecomb.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for recomb
+ */
+
+#include "recomb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+#include <gsl/gsl_rng.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xrecomb [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xrecomb [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	gsl_rng* rng = gsl_rng_alloc(gsl_rng_taus);
+	gsl_rng_set(rng, 11);
+
+	// one interval of any rate is the uniform map
+	int zero = 0;
+	double two = 2;
+	RecombMap* flat = RecombMap_new(&zero, &two, 1, 37);
+	for (int k = 0; k < 37 * 16; k++) {
+		double u = k / (37.0 * 16);
+		assert(RecombMap_locus(flat, u) == (int) (u * 37));
+	}
+	RecombMap_free(flat);
+
+	// maps no crossover can fall in, or out of order, are refused
+	int starts[] = {0, 50, 80, 120};
+	double rates[] = {1, 0, 9, 5};
+	double none[] = {0, 0, 0, 0};
+	double negative[] = {1, -1, 9, 5};
+	int backwards[] = {0, 80, 50, 120};
+	assert(RecombMap_new(starts, none, 4, 100) == NULL);
+	assert(RecombMap_new(starts, negative, 4, 100) == NULL);
+	assert(RecombMap_new(backwards, rates, 4, 100) == NULL);
+	assert(RecombMap_new(starts + 3, rates + 3, 1, 100) == NULL);	// past the end
+
+	// a cold stretch, a gap and a hotspot; the interval at 120 is past
+	// the end of the chromosome and dropped
+	int c = 100;
+	RecombMap* map = RecombMap_new(starts, rates, 4, c);
+	assert(map != NULL);
+
+	// the inverse is monotone and never lands in the gap
+	int last = 0;
+	for (int k = 0; k < 100000; k++) {
+		int x = RecombMap_locus(map, k / 100000.0);
+		assert(x >= last && x < c);
+		assert(x < 50 || x >= 80);
+		last = x;
+	}
+
+	// single draws fall in proportion to rate x length: 50 and 180 of
+	// 230, and evenly over the loci of the hotspot
+	int n = 200000;
+	int counts[100] = {0};
+	for (int k = 0; k < n; k++) {
+		int x;
+		RecombMap_draw(map, rng, 1, &x);
+		counts[x]++;
+	}
+	int hot = 0;
+	for (int x = 80; x < c; x++) {
+		hot += counts[x];
+		assert(fabs(counts[x] - n * 9.0 / 230) < 5 * sqrt(n * 9.0 / 230));
+	}
+	assert(fabs((double) hot / n - 180.0 / 230) < 0.01);
+
+	// several draws come sorted and have the same spread as one
+	int loci[20];
+	hot = 0;
+	int total = 0;
+	for (int k = 0; k < n / 10; k++) {
+		int m = k % 20;
+		RecombMap_draw(map, rng, m, loci);
+		for (int i = 0; i < m; i++) {
+			assert(loci[i] >= 0 && loci[i] < c);
+			assert(loci[i] < 50 || loci[i] >= 80);
+			assert(i == 0 || loci[i-1] <= loci[i]);
+			hot += (loci[i] >= 80);
+		}
+		total += m;
+	}
+	assert(fabs((double) hot / total - 180.0 / 230) < 0.01);
+	if (verbose) {
+		printf("hotspot draws %.4f of crossovers (expected %.4f)\n",
+			   (double) hot / total, 180.0 / 230);
+	}
+
+	// a file gives the same map, skipping comments and blank lines;
+	// loci before its first line have rate 0
+	char path[] = "xrecombXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	FILE* f = fdopen(fd, "w");
+	fprintf(f, "# test map\n\n10 1\n 50 0\n80\t9\n120 5\n");
+	fclose(f);
+	RecombMap* loaded = RecombMap_load(path, c);
+	unlink(path);
+	int lead[] = {0, 10, 50, 80};
+	double lead_rates[] = {0, 1, 0, 9};
+	RecombMap* ref = RecombMap_new(lead, lead_rates, 4, c);
+	for (int k = 0; k < 10000; k++) {
+		double u = k / 10000.0;
+		int x = RecombMap_locus(loaded, u);
+		assert(x == RecombMap_locus(ref, u));
+		assert(x >= 10);
+	}
+	RecombMap_free(loaded);
+	RecombMap_free(ref);
+	RecombMap_free(map);
+	gsl_rng_free(rng);
+
+	printf("All tests for xrecomb completed\n");
+}
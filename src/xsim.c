@@ -0,0 +1,262 @@
+/**
+ * @file xsim.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for sim
+ */
+
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xsim [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xsim [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	SimParams par;
+	sim_default_params(&par);
+	par.pop_size = 6;
+	par.chrom_size = 9;
+	par.mutation_rate = 0;
+	par.num_threads = 1;
+	par.seed = 42;
+
+	Sim* sim = sim_new(&par);
+	SimPopulation pop;
+	double* percent;
+
+	// generation 0: every allele is 10 and degnome i descends from i
+	sim_get_population(sim, &pop);
+	assert(pop.generation == 0);
+	assert(pop.pop_size == 6 && pop.chrom_size == 9);
+	assert(pop.num_traits == 0 && pop.traits == NULL);
+	for (int i = 0; i < pop.pop_size; i++) {
+		assert(pop.hat_sizes[i] == 10 * pop.chrom_size);
+		for (int j = 0; j < pop.chrom_size; j++) {
+			assert(ALLELE_TO(pop.alleles[i*pop.chrom_size + j]) == 10);
+			assert(pop.ancestries[i*pop.chrom_size + j] == i);
+		}
+	}
+	assert(sim_diversity(sim, &percent) == 1);
+	assert(percent[0] == 1 && percent[1] == 0);
+
+	// without mutation alleles never change, ancestries stay in range
+	// and each row of descent fractions sums to 1
+	for (int g = 1; g <= 5; g++) {
+		sim_step(sim);
+		assert(sim_generation(sim) == g);
+
+		double diversity = sim_diversity(sim, &percent);
+		sim_get_population(sim, &pop);
+		assert(diversity >= 0 && diversity <= 1);
+
+		for (int i = 0; i <= pop.pop_size; i++) {
+			double total = 0;
+			for (int j = 0; j < pop.pop_size; j++) {
+				total += percent[i*pop.pop_size + j];
+			}
+			assert(fabs(total - 1) < 1e-9);
+		}
+		for (int i = 0; i < pop.pop_size; i++) {
+			assert(pop.hat_sizes[i] == 10 * pop.chrom_size);
+			for (int j = 0; j < pop.chrom_size; j++) {
+				int goi = pop.ancestries[i*pop.chrom_size + j];
+				assert(goi >= 0 && goi < pop.pop_size);
+			}
+		}
+		if (verbose) {
+			printf("generation %d: diversity %lf\n", g, diversity);
+		}
+	}
+	sim_free(sim);
+
+	// with -b a small population drifts to zero diversity and stops
+	par.pop_size = 3;
+	par.crossover_rate = 0;
+	sim = sim_new(&par);
+	int ran = sim_run(sim, 10000, 1);
+	assert(ran < 10000);
+	assert(sim_generation(sim) == ran);
+	assert(sim_diversity(sim, NULL) == 0);
+	if (verbose) {
+		printf("zero diversity after %d generations\n", ran);
+	}
+	sim_free(sim);
+
+	// sim_identical is zero diversity, generation by generation, for
+	// every schedule, with crossovers that mix ancestries
+	for (int sched = SIM_SCHEDULE_CHILD; sched <= SIM_SCHEDULE_SORTED; sched++) {
+		par.pop_size = 5;
+		par.crossover_rate = 3;
+		par.schedule = sched;
+		sim = sim_new(&par);
+		int g;
+		for (g = 0; g < 10000; g++) {
+			int identical = sim_identical(sim);
+			assert(identical == (sim_diversity(sim, NULL) == 0));
+			if (identical) {
+				break;
+			}
+			sim_step(sim);
+		}
+		assert(g < 10000);
+		sim_free(sim);
+	}
+	par.schedule = SIM_SCHEDULE_CHILD;
+	par.crossover_rate = 0;
+
+	// -t auto mates every child exactly once whichever way it runs
+	par.pop_size = 64;
+	par.chrom_size = 100;
+	par.crossover_rate = 2;
+	par.num_threads = THREADS_AUTO;
+	par.seed = 0;
+	sim = sim_new(&par);
+	sim_run(sim, 200, 0);
+	sim_get_population(sim, &pop);
+	assert(pop.generation == 200);
+	for (int i = 0; i < pop.pop_size; i++) {
+		assert(pop.hat_sizes[i] == 10 * pop.chrom_size);
+		for (int j = 0; j < pop.chrom_size; j++) {
+			int goi = pop.ancestries[i*pop.chrom_size + j];
+			assert(goi >= 0 && goi < pop.pop_size);
+		}
+	}
+	sim_free(sim);
+
+	// inline, a block schedule mates the same children in the same
+	// order as one job per child; sorted mates them in another order
+	// but every child exactly once
+	par.num_threads = 1;
+	par.seed = 7;
+	par.mutation_rate = 1;
+	Sim* ref = sim_new_with_queue(&par, NULL);
+	par.schedule = SIM_SCHEDULE_BLOCK;
+	sim = sim_new_with_queue(&par, NULL);
+	sim_run(ref, 20, 0);
+	sim_run(sim, 20, 0);
+	SimPopulation rpop;
+	sim_get_population(ref, &rpop);
+	sim_get_population(sim, &pop);
+	size_t cells = (size_t) pop.pop_size * pop.chrom_size;
+	assert(memcmp(rpop.alleles, pop.alleles, cells*sizeof(allele_t)) == 0);
+	assert(memcmp(rpop.ancestries, pop.ancestries, cells*sizeof(int)) == 0);
+	sim_free(ref);
+	sim_free(sim);
+
+	// a population in files runs exactly as one in memory
+	par.schedule = SIM_SCHEDULE_CHILD;
+	ref = sim_new_with_queue(&par, NULL);
+	par.mmap_dir = ".";
+	sim = sim_new_with_queue(&par, NULL);
+	par.mmap_dir = NULL;
+	sim_run(ref, 20, 1);
+	sim_run(sim, 20, 1);
+	sim_get_population(ref, &rpop);
+	sim_get_population(sim, &pop);
+	assert(pop.generation == rpop.generation);
+	assert(memcmp(rpop.alleles, pop.alleles, cells*sizeof(allele_t)) == 0);
+	assert(memcmp(rpop.ancestries, pop.ancestries, cells*sizeof(int)) == 0);
+	assert(sim_diversity(sim, NULL) == sim_diversity(ref, NULL));
+	sim_free(ref);
+	sim_free(sim);
+
+	// so does one in an arena, and again in the memory of the last after
+	// a reset, with its rows on cache lines
+	DegnomeArena* arena = DegnomeArena_new(1024);
+	ref = sim_new_with_queue(&par, NULL);
+	sim_run(ref, 20, 1);
+	sim_get_population(ref, &rpop);
+	allele_t* rows = NULL;
+	for (int run = 0; run < 3; run++) {
+		sim = sim_new_in(&par, NULL, arena);
+		sim_run(sim, 20, 1);
+		sim_get_population(sim, &pop);
+		assert(pop.generation == rpop.generation);
+		assert(memcmp(rpop.alleles, pop.alleles, cells*sizeof(allele_t)) == 0);
+		assert(memcmp(rpop.ancestries, pop.ancestries, cells*sizeof(int)) == 0);
+		assert((size_t) pop.alleles % ARENA_ALIGN == 0);
+		assert(rows == NULL || pop.alleles == rows);
+		rows = pop.alleles;
+		sim_free(sim);
+		DegnomeArena_reset(arena);
+	}
+	sim_free(ref);
+	DegnomeArena_free(arena);
+
+	par.mutation_rate = 0;
+	for (int schedule = SIM_SCHEDULE_BLOCK; schedule <= SIM_SCHEDULE_SORTED; schedule++) {
+		for (int threads = 1; threads <= 3; threads++) {
+			par.schedule = schedule;
+			par.num_threads = threads;
+			par.seed = 0;
+			sim = sim_new(&par);
+			sim_run(sim, 50, 0);
+			sim_get_population(sim, &pop);
+			assert(pop.generation == 50);
+			for (int i = 0; i < pop.pop_size; i++) {
+				assert(pop.hat_sizes[i] == 10 * pop.chrom_size);
+				for (int j = 0; j < pop.chrom_size; j++) {
+					int goi = pop.ancestries[i*pop.chrom_size + j];
+					assert(goi >= 0 && goi < pop.pop_size);
+				}
+			}
+			sim_free(sim);
+		}
+	}
+
+	// with a trait file, every degnome's traits are the weighted sums
+	// of its alleles, whichever generation they are asked for
+	char path[] = "xsimXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	FILE* f = fdopen(fd, "w");
+	fprintf(f, "0 0 1\n1 4 2\n");
+	fclose(f);
+	sim_default_params(&par);
+	par.pop_size = 20;
+	par.chrom_size = 9;
+	par.num_threads = 1;
+	par.seed = 7;
+	par.selective = 1;
+	par.traits_file = path;
+	sim = sim_new(&par);
+	unlink(path);
+	for (int g = 0; g < 3; g++) {
+		sim_get_population(sim, &pop);
+		assert(pop.num_traits == 2);
+		for (int i = 0; i < pop.pop_size; i++) {
+			double sum = 0, tail = 0;
+			for (int j = 0; j < pop.chrom_size; j++) {
+				double a = ALLELE_TO(pop.alleles[i*pop.chrom_size + j]);
+				sum += a;
+				tail += (j >= 4 ? 2 * a : 0);
+			}
+			assert(fabs(pop.traits[2*i] - sum) < 1e-9);
+			assert(fabs(pop.traits[2*i] - pop.hat_sizes[i]) < 1e-9);
+			assert(fabs(pop.traits[2*i + 1] - tail) < 1e-9);
+		}
+		sim_run(sim, 5, 0);
+	}
+	sim_free(sim);
+
+	printf("All tests for xsim completed\n");
+}
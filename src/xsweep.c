@@ -0,0 +1,99 @@
+/**
+ * @file xsweep.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for sweep
+ */
+
+#include "sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+/// Run the sweep on num_threads workers and return its output.
+static char* run_sweep(const char* gridfile, const SimParams* par, int num_threads) {
+	Sweep* sw = Sweep_new(gridfile, par, 20, 0);
+	assert(Sweep_size(sw) == 2*3*2);
+
+	FILE* fp = tmpfile();
+	assert(fp != NULL);
+	Sweep_run(sw, num_threads, fp);
+	Sweep_free(sw);
+
+	long len = ftell(fp);
+	char* text = malloc(len + 1);
+	assert(text != NULL);
+	rewind(fp);
+	assert(fread(text, 1, len, fp) == (size_t) len);
+	text[len] = '\0';
+	fclose(fp);
+	return text;
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xsweep [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xsweep [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	char gridfile[] = "xsweep_grid_XXXXXX";
+	FILE* fp = fdopen(mkstemp(gridfile), "w");
+	assert(fp != NULL);
+	fputs("# test grid\n"
+		  "m 0 1\n"
+		  "\n"
+		  "p 4 8 16   # population sizes\n"
+		  "fit linear close\n", fp);
+	fclose(fp);
+
+	SimParams par;
+	sim_default_params(&par);
+	par.chrom_size = 5;
+	par.seed = 7;
+
+	// small runs breed inline from their own seeds, so the results
+	// do not depend on how many workers share them
+	char* one = run_sweep(gridfile, &par, 1);
+	char* three = run_sweep(gridfile, &par, 3);
+	assert(strcmp(one, three) == 0);
+	remove(gridfile);
+
+	// a header and one line per run in grid order, last axis fastest
+	int lines = 0;
+	for (char* line = strtok(one, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+		if (lines > 0) {
+			int id, c, p, g, m;
+			char fit[16];
+			assert(sscanf(line, "%d\t%d\t%d\t%d\t%d\t%*d\t%*d\t%15s",
+						  &id, &c, &p, &g, &m, fit) == 6);
+			assert(id == lines - 1);
+			assert(c == 5 && g == 20);
+			assert(m == id / 6);
+			assert(p == 4 << ((id / 2) % 3));
+			assert(strcmp(fit, (id % 2) ? "close" : "linear") == 0);
+		}
+		if (verbose) {
+			printf("%s\n", line);
+		}
+		lines++;
+	}
+	assert(lines == 1 + 12);
+
+	free(one);
+	free(three);
+
+	printf("All tests for xsweep completed\n");
+}
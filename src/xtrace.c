@@ -0,0 +1,126 @@
+/**
+ * @file xtrace.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for trace
+ */
+
+#include "trace.h"
+#include "jobqueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+#define NJOBS 200
+#define NGENS 3
+
+int spinfunc(void* p, void* tdat);
+static char* slurp(const char* path);
+static int count(const char* s, const char* pattern);
+
+/// Burn a little time, so the workers take turns.
+int spinfunc(void* p, void* tdat) {
+	volatile int x = 0;
+
+	for (int i = 0; i < 1000; i++) {
+		x += i;
+	}
+	*(int*) p = x;
+	return 0;
+}
+
+static char* slurp(const char* path) {
+	FILE* f = fopen(path, "r");
+	assert(f != NULL);
+	fseek(f, 0, SEEK_END);
+	long n = ftell(f);
+	rewind(f);
+	char* s = malloc(n + 1);
+	assert(s != NULL);
+	assert(fread(s, 1, n, f) == (size_t) n);
+	s[n] = '\0';
+	fclose(f);
+	return s;
+}
+
+/// Number of times pattern occurs in s.
+static int count(const char* s, const char* pattern) {
+	int n = 0;
+
+	while ((s = strstr(s, pattern)) != NULL) {
+		n++;
+		s += strlen(pattern);
+	}
+	return n;
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+	char path[] = "xtrace.tmp.json";
+	int out[NJOBS];
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xtrace [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xtrace [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// off: the hooks record nothing and there is nothing to finish
+	assert(trace_on == 0);
+	TRACE_INSTANT(TRACE_GENERATION, 0);
+	assert(Trace_finish() == -1);
+
+	int kinds[] = {JOBQUEUE_MUTEX, JOBQUEUE_RING};
+	for (int k = 0; k < 2; k++) {
+		assert(Trace_start(path) == 0);
+		assert(Trace_start(path) == -1);
+		assert(trace_on == 1);
+
+		JobQueue* jq = JobQueue_newKind(kinds[k], 2, NULL, NULL, NULL);
+		for (int g = 0; g < NGENS; g++) {
+			TRACE_INSTANT(TRACE_GENERATION, g);
+			for (int j = 0; j < NJOBS / NGENS; j++) {
+				JobQueue_addJob(jq, spinfunc, out + j);
+			}
+			JobQueue_waitOnJobs(jq);
+		}
+		JobQueue_free(jq);
+
+		assert(Trace_finish() == 0);
+		assert(trace_on == 0);
+		assert(Trace_finish() == -1);
+
+		char* s = slurp(path);
+		int jobs = count(s, "\"name\":\"job\"");
+		if (verbose) {
+			printf("%s: %d jobs, %d waits, %d idles, %d wakes\n",
+				   (kinds[k] == JOBQUEUE_RING ? "ring" : "mutex"), jobs,
+				   count(s, "\"name\":\"wait\""), count(s, "\"name\":\"idle\""),
+				   count(s, "\"name\":\"wake\""));
+		}
+		assert(strncmp(s, "{\"traceEvents\":[\n", 17) == 0);
+		assert(strcmp(s + strlen(s) - 4, "\n]}\n") == 0);
+		assert(count(s, "{") == count(s, "}"));
+		assert(jobs == NGENS * (NJOBS / NGENS));
+		assert(count(s, "\"name\":\"generation\"") == NGENS);
+		// every waitOnJobs, the one in JobQueue_free included
+		assert(count(s, "\"name\":\"wait\"") == NGENS + 1);
+		assert(count(s, "\"args\":{\"name\":\"main\"}") == 1);
+		assert(count(s, "\"args\":{\"name\":\"worker 0\"}") == 1);
+		assert(count(s, "\"name\":\"thread_name\"") <= 3);
+		free(s);
+	}
+	remove(path);
+
+	printf("All tests for xtrace completed\n");
+}
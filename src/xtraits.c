@@ -0,0 +1,158 @@
+/**
+ * @file xtraits.c
+ * @author Daniel R. Tabin
+ * @brief Unit tests for traits
+ */
+
+#include "traits.h"
+#include "kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#error "Unit tests must be compiled without -DNDEBUG flag"
+#endif
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+
+	if (argc == 2) {
+		if (strncmp(argv[1], "-v", 2) != 0) {
+			fprintf(stderr, "usage: xtraits [-v]\n");
+			exit(EXIT_FAILURE);
+		}
+		verbose = 1;
+	}
+	else if (argc != 1) {
+		fprintf(stderr, "usage: xtraits [-v]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// no traits, or weights that are not numbers, are refused
+	double nan_weights[] = {1, NAN, 2};
+	assert(TraitMatrix_new(nan_weights, 0, 3) == NULL);
+	assert(TraitMatrix_new(nan_weights, 1, 3) == NULL);
+
+	// uneven sizes, so every lane and remainder is used
+	int rows = 37, c = 53, k = 5;
+	allele_t* x = malloc((size_t) rows * c * sizeof(allele_t));
+	double* w = malloc((size_t) k * c * sizeof(double));
+	double* expected = malloc((size_t) rows * k * sizeof(double));
+	double* got = malloc((size_t) rows * k * sizeof(double));
+	assert(x && w && expected && got);
+	for (int i = 0; i < rows * c; i++) {
+		x[i] = ALLELE_FROM((i * 7919 % 211) / 8.0 - 12);
+	}
+	for (int i = 0; i < k * c; i++) {
+		w[i] = (i * 104729 % 17) / 4.0 - 2;
+	}
+	for (int i = 0; i < rows; i++) {
+		for (int t = 0; t < k; t++) {
+			double sum = 0;
+			for (int j = 0; j < c; j++) {
+				sum += w[t*c + j] * ALLELE_TO(x[i*c + j]);
+			}
+			expected[i*k + t] = sum;
+		}
+	}
+
+	// the matrix product and the kernel both give W x for every row
+	TraitMatrix* tm = TraitMatrix_new(w, k, c);
+	assert(tm != NULL && TraitMatrix_traits(tm) == k);
+	w[0] = 1000;		// the weights were copied
+	assert(TraitMatrix_weights(tm)[0] != 1000);
+	TraitMatrix_apply(tm, x, rows, got);
+	double worst = 0;
+	for (int i = 0; i < rows * k; i++) {
+		double err = fabs(got[i] - expected[i]);
+		worst = (err > worst ? err : worst);
+	}
+	assert(worst < 1e-9);
+	Kernel_weightedSums(x, rows, c, TraitMatrix_weights(tm), k, got);
+	for (int i = 0; i < rows * k; i++) {
+		assert(fabs(got[i] - expected[i]) < 1e-9);
+	}
+	if (verbose) {
+		printf("%d x %d traits of %d alleles: largest error %g\n", rows, k, c, worst);
+	}
+
+	// weights too large for cache go through the matrix product
+	int big = 6000;
+	double* bw = malloc((size_t) k * big * sizeof(double));
+	allele_t* bx = malloc((size_t) 3 * big * sizeof(allele_t));
+	double kernel[3 * 5];
+	assert(bw && bx);
+	for (int i = 0; i < k * big; i++) {
+		bw[i] = (i % 13) / 4.0 - 1;
+	}
+	for (int i = 0; i < 3 * big; i++) {
+		bx[i] = ALLELE_FROM((i % 29) / 8.0);
+	}
+	TraitMatrix* large = TraitMatrix_new(bw, k, big);
+	TraitMatrix_apply(large, bx, 3, got);
+	Kernel_weightedSums(bx, 3, big, bw, k, kernel);
+	for (int i = 0; i < 3 * k; i++) {
+		assert(fabs(got[i] - kernel[i]) < 1e-6);
+	}
+	TraitMatrix_free(large);
+	free(bw);
+	free(bx);
+
+	// so do the columns of the transposed alleles
+	allele_t* cols = malloc((size_t) rows * c * sizeof(allele_t));
+	assert(cols);
+	for (int i = 0; i < rows; i++) {
+		for (int j = 0; j < c; j++) {
+			cols[j*rows + i] = x[i*c + j];
+		}
+	}
+	TraitMatrix_applyColumns(tm, cols, rows, got);
+	for (int i = 0; i < rows * k; i++) {
+		assert(fabs(got[i] - expected[i]) < 1e-9);
+	}
+	TraitMatrix_free(tm);
+
+	// a single trait of weight 1 is the hat size
+	for (int j = 0; j < c; j++) {
+		w[j] = 1;
+	}
+	tm = TraitMatrix_new(w, 1, c);
+	TraitMatrix_apply(tm, x, rows, got);
+	for (int i = 0; i < rows; i++) {
+		assert(fabs(got[i] - Kernel_sum(x + i*c, c)) < 1e-9);
+	}
+	TraitMatrix_free(tm);
+
+	// a file: intervals run to the trait's next line or the end, loci
+	// before a trait's first line and traits without lines weigh 0,
+	// and lines past the end of the chromosome are dropped
+	char path[] = "xtraitsXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	FILE* f = fdopen(fd, "w");
+	fprintf(f, "# test traits\n\n1 5 2\n0 0 1\n 1 8\t-0.5\n3 20 4\n");
+	fclose(f);
+	tm = TraitMatrix_load(path, 10);
+	unlink(path);
+	assert(TraitMatrix_traits(tm) == 4);
+	const double* loaded = TraitMatrix_weights(tm);
+	for (int j = 0; j < 10; j++) {
+		assert(loaded[j] == 1);
+		assert(loaded[10 + j] == (j < 5 ? 0 : j < 8 ? 2 : -0.5));
+		assert(loaded[20 + j] == 0);
+		assert(loaded[30 + j] == 0);
+	}
+	TraitMatrix_free(tm);
+
+	free(x);
+	free(w);
+	free(expected);
+	free(got);
+	free(cols);
+
+	printf("All tests for xtraits completed\n");
+}